@@ -62,9 +62,16 @@ $netconvert_binary --osm-files "$osm_file" -o "$file_prefix.net.xml" --junctions
 check_fail "netconvert"
 
 echo "Creating SUMO routes from OSM file"
+# The native random-trips writes the same route file in parallel, much faster on large networks
+random_trips_binary="$(dirname "$0")/build/random-trips"
 # python "$SUMO_HOME/tools/randomTrips.py" -n "$file_prefix.net.xml" --random-routing-factor 2.0 --insertion-density 100 -e 20000 -L -r "$file_prefix.rou.xml"
-python "$SUMO_HOME/tools/randomTrips.py" -n "$file_prefix.net.xml" -e 100000 -L -r "$file_prefix.rou.xml"
-check_fail "randomTrips.py"
+if [ -x "$random_trips_binary" ]; then
+    "$random_trips_binary" "$file_prefix.net.xml" -e 100000 -L -o "$file_prefix.rou.xml"
+    check_fail "random-trips"
+else
+    python "$SUMO_HOME/tools/randomTrips.py" -n "$file_prefix.net.xml" -e 100000 -L -r "$file_prefix.rou.xml"
+    check_fail "randomTrips.py"
+fi
 
 typemap_filename="typemap.xml"
 
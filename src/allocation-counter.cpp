@@ -0,0 +1,50 @@
+#include "allocation-counter.hpp"
+
+#include <cstdlib>
+#include <new>
+
+namespace {
+	// Constant initialized, so using it in `operator new` never allocates itself
+	thread_local std::uint64_t num_allocations = 0;
+} // namespace
+
+[[nodiscard]] auto allocation_count() -> std::uint64_t {
+	return num_allocations;
+}
+
+// The array, nothrow and sized variants of the standard library forward to these
+auto operator new(std::size_t size) -> void* {
+	num_allocations++;
+	if (void* p = std::malloc(size == 0 ? 1 : size)) {
+		return p;
+	}
+	throw std::bad_alloc();
+}
+
+auto operator delete(void* p) noexcept -> void {
+	std::free(p);
+}
+
+auto operator delete(void* p, std::size_t) noexcept -> void {
+	std::free(p);
+}
+
+// `std::pmr::new_delete_resource()` allocates through the aligned variants
+auto operator new(std::size_t size, std::align_val_t alignment) -> void* {
+	num_allocations++;
+	const auto align = static_cast<std::size_t>(alignment);
+	// aligned_alloc wants the size to be a non-zero multiple of the alignment
+	const auto rounded = size == 0 ? align : (size + align - 1) / align * align;
+	if (void* p = std::aligned_alloc(align, rounded)) {
+		return p;
+	}
+	throw std::bad_alloc();
+}
+
+auto operator delete(void* p, std::align_val_t) noexcept -> void {
+	std::free(p);
+}
+
+auto operator delete(void* p, std::size_t, std::align_val_t) noexcept -> void {
+	std::free(p);
+}
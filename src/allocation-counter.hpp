@@ -0,0 +1,10 @@
+#pragma once
+
+#include <cstdint>
+
+// Number of calls to the global `operator new` made by the calling thread since it started, so
+// the difference over a stretch of code only counts that code's allocations, and none of other
+// threads running at the same time. Counting is done by replacing the global `operator new`/
+// `operator delete` in allocation-counter.cpp, which only programs linking that file get.
+[[nodiscard]]
+auto allocation_count() -> std::uint64_t;
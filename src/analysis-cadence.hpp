@@ -0,0 +1,112 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+
+#include <parallel_hashmap/phmap.h>
+
+#include "streetlamp-grid.hpp"
+#include "vehicle-id-table.hpp"
+
+struct AnalysisCadenceOptions {
+	bool   adaptive = false; // false analyses every step
+	double max_interval = 1.0; // Simulated seconds between analyses, at most
+	// Analyse once a vehicle has moved this far since the last analysis, in meters
+	float max_displacement = 0.0f;
+};
+
+// Decides which simulation steps the street lamps are analysed and a snapshot is published on.
+// With small step lengths vehicles barely move between steps, so most steps can be skipped: a
+// step is only analysed when `max_interval` simulated seconds have passed, when a vehicle has
+// moved more than `max_displacement` since the last analysis, or when vehicles entered or left.
+// Between analyses the published state is behind by less than `max_displacement` per vehicle,
+// so a lamp is at worst lit or unlit for a vehicle that is that much closer or further away.
+class AnalysisCadence {
+  public:
+	struct Stats {
+		std::uint64_t steps = 0;
+		std::uint64_t analysed = 0;
+		// The most any vehicle was ahead of the published state on a skipped step, in meters
+		float max_skipped_displacement = 0.0f;
+		// The most simulated time that passed between two analyses, in seconds
+		double max_interval = 0.0;
+	};
+
+	explicit AnalysisCadence(const AnalysisCadenceOptions& options) : options(options) { }
+
+	// Call for every vehicle of a step, before `due`
+	auto observe(const VehicleHandle id, const float x, const float y) -> void {
+		num_observed++;
+		if (! options.adaptive) {
+			return;
+		}
+		const auto it = analysed_at.find(id);
+		if (it == analysed_at.end()) {
+			vehicles_changed = true;
+			return;
+		}
+		const auto dx = x - it->second.x;
+		const auto dy = y - it->second.y;
+		max_displacement_squared = std::max(max_displacement_squared, dx * dx + dy * dy);
+	}
+
+	// Call when vehicles departed or arrived in this step, before `due`. Handles are reused, so a
+	// vehicle that got the handle of one that left would otherwise look like it only moved.
+	auto entered_or_left() -> void { vehicles_changed = true; }
+
+	// Whether the step at `simulation_time` has to be analysed. `force` analyses it regardless,
+	// e.g. for a checkpoint. Resets the vehicles observed for the next step.
+	auto due(const double simulation_time, const bool force = false) -> bool {
+		stats_.steps++;
+		const auto max_displacement_squared_allowed =
+			options.max_displacement * options.max_displacement;
+		const bool due = ! options.adaptive || force || ! analysed_any || vehicles_changed ||
+						 num_observed != analysed_at.size() ||
+						 simulation_time - last_analysis_time >= options.max_interval ||
+						 max_displacement_squared > max_displacement_squared_allowed;
+		if (due) {
+			stats_.analysed++;
+			if (analysed_any) {
+				stats_.max_interval =
+					std::max(stats_.max_interval, simulation_time - last_analysis_time);
+			}
+			last_analysis_time = simulation_time;
+			analysed_any = true;
+		} else {
+			stats_.max_skipped_displacement =
+				std::max(stats_.max_skipped_displacement, std::sqrt(max_displacement_squared));
+		}
+		num_observed = 0;
+		vehicles_changed = false;
+		if (! due) {
+			return false;
+		}
+		// The caller calls `analysed` with the positions the analysis used
+		analysed_at.clear();
+		max_displacement_squared = 0.0f;
+		return true;
+	}
+
+	// Call for every vehicle of an analysed step
+	auto analysed(const VehicleHandle id, const float x, const float y) -> void {
+		if (options.adaptive) {
+			analysed_at.insert_or_assign(id, Point {x, y});
+		}
+	}
+
+	[[nodiscard]] auto stats() const -> const Stats& { return stats_; }
+
+  private:
+	AnalysisCadenceOptions options;
+
+	// Position of each vehicle at the last analysis
+	phmap::flat_hash_map<VehicleHandle, Point> analysed_at;
+	std::size_t								   num_observed = 0;
+	bool									   vehicles_changed = false;
+	float									   max_displacement_squared = 0.0f;
+	bool									   analysed_any = false;
+	double									   last_analysis_time = 0.0;
+
+	Stats stats_;
+};
@@ -0,0 +1,136 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <limits>
+#include <span>
+#include <vector>
+
+// Axis aligned box in the projected (x, y) plane
+struct Box {
+	float min_x = std::numeric_limits<float>::max();
+	float min_y = std::numeric_limits<float>::max();
+	float max_x = std::numeric_limits<float>::lowest();
+	float max_y = std::numeric_limits<float>::lowest();
+
+	auto expand(const float x, const float y) -> void {
+		min_x = std::min(min_x, x);
+		min_y = std::min(min_y, y);
+		max_x = std::max(max_x, x);
+		max_y = std::max(max_y, y);
+	}
+	auto expand(const Box& other) -> void {
+		min_x = std::min(min_x, other.min_x);
+		min_y = std::min(min_y, other.min_y);
+		max_x = std::max(max_x, other.max_x);
+		max_y = std::max(max_y, other.max_y);
+	}
+	[[nodiscard]] auto overlaps(const Box& other) const -> bool {
+		return min_x <= other.max_x && other.min_x <= max_x && min_y <= other.max_y &&
+			   other.min_y <= max_y;
+	}
+};
+
+// Static R-tree over boxes, bulk loaded with Sort-Tile-Recursive: the boxes are sorted into
+// vertical slices by x, each slice by y, and every run of `fanout` boxes becomes a node. The same
+// is repeated for the nodes until one is left. Items are referred to by their index in the boxes
+// given to the constructor.
+class BoxRTree {
+  public:
+	static constexpr std::uint32_t fanout = 16;
+
+	BoxRTree() = default;
+	explicit BoxRTree(const std::span<const Box> boxes) {
+		auto level = std::vector<Node>(boxes.size());
+		for (std::uint32_t idx = 0; idx < boxes.size(); ++idx) {
+			level[idx] = Node {.box = boxes[idx], .begin = idx, .end = idx + 1};
+		}
+		if (level.empty()) {
+			return;
+		}
+		// Level 0 are the items, each level above groups the level below, up to a single root
+		while (true) {
+			sort_tile_recursive(level);
+			if (level.size() == 1) {
+				levels.push_back(std::move(level));
+				break;
+			}
+			auto parents = std::vector<Node> {};
+			const auto num_nodes = static_cast<std::uint32_t>(level.size());
+			for (std::uint32_t begin = 0; begin < num_nodes; begin += fanout) {
+				const auto end = std::min(begin + fanout, num_nodes);
+				auto	   parent = Node {.box = {}, .begin = begin, .end = end};
+				for (auto idx = begin; idx < end; ++idx) {
+					parent.box.expand(level[idx].box);
+				}
+				parents.push_back(parent);
+			}
+			levels.push_back(std::move(level));
+			level = std::move(parents);
+		}
+	}
+
+	[[nodiscard]] auto size() const -> std::size_t { return levels.empty() ? 0 : levels[0].size(); }
+
+	// Calls `visit(item)` for every item whose box overlaps the boxes `overlaps(box)` accepts,
+	// e.g. the ones a segment passes through. Stops early once `visit` returns true, and then
+	// returns true.
+	template <typename Overlaps, typename Visit>
+	auto query_if(Overlaps&& overlaps, Visit&& visit) const -> bool {
+		if (levels.empty()) {
+			return false;
+		}
+		return this->query_node(levels.size() - 1, 0, overlaps, visit);
+	}
+
+	// Calls `visit(item)` for every item whose box overlaps `box`
+	template <typename Visit>
+	auto query(const Box& box, Visit&& visit) const -> bool {
+		return this->query_if([&](const Box& other) { return box.overlaps(other); }, visit);
+	}
+
+  private:
+	struct Node {
+		Box			  box;
+		std::uint32_t begin; // Children in the level below, or the item for level 0
+		std::uint32_t end;
+	};
+
+	static auto sort_tile_recursive(std::vector<Node>& nodes) -> void {
+		const auto center_x = [](const Node& n) { return n.box.min_x + n.box.max_x; };
+		const auto center_y = [](const Node& n) { return n.box.min_y + n.box.max_y; };
+		std::sort(nodes.begin(), nodes.end(),
+				  [&](const Node& a, const Node& b) { return center_x(a) < center_x(b); });
+		const auto num_parents = (nodes.size() + fanout - 1) / fanout;
+		const auto num_slices =
+			static_cast<std::size_t>(std::ceil(std::sqrt(static_cast<double>(num_parents))));
+		const auto slice_size = num_slices * fanout;
+		for (std::size_t begin = 0; begin < nodes.size(); begin += slice_size) {
+			const auto end = std::min(begin + slice_size, nodes.size());
+			std::sort(nodes.begin() + static_cast<std::ptrdiff_t>(begin),
+					  nodes.begin() + static_cast<std::ptrdiff_t>(end),
+					  [&](const Node& a, const Node& b) { return center_y(a) < center_y(b); });
+		}
+	}
+
+	template <typename Overlaps, typename Visit>
+	auto query_node(const std::size_t level, const std::uint32_t idx, Overlaps& overlaps,
+					Visit& visit) const -> bool {
+		const auto& node = levels[level][idx];
+		if (! overlaps(node.box)) {
+			return false;
+		}
+		if (level == 0) {
+			return visit(node.begin);
+		}
+		for (auto child = node.begin; child < node.end; ++child) {
+			if (this->query_node(level - 1, child, overlaps, visit)) {
+				return true;
+			}
+		}
+		return false;
+	}
+
+	std::vector<std::vector<Node>> levels; // levels[0] are the items, levels.back() the root
+};
@@ -0,0 +1,213 @@
+#include "building-occlusion.hpp"
+
+#include <algorithm>
+#include <bit>
+#include <charconv>
+#include <cstring>
+#include <utility>
+
+#include <pugixml.hpp>
+
+auto BuildingFootprints::add(const std::span<const Point> outline) -> void {
+	vertices.insert(vertices.end(), outline.begin(), outline.end());
+	offsets.push_back(static_cast<std::uint32_t>(vertices.size()));
+}
+
+auto BuildingFootprints::append(const BuildingFootprints& other) -> void {
+	for (std::size_t building = 0; building < other.size(); ++building) {
+		this->add(other.outline(building));
+	}
+}
+
+auto format_load_building_footprints_error(const load_building_footprints_error err)
+	-> std::string_view {
+	switch (err) {
+		case load_building_footprints_error::file_not_found:
+			return "file not found";
+		case load_building_footprints_error::xml_parse_error:
+			return "XML parse error";
+		case load_building_footprints_error::malformed_shape:
+			return "malformed shape of a building";
+	}
+	return "unknown error";
+}
+
+namespace {
+	// Parses a SUMO shape, "x0,y0 x1,y1 ...", into `out`
+	auto parse_shape(std::string_view shape, std::vector<Point>& out) -> bool {
+		out.clear();
+		while (! shape.empty()) {
+			if (shape.front() == ' ') {
+				shape.remove_prefix(1);
+				continue;
+			}
+			auto	   p = Point {};
+			const auto end = shape.data() + shape.size();
+			const auto x = std::from_chars(shape.data(), end, p.x);
+			if (x.ec != std::errc {} || x.ptr == end || *x.ptr != ',') {
+				return false;
+			}
+			const auto y = std::from_chars(x.ptr + 1, end, p.y);
+			if (y.ec != std::errc {}) {
+				return false;
+			}
+			out.push_back(p);
+			shape.remove_prefix(static_cast<std::size_t>(y.ptr - shape.data()));
+		}
+		return true;
+	}
+} // namespace
+
+auto load_building_footprints(const std::filesystem::path& poly_xml)
+	-> tl::expected<BuildingFootprints, load_building_footprints_error> {
+	if (! std::filesystem::exists(poly_xml)) {
+		return tl::make_unexpected(load_building_footprints_error::file_not_found);
+	}
+	pugi::xml_document doc;
+	if (! doc.load_file(poly_xml.c_str())) {
+		return tl::make_unexpected(load_building_footprints_error::xml_parse_error);
+	}
+
+	auto footprints = BuildingFootprints {};
+	auto outline = std::vector<Point> {};
+	for (const auto poly : doc.child("additional").children("poly")) {
+		const auto type = std::string_view(poly.attribute("type").value());
+		if (type != "building" && ! type.starts_with("building.")) {
+			continue;
+		}
+		if (! parse_shape(poly.attribute("shape").value(), outline)) {
+			return tl::make_unexpected(load_building_footprints_error::malformed_shape);
+		}
+		if (outline.size() >= 3) {
+			footprints.add(outline);
+		}
+	}
+	return footprints;
+}
+
+namespace {
+	auto bounds_of(const std::span<const Point> outline) -> Box {
+		auto box = Box {};
+		for (const auto p : outline) {
+			box.expand(p.x, p.y);
+		}
+		return box;
+	}
+
+	auto cross(const Point o, const Point a, const Point b) -> double {
+		return (static_cast<double>(a.x) - o.x) * (static_cast<double>(b.y) - o.y) -
+			   (static_cast<double>(a.y) - o.y) * (static_cast<double>(b.x) - o.x);
+	}
+
+	// True if the segments cross at a point inside both. Touching an end point or running along
+	// an edge does not count, so lamps on a wall still light the street in front of it.
+	auto segments_cross(const Point a, const Point b, const Point p, const Point q) -> bool {
+		const auto d1 = cross(a, b, p);
+		const auto d2 = cross(a, b, q);
+		const auto d3 = cross(p, q, a);
+		const auto d4 = cross(p, q, b);
+		return ((d1 > 0 && d2 < 0) || (d1 < 0 && d2 > 0)) &&
+			   ((d3 > 0 && d4 < 0) || (d3 < 0 && d4 > 0));
+	}
+
+	// Slab test of the segment from `a` to `b` against `box`
+	auto segment_overlaps(const Point a, const Point b, const Box& box) -> bool {
+		auto	   t0 = 0.0f;
+		auto	   t1 = 1.0f;
+		const auto clip = [&](const float start, const float delta, const float lo,
+							  const float hi) {
+			if (delta == 0.0f) {
+				return lo <= start && start <= hi;
+			}
+			auto near = (lo - start) / delta;
+			auto far = (hi - start) / delta;
+			if (near > far) {
+				std::swap(near, far);
+			}
+			t0 = std::max(t0, near);
+			t1 = std::min(t1, far);
+			return t0 <= t1;
+		};
+		return clip(a.x, b.x - a.x, box.min_x, box.max_x) &&
+			   clip(a.y, b.y - a.y, box.min_y, box.max_y);
+	}
+} // namespace
+
+BuildingOcclusion::BuildingOcclusion(BuildingFootprints footprints_,
+									 const StreetLampGridView& grid,
+									 const float distance_threshold)
+	: footprints(std::move(footprints_)), clear_cells(grid.lamps.size(), 0) {
+	auto boxes = std::vector<Box>(footprints.size());
+	for (std::size_t building = 0; building < footprints.size(); ++building) {
+		boxes[building] = bounds_of(footprints.outline(building));
+	}
+	tree = BoxRTree(boxes);
+
+	// A segment from the lamp to a point of a cell stays inside the bounding box of the lamp and
+	// the part of the cell within the threshold, so if no building's box overlaps that box, no
+	// building can be in the way
+	const auto& spec = grid.spec;
+	for (std::uint32_t lamp = 0; lamp < grid.lamps.size(); ++lamp) {
+		const auto position = Point {grid.lamps[lamp].lon, grid.lamps[lamp].lat};
+		const auto column = spec.column_of(position.x);
+		const auto row = spec.row_of(position.y);
+		for (std::int64_t dr = -1; dr <= 1; ++dr) {
+			for (std::int64_t dc = -1; dc <= 1; ++dc) {
+				const auto x = spec.origin_x + static_cast<float>(column + dc) * spec.cell_size;
+				const auto y = spec.origin_y + static_cast<float>(row + dr) * spec.cell_size;
+				const auto d = distance_threshold;
+				auto	   reach = Box {
+						  .min_x = std::max(x, position.x - d),
+						  .min_y = std::max(y, position.y - d),
+						  .max_x = std::min(x + spec.cell_size, position.x + d),
+						  .max_y = std::min(y + spec.cell_size, position.y + d),
+				  };
+				reach.expand(position.x, position.y);
+				if (! tree.query(reach, [](std::uint32_t) { return true; })) {
+					clear_cells[lamp] |= static_cast<std::uint16_t>(1u << neighbour(dc, dr));
+				}
+			}
+		}
+	}
+}
+
+auto BuildingOcclusion::line_of_sight(const Point a, const Point b) const -> bool {
+	return ! tree.query_if([&](const Box& box) { return segment_overlaps(a, b, box); },
+						   [&](const std::uint32_t building) {
+							   const auto outline = footprints.outline(building);
+							   for (std::size_t i = 0; i < outline.size(); ++i) {
+								   const auto next = outline[(i + 1) % outline.size()];
+								   if (segments_cross(a, b, outline[i], next)) {
+									   return true;
+								   }
+							   }
+							   return false;
+						   });
+}
+
+auto BuildingOcclusion::clear_share() const -> double {
+	if (clear_cells.empty()) {
+		return 1.0;
+	}
+	std::uint64_t clear = 0;
+	for (const auto cells : clear_cells) {
+		clear += static_cast<std::uint64_t>(std::popcount(cells));
+	}
+	return static_cast<double>(clear) / (9.0 * static_cast<double>(clear_cells.size()));
+}
+
+auto BuildingOcclusion::record(const OcclusionStats& stats) const -> void {
+	sight_tests.fetch_add(stats.sight_tests, std::memory_order_relaxed);
+	blocked.fetch_add(stats.blocked, std::memory_order_relaxed);
+	lit_lamps.fetch_add(stats.lit_lamps, std::memory_order_relaxed);
+	occluded_lamps.fetch_add(stats.occluded_lamps, std::memory_order_relaxed);
+}
+
+auto BuildingOcclusion::stats() const -> OcclusionStats {
+	return {
+		.sight_tests = sight_tests.load(std::memory_order_relaxed),
+		.blocked = blocked.load(std::memory_order_relaxed),
+		.lit_lamps = lit_lamps.load(std::memory_order_relaxed),
+		.occluded_lamps = occluded_lamps.load(std::memory_order_relaxed),
+	};
+}
@@ -0,0 +1,92 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <filesystem>
+#include <span>
+#include <string_view>
+#include <vector>
+
+#include <tl/expected.hpp>
+
+#include "box-rtree.hpp"
+#include "streetlamp-grid.hpp"
+
+// Outlines of the buildings of a scenario in SUMO's projected (x, y) plane. The outline of
+// building i is the closed ring `vertices[offsets[i] .. offsets[i + 1])`.
+struct BuildingFootprints {
+	std::vector<Point>		   vertices;
+	std::vector<std::uint32_t> offsets {0};
+
+	[[nodiscard]] auto size() const -> std::size_t { return offsets.size() - 1; }
+	[[nodiscard]] auto outline(const std::size_t building) const -> std::span<const Point> {
+		return std::span(vertices).subspan(offsets[building],
+										   offsets[building + 1] - offsets[building]);
+	}
+	auto add(std::span<const Point> outline) -> void;
+	auto append(const BuildingFootprints& other) -> void;
+};
+
+enum class load_building_footprints_error {
+	file_not_found,
+	xml_parse_error,
+	malformed_shape,
+};
+
+[[nodiscard]] auto format_load_building_footprints_error(load_building_footprints_error err)
+	-> std::string_view;
+
+// Reads the `<poly>`s of type "building" (or "building.<kind>") from a SUMO additional file, e.g.
+// the horsens.poly.xml polyconvert wrote. Their shapes are already projected.
+[[nodiscard]] auto load_building_footprints(const std::filesystem::path& poly_xml)
+	-> tl::expected<BuildingFootprints, load_building_footprints_error>;
+
+struct OcclusionStats {
+	std::uint64_t sight_tests = 0; // Lamp-vehicle pairs within the threshold checked for buildings
+	std::uint64_t blocked = 0;	   // of which had a building in between
+	std::uint64_t lit_lamps = 0;
+	std::uint64_t occluded_lamps = 0; // Vehicles within the threshold, but all behind buildings
+};
+
+// Keeps lamps from being lit by vehicles on the other side of a building. The building outlines
+// are kept in an R-tree over their bounding boxes, and a lamp-vehicle pair within the distance
+// threshold only counts if the segment between them crosses no outline.
+//
+// Most pairs never need that test: for every lamp and each of the 3x3 grid cells around it, it is
+// precomputed whether any building is near the segments from the lamp into that cell at all. Only
+// vehicles in cells with buildings in between are tested.
+class BuildingOcclusion {
+  public:
+	BuildingOcclusion(BuildingFootprints footprints, const StreetLampGridView& grid,
+					  float distance_threshold);
+
+	// Index of the cell at column offset `dc` and row offset `dr` (both -1, 0 or 1) from a lamp's
+	static constexpr auto neighbour(const std::int64_t dc, const std::int64_t dr) -> int {
+		return static_cast<int>((dr + 1) * 3 + (dc + 1));
+	}
+	// True if no building is in the way from lamp `lamp` (in grid order) to any point of its
+	// `neighbour` cell within the distance threshold
+	[[nodiscard]] auto cell_clear(const std::uint32_t lamp, const int neighbour) const -> bool {
+		return (clear_cells[lamp] >> neighbour) & 1;
+	}
+	// True if the segment from `a` to `b` crosses no building outline
+	[[nodiscard]] auto line_of_sight(Point a, Point b) const -> bool;
+
+	[[nodiscard]] auto num_buildings() const -> std::size_t { return footprints.size(); }
+	// Share of the lamp-cell pairs that need no line of sight tests
+	[[nodiscard]] auto clear_share() const -> double;
+
+	// Adds to the totals, can be called from several threads at once
+	auto record(const OcclusionStats& stats) const -> void;
+	[[nodiscard]] auto stats() const -> OcclusionStats;
+
+  private:
+	BuildingFootprints		   footprints;
+	BoxRTree				   tree;
+	std::vector<std::uint16_t> clear_cells; // Per lamp, bit `neighbour(dc, dr)`
+
+	mutable std::atomic<std::uint64_t> sight_tests {0};
+	mutable std::atomic<std::uint64_t> blocked {0};
+	mutable std::atomic<std::uint64_t> lit_lamps {0};
+	mutable std::atomic<std::uint64_t> occluded_lamps {0};
+};
@@ -0,0 +1,123 @@
+#pragma once
+
+#include <algorithm>
+#include <charconv>
+#include <cmath>
+#include <cstdint>
+#include <span>
+#include <string_view>
+#include <vector>
+
+#include "step-snapshot.hpp"
+#include "streetlamp-grid.hpp"
+
+// Groups cars into square tiles for the spatially filtered cars topic. Tiles are aligned with the
+// cells of the street lamp grid: a tile at zoom `z` is 2^z x 2^z cells, and tile (0, 0) starts at
+// the grid's origin. Cars outside the lamp grid still get a tile, with coordinates outside of it.
+//
+// A tile is published as `<prefix>/<z>/<x>/<y>/` followed by the message header and the same map
+// as the cars topic, see message-header.hpp.
+// The trailing '/' keeps a ZMQ prefix subscription to tile (1, 2) from matching tile (1, 23).
+class CarTiles {
+  public:
+	struct Tile {
+		std::int32_t  x;
+		std::int32_t  y;
+		std::uint32_t begin; // Range in `car_indices()`
+		std::uint32_t end;
+
+		auto operator==(const Tile& other) const -> bool { return x == other.x && y == other.y; }
+	};
+
+	CarTiles(const GridSpec& spec, const int zoom)
+		: origin_x(spec.origin_x), origin_y(spec.origin_y),
+		  tile_size(spec.cell_size * static_cast<float>(1 << zoom)), zoom_(zoom) { }
+
+	auto zoom() const -> int { return zoom_; }
+
+	// Groups the cars of `snapshot` by tile. Tiles are sorted by (y, x).
+	auto assign(const StepSnapshot& snapshot) -> void {
+		keyed.clear();
+		for (std::uint32_t idx = 0; idx < snapshot.cars.size(); ++idx) {
+			const auto& car = snapshot.cars[idx];
+			keyed.push_back({this->tile_x(static_cast<float>(car.x)),
+							 this->tile_y(static_cast<float>(car.y)), idx});
+		}
+		std::sort(keyed.begin(), keyed.end(), [](const Keyed& a, const Keyed& b) {
+			return a.y != b.y ? a.y < b.y : (a.x != b.x ? a.x < b.x : a.idx < b.idx);
+		});
+
+		tiles_.clear();
+		indices.clear();
+		for (std::uint32_t idx = 0; idx < keyed.size(); ++idx) {
+			const auto& k = keyed[idx];
+			if (tiles_.empty() || tiles_.back().x != k.x || tiles_.back().y != k.y) {
+				tiles_.push_back({k.x, k.y, idx, idx});
+			}
+			tiles_.back().end = idx + 1;
+			indices.push_back(k.idx);
+		}
+	}
+
+	auto tiles() const -> std::span<const Tile> { return tiles_; }
+	auto car_indices(const Tile& tile) const -> std::span<const std::uint32_t> {
+		return std::span(indices).subspan(tile.begin, tile.end - tile.begin);
+	}
+
+	// Appends `<prefix>/<z>/<x>/<y>/`
+	template <typename Buffer>
+	auto append_topic(const std::string_view prefix, const Tile& tile, Buffer& out) const -> void {
+		out.insert(out.end(), prefix.begin(), prefix.end());
+		for (const auto n : {zoom_, static_cast<int>(tile.x), static_cast<int>(tile.y)}) {
+			char	   text[16];
+			const auto end = std::to_chars(std::begin(text), std::end(text), n).ptr;
+			out.push_back('/');
+			out.insert(out.end(), std::begin(text), end);
+		}
+		out.push_back('/');
+	}
+
+	// Appends the topic of `tile` and the cars in it, written with `Writer`
+	template <template <typename> class Writer, typename Buffer>
+	auto encode_tile_message(const StepSnapshot& snapshot, const std::string_view prefix,
+							 const Tile& tile, Buffer& out) const -> void {
+		this->append_topic(prefix, tile, out);
+		this->encode_tile_cars<Writer>(snapshot, tile, out);
+	}
+
+	// Appends only the cars in `tile`, for a message with more than the topic in front of them
+	template <template <typename> class Writer, typename Buffer>
+	auto encode_tile_cars(const StepSnapshot& snapshot, const Tile& tile, Buffer& out) const
+		-> void {
+		auto	   writer = Writer<Buffer>(out);
+		const auto cars = this->car_indices(tile);
+		writer.map(cars.size());
+		for (const auto idx : cars) {
+			writer.integer_key(snapshot.car_handles[idx]);
+			encode_record(writer, snapshot.cars[idx]);
+		}
+	}
+
+  private:
+	struct Keyed {
+		std::int32_t  x;
+		std::int32_t  y;
+		std::uint32_t idx;
+	};
+
+	auto tile_x(const float x) const -> std::int32_t {
+		return static_cast<std::int32_t>(std::floor((x - origin_x) / tile_size));
+	}
+	auto tile_y(const float y) const -> std::int32_t {
+		return static_cast<std::int32_t>(std::floor((y - origin_y) / tile_size));
+	}
+
+	float origin_x;
+	float origin_y;
+	float tile_size;
+	int	  zoom_;
+
+	std::vector<Keyed>		   keyed;
+	std::vector<Tile>		   tiles_;
+	std::vector<std::uint32_t> indices;
+};
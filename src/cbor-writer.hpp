@@ -0,0 +1,99 @@
+#pragma once
+
+#include <bit>
+#include <charconv>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <iterator>
+#include <span>
+#include <string_view>
+
+// Minimal CBOR (RFC 8949) encoder appending to a byte container, e.g. `std::vector<u8>` or
+// `std::pmr::vector<u8>`. It writes the same bytes as `nlohmann::json::to_cbor` for the types it
+// supports, without building a json tree first. Only definite length maps and arrays.
+template <typename Buffer>
+class CborWriter {
+  public:
+	explicit CborWriter(Buffer& out) : out(out) { }
+
+	auto map(const std::uint64_t num_pairs) -> void { this->head(major_map, num_pairs); }
+	auto array(const std::uint64_t num_items) -> void { this->head(major_array, num_items); }
+
+	// Records (see record-fields.hpp) are maps from field names to values
+	auto record(const std::uint64_t num_fields) -> void { this->map(num_fields); }
+	auto field_name(const std::string_view name) -> void { this->text(name); }
+
+	// Map keys that are numbers, e.g. vehicle handles, are written as text like in JSON
+	auto integer_key(const std::uint32_t key) -> void {
+		char	   text[16];
+		const auto end = std::to_chars(std::begin(text), std::end(text), key).ptr;
+		this->text({text, end});
+	}
+
+	auto text(const std::string_view s) -> void {
+		this->head(major_text, s.size());
+		this->out.insert(this->out.end(), s.begin(), s.end());
+	}
+
+	auto bytes(const std::span<const std::uint8_t> b) -> void {
+		this->head(major_bytes, b.size());
+		this->out.insert(this->out.end(), b.begin(), b.end());
+	}
+
+	auto integer(const std::int64_t i) -> void {
+		if (i >= 0) {
+			this->head(major_unsigned, static_cast<std::uint64_t>(i));
+		} else {
+			this->head(major_negative, static_cast<std::uint64_t>(-1 - i));
+		}
+	}
+
+	auto boolean(const bool b) -> void { this->out.push_back(b ? 0xF5 : 0xF4); }
+
+	// Written as a 32 bit float when that is lossless, like nlohmann does
+	auto floating(const double d) -> void {
+		const auto f = static_cast<float>(d);
+		if (std::isnan(d) || static_cast<double>(f) == d) {
+			this->out.push_back(0xFA);
+			this->big_endian(std::bit_cast<std::uint32_t>(f), 4);
+		} else {
+			this->out.push_back(0xFB);
+			this->big_endian(std::bit_cast<std::uint64_t>(d), 8);
+		}
+	}
+
+  private:
+	static constexpr std::uint8_t major_unsigned = 0 << 5;
+	static constexpr std::uint8_t major_negative = 1 << 5;
+	static constexpr std::uint8_t major_bytes = 2 << 5;
+	static constexpr std::uint8_t major_text = 3 << 5;
+	static constexpr std::uint8_t major_array = 4 << 5;
+	static constexpr std::uint8_t major_map = 5 << 5;
+
+	auto head(const std::uint8_t major, const std::uint64_t argument) -> void {
+		if (argument < 24) {
+			this->out.push_back(static_cast<std::uint8_t>(major | argument));
+		} else if (argument <= 0xFF) {
+			this->out.push_back(major | 24);
+			this->big_endian(argument, 1);
+		} else if (argument <= 0xFFFF) {
+			this->out.push_back(major | 25);
+			this->big_endian(argument, 2);
+		} else if (argument <= 0xFFFFFFFF) {
+			this->out.push_back(major | 26);
+			this->big_endian(argument, 4);
+		} else {
+			this->out.push_back(major | 27);
+			this->big_endian(argument, 8);
+		}
+	}
+
+	auto big_endian(const std::uint64_t value, const int num_bytes) -> void {
+		for (int shift = 8 * (num_bytes - 1); shift >= 0; shift -= 8) {
+			this->out.push_back(static_cast<std::uint8_t>(value >> shift));
+		}
+	}
+
+	Buffer& out;
+};
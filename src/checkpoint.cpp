@@ -0,0 +1,278 @@
+#include "checkpoint.hpp"
+
+#include <cstring>
+#include <fstream>
+#include <string>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include <fmt/core.h>
+#include <spdlog/spdlog.h>
+
+static_assert(std::is_trivially_copyable_v<Car>);
+static_assert(std::is_trivially_copyable_v<CheckpointHeader>);
+
+namespace {
+	constexpr auto align8(const std::uint64_t offset) -> std::uint64_t {
+		return (offset + 7) & ~std::uint64_t {7};
+	}
+
+	// Byte offsets of the sections after the header
+	struct CheckpointLayout {
+		std::uint64_t car_handles;
+		std::uint64_t cars;
+		std::uint64_t car_name_offsets;
+		std::uint64_t car_names;
+		std::uint64_t lit_streetlamp_ids;
+		std::uint64_t sumo_state_path;
+		std::uint64_t file_size;
+	};
+
+	auto layout_of(const CheckpointHeader& h) -> CheckpointLayout {
+		auto layout = CheckpointLayout {};
+		layout.car_handles = align8(sizeof(CheckpointHeader));
+		layout.cars = align8(layout.car_handles + h.num_cars * sizeof(std::uint32_t));
+		layout.car_name_offsets = align8(layout.cars + h.num_cars * sizeof(Car));
+		layout.car_names =
+			align8(layout.car_name_offsets + (h.num_cars + 1) * sizeof(std::uint32_t));
+		layout.lit_streetlamp_ids = align8(layout.car_names + h.car_names_size);
+		layout.sumo_state_path =
+			align8(layout.lit_streetlamp_ids + h.num_lit_streetlamps * sizeof(std::int64_t));
+		layout.file_size = align8(layout.sumo_state_path + h.sumo_state_path_size);
+		return layout;
+	}
+} // namespace
+
+auto format_checkpoint_error(const checkpoint_error err) -> std::string_view {
+	switch (err) {
+		case checkpoint_error::file_not_found:
+			return "file not found";
+		case checkpoint_error::open_failed:
+			return "could not open the file";
+		case checkpoint_error::read_failed:
+			return "could not read the file";
+		case checkpoint_error::write_failed:
+			return "could not write the file";
+		case checkpoint_error::bad_magic:
+			return "not a checkpoint";
+		case checkpoint_error::version_mismatch:
+			return "checkpoint was written by a different version";
+		case checkpoint_error::truncated:
+			return "checkpoint is smaller than its header says";
+	}
+	return "unknown error";
+}
+
+auto write_checkpoint(const std::filesystem::path& path, const Checkpoint& checkpoint)
+	-> tl::expected<void, checkpoint_error> {
+	const auto& snapshot = checkpoint.snapshot;
+	const auto	sumo_state_path = checkpoint.sumo_state_path.string();
+
+	auto car_name_offsets = std::vector<std::uint32_t> {0};
+	auto car_names = std::string {};
+	for (const auto& name : snapshot.car_names) {
+		car_names += name;
+		car_name_offsets.push_back(static_cast<std::uint32_t>(car_names.size()));
+	}
+
+	auto header = CheckpointHeader {};
+	std::memcpy(header.magic, checkpoint_magic, sizeof(header.magic));
+	header.version = checkpoint_version;
+	header.header_size = sizeof(CheckpointHeader);
+	header.step = snapshot.step;
+	header.simulation_time = snapshot.simulation_time;
+	header.num_cars = snapshot.cars.size();
+	header.car_names_size = car_names.size();
+	header.num_lit_streetlamps = snapshot.lit_streetlamp_ids.size();
+	header.sumo_state_path_size = sumo_state_path.size();
+	const auto layout = layout_of(header);
+	header.file_size = layout.file_size;
+
+	auto tmp_path = path;
+	tmp_path += ".tmp";
+	{
+		auto out = std::ofstream(tmp_path, std::ios::binary | std::ios::trunc);
+		if (! out) {
+			return tl::make_unexpected(checkpoint_error::open_failed);
+		}
+		const auto write_at = [&](const std::uint64_t at, const void* data, const std::size_t n) {
+			static constexpr char zeros[8] = {};
+			const auto			  pos = static_cast<std::uint64_t>(out.tellp());
+			out.write(zeros, static_cast<std::streamsize>(at - pos));
+			out.write(static_cast<const char*>(data), static_cast<std::streamsize>(n));
+		};
+		write_at(0, &header, sizeof(header));
+		write_at(layout.car_handles, snapshot.car_handles.data(),
+				 snapshot.car_handles.size() * sizeof(std::uint32_t));
+		write_at(layout.cars, snapshot.cars.data(), snapshot.cars.size() * sizeof(Car));
+		write_at(layout.car_name_offsets, car_name_offsets.data(),
+				 car_name_offsets.size() * sizeof(std::uint32_t));
+		write_at(layout.car_names, car_names.data(), car_names.size());
+		write_at(layout.lit_streetlamp_ids, snapshot.lit_streetlamp_ids.data(),
+				 snapshot.lit_streetlamp_ids.size() * sizeof(std::int64_t));
+		write_at(layout.sumo_state_path, sumo_state_path.data(), sumo_state_path.size());
+		write_at(layout.file_size, nullptr, 0);
+		if (! out.flush()) {
+			return tl::make_unexpected(checkpoint_error::write_failed);
+		}
+	}
+
+	auto ec = std::error_code {};
+	std::filesystem::rename(tmp_path, path, ec);
+	if (ec) {
+		return tl::make_unexpected(checkpoint_error::write_failed);
+	}
+	return {};
+}
+
+auto read_checkpoint(const std::filesystem::path& path)
+	-> tl::expected<Checkpoint, checkpoint_error> {
+	if (! std::filesystem::exists(path)) {
+		return tl::make_unexpected(checkpoint_error::file_not_found);
+	}
+	auto in = std::ifstream(path, std::ios::binary);
+	if (! in) {
+		return tl::make_unexpected(checkpoint_error::open_failed);
+	}
+	const auto file_size = std::filesystem::file_size(path);
+
+	auto header = CheckpointHeader {};
+	if (file_size < sizeof(header)) {
+		return tl::make_unexpected(checkpoint_error::truncated);
+	}
+	if (! in.read(reinterpret_cast<char*>(&header), sizeof(header))) {
+		return tl::make_unexpected(checkpoint_error::read_failed);
+	}
+	if (std::memcmp(header.magic, checkpoint_magic, sizeof(header.magic)) != 0) {
+		return tl::make_unexpected(checkpoint_error::bad_magic);
+	}
+	if (header.version != checkpoint_version || header.header_size != sizeof(CheckpointHeader)) {
+		return tl::make_unexpected(checkpoint_error::version_mismatch);
+	}
+	const auto layout = layout_of(header);
+	if (header.file_size != file_size || layout.file_size != file_size) {
+		return tl::make_unexpected(checkpoint_error::truncated);
+	}
+
+	auto checkpoint = Checkpoint {};
+	auto& snapshot = checkpoint.snapshot;
+	snapshot.step = header.step;
+	snapshot.simulation_time = header.simulation_time;
+	snapshot.car_handles.resize(header.num_cars);
+	snapshot.cars.resize(header.num_cars);
+	snapshot.lit_streetlamp_ids.resize(header.num_lit_streetlamps);
+	auto car_name_offsets = std::vector<std::uint32_t>(header.num_cars + 1);
+	auto car_names = std::string(header.car_names_size, '\0');
+	auto sumo_state_path = std::string(header.sumo_state_path_size, '\0');
+
+	const auto read_at = [&](const std::uint64_t at, void* data, const std::size_t n) {
+		in.seekg(static_cast<std::streamoff>(at));
+		in.read(static_cast<char*>(data), static_cast<std::streamsize>(n));
+	};
+	read_at(layout.car_handles, snapshot.car_handles.data(),
+			snapshot.car_handles.size() * sizeof(std::uint32_t));
+	read_at(layout.cars, snapshot.cars.data(), snapshot.cars.size() * sizeof(Car));
+	read_at(layout.car_name_offsets, car_name_offsets.data(),
+			car_name_offsets.size() * sizeof(std::uint32_t));
+	read_at(layout.car_names, car_names.data(), car_names.size());
+	read_at(layout.lit_streetlamp_ids, snapshot.lit_streetlamp_ids.data(),
+			snapshot.lit_streetlamp_ids.size() * sizeof(std::int64_t));
+	read_at(layout.sumo_state_path, sumo_state_path.data(), sumo_state_path.size());
+	if (! in) {
+		return tl::make_unexpected(checkpoint_error::read_failed);
+	}
+	for (std::size_t idx = 0; idx < header.num_cars; ++idx) {
+		const auto begin = car_name_offsets[idx];
+		const auto end = car_name_offsets[idx + 1];
+		if (begin > end || end > car_names.size()) {
+			return tl::make_unexpected(checkpoint_error::truncated);
+		}
+		snapshot.car_names.emplace_back(car_names, begin, end - begin);
+	}
+	checkpoint.sumo_state_path = sumo_state_path;
+	return checkpoint;
+}
+
+CheckpointWriter::CheckpointWriter(std::filesystem::path path)
+	: path(std::move(path)), thread([this] { this->run(); }) { }
+
+CheckpointWriter::~CheckpointWriter() {
+	this->close();
+}
+
+auto CheckpointWriter::submit(const StepSnapshot&			snapshot,
+							  const std::filesystem::path& sumo_state_path) -> void {
+	{
+		const auto lock = std::lock_guard(mutex);
+		if (has_pending) {
+			// Never written, so nothing refers to its SUMO state
+			auto ec = std::error_code {};
+			std::filesystem::remove(pending.sumo_state_path, ec);
+			skipped++;
+		}
+		pending.snapshot = snapshot;
+		pending.sumo_state_path = sumo_state_path;
+		has_pending = true;
+	}
+	pending_or_closed.notify_one();
+}
+
+auto CheckpointWriter::close() -> void {
+	{
+		const auto lock = std::lock_guard(mutex);
+		closed = true;
+	}
+	pending_or_closed.notify_one();
+	if (thread.joinable()) {
+		thread.join();
+	}
+}
+
+auto CheckpointWriter::sumo_state_path(const std::uint64_t step) const -> std::filesystem::path {
+	auto state_path = path;
+	state_path += fmt::format(".{}.state.xml", step);
+	return state_path;
+}
+
+auto CheckpointWriter::run() -> void {
+	// Swapped with `pending`, so both keep their capacity
+	auto writing = Checkpoint {};
+	auto previous_sumo_state_path = std::filesystem::path {};
+	while (true) {
+		{
+			auto lock = std::unique_lock(mutex);
+			pending_or_closed.wait(lock, [&] { return has_pending || closed; });
+			if (! has_pending) {
+				break;
+			}
+			std::swap(writing, pending);
+			has_pending = false;
+		}
+
+		const auto written = write_checkpoint(path, writing);
+		if (! written) {
+			spdlog::error("Failed to write checkpoint {}: {}", path.string(),
+						  format_checkpoint_error(written.error()));
+			// No checkpoint refers to its SUMO state, unless it is the one already on disk
+			if (writing.sumo_state_path != previous_sumo_state_path) {
+				auto ec = std::error_code {};
+				std::filesystem::remove(writing.sumo_state_path, ec);
+			}
+			continue;
+		}
+		spdlog::info("Checkpoint of step {} written to {}", writing.snapshot.step, path.string());
+		if (! previous_sumo_state_path.empty() &&
+			previous_sumo_state_path != writing.sumo_state_path) {
+			auto ec = std::error_code {};
+			std::filesystem::remove(previous_sumo_state_path, ec);
+		}
+		previous_sumo_state_path = writing.sumo_state_path;
+	}
+
+	const auto lock = std::lock_guard(mutex);
+	if (skipped > 0) {
+		spdlog::warn("Skipped {} checkpoints, writing them took longer than the interval",
+					 skipped);
+	}
+}
@@ -0,0 +1,102 @@
+#pragma once
+
+#include <condition_variable>
+#include <cstdint>
+#include <filesystem>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <thread>
+
+#include <tl/expected.hpp>
+
+#include "step-snapshot.hpp"
+
+// A checkpoint is the publisher's own state after a step, next to the SUMO state SUMO saved for
+// the same step. Together they are enough to resume a run: SUMO loads its state, and the vehicle
+// handles, the cars and the lit street lamps are restored from the snapshot.
+//
+// Layout: a `CheckpointHeader` followed by `u32 car_handles[num_cars]`, `Car cars[num_cars]`,
+// `u32 car_name_offsets[num_cars + 1]`, the car names back to back (`car_names_size` bytes),
+// `i64 lit_streetlamp_ids[num_lit_streetlamps]` and the path of the SUMO state file, each 8 byte
+// aligned and in the byte order of the machine that wrote it.
+
+inline constexpr char checkpoint_magic[8] = {'S', 'U', 'M', 'O', 'C', 'K', 'P', 'T'};
+inline constexpr std::uint32_t checkpoint_version = 2;
+
+struct CheckpointHeader {
+	char		  magic[8];
+	std::uint32_t version;
+	std::uint32_t header_size;
+	std::uint64_t step;
+	double		  simulation_time;
+	std::uint64_t num_cars;
+	std::uint64_t car_names_size;
+	std::uint64_t num_lit_streetlamps;
+	std::uint64_t sumo_state_path_size;
+	std::uint64_t file_size;
+};
+
+struct Checkpoint {
+	StepSnapshot		  snapshot;
+	std::filesystem::path sumo_state_path; // Saved by `Simulation::saveState`
+};
+
+enum class checkpoint_error {
+	file_not_found,
+	open_failed,
+	read_failed,
+	write_failed,
+	bad_magic,
+	version_mismatch,
+	truncated,
+};
+
+[[nodiscard]] auto format_checkpoint_error(checkpoint_error err) -> std::string_view;
+
+// Writes to a temporary file next to `path` and renames it in place, so a crash while writing
+// leaves the previous checkpoint intact
+[[nodiscard]] auto write_checkpoint(const std::filesystem::path& path, const Checkpoint& checkpoint)
+	-> tl::expected<void, checkpoint_error>;
+
+[[nodiscard]] auto read_checkpoint(const std::filesystem::path& path)
+	-> tl::expected<Checkpoint, checkpoint_error>;
+
+// Writes checkpoints on a thread of its own, so the simulation loop only pays for copying the
+// snapshot. If a checkpoint is submitted while the previous one is still waiting to be written,
+// the previous one is skipped.
+//
+// Once a checkpoint is on disk the SUMO state file of the checkpoint before it is removed, so there
+// is always a complete pair to resume from.
+class CheckpointWriter {
+  public:
+	explicit CheckpointWriter(std::filesystem::path path);
+	~CheckpointWriter();
+
+	CheckpointWriter(const CheckpointWriter&) = delete;
+	auto operator=(const CheckpointWriter&) -> CheckpointWriter& = delete;
+
+	// Copies `snapshot`, reusing the capacity of the previous copy
+	auto submit(const StepSnapshot& snapshot, const std::filesystem::path& sumo_state_path)
+		-> void;
+
+	// Waits for the pending checkpoint to be written and stops the writer thread
+	auto close() -> void;
+
+	// The SUMO state file of the step about to be checkpointed, e.g. `<path>.1000.state.xml`
+	[[nodiscard]] auto sumo_state_path(std::uint64_t step) const -> std::filesystem::path;
+
+  private:
+	auto run() -> void;
+
+	std::filesystem::path path;
+
+	std::mutex				mutex;
+	std::condition_variable pending_or_closed;
+	Checkpoint				pending;
+	bool					has_pending = false;
+	bool					closed = false;
+	std::uint64_t			skipped = 0;
+
+	std::thread thread;
+};
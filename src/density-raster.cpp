@@ -0,0 +1,206 @@
+#include "density-raster.hpp"
+
+#include <algorithm>
+#include <array>
+#include <bit>
+#include <charconv>
+#include <cmath>
+#include <fstream>
+#include <numbers>
+#include <string>
+#include <utility>
+
+auto format_read_net_boundary_error(const read_net_boundary_error err) -> std::string_view {
+	switch (err) {
+		case read_net_boundary_error::open_failed:
+			return "failed to open the network";
+		case read_net_boundary_error::no_location:
+			return "the network has no <location> with a convBoundary";
+		case read_net_boundary_error::malformed_boundary:
+			return "the convBoundary of the network is not four numbers";
+	}
+	return "unknown error";
+}
+
+auto read_net_boundary(const std::filesystem::path& net_file)
+	-> tl::expected<NetBoundary, read_net_boundary_error> {
+	auto file = std::ifstream(net_file, std::ios::binary);
+	if (! file) {
+		return tl::make_unexpected(read_net_boundary_error::open_failed);
+	}
+	// netconvert writes a license comment and the <net> element before it, a few KB at most
+	auto head = std::string(64 * 1024, '\0');
+	file.read(head.data(), static_cast<std::streamsize>(head.size()));
+	head.resize(static_cast<std::size_t>(file.gcount()));
+	return parse_net_boundary(head);
+}
+
+auto parse_net_boundary(const std::string_view xml)
+	-> tl::expected<NetBoundary, read_net_boundary_error> {
+	const auto location = xml.find("<location");
+	if (location == std::string_view::npos) {
+		return tl::make_unexpected(read_net_boundary_error::no_location);
+	}
+	constexpr auto attribute = std::string_view("convBoundary=\"");
+	const auto	   element = xml.substr(location, xml.find('>', location) - location);
+	const auto	   start = element.find(attribute);
+	if (start == std::string_view::npos) {
+		return tl::make_unexpected(read_net_boundary_error::no_location);
+	}
+	const auto value = element.substr(start + attribute.size());
+	const auto end = value.find('"');
+	if (end == std::string_view::npos) {
+		return tl::make_unexpected(read_net_boundary_error::malformed_boundary);
+	}
+
+	auto numbers = std::array<double, 4> {};
+	auto first = value.data();
+	const auto last = value.data() + end;
+	for (std::size_t idx = 0; idx < numbers.size(); ++idx) {
+		const auto [ptr, ec] = std::from_chars(first, last, numbers[idx]);
+		const auto separator = idx + 1 < numbers.size() ? ',' : '"';
+		if (ec != std::errc {} || (ptr != last && *ptr != separator) ||
+			(ptr == last && separator == ',')) {
+			return tl::make_unexpected(read_net_boundary_error::malformed_boundary);
+		}
+		first = ptr + 1;
+	}
+	const auto [x_min, y_min, x_max, y_max] = numbers;
+	if (! (x_min <= x_max && y_min <= y_max)) {
+		return tl::make_unexpected(read_net_boundary_error::malformed_boundary);
+	}
+	return NetBoundary {x_min, y_min, x_max, y_max};
+}
+
+auto RasterSpec::covering(const NetBoundary& boundary, const double cell_size) -> RasterSpec {
+	// At least one cell, and the boundary's maximum inside the last one
+	const auto cells = [&](const double min, const double max) {
+		return static_cast<std::uint32_t>(std::floor((max - min) / cell_size)) + 1;
+	};
+	return RasterSpec {
+		.x_min = boundary.x_min,
+		.y_min = boundary.y_min,
+		.cell_size = cell_size,
+		.columns = cells(boundary.x_min, boundary.x_max),
+		.rows = cells(boundary.y_min, boundary.y_max),
+	};
+}
+
+auto RasterSpec::cell_of(const double x, const double y) const -> std::size_t {
+	const auto column = std::floor((x - x_min) / cell_size);
+	const auto row = std::floor((y - y_min) / cell_size);
+	if (column < 0.0 || row < 0.0 || column >= columns || row >= rows) {
+		return this->num_cells();
+	}
+	return static_cast<std::size_t>(row) * columns + static_cast<std::size_t>(column);
+}
+
+namespace {
+	auto little_endian(const std::uint16_t value) -> std::uint16_t {
+		if constexpr (std::endian::native == std::endian::big) {
+			return static_cast<std::uint16_t>((value >> 8) | (value << 8));
+		}
+		return value;
+	}
+
+	// Cells per task of the reduction, small enough to spread over the threads and large enough
+	// that a task is not only overhead
+	constexpr std::size_t cells_per_range = 16 * 1024;
+} // namespace
+
+DensityRaster::DensityRaster(const RasterSpec spec, const unsigned num_threads)
+	: spec_(spec), partials(std::max(num_threads, 1u)), counts_(spec.num_cells(), 0),
+	  headings_(spec.num_cells(), 0),
+	  num_ranges(static_cast<std::uint32_t>((spec.num_cells() + cells_per_range - 1) /
+											cells_per_range)) {
+	for (auto& partial : partials) {
+		partial.counts.assign(spec.num_cells(), 0);
+		partial.sin_sum.assign(spec.num_cells(), 0.0f);
+		partial.cos_sum.assign(spec.num_cells(), 0.0f);
+	}
+	if (partials.size() > 1) {
+		pool.emplace(static_cast<unsigned>(partials.size()));
+		accumulate_task = [this](const std::uint32_t block) { this->accumulate(block); };
+		reduce_task = [this](const std::uint32_t range) { this->reduce(range); };
+	}
+}
+
+auto DensityRaster::compute(const std::span<const Car> cars) -> void {
+	cars_to_count = cars;
+	const auto num_blocks = static_cast<std::uint32_t>(partials.size());
+	if (pool) {
+		// Every block has a partial raster of its own, so stealing is safe, and evens out blocks
+		// whose cars are spread over more cells
+		pool->run(num_blocks, accumulate_task);
+		pool->run(num_ranges, reduce_task);
+	} else {
+		this->accumulate(0);
+		for (std::uint32_t range = 0; range < num_ranges; ++range) {
+			this->reduce(range);
+		}
+	}
+	cars_ = 0;
+	for (const auto& partial : partials) {
+		cars_ += partial.cars;
+	}
+}
+
+auto DensityRaster::accumulate(const std::uint32_t block) -> void {
+	auto&	   partial = partials[block];
+	const auto num_blocks = partials.size();
+	const auto begin = cars_to_count.size() * block / num_blocks;
+	const auto end = cars_to_count.size() * (block + 1) / num_blocks;
+	const auto outside = spec_.num_cells();
+
+	partial.cars = 0;
+	for (auto idx = begin; idx < end; ++idx) {
+		const auto& car = cars_to_count[idx];
+		if (! car.alive) {
+			continue;
+		}
+		const auto cell = spec_.cell_of(car.x, car.y);
+		if (cell == outside) {
+			continue;
+		}
+		const auto radians = static_cast<float>(car.heading * std::numbers::pi / 180.0);
+		partial.counts[cell]++;
+		partial.sin_sum[cell] += std::sin(radians);
+		partial.cos_sum[cell] += std::cos(radians);
+		partial.cars++;
+	}
+}
+
+auto DensityRaster::reduce(const std::uint32_t range) -> void {
+	const auto begin = static_cast<std::size_t>(range) * cells_per_range;
+	const auto end = std::min(begin + cells_per_range, spec_.num_cells());
+	constexpr auto turn = 65536.0f;
+	for (auto cell = begin; cell < end; ++cell) {
+		std::uint32_t count = 0;
+		auto		  sin_sum = 0.0f;
+		auto		  cos_sum = 0.0f;
+		// Also clears the partial rasters for the next `compute`
+		for (auto& partial : partials) {
+			count += std::exchange(partial.counts[cell], 0);
+			sin_sum += std::exchange(partial.sin_sum[cell], 0.0f);
+			cos_sum += std::exchange(partial.cos_sum[cell], 0.0f);
+		}
+
+		auto heading = std::uint16_t {0};
+		if (count > 0) {
+			auto fraction = std::atan2(sin_sum, cos_sum) / (2.0f * std::numbers::pi_v<float>);
+			fraction += fraction < 0.0f ? 1.0f : 0.0f;
+			heading = static_cast<std::uint16_t>(
+				static_cast<std::uint32_t>(std::lround(fraction * turn)) & 0xFFFF);
+		}
+		counts_[cell] = little_endian(static_cast<std::uint16_t>(std::min(count, 0xFFFFu)));
+		headings_[cell] = little_endian(heading);
+	}
+}
+
+auto DensityRaster::count(const std::size_t cell) const -> std::uint16_t {
+	return little_endian(counts_[cell]);
+}
+
+auto DensityRaster::heading(const std::size_t cell) const -> std::uint16_t {
+	return little_endian(headings_[cell]);
+}
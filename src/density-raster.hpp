@@ -0,0 +1,145 @@
+#pragma once
+
+#include <cstdint>
+#include <filesystem>
+#include <functional>
+#include <optional>
+#include <span>
+#include <string_view>
+#include <vector>
+
+#include <tl/expected.hpp>
+
+#include "step-snapshot.hpp"
+#include "work-stealing-pool.hpp"
+
+// Vehicle density on a raster of square cells over the whole network, for the heatmap topic.
+// Browsers draw it as is, instead of binning every car of the cars topic themselves.
+
+// The rectangle SUMO converted the network into, `convBoundary` of the `<location>` of a .net.xml
+struct NetBoundary {
+	double x_min = 0.0;
+	double y_min = 0.0;
+	double x_max = 0.0;
+	double y_max = 0.0;
+};
+
+enum class read_net_boundary_error {
+	open_failed,
+	no_location,
+	malformed_boundary,
+};
+
+[[nodiscard]] auto format_read_net_boundary_error(read_net_boundary_error err) -> std::string_view;
+
+// `<location>` is the first element of a .net.xml, so only the start of the file is read
+[[nodiscard]] auto read_net_boundary(const std::filesystem::path& net_file)
+	-> tl::expected<NetBoundary, read_net_boundary_error>;
+// Finds the `convBoundary="x_min,y_min,x_max,y_max"` of the first `<location>` in `xml`
+[[nodiscard]] auto parse_net_boundary(std::string_view xml)
+	-> tl::expected<NetBoundary, read_net_boundary_error>;
+
+// Cells of `cell_size` meters covering a boundary, in row major order. Cell (column, row) starts
+// at (x_min + column * cell_size, y_min + row * cell_size), so row 0 is the southern edge.
+struct RasterSpec {
+	double		  x_min = 0.0;
+	double		  y_min = 0.0;
+	double		  cell_size = 25.0;
+	std::uint32_t columns = 0;
+	std::uint32_t rows = 0;
+
+	[[nodiscard]] static auto covering(const NetBoundary& boundary, double cell_size)
+		-> RasterSpec;
+
+	[[nodiscard]] auto num_cells() const -> std::size_t {
+		return static_cast<std::size_t>(columns) * rows;
+	}
+	// The cell containing (x, y), or `num_cells()` if it is outside the raster
+	[[nodiscard]] auto cell_of(double x, double y) const -> std::size_t;
+};
+
+// Counts the cars in every cell and their mean heading. The cars are split into one block per
+// thread, each counted into a partial raster of its own, and the partial rasters are then added
+// up a range of cells per task. With one thread everything runs on the calling thread. The
+// results are kept as the u16 arrays that are sent, in little endian byte order.
+class DensityRaster {
+  public:
+	DensityRaster(RasterSpec spec, unsigned num_threads);
+
+	auto compute(std::span<const Car> cars) -> void;
+
+	[[nodiscard]] auto spec() const -> const RasterSpec& { return spec_; }
+	// Cars in the raster in the last `compute`, cars outside it are not counted
+	[[nodiscard]] auto cars() const -> std::uint64_t { return cars_; }
+	// Cars per cell, capped at 65535
+	[[nodiscard]] auto counts() const -> std::span<const std::uint8_t> {
+		return as_bytes(counts_);
+	}
+	// The circular mean of the headings of the cars per cell, in 1/65536 of a full turn
+	// clockwise from north like SUMO's angles, 0 for empty cells
+	[[nodiscard]] auto headings() const -> std::span<const std::uint8_t> {
+		return as_bytes(headings_);
+	}
+
+	// The values of one cell in the byte order of this machine
+	[[nodiscard]] auto count(std::size_t cell) const -> std::uint16_t;
+	[[nodiscard]] auto heading(std::size_t cell) const -> std::uint16_t;
+
+  private:
+	struct Partial {
+		std::vector<std::uint32_t> counts;
+		std::vector<float>		   sin_sum;
+		std::vector<float>		   cos_sum;
+		std::uint64_t			   cars = 0;
+	};
+
+	static auto as_bytes(const std::vector<std::uint16_t>& values)
+		-> std::span<const std::uint8_t> {
+		return {reinterpret_cast<const std::uint8_t*>(values.data()),
+				values.size() * sizeof(std::uint16_t)};
+	}
+
+	auto accumulate(std::uint32_t block) -> void;
+	auto reduce(std::uint32_t range) -> void;
+
+	RasterSpec				   spec_;
+	std::vector<Partial>	   partials;
+	std::vector<std::uint16_t> counts_;
+	std::vector<std::uint16_t> headings_;
+	std::uint64_t			   cars_ = 0;
+	std::uint32_t			   num_ranges;
+
+	std::span<const Car> cars_to_count; // Of the `compute` running
+
+	// Built once, the pool only keeps a reference to the task it runs
+	std::optional<WorkStealingPool>	   pool;
+	std::function<void(std::uint32_t)> accumulate_task;
+	std::function<void(std::uint32_t)> reduce_task;
+};
+
+// Appends the raster as
+//   { "x": x_min, "y": y_min, "cell_size": 25, "columns": 400, "rows": 300, "cars": 1234,
+//     "counts": <bytes>, "headings": <bytes> }
+// where the bytes are the u16 arrays of the raster, see `DensityRaster`
+template <template <typename> class Writer, typename Buffer>
+auto encode_density_raster(const DensityRaster& raster, Buffer& out) -> void {
+	auto		writer = Writer<Buffer>(out);
+	const auto& spec = raster.spec();
+	writer.record(8);
+	writer.field_name("x");
+	writer.floating(spec.x_min);
+	writer.field_name("y");
+	writer.floating(spec.y_min);
+	writer.field_name("cell_size");
+	writer.floating(spec.cell_size);
+	writer.field_name("columns");
+	writer.integer(spec.columns);
+	writer.field_name("rows");
+	writer.integer(spec.rows);
+	writer.field_name("cars");
+	writer.integer(static_cast<std::int64_t>(raster.cars()));
+	writer.field_name("counts");
+	writer.bytes(raster.counts());
+	writer.field_name("headings");
+	writer.bytes(raster.headings());
+}
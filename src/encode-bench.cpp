@@ -0,0 +1,159 @@
+// Compares the throughput of the topic encoders generated from the record field lists
+// (record-fields.hpp) with building a nlohmann::json tree of the same message and serializing it,
+// which is how the publisher encoded its topics before. Every run encodes the cars message of one
+// snapshot over and over into a reused buffer.
+//
+// The CBOR and MessagePack outputs are also checked against nlohmann's, byte for byte.
+
+#include <algorithm>
+#include <charconv>
+#include <chrono>
+#include <cstdint>
+#include <iostream>
+#include <iterator>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include <argparse/argparse.hpp>
+#include <fmt/core.h>
+#include <nlohmann/json.hpp>
+#include <spdlog/spdlog.h>
+
+#include "encoding-format.hpp"
+#include "step-snapshot.hpp"
+
+namespace {
+	using clock = std::chrono::steady_clock;
+	using json = nlohmann::json;
+	using Bytes = std::vector<std::uint8_t>;
+
+	struct EncodeReport {
+		std::string name;
+		std::size_t message_bytes = 0;
+		double		seconds = 0.0;
+	};
+
+	auto make_snapshot(const int num_cars) -> StepSnapshot {
+		auto snapshot = StepSnapshot {};
+		for (int i = 0; i < num_cars; ++i) {
+			snapshot.car_handles.push_back(static_cast<std::uint32_t>(i));
+			snapshot.car_names.push_back(fmt::format("veh{}", i));
+			// Headings in whole degrees are lossless as 32 bit floats, the others are not
+			const auto heading = i % 2 == 0 ? static_cast<double>(i % 360) : 0.1 * i;
+			snapshot.cars.push_back(Car {.x = 1000 + 7 * i, .y = 2000 - 3 * i, .heading = heading});
+		}
+		return snapshot;
+	}
+
+	// The cars message as a json tree, like the publisher built it before the writers. json sorts
+	// the keys, the writers keep the snapshot order, so the byte checks use ordered_json.
+	template <typename Json = json>
+	auto cars_json(const StepSnapshot& snapshot) -> Json {
+		auto cars = Json::object();
+		for (std::size_t idx = 0; idx < snapshot.cars.size(); ++idx) {
+			const auto& car = snapshot.cars[idx];
+			cars[std::to_string(snapshot.car_handles[idx])] = {
+				{"heading", car.heading},
+				{"x", car.x},
+				{"y", car.y},
+			};
+		}
+		return cars;
+	}
+
+	template <typename Encode>
+	auto bench(const std::string& name, const int iterations, Encode&& encode) -> EncodeReport {
+		auto out = Bytes {};
+		encode(out); // Warm up and size the buffer
+		const auto start = clock::now();
+		for (int i = 0; i < iterations; ++i) {
+			out.clear();
+			encode(out);
+		}
+		const auto seconds = std::chrono::duration<double>(clock::now() - start).count();
+		return {.name = name, .message_bytes = out.size(), .seconds = seconds};
+	}
+
+	template <template <typename> class Writer>
+	auto encode_cars(const StepSnapshot& snapshot) -> Bytes {
+		auto out = Bytes {};
+		encode_cars_message<Writer>(snapshot, "", out);
+		return out;
+	}
+
+	auto print_report(const EncodeReport& report, const int iterations, const double baseline)
+		-> void {
+		const auto per_message_us = report.seconds / iterations * 1e6;
+		const auto mb_per_s =
+			static_cast<double>(report.message_bytes) * iterations / report.seconds / 1e6;
+		fmt::println("{:>16}: {:>8} bytes/message, {:>9.1f} us/message, {:>8.1f} MB/s, {:>5.1f}x",
+					 report.name, report.message_bytes, per_message_us, mb_per_s,
+					 baseline / report.seconds);
+	}
+} // namespace
+
+auto main(int argc, char** argv) -> int {
+	auto argv_parser = argparse::ArgumentParser("encode-bench", "0.1.0");
+	argv_parser.add_argument("--cars")
+		.help("Number of cars in the snapshot")
+		.default_value(5000)
+		.scan<'i', int>();
+	argv_parser.add_argument("--iterations")
+		.help("Number of times the message is encoded per encoder")
+		.default_value(500)
+		.scan<'i', int>();
+
+	try {
+		argv_parser.parse_args(argc, argv);
+	} catch (const std::exception& err) {
+		spdlog::error("{}", err.what());
+		std::cerr << argv_parser;
+		return 2;
+	}
+
+	const auto num_cars = std::max(1, argv_parser.get<int>("--cars"));
+	const auto iterations = std::max(1, argv_parser.get<int>("--iterations"));
+	const auto snapshot = make_snapshot(num_cars);
+
+	const auto ordered_cars = cars_json<nlohmann::ordered_json>(snapshot);
+	if (encode_cars<CborWriter>(snapshot) != nlohmann::ordered_json::to_cbor(ordered_cars)) {
+		spdlog::error("CborWriter does not write the same bytes as nlohmann::json::to_cbor");
+		return 1;
+	}
+	if (encode_cars<MsgpackWriter>(snapshot) != nlohmann::ordered_json::to_msgpack(ordered_cars)) {
+		spdlog::error("MsgpackWriter does not write the same bytes as nlohmann::json::to_msgpack");
+		return 1;
+	}
+
+	const auto nlohmann_cbor = bench("nlohmann cbor", iterations, [&](Bytes& out) {
+		json::to_cbor(cars_json(snapshot), out);
+	});
+	const auto nlohmann_msgpack = bench("nlohmann msgpack", iterations, [&](Bytes& out) {
+		json::to_msgpack(cars_json(snapshot), out);
+	});
+	const auto nlohmann_json = bench("nlohmann json", iterations, [&](Bytes& out) {
+		const auto text = cars_json(snapshot).dump();
+		out.insert(out.end(), text.begin(), text.end());
+	});
+
+	const auto writer_report = [&](const EncodingFormat format) {
+		return with_writer(format, [&](auto tag) {
+			return bench(std::string(encoding_format_name(format)), iterations, [&](Bytes& out) {
+				encode_cars_message<decltype(tag)::template Writer>(snapshot, "", out);
+			});
+		});
+	};
+
+	fmt::println("cars message of {} cars, encoded {} times; the last column is the speedup over "
+				 "nlohmann cbor",
+				 num_cars, iterations);
+	for (const auto& report : {nlohmann_cbor, nlohmann_msgpack, nlohmann_json}) {
+		print_report(report, iterations, nlohmann_cbor.seconds);
+	}
+	for (const auto format : {EncodingFormat::cbor, EncodingFormat::msgpack, EncodingFormat::json,
+							  EncodingFormat::packed}) {
+		print_report(writer_report(format), iterations, nlohmann_cbor.seconds);
+	}
+	return 0;
+}
@@ -0,0 +1,58 @@
+#pragma once
+
+#include <string_view>
+
+#include "cbor-writer.hpp"
+#include "json-writer.hpp"
+#include "msgpack-writer.hpp"
+#include "packed-writer.hpp"
+
+// Wire format of a topic, `format` in its `[topics.<key>]` table
+enum class EncodingFormat {
+	cbor,
+	msgpack,
+	json,
+	packed, // See packed-writer.hpp
+};
+
+[[nodiscard]] constexpr auto encoding_format_name(const EncodingFormat format) -> std::string_view {
+	switch (format) {
+		case EncodingFormat::cbor:
+			return "cbor";
+		case EncodingFormat::msgpack:
+			return "msgpack";
+		case EncodingFormat::json:
+			return "json";
+		case EncodingFormat::packed:
+			return "packed";
+	}
+	return "unknown";
+}
+
+// Names a writer template, so it can be passed to a generic lambda
+template <template <typename> class W>
+struct WriterTag {
+	template <typename Buffer>
+	using Writer = W<Buffer>;
+};
+
+// Calls `f(WriterTag<W>{})` with the writer `W` of `format`, which picks the encoders for a topic
+// once instead of per message:
+//
+//   auto encode = with_writer(format, [](auto tag) -> Encode {
+//       return encode_cars_message<decltype(tag)::template Writer>;
+//   });
+template <typename F>
+auto with_writer(const EncodingFormat format, F&& f) -> decltype(auto) {
+	switch (format) {
+		case EncodingFormat::msgpack:
+			return f(WriterTag<MsgpackWriter> {});
+		case EncodingFormat::json:
+			return f(WriterTag<JsonWriter> {});
+		case EncodingFormat::packed:
+			return f(WriterTag<PackedWriter> {});
+		case EncodingFormat::cbor:
+		default:
+			return f(WriterTag<CborWriter> {});
+	}
+}
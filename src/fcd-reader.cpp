@@ -0,0 +1,300 @@
+#include "fcd-reader.hpp"
+
+#include <algorithm>
+#include <charconv>
+#include <optional>
+
+auto format_read_fcd_error(const read_fcd_error err) -> std::string_view {
+	switch (err) {
+		case read_fcd_error::empty_file:
+			return "empty file";
+		case read_fcd_error::missing_columns:
+			return "CSV header without time, x and y columns";
+		case read_fcd_error::malformed_timestep:
+			return "malformed timestep";
+		case read_fcd_error::malformed_vehicle:
+			return "malformed vehicle";
+	}
+	return "unknown error";
+}
+
+namespace {
+	constexpr auto npos = std::string_view::npos;
+
+	auto is_space(const char c) -> bool {
+		return c == ' ' || c == '\t' || c == '\n' || c == '\r';
+	}
+
+	template <typename T>
+	auto parse_number(const std::string_view text) -> std::optional<T> {
+		auto	   value = T {};
+		const auto end = text.data() + text.size();
+		const auto [ptr, ec] = std::from_chars(text.data(), end, value);
+		if (ec != std::errc {} || ptr != end) {
+			return std::nullopt;
+		}
+		return value;
+	}
+
+	// True if the text of an XML tag, without the '<', is a `name` element
+	auto tag_is(const std::string_view tag, const std::string_view name) -> bool {
+		return tag.starts_with(name) &&
+			   (tag.size() == name.size() || is_space(tag[name.size()]) ||
+				tag[name.size()] == '/' || tag[name.size()] == '>');
+	}
+
+	// The value of attribute `name` in the text of an XML tag
+	auto attribute(const std::string_view tag, const std::string_view name)
+		-> std::optional<std::string_view> {
+		for (auto pos = tag.find(name); pos != npos; pos = tag.find(name, pos + 1)) {
+			const auto value = pos + name.size() + 2;
+			if (pos == 0 || ! is_space(tag[pos - 1]) || value > tag.size() ||
+				tag.substr(pos + name.size(), 2) != "=\"") {
+				continue;
+			}
+			const auto end = tag.find('"', value);
+			if (end == npos) {
+				return std::nullopt;
+			}
+			return tag.substr(value, end - value);
+		}
+		return std::nullopt;
+	}
+
+	template <typename T>
+	auto number_attribute(const std::string_view tag, const std::string_view name)
+		-> std::optional<T> {
+		const auto value = attribute(tag, name);
+		return value ? parse_number<T>(*value) : std::nullopt;
+	}
+
+	// Field `column` of a CSV row, empty if the row has fewer fields
+	auto csv_field(std::string_view row, const char separator, std::uint32_t column)
+		-> std::string_view {
+		for (; column > 0; --column) {
+			const auto next = row.find(separator);
+			if (next == npos) {
+				return {};
+			}
+			row.remove_prefix(next + 1);
+		}
+		auto field = row.substr(0, row.find(separator));
+		while (! field.empty() && field.back() == '\r') {
+			field.remove_suffix(1);
+		}
+		return field;
+	}
+
+	// The row starting at `begin` and the offset of the row after it
+	auto csv_row(const std::string_view text, const std::size_t begin)
+		-> std::pair<std::string_view, std::size_t> {
+		const auto end = std::min(text.find('\n', begin), text.size());
+		return {text.substr(begin, end - begin), std::min(end + 1, text.size())};
+	}
+
+	auto next_xml_timestep(const std::string_view text, std::size_t from) -> std::size_t {
+		for (auto pos = text.find("<timestep", from); pos != npos;
+			 pos = text.find("<timestep", pos + 1)) {
+			if (tag_is(text.substr(pos + 1), "timestep")) {
+				return pos;
+			}
+		}
+		return text.size();
+	}
+
+	// The first row at or after `from` whose time differs from the row before it
+	auto next_csv_timestep(const std::string_view text, const FcdLayout& layout,
+						   const std::size_t from) -> std::size_t {
+		const auto newline = text.find('\n', from);
+		if (newline == npos) {
+			return text.size();
+		}
+		const auto previous_begin =
+			std::max(layout.data_begin, newline == 0 ? 0 : text.rfind('\n', newline - 1) + 1);
+		const auto previous_time =
+			csv_field(csv_row(text, previous_begin).first, layout.separator, layout.time_column);
+		auto begin = newline + 1;
+		while (begin < text.size()) {
+			const auto [row, next] = csv_row(text, begin);
+			if (csv_field(row, layout.separator, layout.time_column) != previous_time) {
+				break;
+			}
+			begin = next;
+		}
+		return begin;
+	}
+
+	using OnTimestep = std::function<void(double, std::span<const Point>)>;
+
+	auto read_xml_chunk(const std::string_view chunk, const OnTimestep& on_timestep)
+		-> tl::expected<void, read_fcd_error> {
+		auto		points = std::vector<Point> {};
+		auto		time = 0.0;
+		bool		in_timestep = false;
+		std::size_t pos = 0;
+		while ((pos = chunk.find('<', pos)) != npos) {
+			if (chunk.substr(pos, 4) == "<!--") {
+				const auto end = chunk.find("-->", pos);
+				pos = end == npos ? chunk.size() : end + 3;
+				continue;
+			}
+			const auto close = chunk.find('>', pos);
+			if (close == npos) {
+				break;
+			}
+			const auto tag = chunk.substr(pos + 1, close - pos - 1);
+			pos = close + 1;
+
+			if (tag_is(tag, "vehicle")) {
+				const auto x = number_attribute<float>(tag, "x");
+				const auto y = number_attribute<float>(tag, "y");
+				if (! in_timestep || ! x || ! y) {
+					return tl::make_unexpected(read_fcd_error::malformed_vehicle);
+				}
+				points.push_back(Point {*x, *y});
+			} else if (tag_is(tag, "timestep")) {
+				if (in_timestep) {
+					return tl::make_unexpected(read_fcd_error::malformed_timestep);
+				}
+				const auto t = number_attribute<double>(tag, "time");
+				if (! t) {
+					return tl::make_unexpected(read_fcd_error::malformed_timestep);
+				}
+				time = *t;
+				points.clear();
+				in_timestep = ! tag.ends_with('/');
+				if (! in_timestep) {
+					on_timestep(time, points);
+				}
+			} else if (tag_is(tag, "/timestep")) {
+				if (! in_timestep) {
+					return tl::make_unexpected(read_fcd_error::malformed_timestep);
+				}
+				on_timestep(time, points);
+				in_timestep = false;
+			}
+		}
+		// The last timestep of a file SUMO is still writing
+		if (in_timestep) {
+			on_timestep(time, points);
+		}
+		return {};
+	}
+
+	auto read_csv_chunk(const std::string_view chunk, const FcdLayout& layout,
+						const OnTimestep& on_timestep) -> tl::expected<void, read_fcd_error> {
+		auto			 points = std::vector<Point> {};
+		auto			 time = 0.0;
+		std::string_view time_field;
+		for (std::size_t begin = 0; begin < chunk.size();) {
+			const auto [row, next] = csv_row(chunk, begin);
+			begin = next;
+			if (row.empty() || row == "\r") {
+				continue;
+			}
+			const auto field = csv_field(row, layout.separator, layout.time_column);
+			if (field.empty()) {
+				return tl::make_unexpected(read_fcd_error::malformed_timestep);
+			}
+			if (field != time_field) {
+				if (! time_field.empty()) {
+					on_timestep(time, points);
+				}
+				const auto t = parse_number<double>(field);
+				if (! t) {
+					return tl::make_unexpected(read_fcd_error::malformed_timestep);
+				}
+				time = *t;
+				time_field = field;
+				points.clear();
+			}
+			// Rows of persons, or of a timestep without vehicles, have no vehicle position
+			const auto x_field = csv_field(row, layout.separator, layout.x_column);
+			const auto y_field = csv_field(row, layout.separator, layout.y_column);
+			if (x_field.empty() && y_field.empty()) {
+				continue;
+			}
+			const auto x = parse_number<float>(x_field);
+			const auto y = parse_number<float>(y_field);
+			if (! x || ! y) {
+				return tl::make_unexpected(read_fcd_error::malformed_vehicle);
+			}
+			points.push_back(Point {*x, *y});
+		}
+		if (! time_field.empty()) {
+			on_timestep(time, points);
+		}
+		return {};
+	}
+} // namespace
+
+auto detect_fcd_layout(const std::string_view text) -> tl::expected<FcdLayout, read_fcd_error> {
+	auto begin = std::size_t {0};
+	if (text.starts_with("\xEF\xBB\xBF")) {
+		begin = 3;
+	}
+	while (begin < text.size() && is_space(text[begin])) {
+		++begin;
+	}
+	if (begin == text.size()) {
+		return tl::make_unexpected(read_fcd_error::empty_file);
+	}
+	if (text[begin] == '<') {
+		return FcdLayout {.format = FcdFormat::xml};
+	}
+
+	auto layout = FcdLayout {.format = FcdFormat::csv};
+	const auto [header, data_begin] = csv_row(text, begin);
+	layout.data_begin = data_begin;
+	layout.separator = header.find(';') != npos ? ';' : ',';
+	const auto column_of = [&](const std::string_view a, const std::string_view b) {
+		auto column = std::optional<std::uint32_t> {};
+		for (std::uint32_t idx = 0;; ++idx) {
+			const auto name = csv_field(header, layout.separator, idx);
+			if (name.empty()) {
+				return column;
+			}
+			if (name == a || name == b) {
+				column = idx;
+			}
+		}
+	};
+	const auto time = column_of("timestep_time", "time");
+	const auto x = column_of("vehicle_x", "x");
+	const auto y = column_of("vehicle_y", "y");
+	if (! time || ! x || ! y) {
+		return tl::make_unexpected(read_fcd_error::missing_columns);
+	}
+	layout.time_column = *time;
+	layout.x_column = *x;
+	layout.y_column = *y;
+	return layout;
+}
+
+auto split_fcd(const std::string_view text, const FcdLayout& layout, std::size_t chunk_bytes)
+	-> std::vector<std::string_view> {
+	chunk_bytes = std::max<std::size_t>(chunk_bytes, 1);
+	auto chunks = std::vector<std::string_view> {};
+	auto begin = layout.data_begin;
+	while (begin < text.size()) {
+		auto end = begin + chunk_bytes;
+		if (end >= text.size()) {
+			end = text.size();
+		} else if (layout.format == FcdFormat::xml) {
+			end = next_xml_timestep(text, end);
+		} else {
+			end = next_csv_timestep(text, layout, end);
+		}
+		chunks.push_back(text.substr(begin, end - begin));
+		begin = end;
+	}
+	return chunks;
+}
+
+auto read_fcd_chunk(const std::string_view chunk, const FcdLayout& layout,
+					const OnTimestep& on_timestep) -> tl::expected<void, read_fcd_error> {
+	if (layout.format == FcdFormat::xml) {
+		return read_xml_chunk(chunk, on_timestep);
+	}
+	return read_csv_chunk(chunk, layout, on_timestep);
+}
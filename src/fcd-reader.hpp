@@ -0,0 +1,62 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <span>
+#include <string_view>
+#include <vector>
+
+#include <tl/expected.hpp>
+
+#include "streetlamp-grid.hpp"
+
+// Streaming reader for SUMO's floating car data, `sumo --fcd-output`. Only the vehicle positions
+// of every timestep are read, in SUMO's projected (x, y) plane, so the output must not be written
+// with --fcd-output.geo.
+//
+// The file is read as one block of text, e.g. a `MappedFile`, and cut into chunks of whole
+// timesteps with `split_fcd`, which can be read in parallel. Two layouts are supported:
+//
+//   XML: <timestep time="0.00"><vehicle id="a" x="1.00" y="2.00" .../></timestep>
+//   CSV: a header row naming the columns, e.g. "timestep_time;vehicle_id;vehicle_x;vehicle_y",
+//        then one row per vehicle and timestep. Rows of a timestep without vehicles have empty
+//        vehicle columns.
+
+enum class FcdFormat {
+	xml,
+	csv,
+};
+
+struct FcdLayout {
+	FcdFormat	  format = FcdFormat::xml;
+	char		  separator = ';'; // CSV only
+	std::uint32_t time_column = 0;
+	std::uint32_t x_column = 0;
+	std::uint32_t y_column = 0;
+	std::size_t	  data_begin = 0; // Offset of the first row after the CSV header
+};
+
+enum class read_fcd_error {
+	empty_file,
+	missing_columns,
+	malformed_timestep,
+	malformed_vehicle,
+};
+
+[[nodiscard]] auto format_read_fcd_error(read_fcd_error err) -> std::string_view;
+
+// XML if the text starts with a '<', else CSV with the columns named in the header row
+[[nodiscard]] auto detect_fcd_layout(std::string_view text)
+	-> tl::expected<FcdLayout, read_fcd_error>;
+
+// Cuts `text` into chunks of about `chunk_bytes`, each starting at a timestep, so that every
+// timestep is in exactly one chunk. The chunks are in file order.
+[[nodiscard]] auto split_fcd(std::string_view text, const FcdLayout& layout,
+							 std::size_t chunk_bytes) -> std::vector<std::string_view>;
+
+// Calls `on_timestep(time, positions)` for every timestep of `chunk` in order, with the positions
+// of its vehicles. `positions` is only valid during the call.
+auto read_fcd_chunk(std::string_view chunk, const FcdLayout& layout,
+					const std::function<void(double, std::span<const Point>)>& on_timestep)
+	-> tl::expected<void, read_fcd_error>;
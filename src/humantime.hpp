@@ -1,9 +1,10 @@
 #pragma once
 
 #include <chrono>
+#include <string>
 
 // t is in microseconds
-auto humantime(const long t) -> std::string {
+inline auto humantime(const long t) -> std::string {
     using namespace std::chrono;
     const auto h = duration_cast<hours>(microseconds(t));
     const auto m = duration_cast<minutes>(microseconds(t) - h);
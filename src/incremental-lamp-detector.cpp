@@ -0,0 +1,140 @@
+#include "incremental-lamp-detector.hpp"
+
+#include <utility>
+
+IncrementalLampDetector::IncrementalLampDetector(const StreetLampGridView& grid,
+												 const float distance_threshold_squared,
+												 const BuildingOcclusion* occlusion)
+	: grid(grid), distance_threshold_squared(distance_threshold_squared), occlusion(occlusion),
+	  vehicles_near_(grid.lamps.size(), 0),
+	  vehicles_hidden(occlusion != nullptr ? grid.lamps.size() : 0, 0),
+	  lit_(grid.lamps.size(), 0) { }
+
+namespace {
+	// Both lists are sorted, so walking them together finds the lamps a vehicle left and the ones
+	// it approached
+	template <typename Add, typename Remove>
+	auto walk_changes(const std::vector<std::uint32_t>& before,
+					  const std::vector<std::uint32_t>& after, Add&& add, Remove&& remove) -> void {
+		std::size_t i = 0;
+		std::size_t j = 0;
+		while (i < before.size() || j < after.size()) {
+			if (j == after.size() || (i < before.size() && before[i] < after[j])) {
+				remove(before[i++]);
+			} else if (i == before.size() || after[j] < before[i]) {
+				add(after[j++]);
+			} else {
+				i++;
+				j++;
+			}
+		}
+	}
+} // namespace
+
+auto IncrementalLampDetector::update(const VehicleHandle vehicle_id, const Point position)
+	-> void {
+	stats_.updates++;
+	const auto [it, entered] = vehicles.try_emplace(vehicle_id);
+	auto& vehicle = it->second;
+	vehicle.seen_in_step = step;
+	if (! entered && vehicle.position.x == position.x && vehicle.position.y == position.y) {
+		return;
+	}
+	vehicle.position = position;
+	stats_.requeried++;
+
+	scratch.clear();
+	scratch_hidden.clear();
+	this->lamps_near(position, scratch, scratch_hidden);
+
+	walk_changes(
+		vehicle.lamps, scratch, [&](const auto lamp) { this->count_vehicles(lamp, 1, 0); },
+		[&](const auto lamp) { this->count_vehicles(lamp, -1, 0); });
+	walk_changes(
+		vehicle.hidden, scratch_hidden, [&](const auto lamp) { this->count_vehicles(lamp, 0, 1); },
+		[&](const auto lamp) { this->count_vehicles(lamp, 0, -1); });
+	std::swap(vehicle.lamps, scratch);
+	std::swap(vehicle.hidden, scratch_hidden);
+}
+
+auto IncrementalLampDetector::end_step() -> void {
+	departed.clear();
+	for (const auto& [vehicle_id, vehicle] : vehicles) {
+		if (vehicle.seen_in_step != step) {
+			departed.push_back(vehicle_id);
+		}
+	}
+	for (const auto vehicle_id : departed) {
+		const auto it = vehicles.find(vehicle_id);
+		for (const auto lamp : it->second.lamps) {
+			this->count_vehicles(lamp, -1, 0);
+		}
+		for (const auto lamp : it->second.hidden) {
+			this->count_vehicles(lamp, 0, -1);
+		}
+		vehicles.erase(it);
+	}
+	stats_.left += departed.size();
+	step++;
+}
+
+auto IncrementalLampDetector::lamps_near(const Point p, std::vector<std::uint32_t>& visible,
+										 std::vector<std::uint32_t>& hidden) -> void {
+	const auto& spec = grid.spec;
+	// `mark_lit_streetlamps` never sees points outside of the grid, which are too far away from
+	// every lamp anyway because of the padding
+	if (spec.cell_of(p) == spec.num_cells()) {
+		return;
+	}
+	const auto column = spec.column_of(p.x);
+	const auto row = spec.row_of(p.y);
+	// Cells are visited in index order and lamps are sorted by cell, so the lists end up sorted
+	for (auto r = row - 1; r <= row + 1; ++r) {
+		for (auto c = column - 1; c <= column + 1; ++c) {
+			if (! spec.contains(c, r)) {
+				continue;
+			}
+			const auto cell = spec.cell_index(c, r);
+			// Seen from the lamps of this cell, `p` is in the cell at the opposite offset
+			const auto from_lamp = BuildingOcclusion::neighbour(column - c, row - r);
+			for (auto idx = grid.cell_offsets[cell]; idx < grid.cell_offsets[cell + 1]; ++idx) {
+				const auto& lamp = grid.lamps[idx];
+				const auto	dx = p.x - lamp.lon;
+				const auto	dy = p.y - lamp.lat;
+				if (dx * dx + dy * dy > distance_threshold_squared) {
+					continue;
+				}
+				if (occlusion != nullptr && ! occlusion->cell_clear(idx, from_lamp)) {
+					stats_.sight_tests++;
+					if (! occlusion->line_of_sight({lamp.lon, lamp.lat}, p)) {
+						stats_.blocked++;
+						hidden.push_back(idx);
+						continue;
+					}
+				}
+				visible.push_back(idx);
+			}
+		}
+	}
+}
+
+auto IncrementalLampDetector::count_vehicles(const std::uint32_t lamp, const int near,
+											 const int hidden) -> void {
+	const auto num_hidden = [&] { return vehicles_hidden.empty() ? 0u : vehicles_hidden[lamp]; };
+	const bool was_lit = vehicles_near_[lamp] > 0;
+	const bool was_occluded = ! was_lit && num_hidden() > 0;
+	vehicles_near_[lamp] += static_cast<std::uint32_t>(near);
+	if (hidden != 0) {
+		vehicles_hidden[lamp] += static_cast<std::uint32_t>(hidden);
+	}
+	const bool is_lit = vehicles_near_[lamp] > 0;
+	const bool is_occluded = ! is_lit && num_hidden() > 0;
+
+	if (was_lit != is_lit) {
+		lit_[lamp] = is_lit ? 1 : 0;
+		is_lit ? num_lit_++ : num_lit_--;
+	}
+	if (was_occluded != is_occluded) {
+		is_occluded ? num_occluded_++ : num_occluded_--;
+	}
+}
@@ -0,0 +1,82 @@
+#pragma once
+
+#include <cstdint>
+#include <span>
+#include <vector>
+
+#include <parallel_hashmap/phmap.h>
+
+#include "building-occlusion.hpp"
+#include "streetlamp-grid.hpp"
+#include "vehicle-id-table.hpp"
+
+// Keeps the set of lit street lamps up to date from vehicle movement, instead of recomputing it
+// from every lamp each step like `mark_lit_streetlamps`. Every vehicle remembers the lamps within
+// the distance threshold of it, and every lamp counts the vehicles near it. A step only looks at
+// the lamps around vehicles that moved, entered or left, so vehicles waiting at a junction or
+// parked cost nothing. The result is the same as `mark_lit_streetlamps` for the same positions.
+//
+// With a `BuildingOcclusion`, vehicles only count for the lamps they are in sight of. The lamps
+// they are near but hidden from are tracked as well, to count the lamps only buildings keep dark.
+class IncrementalLampDetector {
+  public:
+	struct Stats {
+		std::uint64_t updates = 0;	 // Vehicles given to `update`
+		std::uint64_t requeried = 0; // of which moved or entered, so their lamps were looked up
+		std::uint64_t left = 0;
+		std::uint64_t sight_tests = 0; // Line of sight tests against buildings
+		std::uint64_t blocked = 0;	   // of which had a building in between
+	};
+
+	IncrementalLampDetector(const StreetLampGridView& grid, float distance_threshold_squared,
+							const BuildingOcclusion* occlusion = nullptr);
+
+	// Call for every vehicle in the simulation, once per step
+	auto update(VehicleHandle vehicle_id, Point position) -> void;
+	// Removes the vehicles that were not updated since the previous call, they left
+	auto end_step() -> void;
+
+	// `lit()[idx]` is 1 if the lamp at index idx (in grid order) has vehicles nearby
+	[[nodiscard]] auto lit() const -> std::span<const std::uint8_t> { return lit_; }
+	[[nodiscard]] auto num_lit() const -> std::size_t { return num_lit_; }
+	// `vehicles_near()[idx]` is the number of vehicles near the lamp at index idx and in sight of it
+	[[nodiscard]] auto vehicles_near() const -> std::span<const std::uint32_t> {
+		return vehicles_near_;
+	}
+	// Lamps with vehicles within the threshold, but all of them behind buildings
+	[[nodiscard]] auto num_occluded() const -> std::size_t { return num_occluded_; }
+	[[nodiscard]] auto stats() const -> const Stats& { return stats_; }
+
+  private:
+	struct Vehicle {
+		Point					   position;
+		std::uint64_t			   seen_in_step;
+		std::vector<std::uint32_t> lamps;  // Sorted indices of the lamps near it
+		std::vector<std::uint32_t> hidden; // and of the ones near it, but behind buildings
+	};
+
+	// Appends the sorted indices of the lamps within the threshold of `p` to `visible`, or to
+	// `hidden` if a building is in between
+	auto lamps_near(Point p, std::vector<std::uint32_t>& visible,
+					std::vector<std::uint32_t>& hidden) -> void;
+	// Adds `near` to the vehicles in sight of `lamp` and `hidden` to the ones behind buildings
+	auto count_vehicles(std::uint32_t lamp, int near, int hidden) -> void;
+
+	StreetLampGridView		 grid;
+	float					 distance_threshold_squared;
+	const BuildingOcclusion* occlusion;
+
+	std::vector<std::uint32_t> vehicles_near_;  // Per lamp
+	std::vector<std::uint32_t> vehicles_hidden; // Per lamp, only with `occlusion`
+	std::vector<std::uint8_t>  lit_;
+	std::size_t				   num_lit_ = 0;
+	std::size_t				   num_occluded_ = 0;
+
+	phmap::flat_hash_map<VehicleHandle, Vehicle> vehicles;
+	std::uint64_t								 step = 1;
+	std::vector<std::uint32_t>					 scratch;
+	std::vector<std::uint32_t>					 scratch_hidden;
+	std::vector<VehicleHandle>					 departed;
+
+	Stats stats_;
+};
@@ -0,0 +1,144 @@
+#pragma once
+
+#include <array>
+#include <charconv>
+#include <cmath>
+#include <cstdint>
+#include <iterator>
+#include <span>
+#include <string_view>
+
+// Minimal JSON encoder appending to a byte container, with the same interface as `CborWriter`.
+// Maps and arrays are opened with the number of entries they will hold, like in CBOR, and are
+// closed by the writer after their last entry, so callers never write separators or brackets.
+// Floats are written in their shortest round trip form; NaN and infinities, which JSON has no
+// numbers for, are written as null like nlohmann does. Byte strings are written as base64 text.
+template <typename Buffer>
+class JsonWriter {
+  public:
+	explicit JsonWriter(Buffer& out) : out(out) { }
+
+	auto map(const std::uint64_t num_pairs) -> void { this->open('{', '}', 2 * num_pairs); }
+	auto array(const std::uint64_t num_items) -> void { this->open('[', ']', num_items); }
+
+	auto record(const std::uint64_t num_fields) -> void { this->map(num_fields); }
+	auto field_name(const std::string_view name) -> void { this->text(name); }
+
+	auto integer_key(const std::uint32_t key) -> void {
+		char	   text[16];
+		const auto end = std::to_chars(std::begin(text), std::end(text), key).ptr;
+		this->text({text, end});
+	}
+
+	auto text(const std::string_view s) -> void {
+		static constexpr auto hex = std::string_view("0123456789abcdef");
+		this->before_value();
+		this->out.push_back('"');
+		for (const auto c : s) {
+			const auto byte = static_cast<std::uint8_t>(c);
+			if (c == '"' || c == '\\') {
+				this->out.push_back('\\');
+				this->out.push_back(static_cast<std::uint8_t>(c));
+			} else if (byte < 0x20) {
+				for (const auto e : {'\\', 'u', '0', '0', hex[byte >> 4], hex[byte & 0xF]}) {
+					this->out.push_back(static_cast<std::uint8_t>(e));
+				}
+			} else {
+				this->out.push_back(byte);
+			}
+		}
+		this->out.push_back('"');
+		this->after_value();
+	}
+
+	auto bytes(const std::span<const std::uint8_t> b) -> void {
+		static constexpr auto alphabet =
+			std::string_view("ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/");
+		this->before_value();
+		this->out.push_back('"');
+		for (std::size_t idx = 0; idx < b.size(); idx += 3) {
+			const auto left = b.size() - idx;
+			const auto triple = static_cast<std::uint32_t>(b[idx]) << 16 |
+								(left > 1 ? static_cast<std::uint32_t>(b[idx + 1]) << 8 : 0) |
+								(left > 2 ? static_cast<std::uint32_t>(b[idx + 2]) : 0);
+			for (std::size_t sextet = 0; sextet < 4; ++sextet) {
+				const auto c = sextet <= left ? alphabet[(triple >> (18 - 6 * sextet)) & 0x3F] : '=';
+				this->out.push_back(static_cast<std::uint8_t>(c));
+			}
+		}
+		this->out.push_back('"');
+		this->after_value();
+	}
+
+	auto integer(const std::int64_t i) -> void {
+		char	   text[24];
+		const auto end = std::to_chars(std::begin(text), std::end(text), i).ptr;
+		this->raw({text, end});
+	}
+
+	auto boolean(const bool b) -> void { this->raw(b ? "true" : "false"); }
+
+	auto floating(const double d) -> void {
+		if (! std::isfinite(d)) {
+			this->raw("null");
+			return;
+		}
+		char	   text[32];
+		const auto end = std::to_chars(std::begin(text), std::end(text), d).ptr;
+		this->raw({text, end});
+	}
+
+  private:
+	struct Container {
+		std::uint8_t  close;
+		std::uint64_t num_values; // Keys and values for maps
+		std::uint64_t written;
+		bool		  is_map;
+	};
+
+	auto raw(const std::string_view token) -> void {
+		this->before_value();
+		this->out.insert(this->out.end(), token.begin(), token.end());
+		this->after_value();
+	}
+
+	auto open(const char open, const char close, const std::uint64_t num_values) -> void {
+		this->before_value();
+		this->out.push_back(static_cast<std::uint8_t>(open));
+		if (num_values == 0) {
+			this->out.push_back(static_cast<std::uint8_t>(close));
+			this->after_value();
+			return;
+		}
+		this->open_containers[this->depth++] = {static_cast<std::uint8_t>(close), num_values, 0,
+												close == '}'};
+	}
+
+	auto before_value() -> void {
+		if (this->depth == 0) {
+			return;
+		}
+		const auto& container = this->open_containers[this->depth - 1];
+		if (container.written == 0) {
+			return;
+		}
+		const auto is_value = container.is_map && container.written % 2 == 1;
+		this->out.push_back(is_value ? ':' : ',');
+	}
+
+	// Counts the value just written, closing every container it completes
+	auto after_value() -> void {
+		while (this->depth > 0) {
+			auto& container = this->open_containers[this->depth - 1];
+			if (++container.written < container.num_values) {
+				return;
+			}
+			this->out.push_back(container.close);
+			--this->depth;
+		}
+	}
+
+	Buffer&					  out;
+	std::array<Container, 16> open_containers {};
+	std::size_t				  depth = 0;
+};
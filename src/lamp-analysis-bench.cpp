@@ -0,0 +1,210 @@
+// Compares checking every street lamp for nearby cars with BS::thread_pool's equal blocks of
+// lamps against the work stealing pool, on a synthetic city where lamps and cars are dense in the
+// centre and sparse in the outskirts. Lamps in the centre have many more cars in the 3x3 cells
+// around them, so equal blocks of lamps are far from equal amounts of work.
+//
+// With --buildings, the work stealing pass is repeated with that many random buildings keeping
+// lamps behind them dark, to measure what the line of sight tests add to a step.
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <iostream>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <BS_thread_pool.hpp>
+#include <argparse/argparse.hpp>
+#include <fmt/core.h>
+#include <spdlog/spdlog.h>
+
+#include "building-occlusion.hpp"
+#include "streetlamp-grid.hpp"
+#include "work-stealing-pool.hpp"
+
+namespace {
+	using clock = std::chrono::steady_clock;
+
+	constexpr float distance_threshold = 50.0f;
+	constexpr float city_size = 20'000.0f;
+
+	struct StepTimes {
+		std::string				   scheduler;
+		std::vector<std::uint32_t> step_us {};
+	};
+
+	// A point near the centre with probability `dense`, else anywhere in the city
+	auto city_point(std::mt19937& rng, const double dense) -> Point {
+		auto centre = std::normal_distribution<float>(city_size / 2, city_size / 20);
+		auto anywhere = std::uniform_real_distribution<float>(0.0f, city_size);
+		if (std::bernoulli_distribution(dense)(rng)) {
+			const auto x = std::clamp(centre(rng), 0.0f, city_size);
+			return {x, std::clamp(centre(rng), 0.0f, city_size)};
+		}
+		return {anywhere(rng), anywhere(rng)};
+	}
+
+	auto report(const StepTimes& times) -> void {
+		auto sorted = times.step_us;
+		std::sort(sorted.begin(), sorted.end());
+		double sum = 0.0;
+		for (const auto us : sorted) {
+			sum += us;
+		}
+		fmt::println("{:>14}: mean {:>7.0f} us, p50 {:>6} us, p99 {:>6} us, max {:>6} us",
+					 times.scheduler, sum / sorted.size(), sorted[sorted.size() / 2],
+					 sorted[sorted.size() * 99 / 100], sorted.back());
+	}
+} // namespace
+
+auto main(int argc, char** argv) -> int {
+	auto argv_parser = argparse::ArgumentParser("lamp-analysis-bench", "0.1.0");
+	argv_parser.add_argument("--threads")
+		.help("Threads of both pools, 0 uses all but one hardware thread")
+		.default_value(0)
+		.scan<'i', int>();
+	argv_parser.add_argument("--lamps").default_value(100'000).scan<'i', int>();
+	argv_parser.add_argument("--cars").default_value(20'000).scan<'i', int>();
+	argv_parser.add_argument("--steps").default_value(200).scan<'i', int>();
+	argv_parser.add_argument("--lamps-per-task").default_value(256).scan<'i', int>();
+	argv_parser.add_argument("--buildings")
+		.help("Random buildings for a pass with occlusion, 0 skips it")
+		.default_value(0)
+		.scan<'i', int>();
+
+	try {
+		argv_parser.parse_args(argc, argv);
+	} catch (const std::exception& err) {
+		spdlog::error("{}", err.what());
+		std::cerr << argv_parser;
+		return 2;
+	}
+
+	const auto requested_threads = argv_parser.get<int>("--threads");
+	const auto num_threads =
+		requested_threads > 0 ? static_cast<unsigned>(requested_threads)
+							  : std::max(std::thread::hardware_concurrency(), 2u) - 1;
+	const auto num_steps = std::max(1, argv_parser.get<int>("--steps"));
+	const auto lamps_per_task =
+		static_cast<std::size_t>(std::max(1, argv_parser.get<int>("--lamps-per-task")));
+
+	auto rng = std::mt19937(7);
+	auto lamps = std::vector<StreetLamp> {};
+	for (int idx = 0; idx < argv_parser.get<int>("--lamps"); ++idx) {
+		const auto p = city_point(rng, 0.5);
+		lamps.push_back(StreetLamp {.id = idx, .lat = p.y, .lon = p.x});
+	}
+	const auto grid_storage = build_streetlamp_grid(std::move(lamps), distance_threshold);
+	const auto grid = grid_storage.view();
+
+	auto cars = std::vector<Point> {};
+	for (int idx = 0; idx < argv_parser.get<int>("--cars"); ++idx) {
+		cars.push_back(city_point(rng, 0.9));
+	}
+	auto buckets = CellBuckets {};
+	buckets.rebuild(grid.spec, cars);
+
+	fmt::println("{} lamps, {} cars, {} threads, {} steps", grid.lamps.size(), cars.size(),
+				 num_threads, num_steps);
+
+	const auto threshold_squared = distance_threshold * distance_threshold;
+	auto	   static_lit = std::vector<std::uint8_t>(grid.lamps.size(), 0);
+	auto	   stealing_lit = std::vector<std::uint8_t>(grid.lamps.size(), 0);
+
+	auto static_times = StepTimes {.scheduler = "static blocks"};
+	{
+		auto pool = BS::thread_pool(num_threads);
+		for (int step = 0; step < num_steps; ++step) {
+			const auto start = clock::now();
+			pool.parallelize_loop(0, grid.lamps.size(), [&](const auto begin, const auto end) {
+					mark_lit_streetlamps(grid, buckets, cars, threshold_squared, begin, end,
+										 static_lit);
+				})
+				.wait();
+			static_times.step_us.push_back(static_cast<std::uint32_t>(
+				std::chrono::duration_cast<std::chrono::microseconds>(clock::now() - start)
+					.count()));
+		}
+	}
+
+	auto stealing_times = StepTimes {.scheduler = "work stealing"};
+	auto pool = WorkStealingPool(num_threads);
+	const auto num_tasks =
+		static_cast<std::uint32_t>((grid.lamps.size() + lamps_per_task - 1) / lamps_per_task);
+	const auto task = std::function<void(std::uint32_t)>([&](const std::uint32_t idx) {
+		const auto begin = idx * lamps_per_task;
+		const auto end = std::min(begin + lamps_per_task, grid.lamps.size());
+		mark_lit_streetlamps(grid, buckets, cars, threshold_squared, begin, end, stealing_lit);
+	});
+	for (int step = 0; step < num_steps; ++step) {
+		const auto start = clock::now();
+		pool.run(num_tasks, task);
+		stealing_times.step_us.push_back(static_cast<std::uint32_t>(
+			std::chrono::duration_cast<std::chrono::microseconds>(clock::now() - start).count()));
+	}
+
+	if (static_lit != stealing_lit) {
+		spdlog::error("The pools found different lit lamps");
+		return 1;
+	}
+
+	report(static_times);
+	report(stealing_times);
+
+	if (const auto num_buildings = argv_parser.get<int>("--buildings"); num_buildings > 0) {
+		auto footprints = BuildingFootprints {};
+		auto size = std::uniform_real_distribution<float>(8.0f, 30.0f);
+		for (int idx = 0; idx < num_buildings; ++idx) {
+			const auto corner = city_point(rng, 0.7);
+			const auto width = size(rng);
+			const auto depth = size(rng);
+			const auto outline = std::vector<Point> {{corner.x, corner.y},
+													 {corner.x + width, corner.y},
+													 {corner.x + width, corner.y + depth},
+													 {corner.x, corner.y + depth}};
+			footprints.add(outline);
+		}
+		const auto build_start = clock::now();
+		const auto occlusion = BuildingOcclusion(std::move(footprints), grid, distance_threshold);
+		const auto build_ms =
+			std::chrono::duration<double, std::milli>(clock::now() - build_start).count();
+
+		auto occluded_times = StepTimes {.scheduler = "with buildings"};
+		const auto occluded_task = std::function<void(std::uint32_t)>([&](const std::uint32_t idx) {
+			const auto begin = idx * lamps_per_task;
+			const auto end = std::min(begin + lamps_per_task, grid.lamps.size());
+			mark_lit_streetlamps(grid, buckets, cars, threshold_squared, begin, end, stealing_lit,
+								 &occlusion);
+		});
+		for (int step = 0; step < num_steps; ++step) {
+			const auto start = clock::now();
+			pool.run(num_tasks, occluded_task);
+			occluded_times.step_us.push_back(static_cast<std::uint32_t>(
+				std::chrono::duration_cast<std::chrono::microseconds>(clock::now() - start)
+					.count()));
+		}
+		report(occluded_times);
+
+		const auto stats = occlusion.stats();
+		const auto near = stats.lit_lamps + stats.occluded_lamps;
+		fmt::println("  {} buildings in {:.0f} ms, {:.1f}% of the lamp cells clear", num_buildings,
+					 build_ms, 100.0 * occlusion.clear_share());
+		fmt::println("  {} line of sight tests per step, {:.1f}% blocked",
+					 stats.sight_tests / num_steps,
+					 stats.sight_tests == 0 ? 0.0 : 100.0 * stats.blocked / stats.sight_tests);
+		fmt::println("  {} lamps lit instead of {} ({:.1f}% fewer)", stats.lit_lamps / num_steps,
+					 near / num_steps, near == 0 ? 0.0 : 100.0 * stats.occluded_lamps / near);
+	}
+
+	const auto stats = pool.stats();
+	const auto seconds = std::chrono::duration<double>(pool.time_in_run()).count();
+	for (std::size_t worker = 0; worker < stats.size(); ++worker) {
+		fmt::println("  thread {:>2}: {:>5.1f}% busy, {:>6} tasks, {:>4} steals", worker,
+					 100.0 * std::chrono::duration<double>(stats[worker].busy).count() / seconds,
+					 stats[worker].tasks, stats[worker].steals);
+	}
+	return 0;
+}
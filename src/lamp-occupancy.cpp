@@ -0,0 +1,291 @@
+#include "lamp-occupancy.hpp"
+
+#include <algorithm>
+#include <cmath>
+
+#include <spdlog/spdlog.h>
+#include <sqlite3.h>
+
+auto OccupancyBucket::reset(const double start, const double width, const std::size_t num_lamps)
+	-> void {
+	this->start = start;
+	this->width = width;
+	vehicle_seconds.assign(num_lamps, 0.0f);
+	lit_seconds.assign(num_lamps, 0.0f);
+	max_vehicles.assign(num_lamps, 0);
+	activations.assign(num_lamps, 0);
+}
+
+auto OccupancyBucket::add(const OccupancyBucket& finer) -> void {
+	for (std::size_t lamp = 0; lamp < vehicle_seconds.size(); ++lamp) {
+		vehicle_seconds[lamp] += finer.vehicle_seconds[lamp];
+		lit_seconds[lamp] += finer.lit_seconds[lamp];
+		max_vehicles[lamp] = std::max(max_vehicles[lamp], finer.max_vehicles[lamp]);
+		activations[lamp] += finer.activations[lamp];
+	}
+}
+
+auto format_occupancy_archive_error(const occupancy_archive_error err) -> std::string_view {
+	switch (err) {
+		case occupancy_archive_error::open_failed:
+			return "failed to open the database";
+		case occupancy_archive_error::write_failed:
+			return "failed to write the database";
+	}
+	return "unknown error";
+}
+
+auto SqliteClose::operator()(sqlite3* db) const -> void {
+	sqlite3_close(db);
+}
+auto SqliteClose::operator()(sqlite3_stmt* statement) const -> void {
+	sqlite3_finalize(statement);
+}
+
+namespace {
+	auto exec(sqlite3* db, const char* sql) -> tl::expected<void, occupancy_archive_error> {
+		if (sqlite3_exec(db, sql, nullptr, nullptr, nullptr) != SQLITE_OK) {
+			return tl::make_unexpected(occupancy_archive_error::write_failed);
+		}
+		return {};
+	}
+
+	auto prepare(sqlite3* db, const char* sql) -> std::unique_ptr<sqlite3_stmt, SqliteClose> {
+		sqlite3_stmt* statement = nullptr;
+		sqlite3_prepare_v2(db, sql, -1, &statement, nullptr);
+		return std::unique_ptr<sqlite3_stmt, SqliteClose>(statement);
+	}
+
+	// Steps a statement with its parameters bound, and resets it for the next row
+	auto insert(sqlite3_stmt* statement) -> bool {
+		const auto status = sqlite3_step(statement);
+		sqlite3_reset(statement);
+		return status == SQLITE_DONE;
+	}
+} // namespace
+
+auto OccupancyDatabase::open(const std::filesystem::path&		path,
+							 const std::span<const std::int64_t> lamp_osm_ids)
+	-> tl::expected<OccupancyDatabase, occupancy_archive_error> {
+	sqlite3*   handle = nullptr;
+	const auto opened = sqlite3_open(path.c_str(), &handle);
+	auto	   database = OccupancyDatabase {};
+	database.db.reset(handle);
+	if (opened != SQLITE_OK) {
+		return tl::make_unexpected(occupancy_archive_error::open_failed);
+	}
+
+	// With WAL a commit appends to the log instead of rewriting pages, and readers do not block
+	// the flusher. Losing the last transactions in a power cut is fine, they are only statistics.
+	const auto created =
+		exec(database.db.get(),
+			 "PRAGMA journal_mode = WAL;"
+			 "PRAGMA synchronous = NORMAL;"
+			 "BEGIN;"
+			 "CREATE TABLE IF NOT EXISTS lamps (lamp INTEGER PRIMARY KEY,"
+			 " osm_id INTEGER NOT NULL);"
+			 "CREATE TABLE IF NOT EXISTS occupancy (resolution REAL NOT NULL, start REAL NOT NULL,"
+			 " lamp INTEGER NOT NULL, vehicle_seconds REAL NOT NULL, lit_seconds REAL NOT NULL,"
+			 " max_vehicles INTEGER NOT NULL, activations INTEGER NOT NULL,"
+			 " PRIMARY KEY (resolution, start, lamp)) WITHOUT ROWID;");
+	if (! created) {
+		return tl::make_unexpected(occupancy_archive_error::open_failed);
+	}
+
+	const auto insert_lamp =
+		prepare(database.db.get(), "INSERT OR REPLACE INTO lamps VALUES (?, ?)");
+	database.insert_occupancy = prepare(database.db.get(),
+							  "INSERT OR REPLACE INTO occupancy VALUES (?, ?, ?, ?, ?, ?, ?)");
+	if (! insert_lamp || ! database.insert_occupancy) {
+		return tl::make_unexpected(occupancy_archive_error::open_failed);
+	}
+	for (std::size_t lamp = 0; lamp < lamp_osm_ids.size(); ++lamp) {
+		sqlite3_bind_int64(insert_lamp.get(), 1, static_cast<sqlite3_int64>(lamp));
+		sqlite3_bind_int64(insert_lamp.get(), 2, lamp_osm_ids[lamp]);
+		if (! insert(insert_lamp.get())) {
+			return tl::make_unexpected(occupancy_archive_error::write_failed);
+		}
+	}
+	if (! exec(database.db.get(), "COMMIT;")) {
+		return tl::make_unexpected(occupancy_archive_error::write_failed);
+	}
+	return database;
+}
+
+auto OccupancyDatabase::begin() -> tl::expected<void, occupancy_archive_error> {
+	return exec(db.get(), "BEGIN;");
+}
+
+auto OccupancyDatabase::commit() -> tl::expected<void, occupancy_archive_error> {
+	return exec(db.get(), "COMMIT;");
+}
+
+auto OccupancyDatabase::write(const OccupancyBucket& bucket)
+	-> tl::expected<void, occupancy_archive_error> {
+	for (std::size_t lamp = 0; lamp < bucket.lit_seconds.size(); ++lamp) {
+		if (bucket.lit_seconds[lamp] == 0.0f) {
+			continue;
+		}
+		sqlite3_bind_double(insert_occupancy.get(), 1, bucket.width);
+		sqlite3_bind_double(insert_occupancy.get(), 2, bucket.start);
+		sqlite3_bind_int64(insert_occupancy.get(), 3, static_cast<sqlite3_int64>(lamp));
+		sqlite3_bind_double(insert_occupancy.get(), 4, bucket.vehicle_seconds[lamp]);
+		sqlite3_bind_double(insert_occupancy.get(), 5, bucket.lit_seconds[lamp]);
+		sqlite3_bind_int64(insert_occupancy.get(), 6, bucket.max_vehicles[lamp]);
+		sqlite3_bind_int64(insert_occupancy.get(), 7, bucket.activations[lamp]);
+		if (! insert(insert_occupancy.get())) {
+			return tl::make_unexpected(occupancy_archive_error::write_failed);
+		}
+		rows_++;
+	}
+	return {};
+}
+
+OccupancyArchive::OccupancyArchive(OccupancyDatabase database, const std::size_t num_lamps,
+								   std::vector<double> resolutions, const std::size_t num_buffers)
+	: resolutions(std::move(resolutions)), num_lamps(num_lamps), lit(num_lamps, 0),
+	  database(std::move(database)) {
+	// Every buffer is allocated up front, handing a bucket over only moves vectors around
+	current.reset(-1.0, this->resolutions.front(), num_lamps);
+	pending.reserve(num_buffers);
+	batch.reserve(num_buffers);
+	free.resize(num_buffers);
+	for (auto& bucket : free) {
+		bucket.reset(0.0, this->resolutions.front(), num_lamps);
+	}
+	thread = std::thread([this] { this->run(); });
+}
+
+OccupancyArchive::~OccupancyArchive() {
+	this->close();
+}
+
+auto OccupancyArchive::record(const double time, const double seconds,
+							  const std::span<const std::uint32_t> vehicles_near) -> void {
+	const auto width = resolutions.front();
+	const auto end = time + seconds;
+	// An interval longer than a step, e.g. steps the cadence skipped, can cross the end of a
+	// bucket. It is split there, and every bucket it overlaps gets its share of the seconds.
+	auto from = time;
+	auto first = true;
+	do {
+		// The epsilon keeps e.g. 10 * 0.1 in the bucket starting at 1
+		const auto start = std::floor(from / width + 1e-9) * width;
+		if (start != current.start) {
+			if (current.start >= 0.0) {
+				this->submit();
+			}
+			current.reset(start, width, num_lamps);
+		}
+		const auto until = std::min(end, start + width);
+		const auto share = static_cast<float>(until - from);
+		for (std::size_t lamp = 0; lamp < vehicles_near.size(); ++lamp) {
+			const auto vehicles = vehicles_near[lamp];
+			const auto is_lit = vehicles > 0;
+			current.vehicle_seconds[lamp] += static_cast<float>(vehicles) * share;
+			current.lit_seconds[lamp] += is_lit ? share : 0.0f;
+			current.max_vehicles[lamp] = std::max(current.max_vehicles[lamp], vehicles);
+			// A lamp turns on once, at the start of the interval
+			current.activations[lamp] += first && is_lit && ! lit[lamp] ? 1 : 0;
+		}
+		first = false;
+		from = until;
+	} while (end - from > 1e-9 * width);
+
+	for (std::size_t lamp = 0; lamp < vehicles_near.size(); ++lamp) {
+		lit[lamp] = static_cast<std::uint8_t>(vehicles_near[lamp] > 0);
+	}
+}
+
+auto OccupancyArchive::submit() -> void {
+	{
+		const auto lock = std::lock_guard(mutex);
+		if (free.empty()) {
+			// The bucket is overwritten by the next one
+			dropped_++;
+			return;
+		}
+		pending.push_back(std::move(current));
+		current = std::move(free.back());
+		free.pop_back();
+	}
+	pending_or_closed.notify_one();
+}
+
+auto OccupancyArchive::close() -> void {
+	if (! thread.joinable()) {
+		return;
+	}
+	if (current.start >= 0.0) {
+		this->submit();
+		current.start = -1.0;
+	}
+	{
+		const auto lock = std::lock_guard(mutex);
+		closed = true;
+	}
+	pending_or_closed.notify_one();
+	thread.join();
+}
+
+auto OccupancyArchive::run() -> void {
+	// One bucket per coarser resolution, each filled from the finest buckets
+	auto rollups = std::vector<OccupancyBucket>(resolutions.size() - 1);
+	for (std::size_t level = 0; level < rollups.size(); ++level) {
+		rollups[level].reset(-1.0, resolutions[level + 1], num_lamps);
+	}
+	// Of the current transaction
+	auto written = tl::expected<void, occupancy_archive_error> {};
+	const auto write = [&](const OccupancyBucket& bucket) {
+		if (written) {
+			written = database.write(bucket);
+		}
+	};
+
+	auto done = false;
+	while (! done) {
+		{
+			auto lock = std::unique_lock(mutex);
+			pending_or_closed.wait(lock, [&] { return ! pending.empty() || closed; });
+			std::swap(batch, pending);
+			done = closed;
+		}
+
+		// Everything that piled up while the previous batch was written goes in one transaction
+		written = database.begin();
+		for (const auto& bucket : batch) {
+			write(bucket);
+			for (auto& rollup : rollups) {
+				const auto start = std::floor(bucket.start / rollup.width + 1e-9) * rollup.width;
+				if (start != rollup.start) {
+					if (rollup.start >= 0.0) {
+						write(rollup);
+					}
+					rollup.reset(start, rollup.width, num_lamps);
+				}
+				rollup.add(bucket);
+			}
+		}
+		if (done) {
+			for (const auto& rollup : rollups) {
+				if (rollup.start >= 0.0) {
+					write(rollup);
+				}
+			}
+		}
+		if (written) {
+			written = database.commit();
+		}
+		if (! written) {
+			spdlog::error("Failed to archive lamp occupancy: {}",
+						  format_occupancy_archive_error(written.error()));
+			(void)database.commit();
+		}
+
+		const auto lock = std::lock_guard(mutex);
+		for (auto& bucket : batch) {
+			free.push_back(std::move(bucket));
+		}
+		batch.clear();
+	}
+}
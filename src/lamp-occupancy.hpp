@@ -0,0 +1,130 @@
+#pragma once
+
+#include <condition_variable>
+#include <cstdint>
+#include <filesystem>
+#include <memory>
+#include <mutex>
+#include <span>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+#include <tl/expected.hpp>
+
+struct sqlite3;
+struct sqlite3_stmt;
+
+// How busy every street lamp was over a run, kept in time buckets of simulated seconds instead of
+// step by step. The simulation thread adds every analysed step to the counters of the finest
+// bucket, dense arrays indexed by lamp in grid order. Full buckets are handed to a flusher thread
+// that rolls them up into the coarser resolutions and writes them to SQLite.
+
+// The counters of every lamp in `[start, start + width)`
+struct OccupancyBucket {
+	double					   start = 0.0;
+	double					   width = 0.0;
+	std::vector<float>		   vehicle_seconds; // Vehicles near the lamp times how long they were
+	std::vector<float>		   lit_seconds;		// How long at least one vehicle was near it
+	std::vector<std::uint32_t> max_vehicles;	// Most vehicles near it at once
+	std::vector<std::uint32_t> activations;		// Times it went from dark to lit
+
+	// Zeroes the counters of `num_lamps` lamps, keeping the capacity of the arrays
+	auto reset(double start, double width, std::size_t num_lamps) -> void;
+	// Adds a bucket of a finer resolution that lies within this one
+	auto add(const OccupancyBucket& finer) -> void;
+};
+
+enum class occupancy_archive_error {
+	open_failed,
+	write_failed,
+};
+
+[[nodiscard]] auto format_occupancy_archive_error(occupancy_archive_error err) -> std::string_view;
+
+struct SqliteClose {
+	auto operator()(sqlite3* db) const -> void;
+	auto operator()(sqlite3_stmt* statement) const -> void;
+};
+
+// An SQLite database of lamp occupancy, in WAL mode so readers can query it while it is written:
+//
+//   lamps     (lamp INTEGER PRIMARY KEY, osm_id INTEGER)  -- lamp is the grid order
+//   occupancy (resolution REAL, start REAL, lamp INTEGER, vehicle_seconds REAL,
+//              lit_seconds REAL, max_vehicles INTEGER, activations INTEGER)
+//
+// `occupancy` has a row for every bucket and lamp that had vehicles near it, keyed by
+// (resolution, start, lamp). Buckets written again, e.g. after resuming from a checkpoint,
+// replace the old rows.
+class OccupancyDatabase {
+  public:
+	// Opens the database at `path`, or creates it, and records the OSM ids of the lamps
+	[[nodiscard]] static auto open(const std::filesystem::path& path,
+								   std::span<const std::int64_t> lamp_osm_ids)
+		-> tl::expected<OccupancyDatabase, occupancy_archive_error>;
+
+	// Rows written between `begin` and `commit` are one transaction
+	[[nodiscard]] auto begin() -> tl::expected<void, occupancy_archive_error>;
+	[[nodiscard]] auto write(const OccupancyBucket& bucket)
+		-> tl::expected<void, occupancy_archive_error>;
+	[[nodiscard]] auto commit() -> tl::expected<void, occupancy_archive_error>;
+
+	[[nodiscard]] auto rows() const -> std::uint64_t { return rows_; }
+
+  private:
+	std::unique_ptr<sqlite3, SqliteClose>	   db;
+	std::unique_ptr<sqlite3_stmt, SqliteClose> insert_occupancy;
+	std::uint64_t							   rows_ = 0;
+};
+
+// Collects the occupancy of the lamps on the simulation thread and archives it on a flusher thread
+// of its own. `record` never waits for the database: full buckets go through a fixed pool of
+// buffers, and if the flusher has fallen so far behind that none is free the bucket is dropped.
+class OccupancyArchive {
+  public:
+	// `resolutions` in simulated seconds, ascending, each a multiple of the one before. Buckets
+	// of the first are collected, the others are rolled up from them. Up to `num_buffers` full
+	// buckets can wait for the flusher.
+	OccupancyArchive(OccupancyDatabase database, std::size_t num_lamps,
+					 std::vector<double> resolutions, std::size_t num_buffers = 32);
+	~OccupancyArchive();
+
+	OccupancyArchive(const OccupancyArchive&) = delete;
+	auto operator=(const OccupancyArchive&) -> OccupancyArchive& = delete;
+
+	// Adds the `seconds` of simulated time from `time` on, during which `vehicles_near[lamp]`
+	// vehicles were near each lamp, to the buckets they overlap
+	auto record(double time, double seconds, std::span<const std::uint32_t> vehicles_near)
+		-> void;
+
+	// Archives the buckets collected so far, including the unfinished ones, and stops the flusher
+	auto close() -> void;
+
+	// Buckets dropped because the flusher was behind, and rows written. Only valid after `close`.
+	[[nodiscard]] auto dropped() const -> std::uint64_t { return dropped_; }
+	[[nodiscard]] auto rows() const -> std::uint64_t { return database.rows(); }
+
+  private:
+	auto submit() -> void;
+	auto run() -> void;
+
+	std::vector<double> resolutions;
+	std::size_t			num_lamps;
+
+	// Only touched by the simulation thread
+	OccupancyBucket			  current;
+	std::vector<std::uint8_t> lit; // Whether each lamp was lit at the previous `record`
+	std::uint64_t			  dropped_ = 0;
+
+	// Only touched by the flusher. Swapped with `pending`, so both keep their capacity.
+	OccupancyDatabase			 database;
+	std::vector<OccupancyBucket> batch;
+
+	std::mutex					 mutex;
+	std::condition_variable		 pending_or_closed;
+	std::vector<OccupancyBucket> pending;
+	std::vector<OccupancyBucket> free;
+	bool						 closed = false;
+
+	std::thread thread;
+};
@@ -0,0 +1,205 @@
+#include "lamp-timeline.hpp"
+
+#include <memory>
+#include <system_error>
+#include <type_traits>
+#include <utility>
+
+#include <sqlite3.h>
+
+auto detect_timeline_chunk(const StreetLampGridView& grid, const std::string_view chunk,
+						   const FcdLayout& layout, const float distance_threshold_squared,
+						   const BuildingOcclusion* occlusion)
+	-> tl::expected<TimelineChunk, read_fcd_error> {
+	const auto num_lamps = grid.lamps.size();
+	auto	   result = TimelineChunk {};
+	auto	   buckets = CellBuckets {};
+	auto	   lit = std::vector<std::uint8_t>(num_lamps, 0);
+	auto	   previous_lit = std::vector<std::uint8_t>(num_lamps, 0);
+	auto	   previous_time = 0.0;
+
+	const auto read = read_fcd_chunk(chunk, layout, [&](const double time, const auto points) {
+		buckets.rebuild(grid.spec, points);
+		mark_lit_streetlamps(grid, buckets, points, distance_threshold_squared, 0, num_lamps, lit,
+							 occlusion);
+		if (result.steps == 0) {
+			result.first_time = time;
+			result.first_lit = lit;
+		} else {
+			for (std::uint32_t lamp = 0; lamp < num_lamps; ++lamp) {
+				if (lit[lamp] != previous_lit[lamp]) {
+					result.transitions.push_back(
+						{.time = time, .lamp = lamp, .lit = lit[lamp] != 0});
+				}
+			}
+			result.step_length = time - previous_time;
+		}
+		previous_time = time;
+		std::swap(lit, previous_lit);
+		result.steps++;
+	});
+	if (! read) {
+		return tl::make_unexpected(read.error());
+	}
+	result.last_time = previous_time;
+	result.last_lit = std::move(previous_lit);
+	return result;
+}
+
+auto merge_timeline_chunks(const std::span<const TimelineChunk> chunks,
+						   const std::size_t num_lamps) -> LampTimeline {
+	auto timeline = LampTimeline {};
+	auto lit = std::vector<std::uint8_t>(num_lamps, 0);
+	auto on_at = std::vector<double>(num_lamps, 0.0);
+	auto step_length = 0.0;
+
+	const auto set = [&](const std::uint32_t lamp, const double time, const bool is_lit) {
+		if (is_lit) {
+			on_at[lamp] = time;
+		} else {
+			timeline.intervals.push_back({.lamp = lamp, .on_at = on_at[lamp], .off_at = time});
+		}
+		lit[lamp] = is_lit ? 1 : 0;
+	};
+
+	for (const auto& chunk : chunks) {
+		if (chunk.steps == 0) {
+			continue;
+		}
+		if (timeline.steps == 0) {
+			timeline.begin = chunk.first_time;
+		} else {
+			step_length = chunk.first_time - timeline.end;
+		}
+		if (chunk.step_length > 0.0) {
+			step_length = chunk.step_length;
+		}
+		// The lamps that changed between the last timestep of the chunk before and this one
+		for (std::uint32_t lamp = 0; lamp < num_lamps; ++lamp) {
+			if (chunk.first_lit[lamp] != lit[lamp]) {
+				set(lamp, chunk.first_time, chunk.first_lit[lamp] != 0);
+			}
+		}
+		for (const auto& transition : chunk.transitions) {
+			set(transition.lamp, transition.time, transition.lit);
+		}
+		timeline.steps += chunk.steps;
+		timeline.end = chunk.last_time;
+	}
+
+	timeline.end += step_length;
+	for (std::uint32_t lamp = 0; lamp < num_lamps; ++lamp) {
+		if (lit[lamp] != 0) {
+			set(lamp, timeline.end, false);
+		}
+	}
+	return timeline;
+}
+
+auto format_write_lamp_timeline_error(const write_lamp_timeline_error err) -> std::string_view {
+	switch (err) {
+		case write_lamp_timeline_error::open_failed:
+			return "failed to create the database";
+		case write_lamp_timeline_error::write_failed:
+			return "failed to write the database";
+	}
+	return "unknown error";
+}
+
+namespace {
+	using Database = std::unique_ptr<sqlite3, decltype(&sqlite3_close)>;
+	using Statement = std::unique_ptr<sqlite3_stmt, decltype(&sqlite3_finalize)>;
+
+	auto prepare(sqlite3* db, const char* sql) -> Statement {
+		sqlite3_stmt* statement = nullptr;
+		sqlite3_prepare_v2(db, sql, -1, &statement, nullptr);
+		return {statement, &sqlite3_finalize};
+	}
+
+	// Steps a statement with its parameters bound, and resets it for the next row
+	auto insert(sqlite3_stmt* statement) -> bool {
+		const auto status = sqlite3_step(statement);
+		sqlite3_reset(statement);
+		return status == SQLITE_DONE;
+	}
+} // namespace
+
+auto write_lamp_timeline(const std::filesystem::path& path, const StreetLampGridView& grid,
+						 const LampTimeline& timeline, const std::string_view fcd_file,
+						 const float distance_threshold)
+	-> tl::expected<void, write_lamp_timeline_error> {
+	auto ec = std::error_code {};
+	std::filesystem::remove(path, ec);
+
+	sqlite3* handle = nullptr;
+	const auto opened = sqlite3_open(path.c_str(), &handle);
+	auto	   db = Database(handle, &sqlite3_close);
+	if (opened != SQLITE_OK) {
+		return tl::make_unexpected(write_lamp_timeline_error::open_failed);
+	}
+	const auto failed = tl::make_unexpected(write_lamp_timeline_error::write_failed);
+
+	// A half written file is useless anyway, so there is nothing for a journal to protect
+	if (sqlite3_exec(db.get(),
+					 "PRAGMA journal_mode = OFF;"
+					 "PRAGMA synchronous = OFF;"
+					 "BEGIN;"
+					 "CREATE TABLE lamps (lamp INTEGER PRIMARY KEY, osm_id INTEGER NOT NULL,"
+					 " x REAL NOT NULL, y REAL NOT NULL);"
+					 "CREATE TABLE lit (lamp INTEGER NOT NULL, on_at REAL NOT NULL,"
+					 " off_at REAL NOT NULL);"
+					 "CREATE TABLE info (key TEXT PRIMARY KEY, value);",
+					 nullptr, nullptr, nullptr) != SQLITE_OK) {
+		return failed;
+	}
+
+	const auto insert_lamp = prepare(db.get(), "INSERT INTO lamps VALUES (?, ?, ?, ?)");
+	const auto insert_lit = prepare(db.get(), "INSERT INTO lit VALUES (?, ?, ?)");
+	const auto insert_info = prepare(db.get(), "INSERT INTO info VALUES (?, ?)");
+	if (! insert_lamp || ! insert_lit || ! insert_info) {
+		return failed;
+	}
+
+	for (std::uint32_t lamp = 0; lamp < grid.lamps.size(); ++lamp) {
+		sqlite3_bind_int64(insert_lamp.get(), 1, lamp);
+		sqlite3_bind_int64(insert_lamp.get(), 2, grid.lamps[lamp].id);
+		sqlite3_bind_double(insert_lamp.get(), 3, grid.lamps[lamp].lon);
+		sqlite3_bind_double(insert_lamp.get(), 4, grid.lamps[lamp].lat);
+		if (! insert(insert_lamp.get())) {
+			return failed;
+		}
+	}
+	for (const auto& interval : timeline.intervals) {
+		sqlite3_bind_int64(insert_lit.get(), 1, interval.lamp);
+		sqlite3_bind_double(insert_lit.get(), 2, interval.on_at);
+		sqlite3_bind_double(insert_lit.get(), 3, interval.off_at);
+		if (! insert(insert_lit.get())) {
+			return failed;
+		}
+	}
+
+	const auto info = [&](const char* key, const auto value) {
+		sqlite3_bind_text(insert_info.get(), 1, key, -1, SQLITE_STATIC);
+		if constexpr (std::is_same_v<decltype(value), const std::string_view>) {
+			sqlite3_bind_text(insert_info.get(), 2, value.data(), static_cast<int>(value.size()),
+							  SQLITE_STATIC);
+		} else if constexpr (std::is_integral_v<decltype(value)>) {
+			sqlite3_bind_int64(insert_info.get(), 2, static_cast<sqlite3_int64>(value));
+		} else {
+			sqlite3_bind_double(insert_info.get(), 2, value);
+		}
+		return insert(insert_info.get());
+	};
+	if (! info("fcd_file", fcd_file) || ! info("steps", timeline.steps) ||
+		! info("begin", timeline.begin) || ! info("end", timeline.end) ||
+		! info("distance_threshold", static_cast<double>(distance_threshold))) {
+		return failed;
+	}
+
+	// Indexing once after the inserts is much faster than keeping the index up to date
+	if (sqlite3_exec(db.get(), "CREATE INDEX lit_by_lamp ON lit (lamp, on_at); COMMIT;", nullptr,
+					 nullptr, nullptr) != SQLITE_OK) {
+		return failed;
+	}
+	return {};
+}
@@ -0,0 +1,80 @@
+#pragma once
+
+#include <cstdint>
+#include <filesystem>
+#include <span>
+#include <string_view>
+#include <vector>
+
+#include <tl/expected.hpp>
+
+#include "fcd-reader.hpp"
+#include "streetlamp-grid.hpp"
+
+class BuildingOcclusion;
+
+// When every street lamp was lit, computed offline from SUMO's floating car data instead of
+// stepping the simulation over TraCI. Every timestep is checked with `mark_lit_streetlamps`, the
+// same full pass the live publisher uses.
+//
+// The FCD file is cut into chunks of timesteps that are checked independently, each only
+// keeping the lamps that changed. `merge_timeline_chunks` then stitches the chunks together in
+// file order into the intervals each lamp was lit.
+
+struct LampTransition {
+	double		  time;
+	std::uint32_t lamp; // In grid order
+	bool		  lit;
+};
+
+struct TimelineChunk {
+	std::uint64_t			   steps = 0;
+	double					   first_time = 0.0;
+	double					   last_time = 0.0;
+	double					   step_length = 0.0; // Between the last two timesteps, 0 if only one
+	std::vector<std::uint8_t>  first_lit;		  // The lamps lit at `first_time`
+	std::vector<std::uint8_t>  last_lit;		  // and at `last_time`
+	std::vector<LampTransition> transitions;	  // After `first_time`, in time order
+};
+
+[[nodiscard]] auto detect_timeline_chunk(const StreetLampGridView& grid, std::string_view chunk,
+										 const FcdLayout& layout, float distance_threshold_squared,
+										 const BuildingOcclusion* occlusion = nullptr)
+	-> tl::expected<TimelineChunk, read_fcd_error>;
+
+// Lamp `lamp` was lit from `on_at` up to `off_at`, the first timestep it was dark again, in
+// simulated seconds. Lamps still lit at the last timestep are lit for one more step length.
+struct LitInterval {
+	std::uint32_t lamp;
+	double		  on_at;
+	double		  off_at;
+};
+
+struct LampTimeline {
+	std::uint64_t			 steps = 0;
+	double					 begin = 0.0;
+	double					 end = 0.0;
+	std::vector<LitInterval> intervals; // Sorted by `off_at`
+};
+
+// `chunks` in file order. Every lamp is dark before the first timestep.
+[[nodiscard]] auto merge_timeline_chunks(std::span<const TimelineChunk> chunks,
+										 std::size_t num_lamps) -> LampTimeline;
+
+enum class write_lamp_timeline_error {
+	open_failed,
+	write_failed,
+};
+
+[[nodiscard]] auto format_write_lamp_timeline_error(write_lamp_timeline_error err)
+	-> std::string_view;
+
+// Writes the timeline to a new SQLite database at `path`, replacing any file there:
+//
+//   lamps (lamp INTEGER PRIMARY KEY, osm_id INTEGER, x REAL, y REAL) -- lamp is the grid order
+//   lit   (lamp INTEGER, on_at REAL, off_at REAL)                     -- indexed by (lamp, on_at)
+//   info  (key TEXT PRIMARY KEY, value)                               -- steps, begin, end, ...
+[[nodiscard]] auto write_lamp_timeline(const std::filesystem::path& path,
+									   const StreetLampGridView& grid, const LampTimeline& timeline,
+									   std::string_view fcd_file, float distance_threshold)
+	-> tl::expected<void, write_lamp_timeline_error>;
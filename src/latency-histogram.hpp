@@ -0,0 +1,100 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <bit>
+#include <cmath>
+#include <cstdint>
+
+// Counts latencies in nanoseconds in log-scale buckets, 8 per power of two, so percentiles are
+// within 12.5% of the exact value without keeping every sample or allocating. Latencies of 2^36
+// ns (about a minute) and more all go in the last bucket.
+class LatencyHistogram {
+  public:
+	static constexpr int		 sub_bits = 3;
+	static constexpr int		 max_exponent = 36;
+	static constexpr std::size_t num_buckets = (max_exponent - sub_bits + 2) << sub_bits;
+
+	auto record(const std::int64_t ns) -> void {
+		const auto value = static_cast<std::uint64_t>(std::max<std::int64_t>(ns, 0));
+		buckets[bucket_of(value)]++;
+		count_++;
+		max_ = std::max(max_, static_cast<std::int64_t>(value));
+	}
+
+	auto count() const -> std::uint64_t { return count_; }
+	auto max() const -> std::int64_t { return max_; }
+
+	// The latency `p` of the recorded ones are at most, rounded up to the end of its bucket, e.g.
+	// `percentile(0.99)`. 0 if nothing was recorded.
+	auto percentile(const double p) const -> std::int64_t {
+		if (count_ == 0) {
+			return 0;
+		}
+		const auto rank = std::max<std::uint64_t>(
+			1, static_cast<std::uint64_t>(std::ceil(p * static_cast<double>(count_))));
+		std::uint64_t seen = 0;
+		for (std::size_t idx = 0; idx < num_buckets; ++idx) {
+			seen += buckets[idx];
+			if (seen >= rank) {
+				return std::min(bucket_end(idx) - 1, max_);
+			}
+		}
+		return max_;
+	}
+
+	// Calls `visit(begin, end, count)` for the buckets with latencies in them, in order. `end`
+	// is exclusive.
+	template <typename Visit>
+	auto for_each_bucket(Visit&& visit) const -> void {
+		for (std::size_t idx = 0; idx < num_buckets; ++idx) {
+			if (buckets[idx] > 0) {
+				visit(bucket_begin(idx), bucket_end(idx), buckets[idx]);
+			}
+		}
+	}
+
+	auto reset() -> void { *this = LatencyHistogram {}; }
+
+	auto operator+=(const LatencyHistogram& other) -> LatencyHistogram& {
+		for (std::size_t idx = 0; idx < num_buckets; ++idx) {
+			buckets[idx] += other.buckets[idx];
+		}
+		count_ += other.count_;
+		max_ = std::max(max_, other.max_);
+		return *this;
+	}
+
+	// The first value of bucket `idx`. Values below 2^sub_bits have a bucket each.
+	static constexpr auto bucket_begin(const std::size_t idx) -> std::int64_t {
+		constexpr auto sub_buckets = std::size_t {1} << sub_bits;
+		if (idx < sub_buckets) {
+			return static_cast<std::int64_t>(idx);
+		}
+		const auto exponent = (idx - sub_buckets) / sub_buckets + sub_bits;
+		const auto sub = (idx - sub_buckets) % sub_buckets;
+		return static_cast<std::int64_t>((sub_buckets + sub) << (exponent - sub_bits));
+	}
+
+	static constexpr auto bucket_end(const std::size_t idx) -> std::int64_t {
+		return bucket_begin(idx + 1);
+	}
+
+	static constexpr auto bucket_of(const std::uint64_t value) -> std::size_t {
+		constexpr auto sub_buckets = std::uint64_t {1} << sub_bits;
+		if (value < sub_buckets) {
+			return static_cast<std::size_t>(value);
+		}
+		const auto exponent = static_cast<std::uint64_t>(std::bit_width(value) - 1);
+		if (exponent > max_exponent) {
+			return num_buckets - 1;
+		}
+		const auto sub = (value >> (exponent - sub_bits)) & (sub_buckets - 1);
+		return static_cast<std::size_t>(sub_buckets + (exponent - sub_bits) * sub_buckets + sub);
+	}
+
+  private:
+	std::array<std::uint64_t, num_buckets> buckets {};
+	std::uint64_t						   count_ = 0;
+	std::int64_t						   max_ = 0;
+};
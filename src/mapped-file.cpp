@@ -0,0 +1,56 @@
+#include "mapped-file.hpp"
+
+#include <utility>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+MappedFile::MappedFile(MappedFile&& other) noexcept
+	: data_(std::exchange(other.data_, nullptr)), size_(std::exchange(other.size_, 0)) { }
+
+auto MappedFile::operator=(MappedFile&& other) noexcept -> MappedFile& {
+	if (this != &other) {
+		this->~MappedFile();
+		data_ = std::exchange(other.data_, nullptr);
+		size_ = std::exchange(other.size_, 0);
+	}
+	return *this;
+}
+
+MappedFile::~MappedFile() {
+	if (data_ != nullptr) {
+		munmap(const_cast<std::byte*>(data_), size_);
+	}
+}
+
+[[nodiscard]] auto map_file_readonly(const std::filesystem::path& path)
+	-> tl::expected<MappedFile, map_file_error> {
+	if (! std::filesystem::exists(path)) {
+		return tl::make_unexpected(map_file_error::file_not_found);
+	}
+
+	const int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+	if (fd == -1) {
+		return tl::make_unexpected(map_file_error::open_failed);
+	}
+
+	struct stat st {};
+	if (fstat(fd, &st) == -1 || st.st_size == 0) {
+		close(fd);
+		return tl::make_unexpected(map_file_error::open_failed);
+	}
+
+	const auto size = static_cast<std::size_t>(st.st_size);
+	void*	   data = mmap(nullptr, size, PROT_READ, MAP_SHARED, fd, 0);
+	// The mapping keeps its own reference to the file
+	close(fd);
+	if (data == MAP_FAILED) {
+		return tl::make_unexpected(map_file_error::mmap_failed);
+	}
+	// Everything in the file is used during startup, so ask the kernel to read it in right away
+	madvise(data, size, MADV_WILLNEED);
+
+	return MappedFile(static_cast<const std::byte*>(data), size);
+}
@@ -0,0 +1,43 @@
+#pragma once
+
+#include <cstddef>
+#include <filesystem>
+#include <span>
+
+#include <tl/expected.hpp>
+
+enum class map_file_error {
+	file_not_found,
+	open_failed,
+	mmap_failed,
+};
+
+class MappedFile;
+
+[[nodiscard]]
+auto map_file_readonly(const std::filesystem::path& path)
+	-> tl::expected<MappedFile, map_file_error>;
+
+// Read-only, shared memory mapping of a whole file. Processes mapping the same file share its
+// pages in the page cache.
+class MappedFile {
+  public:
+	MappedFile() = default;
+	MappedFile(const MappedFile&) = delete;
+	auto operator=(const MappedFile&) -> MappedFile& = delete;
+	MappedFile(MappedFile&& other) noexcept;
+	auto operator=(MappedFile&& other) noexcept -> MappedFile&;
+	~MappedFile();
+
+	auto bytes() const -> std::span<const std::byte> { return {data_, size_}; }
+	auto size() const -> std::size_t { return size_; }
+
+  private:
+	MappedFile(const std::byte* data, std::size_t size) : data_(data), size_(size) { }
+
+	const std::byte* data_ = nullptr;
+	std::size_t		 size_ = 0;
+
+	friend auto map_file_readonly(const std::filesystem::path& path)
+		-> tl::expected<MappedFile, map_file_error>;
+};
@@ -0,0 +1,68 @@
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <optional>
+#include <span>
+#include <type_traits>
+
+#include "payload-compression.hpp"
+
+// Every published message is its topic, then this header, then the payload in the topic's format:
+//
+//   <topic> <MessageHeader, 48 bytes> <payload>
+//
+// so a subscriber can tell how old the data it got is, and whether it missed messages. For the
+// car-tiles topic <topic> is the whole tile topic, `<prefix>/<z>/<x>/<y>/`. The payload may be
+// compressed, see payload-compression.hpp.
+//
+// The fields are in the publisher's native byte order. The timestamps are `monotonic_ns`, which
+// every process on a host reads from the same clock, so latencies can only be computed by
+// subscribers on the same host as the publisher.
+struct MessageHeader {
+	std::uint64_t sequence = 0; // Per topic, +1 every time the topic is published
+	std::uint64_t step = 0;
+	double		  simulation_time = 0.0; // In simulated seconds
+	std::int64_t  step_done_ns = 0;		 // When `Simulation::step()` of `step` returned
+	std::int64_t  publish_ns = 0;		 // Right before the message was handed to ZMQ
+	std::uint32_t payload_size = 0;		 // Before compression
+	Compression	  codec = Compression::none;
+	std::uint8_t  reserved[3] = {};
+};
+
+static_assert(sizeof(MessageHeader) == 48);
+static_assert(std::is_trivially_copyable_v<MessageHeader>);
+
+// Nanoseconds on CLOCK_MONOTONIC, comparable between the processes of one host
+inline auto monotonic_ns() -> std::int64_t {
+	return std::chrono::duration_cast<std::chrono::nanoseconds>(
+			   std::chrono::steady_clock::now().time_since_epoch())
+		.count();
+}
+
+// Appends room for the header, to be filled in with `write_message_header` once the message is
+// encoded. Returns the offset of the header in `out`.
+template <typename Buffer>
+auto reserve_message_header(Buffer& out) -> std::size_t {
+	const auto offset = out.size();
+	out.resize(offset + sizeof(MessageHeader));
+	return offset;
+}
+
+template <typename Buffer>
+auto write_message_header(Buffer& out, const std::size_t offset, const MessageHeader& header)
+	-> void {
+	std::memcpy(out.data() + offset, &header, sizeof(MessageHeader));
+}
+
+// The header of a message whose topic is `topic_size` bytes long, if the message is long enough
+inline auto read_message_header(const std::span<const std::uint8_t> message,
+								const std::size_t topic_size) -> std::optional<MessageHeader> {
+	if (message.size() < topic_size + sizeof(MessageHeader)) {
+		return std::nullopt;
+	}
+	auto header = MessageHeader {};
+	std::memcpy(&header, message.data() + topic_size, sizeof(MessageHeader));
+	return header;
+}
@@ -0,0 +1,141 @@
+#pragma once
+
+#include <bit>
+#include <charconv>
+#include <cstdint>
+#include <iterator>
+#include <limits>
+#include <span>
+#include <string_view>
+
+// Minimal MessagePack encoder appending to a byte container, with the same interface as
+// `CborWriter`. It writes the same bytes as `nlohmann::json::to_msgpack` for the types it
+// supports: the smallest integer, string, array and map encodings, and 32 bit floats when that
+// is lossless.
+template <typename Buffer>
+class MsgpackWriter {
+  public:
+	explicit MsgpackWriter(Buffer& out) : out(out) { }
+
+	auto map(const std::uint64_t num_pairs) -> void {
+		if (num_pairs <= 15) {
+			this->out.push_back(static_cast<std::uint8_t>(0x80 | num_pairs));
+		} else if (num_pairs <= 0xFFFF) {
+			this->out.push_back(0xDE);
+			this->big_endian(num_pairs, 2);
+		} else {
+			this->out.push_back(0xDF);
+			this->big_endian(num_pairs, 4);
+		}
+	}
+
+	auto array(const std::uint64_t num_items) -> void {
+		if (num_items <= 15) {
+			this->out.push_back(static_cast<std::uint8_t>(0x90 | num_items));
+		} else if (num_items <= 0xFFFF) {
+			this->out.push_back(0xDC);
+			this->big_endian(num_items, 2);
+		} else {
+			this->out.push_back(0xDD);
+			this->big_endian(num_items, 4);
+		}
+	}
+
+	auto record(const std::uint64_t num_fields) -> void { this->map(num_fields); }
+	auto field_name(const std::string_view name) -> void { this->text(name); }
+
+	// Map keys that are numbers, e.g. vehicle handles, are written as text like in JSON
+	auto integer_key(const std::uint32_t key) -> void {
+		char	   text[16];
+		const auto end = std::to_chars(std::begin(text), std::end(text), key).ptr;
+		this->text({text, end});
+	}
+
+	auto text(const std::string_view s) -> void {
+		if (s.size() <= 31) {
+			this->out.push_back(static_cast<std::uint8_t>(0xA0 | s.size()));
+		} else if (s.size() <= 0xFF) {
+			this->out.push_back(0xD9);
+			this->big_endian(s.size(), 1);
+		} else if (s.size() <= 0xFFFF) {
+			this->out.push_back(0xDA);
+			this->big_endian(s.size(), 2);
+		} else {
+			this->out.push_back(0xDB);
+			this->big_endian(s.size(), 4);
+		}
+		this->out.insert(this->out.end(), s.begin(), s.end());
+	}
+
+	auto bytes(const std::span<const std::uint8_t> b) -> void {
+		if (b.size() <= 0xFF) {
+			this->out.push_back(0xC4);
+			this->big_endian(b.size(), 1);
+		} else if (b.size() <= 0xFFFF) {
+			this->out.push_back(0xC5);
+			this->big_endian(b.size(), 2);
+		} else {
+			this->out.push_back(0xC6);
+			this->big_endian(b.size(), 4);
+		}
+		this->out.insert(this->out.end(), b.begin(), b.end());
+	}
+
+	auto integer(const std::int64_t i) -> void {
+		if (i >= 0) {
+			const auto u = static_cast<std::uint64_t>(i);
+			if (u <= 0x7F) {
+				this->out.push_back(static_cast<std::uint8_t>(u));
+			} else if (u <= 0xFF) {
+				this->out.push_back(0xCC);
+				this->big_endian(u, 1);
+			} else if (u <= 0xFFFF) {
+				this->out.push_back(0xCD);
+				this->big_endian(u, 2);
+			} else if (u <= 0xFFFFFFFF) {
+				this->out.push_back(0xCE);
+				this->big_endian(u, 4);
+			} else {
+				this->out.push_back(0xCF);
+				this->big_endian(u, 8);
+			}
+		} else if (i >= -32) {
+			this->out.push_back(static_cast<std::uint8_t>(i));
+		} else if (i >= std::numeric_limits<std::int8_t>::min()) {
+			this->out.push_back(0xD0);
+			this->big_endian(static_cast<std::uint64_t>(i), 1);
+		} else if (i >= std::numeric_limits<std::int16_t>::min()) {
+			this->out.push_back(0xD1);
+			this->big_endian(static_cast<std::uint64_t>(i), 2);
+		} else if (i >= std::numeric_limits<std::int32_t>::min()) {
+			this->out.push_back(0xD2);
+			this->big_endian(static_cast<std::uint64_t>(i), 4);
+		} else {
+			this->out.push_back(0xD3);
+			this->big_endian(static_cast<std::uint64_t>(i), 8);
+		}
+	}
+
+	auto boolean(const bool b) -> void { this->out.push_back(b ? 0xC3 : 0xC2); }
+
+	// Written as a 32 bit float when that is lossless, like nlohmann does
+	auto floating(const double d) -> void {
+		const auto f = static_cast<float>(d);
+		if (static_cast<double>(f) == d) {
+			this->out.push_back(0xCA);
+			this->big_endian(std::bit_cast<std::uint32_t>(f), 4);
+		} else {
+			this->out.push_back(0xCB);
+			this->big_endian(std::bit_cast<std::uint64_t>(d), 8);
+		}
+	}
+
+  private:
+	auto big_endian(const std::uint64_t value, const int num_bytes) -> void {
+		for (int shift = 8 * (num_bytes - 1); shift >= 0; shift -= 8) {
+			this->out.push_back(static_cast<std::uint8_t>(value >> shift));
+		}
+	}
+
+	Buffer& out;
+};
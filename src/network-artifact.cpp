@@ -0,0 +1,217 @@
+#include "network-artifact.hpp"
+
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+#include <limits>
+#include <type_traits>
+
+static_assert(std::is_trivially_copyable_v<StreetLamp>);
+static_assert(std::is_trivially_copyable_v<NetworkArtifactHeader>);
+
+namespace {
+	constexpr auto align8(const std::uint64_t offset) -> std::uint64_t {
+		return (offset + 7) & ~std::uint64_t {7};
+	}
+
+	auto osm_file_mtime(const std::filesystem::path& osm) -> std::int64_t {
+		return std::filesystem::last_write_time(osm).time_since_epoch().count();
+	}
+
+	// Whether `count` elements of `T` at `offset` are inside a file of `file_size` bytes, and
+	// aligned for `T`
+	template <typename T>
+	auto section_fits(const std::uint64_t offset, const std::uint64_t count,
+					  const std::uint64_t file_size) -> bool {
+		return offset % alignof(T) == 0 && offset <= file_size &&
+			   count <= (file_size - offset) / sizeof(T);
+	}
+
+	// Whether `offsets` never decrease and end at most at `end`
+	auto offsets_valid(const std::span<const std::uint32_t> offsets, const std::uint64_t end)
+		-> bool {
+		return std::is_sorted(offsets.begin(), offsets.end()) && offsets.back() <= end;
+	}
+} // namespace
+
+auto NetworkArtifact::grid() const -> StreetLampGridView {
+	const auto& h = header();
+	return StreetLampGridView {
+		.spec = h.grid,
+		.lamps = section<StreetLamp>(h.lamps_offset, h.num_lamps),
+		.cell_offsets = section<std::uint32_t>(h.cell_offsets_offset, h.grid.num_cells() + 1),
+	};
+}
+
+auto NetworkArtifact::lane_id(const std::size_t lane) const -> std::string_view {
+	const auto& h = header();
+	const auto	name_offsets = section<std::uint32_t>(h.lane_name_offsets_offset, h.num_lanes + 1);
+	const auto	names = section<char>(h.lane_names_offset, h.lane_names_size);
+	return {names.data() + name_offsets[lane], name_offsets[lane + 1] - name_offsets[lane]};
+}
+
+auto NetworkArtifact::lamps_near_lane(const std::string_view lane_id) const
+	-> std::span<const std::uint32_t> {
+	const auto& h = header();
+	// Lanes are sorted by id
+	std::size_t lo = 0;
+	std::size_t hi = h.num_lanes;
+	while (lo < hi) {
+		const auto mid = lo + (hi - lo) / 2;
+		if (this->lane_id(mid) < lane_id) {
+			lo = mid + 1;
+		} else {
+			hi = mid;
+		}
+	}
+	if (lo == h.num_lanes || this->lane_id(lo) != lane_id) {
+		return {};
+	}
+	const auto offsets = section<std::uint32_t>(h.lane_offsets_offset, h.num_lanes + 1);
+	return section<std::uint32_t>(h.lane_lamps_offset, h.num_lane_lamps)
+		.subspan(offsets[lo], offsets[lo + 1] - offsets[lo]);
+}
+
+[[nodiscard]] auto load_network_artifact(const std::filesystem::path& path,
+										 const std::filesystem::path& osm,
+										 const float distance_threshold)
+	-> tl::expected<NetworkArtifact, load_network_artifact_error> {
+	auto mapped = map_file_readonly(path);
+	if (! mapped) {
+		return tl::make_unexpected(mapped.error() == map_file_error::file_not_found
+									   ? load_network_artifact_error::file_not_found
+									   : load_network_artifact_error::mmap_failed);
+	}
+
+	auto artifact = NetworkArtifact(std::move(*mapped));
+	if (artifact.file.size() < sizeof(NetworkArtifactHeader)) {
+		return tl::make_unexpected(load_network_artifact_error::truncated);
+	}
+	const auto& h = artifact.header();
+	if (std::memcmp(h.magic, network_artifact_magic, sizeof(h.magic)) != 0) {
+		return tl::make_unexpected(load_network_artifact_error::bad_magic);
+	}
+	if (h.version != network_artifact_version || h.header_size != sizeof(NetworkArtifactHeader)) {
+		return tl::make_unexpected(load_network_artifact_error::version_mismatch);
+	}
+	if (h.file_size != artifact.file.size()) {
+		return tl::make_unexpected(load_network_artifact_error::truncated);
+	}
+	if (! std::filesystem::exists(osm) || h.osm_file_size != std::filesystem::file_size(osm) ||
+		h.osm_file_mtime != osm_file_mtime(osm) || h.distance_threshold != distance_threshold) {
+		return tl::make_unexpected(load_network_artifact_error::stale);
+	}
+
+	// Everything below reads the sections without bounds checks, so a damaged file has to be
+	// caught here. The cell count is checked first, `GridSpec::num_cells` is only 32 bits.
+	const auto num_cells = std::uint64_t {h.grid.columns} * h.grid.rows;
+	const auto size = artifact.file.size();
+	if (! (h.grid.cell_size > 0.0f) || num_cells >= std::numeric_limits<std::uint32_t>::max() ||
+		! section_fits<StreetLamp>(h.lamps_offset, h.num_lamps, size) ||
+		! section_fits<std::uint32_t>(h.cell_offsets_offset, num_cells + 1, size) ||
+		! section_fits<std::uint32_t>(h.lane_offsets_offset, h.num_lanes + 1, size) ||
+		! section_fits<std::uint32_t>(h.lane_lamps_offset, h.num_lane_lamps, size) ||
+		! section_fits<std::uint32_t>(h.lane_name_offsets_offset, h.num_lanes + 1, size) ||
+		! section_fits<char>(h.lane_names_offset, h.lane_names_size, size)) {
+		return tl::make_unexpected(load_network_artifact_error::corrupt);
+	}
+	const auto lane_lamps = artifact.section<std::uint32_t>(h.lane_lamps_offset, h.num_lane_lamps);
+	if (! offsets_valid(artifact.section<std::uint32_t>(h.cell_offsets_offset, num_cells + 1),
+						h.num_lamps) ||
+		! offsets_valid(artifact.section<std::uint32_t>(h.lane_offsets_offset, h.num_lanes + 1),
+						h.num_lane_lamps) ||
+		! offsets_valid(
+			artifact.section<std::uint32_t>(h.lane_name_offsets_offset, h.num_lanes + 1),
+			h.lane_names_size) ||
+		std::any_of(lane_lamps.begin(), lane_lamps.end(),
+					[&](const std::uint32_t idx) { return idx >= h.num_lamps; })) {
+		return tl::make_unexpected(load_network_artifact_error::corrupt);
+	}
+
+	return artifact;
+}
+
+[[nodiscard]] auto write_network_artifact(const std::filesystem::path& path,
+										  const StreetLampGridView& grid,
+										  const LaneStreetLampTable& lanes,
+										  const float distance_threshold,
+										  const std::filesystem::path& osm)
+	-> tl::expected<void, write_network_artifact_error> {
+	// Lane ids are stored back to back, with an offset table in front
+	auto lane_name_offsets = std::vector<std::uint32_t> {0};
+	auto lane_names = std::string {};
+	for (const auto& id : lanes.lane_ids) {
+		lane_names += id;
+		lane_name_offsets.push_back(static_cast<std::uint32_t>(lane_names.size()));
+	}
+
+	auto header = NetworkArtifactHeader {};
+	std::memcpy(header.magic, network_artifact_magic, sizeof(header.magic));
+	header.version = network_artifact_version;
+	header.header_size = sizeof(NetworkArtifactHeader);
+	header.osm_file_size = std::filesystem::file_size(osm);
+	header.osm_file_mtime = osm_file_mtime(osm);
+	header.distance_threshold = distance_threshold;
+	header.grid = grid.spec;
+	header.num_lamps = grid.lamps.size();
+	header.num_lanes = lanes.lane_ids.size();
+	header.num_lane_lamps = lanes.lamp_indices.size();
+	header.lane_names_size = lane_names.size();
+
+	std::uint64_t offset = align8(sizeof(NetworkArtifactHeader));
+	const auto	  place = [&](std::uint64_t& section_offset, const std::size_t num_bytes) {
+		 section_offset = offset;
+		 offset = align8(offset + num_bytes);
+	};
+	place(header.lamps_offset, grid.lamps.size_bytes());
+	place(header.cell_offsets_offset, grid.cell_offsets.size_bytes());
+	place(header.lane_offsets_offset, lanes.offsets.size() * sizeof(std::uint32_t));
+	place(header.lane_lamps_offset, lanes.lamp_indices.size() * sizeof(std::uint32_t));
+	place(header.lane_name_offsets_offset, lane_name_offsets.size() * sizeof(std::uint32_t));
+	place(header.lane_names_offset, lane_names.size());
+	header.file_size = offset;
+
+	auto tmp_path = path;
+	tmp_path += ".tmp";
+	{
+		auto out = std::ofstream(tmp_path, std::ios::binary | std::ios::trunc);
+		if (! out) {
+			return tl::make_unexpected(write_network_artifact_error::open_failed);
+		}
+		const auto write_at = [&](const std::uint64_t at, const void* data, const std::size_t n) {
+			static constexpr char zeros[8] = {};
+			const auto			  pos = static_cast<std::uint64_t>(out.tellp());
+			out.write(zeros, static_cast<std::streamsize>(at - pos));
+			out.write(static_cast<const char*>(data), static_cast<std::streamsize>(n));
+		};
+		write_at(0, &header, sizeof(header));
+		write_at(header.lamps_offset, grid.lamps.data(), grid.lamps.size_bytes());
+		write_at(header.cell_offsets_offset, grid.cell_offsets.data(),
+				 grid.cell_offsets.size_bytes());
+		write_at(header.lane_offsets_offset, lanes.offsets.data(),
+				 lanes.offsets.size() * sizeof(std::uint32_t));
+		write_at(header.lane_lamps_offset, lanes.lamp_indices.data(),
+				 lanes.lamp_indices.size() * sizeof(std::uint32_t));
+		write_at(header.lane_name_offsets_offset, lane_name_offsets.data(),
+				 lane_name_offsets.size() * sizeof(std::uint32_t));
+		write_at(header.lane_names_offset, lane_names.data(), lane_names.size());
+		write_at(header.file_size, nullptr, 0);
+		if (! out.flush()) {
+			return tl::make_unexpected(write_network_artifact_error::write_failed);
+		}
+	}
+
+	auto ec = std::error_code {};
+	std::filesystem::rename(tmp_path, path, ec);
+	if (ec) {
+		return tl::make_unexpected(write_network_artifact_error::write_failed);
+	}
+	return {};
+}
+
+[[nodiscard]] auto default_network_artifact_path(const std::filesystem::path& sumocfg)
+	-> std::filesystem::path {
+	auto path = sumocfg;
+	path.replace_extension(".lamps.bin");
+	return path;
+}
@@ -0,0 +1,111 @@
+#pragma once
+
+#include <cstdint>
+#include <filesystem>
+#include <span>
+#include <string_view>
+#include <utility>
+
+#include <tl/expected.hpp>
+
+#include "mapped-file.hpp"
+#include "streetlamp-grid.hpp"
+
+// A network artifact is a precompiled, versioned binary file with everything the publisher needs
+// about a scenario's street lamps: the lamps projected into SUMO's (x, y) plane, the lamp grid,
+// and the lane to lamp table. It is written by the `compile` subcommand and memory mapped
+// read-only at startup, so no XML has to be parsed and no coordinates projected.
+//
+// Layout: a `NetworkArtifactHeader` followed by the sections it points to, each 8 byte aligned
+// and in the byte order of the machine that compiled it.
+
+inline constexpr char network_artifact_magic[8] = {'S', 'U', 'M', 'O', 'L', 'A', 'M', 'P'};
+inline constexpr std::uint32_t network_artifact_version = 1;
+
+struct NetworkArtifactHeader {
+	char		  magic[8];
+	std::uint32_t version;
+	std::uint32_t header_size;
+	// The OSM file the lamps were extracted from, to detect a stale artifact
+	std::uint64_t osm_file_size;
+	std::int64_t  osm_file_mtime;
+	float		  distance_threshold;
+	GridSpec	  grid;
+	std::uint64_t num_lamps;
+	std::uint64_t num_lanes;
+	std::uint64_t num_lane_lamps;
+	std::uint64_t lane_names_size;
+	// Byte offsets from the start of the file
+	std::uint64_t lamps_offset;				// StreetLamp[num_lamps]
+	std::uint64_t cell_offsets_offset;		// u32[grid.num_cells() + 1]
+	std::uint64_t lane_offsets_offset;		// u32[num_lanes + 1]
+	std::uint64_t lane_lamps_offset;		// u32[num_lane_lamps]
+	std::uint64_t lane_name_offsets_offset; // u32[num_lanes + 1]
+	std::uint64_t lane_names_offset;		// char[lane_names_size]
+	std::uint64_t file_size;
+};
+
+class NetworkArtifact;
+
+enum class load_network_artifact_error {
+	file_not_found,
+	mmap_failed,
+	bad_magic,
+	version_mismatch,
+	truncated,
+	stale,
+	corrupt,
+};
+
+// Maps the artifact at `path`. It is `stale` if it was compiled from another version of `osm`, or
+// for another distance threshold, and `corrupt` if a section does not fit in the file or an offset
+// table points past the end of what it indexes.
+[[nodiscard]]
+auto load_network_artifact(const std::filesystem::path& path, const std::filesystem::path& osm,
+						   float distance_threshold)
+	-> tl::expected<NetworkArtifact, load_network_artifact_error>;
+
+class NetworkArtifact {
+  public:
+	auto header() const -> const NetworkArtifactHeader& {
+		return *reinterpret_cast<const NetworkArtifactHeader*>(file.bytes().data());
+	}
+	auto grid() const -> StreetLampGridView;
+	auto num_lanes() const -> std::size_t { return header().num_lanes; }
+	auto lane_id(std::size_t lane) const -> std::string_view;
+	// Indices (in grid order) of the lamps within the distance threshold of a lane, none for a
+	// lane the network does not have
+	auto lamps_near_lane(std::string_view lane_id) const -> std::span<const std::uint32_t>;
+
+  private:
+	explicit NetworkArtifact(MappedFile file) : file(std::move(file)) { }
+
+	// Only checked against the size of the file by `load_network_artifact`
+	template <typename T>
+	auto section(std::uint64_t offset, std::size_t count) const -> std::span<const T> {
+		return {reinterpret_cast<const T*>(file.bytes().data() + offset), count};
+	}
+
+	MappedFile file;
+
+	friend auto load_network_artifact(const std::filesystem::path& path,
+									  const std::filesystem::path& osm, float distance_threshold)
+		-> tl::expected<NetworkArtifact, load_network_artifact_error>;
+};
+
+enum class write_network_artifact_error {
+	open_failed,
+	write_failed,
+};
+
+// Writes to a temporary file next to `path` and renames it in place, so processes that have the
+// old artifact mapped keep their pages.
+[[nodiscard]]
+auto write_network_artifact(const std::filesystem::path& path, const StreetLampGridView& grid,
+							const LaneStreetLampTable& lanes, float distance_threshold,
+							const std::filesystem::path& osm)
+	-> tl::expected<void, write_network_artifact_error>;
+
+// Default location of a scenario's artifact, e.g. `katrinebjerg-lamp/katrinebjerg-lamp.lamps.bin`
+[[nodiscard]]
+auto default_network_artifact_path(const std::filesystem::path& sumocfg) -> std::filesystem::path;
@@ -0,0 +1,71 @@
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <thread>
+
+// How the simulation loop waits for the wall clock to catch up with simulation time
+enum class PacingWait {
+	sleep,	// Sleep until the deadline, the wakeup can be late by the scheduler's granularity
+	spin,	// Busy-wait until the deadline, burns a core but is exact
+	hybrid, // Sleep until `spin_threshold` before the deadline, then busy-wait the rest
+};
+
+struct PacingOptions {
+	bool					  realtime = false; // false runs the simulation as fast as possible
+	double					  speed = 1.0;		// Simulated seconds per wall clock second
+	PacingWait				  wait = PacingWait::hybrid;
+	std::chrono::microseconds spin_threshold {2000};
+};
+
+// Keeps simulation time aligned with wall clock time times a speed factor. Step `n` is due at
+// `start + (n + 1) * dt / speed`. Deadlines are absolute, so a late wakeup or a slow step is made
+// up by the following steps instead of pushing every later step back.
+class Pacer {
+  public:
+	using clock = std::chrono::steady_clock;
+
+	Pacer(const double dt, const PacingOptions& options)
+		: options(options), start(clock::now()),
+		  seconds_per_step(options.realtime ? dt / options.speed : 0.0) { }
+
+	// The wall clock time at which step `step` is due
+	[[nodiscard]] auto deadline(const std::uint64_t step) const -> clock::time_point {
+		const auto offset = std::chrono::duration<double>(static_cast<double>(step + 1) *
+														  seconds_per_step);
+		return start + std::chrono::duration_cast<clock::duration>(offset);
+	}
+
+	// Waits until step `step` is due. Returns how far behind its deadline the simulation is, zero
+	// if it is on time or pacing is off.
+	auto wait_for(const std::uint64_t step) const -> clock::duration {
+		if (! options.realtime) {
+			return clock::duration::zero();
+		}
+		const auto due = this->deadline(step);
+		const auto now = clock::now();
+		if (now >= due) {
+			return now - due;
+		}
+		switch (options.wait) {
+		case PacingWait::sleep:
+			std::this_thread::sleep_until(due);
+			break;
+		case PacingWait::spin:
+			while (clock::now() < due) { }
+			break;
+		case PacingWait::hybrid:
+			if (due - now > options.spin_threshold) {
+				std::this_thread::sleep_until(due - options.spin_threshold);
+			}
+			while (clock::now() < due) { }
+			break;
+		}
+		return clock::duration::zero();
+	}
+
+  private:
+	PacingOptions	  options;
+	clock::time_point start;
+	double			  seconds_per_step;
+};
@@ -0,0 +1,58 @@
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+#include <span>
+#include <string_view>
+#include <type_traits>
+
+// Schema-less binary encoder for clients that know the layout of the records, with the same
+// interface as `CborWriter`. Everything is in the byte order of the publisher's machine and
+// unaligned:
+// - map and array: u32 number of entries, then the entries (keys and values alternating)
+// - record: its fields in the order of `RecordFields<T>`, at their own width, without names
+// - text and bytes: u32 length, then the bytes
+// - integer: i64, floating: f64, boolean: u8, integer key: u32
+//
+// A car of the cars topic is 20 bytes: u32 handle, then f64 heading, i32 x, i32 y.
+template <typename Buffer>
+class PackedWriter {
+  public:
+	explicit PackedWriter(Buffer& out) : out(out) { }
+
+	auto map(const std::uint64_t num_pairs) -> void { this->count(num_pairs); }
+	auto array(const std::uint64_t num_items) -> void { this->count(num_items); }
+
+	auto record(std::uint64_t /*num_fields*/) -> void { }
+	auto field_name(std::string_view /*name*/) -> void { }
+
+	auto integer_key(const std::uint32_t key) -> void { this->native(key); }
+
+	auto text(const std::string_view s) -> void {
+		this->count(s.size());
+		this->out.insert(this->out.end(), s.begin(), s.end());
+	}
+
+	auto bytes(const std::span<const std::uint8_t> b) -> void {
+		this->count(b.size());
+		this->out.insert(this->out.end(), b.begin(), b.end());
+	}
+
+	auto integer(const std::int64_t i) -> void { this->native(i); }
+	auto boolean(const bool b) -> void { this->native(static_cast<std::uint8_t>(b)); }
+	auto floating(const double d) -> void { this->native(d); }
+
+	// Fields of records keep their own width
+	template <typename T>
+		requires std::is_arithmetic_v<T>
+	auto native(const T value) -> void {
+		const auto at = this->out.size();
+		this->out.resize(at + sizeof(T));
+		std::memcpy(this->out.data() + at, &value, sizeof(T));
+	}
+
+  private:
+	auto count(const std::uint64_t n) -> void { this->native(static_cast<std::uint32_t>(n)); }
+
+	Buffer& out;
+};
@@ -0,0 +1,165 @@
+#include "payload-compression.hpp"
+
+#include <algorithm>
+
+#include <lz4.h>
+#include <zdict.h>
+#include <zstd.h>
+
+auto parse_compression(const std::string_view name) -> std::optional<Compression> {
+	for (const auto codec : {Compression::none, Compression::lz4, Compression::zstd}) {
+		if (name == compression_name(codec)) {
+			return codec;
+		}
+	}
+	return std::nullopt;
+}
+
+auto format_compression_error(const compression_error err) -> std::string_view {
+	switch (err) {
+		case compression_error::context_failed:
+			return "failed to create the compression context";
+		case compression_error::invalid_dictionary:
+			return "invalid zstd dictionary";
+		case compression_error::corrupt_payload:
+			return "corrupt compressed payload";
+		case compression_error::too_few_samples:
+			return "too few samples to train a dictionary on";
+	}
+	return "unknown error";
+}
+
+auto ZstdFree::operator()(ZSTD_CCtx_s* ctx) const -> void {
+	ZSTD_freeCCtx(ctx);
+}
+auto ZstdFree::operator()(ZSTD_CDict_s* dict) const -> void {
+	ZSTD_freeCDict(dict);
+}
+auto ZstdFree::operator()(ZSTD_DCtx_s* ctx) const -> void {
+	ZSTD_freeDCtx(ctx);
+}
+auto ZstdFree::operator()(ZSTD_DDict_s* dict) const -> void {
+	ZSTD_freeDDict(dict);
+}
+
+auto PayloadCompressor::create(const Compression codec, const int level,
+							   const std::span<const std::uint8_t> dictionary)
+	-> tl::expected<PayloadCompressor, compression_error> {
+	auto compressor = PayloadCompressor {};
+	compressor.codec_ = codec;
+	compressor.level = level;
+	if (codec == Compression::lz4) {
+		compressor.lz4_state.resize(static_cast<std::size_t>(LZ4_sizeofState()));
+	} else if (codec == Compression::zstd) {
+		const auto zstd_level = level == 0 ? ZSTD_CLEVEL_DEFAULT : level;
+		compressor.zstd_ctx.reset(ZSTD_createCCtx());
+		if (! compressor.zstd_ctx) {
+			return tl::make_unexpected(compression_error::context_failed);
+		}
+		ZSTD_CCtx_setParameter(compressor.zstd_ctx.get(), ZSTD_c_compressionLevel, zstd_level);
+		if (! dictionary.empty()) {
+			compressor.zstd_dict.reset(
+				ZSTD_createCDict(dictionary.data(), dictionary.size(), zstd_level));
+			if (! compressor.zstd_dict) {
+				return tl::make_unexpected(compression_error::invalid_dictionary);
+			}
+		}
+	}
+	return compressor;
+}
+
+auto PayloadCompressor::compress(const std::span<const std::uint8_t> payload,
+								 std::pmr::vector<std::uint8_t>& out) -> bool {
+	const auto at = out.size();
+	if (this->codec_ == Compression::lz4) {
+		const auto bound = LZ4_compressBound(static_cast<int>(payload.size()));
+		out.resize(at + static_cast<std::size_t>(bound));
+		const auto written = LZ4_compress_fast_extState(
+			this->lz4_state.data(), reinterpret_cast<const char*>(payload.data()),
+			reinterpret_cast<char*>(out.data() + at), static_cast<int>(payload.size()), bound,
+			std::max(this->level, 1));
+		out.resize(written > 0 ? at + static_cast<std::size_t>(written) : at);
+		return written > 0;
+	}
+	if (this->codec_ == Compression::zstd) {
+		const auto bound = ZSTD_compressBound(payload.size());
+		out.resize(at + bound);
+		const auto written =
+			this->zstd_dict
+				? ZSTD_compress_usingCDict(this->zstd_ctx.get(), out.data() + at, bound,
+										   payload.data(), payload.size(), this->zstd_dict.get())
+				: ZSTD_compress2(this->zstd_ctx.get(), out.data() + at, bound, payload.data(),
+								 payload.size());
+		const auto failed = ZSTD_isError(written) != 0;
+		out.resize(failed ? at : at + written);
+		return ! failed;
+	}
+	return false;
+}
+
+auto PayloadDecompressor::create(const std::span<const std::uint8_t> dictionary)
+	-> tl::expected<PayloadDecompressor, compression_error> {
+	auto decompressor = PayloadDecompressor {};
+	decompressor.zstd_ctx.reset(ZSTD_createDCtx());
+	if (! decompressor.zstd_ctx) {
+		return tl::make_unexpected(compression_error::context_failed);
+	}
+	if (! dictionary.empty()) {
+		decompressor.zstd_dict.reset(ZSTD_createDDict(dictionary.data(), dictionary.size()));
+		if (! decompressor.zstd_dict) {
+			return tl::make_unexpected(compression_error::invalid_dictionary);
+		}
+	}
+	return decompressor;
+}
+
+auto PayloadDecompressor::decompress(const Compression codec,
+									 const std::span<const std::uint8_t> compressed,
+									 const std::size_t size, std::vector<std::uint8_t>& out)
+	-> tl::expected<void, compression_error> {
+	out.resize(size);
+	auto ok = false;
+	if (codec == Compression::none) {
+		ok = compressed.size() == size;
+		std::copy(compressed.begin(), compressed.begin() + (ok ? size : 0), out.begin());
+	} else if (codec == Compression::lz4) {
+		const auto read = LZ4_decompress_safe(reinterpret_cast<const char*>(compressed.data()),
+											  reinterpret_cast<char*>(out.data()),
+											  static_cast<int>(compressed.size()),
+											  static_cast<int>(size));
+		ok = read >= 0 && static_cast<std::size_t>(read) == size;
+	} else if (codec == Compression::zstd) {
+		const auto read =
+			this->zstd_dict
+				? ZSTD_decompress_usingDDict(this->zstd_ctx.get(), out.data(), size,
+											 compressed.data(), compressed.size(),
+											 this->zstd_dict.get())
+				: ZSTD_decompressDCtx(this->zstd_ctx.get(), out.data(), size, compressed.data(),
+									  compressed.size());
+		ok = ZSTD_isError(read) == 0 && read == size;
+	}
+	if (! ok) {
+		return tl::make_unexpected(compression_error::corrupt_payload);
+	}
+	return {};
+}
+
+auto train_zstd_dictionary(const std::span<const std::vector<std::uint8_t>> samples,
+						   const std::size_t capacity)
+	-> tl::expected<std::vector<std::uint8_t>, compression_error> {
+	auto concatenated = std::vector<std::uint8_t> {};
+	auto sizes = std::vector<std::size_t> {};
+	for (const auto& sample : samples) {
+		concatenated.insert(concatenated.end(), sample.begin(), sample.end());
+		sizes.push_back(sample.size());
+	}
+	auto	   dictionary = std::vector<std::uint8_t>(capacity);
+	const auto size =
+		ZDICT_trainFromBuffer(dictionary.data(), dictionary.size(), concatenated.data(),
+							  sizes.data(), static_cast<unsigned>(sizes.size()));
+	if (ZDICT_isError(size) != 0) {
+		return tl::make_unexpected(compression_error::too_few_samples);
+	}
+	dictionary.resize(size);
+	return dictionary;
+}
@@ -0,0 +1,106 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <memory_resource>
+#include <optional>
+#include <span>
+#include <string_view>
+#include <vector>
+
+#include <tl/expected.hpp>
+
+struct ZSTD_CCtx_s;
+struct ZSTD_CDict_s;
+struct ZSTD_DCtx_s;
+struct ZSTD_DDict_s;
+
+// Optional compression of the payload of a topic's messages, after it is encoded. The codec is
+// flagged in the `MessageHeader`, with the size of the payload before compression:
+//
+//   lz4:  LZ4 block format, fast enough to not add noticeable latency
+//   zstd: Zstandard frame, a better ratio, especially with a dictionary trained on the topic's
+//         payloads, see `train_zstd_dictionary`. Subscribers need the same dictionary.
+enum class Compression : std::uint8_t {
+	none = 0,
+	lz4 = 1,
+	zstd = 2,
+};
+
+[[nodiscard]] constexpr auto compression_name(const Compression codec) -> std::string_view {
+	switch (codec) {
+		case Compression::none:
+			return "none";
+		case Compression::lz4:
+			return "lz4";
+		case Compression::zstd:
+			return "zstd";
+	}
+	return "unknown";
+}
+
+[[nodiscard]] auto parse_compression(std::string_view name) -> std::optional<Compression>;
+
+enum class compression_error {
+	context_failed,
+	invalid_dictionary,
+	corrupt_payload,
+	too_few_samples,
+};
+
+[[nodiscard]] auto format_compression_error(compression_error err) -> std::string_view;
+
+struct ZstdFree {
+	auto operator()(ZSTD_CCtx_s* ctx) const -> void;
+	auto operator()(ZSTD_CDict_s* dict) const -> void;
+	auto operator()(ZSTD_DCtx_s* ctx) const -> void;
+	auto operator()(ZSTD_DDict_s* dict) const -> void;
+};
+
+// Compresses the payloads of one topic. Keeps its context from message to message, so compressing
+// does not allocate. Not thread safe, every publishing thread needs its own.
+class PayloadCompressor {
+  public:
+	// `level` is the acceleration for lz4 (higher is faster, with a worse ratio) and the level
+	// for zstd, 0 picks the codec's default. `dictionary` is only used by zstd, and may be empty.
+	[[nodiscard]] static auto create(Compression codec, int level,
+									 std::span<const std::uint8_t> dictionary)
+		-> tl::expected<PayloadCompressor, compression_error>;
+
+	auto codec() const -> Compression { return codec_; }
+
+	// Appends `payload` compressed to `out`. False if it could not be compressed, `out` is then
+	// unchanged.
+	[[nodiscard]] auto compress(std::span<const std::uint8_t> payload,
+								std::pmr::vector<std::uint8_t>& out) -> bool;
+
+  private:
+	Compression								 codec_ = Compression::none;
+	int										 level = 0;
+	std::vector<std::uint8_t>				 lz4_state;
+	std::unique_ptr<ZSTD_CCtx_s, ZstdFree>	 zstd_ctx;
+	std::unique_ptr<ZSTD_CDict_s, ZstdFree> zstd_dict;
+};
+
+// The subscriber side of `PayloadCompressor`, for any codec
+class PayloadDecompressor {
+  public:
+	// `dictionary` must be the one the publisher compresses zstd payloads with, if any
+	[[nodiscard]] static auto create(std::span<const std::uint8_t> dictionary)
+		-> tl::expected<PayloadDecompressor, compression_error>;
+
+	// Replaces the contents of `out` with `compressed` decompressed, which must give `size` bytes
+	[[nodiscard]] auto decompress(Compression codec, std::span<const std::uint8_t> compressed,
+								  std::size_t size, std::vector<std::uint8_t>& out)
+		-> tl::expected<void, compression_error>;
+
+  private:
+	std::unique_ptr<ZSTD_DCtx_s, ZstdFree>	 zstd_ctx;
+	std::unique_ptr<ZSTD_DDict_s, ZstdFree> zstd_dict;
+};
+
+// Trains a zstd dictionary of at most `capacity` bytes on sample payloads of a topic
+[[nodiscard]] auto train_zstd_dictionary(std::span<const std::vector<std::uint8_t>> samples,
+										 std::size_t capacity)
+	-> tl::expected<std::vector<std::uint8_t>, compression_error>;
@@ -0,0 +1,134 @@
+#include "progress-reporter.hpp"
+
+#include <algorithm>
+
+#include <fmt/core.h>
+#include <fmt/ranges.h>
+#include <indicators/block_progress_bar.hpp>
+#include <indicators/cursor_control.hpp>
+#include <spdlog/async.h>
+#include <spdlog/sinks/stdout_color_sinks.h>
+#include <spdlog/spdlog.h>
+
+#include "humantime.hpp"
+#include "thread-placement.hpp"
+
+auto pformat(const ReportingOptions& reporting) -> std::string {
+	return fmt::format("ReportingOptions {{ period: {} ms, log_queue_size: {} }}",
+					   reporting.period.count(), reporting.log_queue_size);
+}
+
+auto install_async_logger(const ReportingOptions& options) -> void {
+	spdlog::init_thread_pool(options.log_queue_size, 1,
+							 [] { (void)lower_current_thread_priority(); });
+	auto logger = std::make_shared<spdlog::async_logger>(
+		"", std::make_shared<spdlog::sinks::stdout_color_sink_mt>(), spdlog::thread_pool(),
+		spdlog::async_overflow_policy::overrun_oldest);
+	logger->set_level(spdlog::default_logger()->level());
+	spdlog::set_default_logger(std::move(logger));
+}
+
+ProgressReporter::ProgressReporter(const ReportingOptions& options, const int first_step,
+								   const int last_step, const bool verbose, const double speed,
+								   const std::span<const int> cpus)
+	: options(options), first_step(first_step), last_step(last_step), verbose(verbose),
+	  speed(speed), cpus(cpus.begin(), cpus.end()) {
+	progress_.steps_done.store(first_step, std::memory_order_relaxed);
+	thread = std::thread([this] { this->run(); });
+}
+
+ProgressReporter::~ProgressReporter() {
+	this->stop();
+}
+
+auto ProgressReporter::stop() -> void {
+	{
+		const auto lock = std::lock_guard(mutex);
+		stopping = true;
+	}
+	stopped.notify_one();
+	if (thread.joinable()) {
+		thread.join();
+	}
+}
+
+auto ProgressReporter::run() -> void {
+	using clock = std::chrono::steady_clock;
+
+	(void)lower_current_thread_priority();
+	if (! cpus.empty() && ! pin_current_thread_to_cpus(cpus)) {
+		spdlog::warn("Failed to pin the progress reporter thread to CPUs {}",
+					 fmt::join(cpus, ","));
+	}
+
+	auto bar = indicators::BlockProgressBar {
+		indicators::option::BarWidth {80},
+		indicators::option::Start {"|"},
+		indicators::option::End {"|"},
+		indicators::option::ShowElapsedTime {true},
+		indicators::option::ForegroundColor {indicators::Color::blue},
+	};
+	// Hide cursor
+	indicators::show_console_cursor(false);
+
+	auto last_sample = clock::now();
+	auto last_lag_report = last_sample;
+	auto steps_at_last_sample = first_step;
+	// Smoothed over the last samples, for the estimate of the time left
+	auto steps_per_second = 0.0;
+
+	while (true) {
+		{
+			auto lock = std::unique_lock(mutex);
+			if (stopped.wait_for(lock, options.period, [&] { return stopping; })) {
+				break;
+			}
+		}
+
+		const auto now = clock::now();
+		const auto steps_done = progress_.steps_done.load(std::memory_order_relaxed);
+		const auto elapsed = std::chrono::duration<double>(now - last_sample).count();
+		if (elapsed > 0.0 && steps_done > steps_at_last_sample) {
+			const auto rate = (steps_done - steps_at_last_sample) / elapsed;
+			steps_per_second = steps_per_second == 0.0 ? rate : 0.8 * steps_per_second + 0.2 * rate;
+		}
+		last_sample = now;
+		steps_at_last_sample = steps_done;
+
+		const double percent_done = static_cast<double>(steps_done) / last_step * 100.0;
+		if (verbose) {
+			const auto remaining_us =
+				steps_per_second == 0.0
+					? 0L
+					: static_cast<long>((last_step - steps_done) / steps_per_second * 1e6);
+			bar.set_option(indicators::option::PostfixText(fmt::format(
+				"simulation-step: {}/{} (in percent: {:.2f}%) took: {} μs, estimated time to "
+				"completion: {}, allocations per step: traci {:.1f}, publisher {:.1f}",
+				steps_done, last_step, percent_done,
+				progress_.step_us.load(std::memory_order_relaxed), humantime(remaining_us),
+				progress_.traci_allocations_per_step.load(std::memory_order_relaxed),
+				progress_.publisher_allocations_per_step.load(std::memory_order_relaxed))));
+		}
+		bar.set_progress(static_cast<float>(std::min(percent_done, 100.0)));
+
+		if (now - last_lag_report >= std::chrono::seconds(1)) {
+			this->warn_if_late();
+			last_lag_report = now;
+		}
+	}
+
+	this->warn_if_late();
+	bar.set_progress(100.0f);
+	bar.mark_as_completed();
+	indicators::show_console_cursor(true);
+}
+
+auto ProgressReporter::warn_if_late() -> void {
+	const auto late_steps = progress_.late_steps.exchange(0, std::memory_order_relaxed);
+	const auto max_lag_us = progress_.max_lag_us.exchange(0, std::memory_order_relaxed);
+	if (late_steps > 0) {
+		spdlog::warn("Simulation can not keep up with {}x real time: {} late steps, up to {} "
+					 "behind",
+					 speed, late_steps, humantime(max_lag_us));
+	}
+}
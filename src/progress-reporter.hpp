@@ -0,0 +1,87 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <span>
+#include <string>
+#include <thread>
+#include <vector>
+
+// `[reporting]`, how the progress bar and the log reach the terminal. Neither is written from the
+// simulation thread, a slow or piped stdout only holds up the threads below.
+struct ReportingOptions {
+	std::chrono::milliseconds period {100}; // Between redraws of the progress bar
+	// Log messages waiting to be written. When it is full the oldest are dropped, logging never
+	// blocks.
+	std::size_t log_queue_size = 8192;
+};
+
+[[nodiscard]] auto pformat(const ReportingOptions& reporting) -> std::string;
+
+// Makes the default logger asynchronous: log calls only format the message and queue it, a low
+// priority thread writes it to stdout. Messages still queued when the process exits are written
+// before it does.
+auto install_async_logger(const ReportingOptions& options) -> void;
+
+// What the simulation thread tells the reporter after every step. Only relaxed atomic stores, so
+// it never waits for the reporter.
+struct StepProgress {
+	std::atomic<int>		  steps_done {0};
+	std::atomic<std::int64_t> step_us {0}; // How long the last step took
+	std::atomic<double>		  traci_allocations_per_step {0.0};
+	std::atomic<double>		  publisher_allocations_per_step {0.0};
+	// Steps that started late when pacing, and the worst lag, since the last warning
+	std::atomic<std::uint64_t> late_steps {0};
+	std::atomic<std::int64_t>  max_lag_us {0};
+
+	auto record_lag(const std::chrono::microseconds lag) -> void {
+		late_steps.fetch_add(1, std::memory_order_relaxed);
+		auto max = max_lag_us.load(std::memory_order_relaxed);
+		while (lag.count() > max &&
+			   ! max_lag_us.compare_exchange_weak(max, lag.count(), std::memory_order_relaxed)) { }
+	}
+};
+
+// Samples a `StepProgress` every `ReportingOptions::period` on a low priority thread of its own,
+// and draws the progress bar from it. In verbose mode the bar shows how long the last step took,
+// an estimate of the time left and the allocations per step. Falling behind real time is warned
+// about at most once a second.
+class ProgressReporter {
+  public:
+	// Steps `first_step` to `last_step` (exclusive) are simulated. `speed` is the pacing speed, for
+	// the warning. The reporter thread runs on `cpus`, or wherever it is started if it is empty.
+	ProgressReporter(const ReportingOptions& options, int first_step, int last_step, bool verbose,
+					 double speed, std::span<const int> cpus);
+	~ProgressReporter();
+
+	ProgressReporter(const ProgressReporter&) = delete;
+	auto operator=(const ProgressReporter&) -> ProgressReporter& = delete;
+
+	[[nodiscard]] auto progress() -> StepProgress& { return progress_; }
+
+	// Completes the progress bar and stops the reporter thread
+	auto stop() -> void;
+
+  private:
+	auto run() -> void;
+	auto warn_if_late() -> void;
+
+	ReportingOptions options;
+	int				 first_step;
+	int				 last_step;
+	bool			 verbose;
+	double			 speed;
+	std::vector<int> cpus;
+
+	StepProgress progress_;
+
+	std::mutex				mutex;
+	std::condition_variable stopped;
+	bool					stopping = false;
+
+	std::thread thread;
+};
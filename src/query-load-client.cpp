@@ -0,0 +1,125 @@
+// Load generator for the query service. Every client thread has its own DEALER socket and sends
+// batches of random radius queries back to back, measuring the round trip time of each request.
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <iostream>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <argparse/argparse.hpp>
+#include <fmt/core.h>
+#include <nlohmann/json.hpp>
+#include <spdlog/spdlog.h>
+#include <zmq.hpp>
+
+using json = nlohmann::json;
+
+auto main(int argc, char** argv) -> int {
+	auto argv_parser = argparse::ArgumentParser("query-load-client", "0.1.0");
+	argv_parser.add_argument("--endpoint")
+		.help("Endpoint of the query service")
+		.default_value(std::string("tcp://localhost:12001"));
+	argv_parser.add_argument("--clients")
+		.help("Number of concurrent clients")
+		.default_value(8)
+		.scan<'i', int>();
+	argv_parser.add_argument("--batch")
+		.help("Number of queries per request")
+		.default_value(4)
+		.scan<'i', int>();
+	argv_parser.add_argument("--radius")
+		.help("Radius of the queries in meters")
+		.default_value(200.0)
+		.scan<'g', double>();
+	argv_parser.add_argument("--extent")
+		.help("Queries are centered in [0, extent] x [0, extent]")
+		.default_value(5000.0)
+		.scan<'g', double>();
+	argv_parser.add_argument("--seconds")
+		.help("How long to run")
+		.default_value(10)
+		.scan<'i', int>();
+
+	try {
+		argv_parser.parse_args(argc, argv);
+	} catch (const std::exception& err) {
+		spdlog::error("{}", err.what());
+		std::cerr << argv_parser;
+		return 2;
+	}
+
+	const auto endpoint = argv_parser.get<std::string>("--endpoint");
+	const auto num_clients = std::max(1, argv_parser.get<int>("--clients"));
+	const auto batch = std::max(1, argv_parser.get<int>("--batch"));
+	const auto radius = argv_parser.get<double>("--radius");
+	const auto extent = argv_parser.get<double>("--extent");
+	const auto duration = std::chrono::seconds(argv_parser.get<int>("--seconds"));
+
+	auto zmq_ctx = zmq::context_t();
+	auto latencies_us = std::vector<std::vector<std::uint32_t>>(num_clients);
+	auto errors = std::vector<std::uint64_t>(num_clients, 0);
+	auto clients = std::vector<std::thread> {};
+
+	const auto deadline = std::chrono::steady_clock::now() + duration;
+	for (int c = 0; c < num_clients; ++c) {
+		clients.emplace_back([&, c] {
+			auto socket = zmq::socket_t(zmq_ctx, zmq::socket_type::dealer);
+			socket.set(zmq::sockopt::rcvtimeo, 1000);
+			socket.connect(endpoint);
+
+			auto rng = std::mt19937(static_cast<std::uint32_t>(c));
+			auto coordinate = std::uniform_real_distribution<double>(0.0, extent);
+			while (std::chrono::steady_clock::now() < deadline) {
+				auto queries = json::array();
+				for (int q = 0; q < batch; ++q) {
+					queries.push_back({{"type", "radius"},
+									   {"x", coordinate(rng)},
+									   {"y", coordinate(rng)},
+									   {"r", radius}});
+				}
+				const auto request = json {{"queries", std::move(queries)}}.dump();
+
+				const auto sent = std::chrono::steady_clock::now();
+				(void)socket.send(zmq::buffer(request), zmq::send_flags::none);
+				auto reply = zmq::message_t {};
+				if (! socket.recv(reply)) {
+					errors[c]++;
+					continue;
+				}
+				const auto elapsed = std::chrono::steady_clock::now() - sent;
+				latencies_us[c].push_back(static_cast<std::uint32_t>(
+					std::chrono::duration_cast<std::chrono::microseconds>(elapsed).count()));
+			}
+		});
+	}
+	for (auto& client : clients) {
+		client.join();
+	}
+
+	auto all = std::vector<std::uint32_t> {};
+	for (const auto& client_latencies : latencies_us) {
+		all.insert(all.end(), client_latencies.begin(), client_latencies.end());
+	}
+	std::uint64_t num_errors = 0;
+	for (const auto e : errors) {
+		num_errors += e;
+	}
+	if (all.empty()) {
+		spdlog::error("No replies from {}", endpoint);
+		return 1;
+	}
+	std::sort(all.begin(), all.end());
+	const auto percentile = [&](const double p) {
+		return all[static_cast<std::size_t>(p * (all.size() - 1))];
+	};
+	const auto seconds = std::chrono::duration<double>(duration).count();
+	fmt::println("{} clients, {} queries per request: {:.1f} requests/s, {} timeouts", num_clients,
+				 batch, all.size() / seconds, num_errors);
+	fmt::println("round trip latency: p50 {} us, p99 {} us, p99.9 {} us, max {} us",
+				 percentile(0.5), percentile(0.99), percentile(0.999), all.back());
+	return 0;
+}
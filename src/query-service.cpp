@@ -0,0 +1,359 @@
+#include "query-service.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <limits>
+
+#include <spdlog/spdlog.h>
+
+using json = nlohmann::json;
+
+QueryIndex::QueryIndex(const StreetLampGridView& grid, const NetworkArtifact* artifact)
+	: grid(grid), artifact(artifact), lamp_lit(grid.lamps.size(), 0) {
+	lamp_index_by_id.reserve(grid.lamps.size());
+	for (std::uint32_t idx = 0; idx < grid.lamps.size(); ++idx) {
+		lamp_index_by_id.emplace(grid.lamps[idx].id, idx);
+	}
+	// Answer queries made before the first step with no cars
+	car_buckets.rebuild(grid.spec, car_positions);
+}
+
+auto QueryIndex::update(const StepSnapshot& latest) -> void {
+	snapshot = latest; // Reuses the capacity of the vectors
+
+	std::fill(lamp_lit.begin(), lamp_lit.end(), 0);
+	for (const auto id : snapshot.lit_streetlamp_ids) {
+		if (const auto it = lamp_index_by_id.find(id); it != lamp_index_by_id.end()) {
+			lamp_lit[it->second] = 1;
+		}
+	}
+
+	car_positions.clear();
+	for (const auto& car : snapshot.cars) {
+		car_positions.push_back({static_cast<float>(car.x), static_cast<float>(car.y)});
+	}
+	car_buckets.rebuild(grid.spec, car_positions);
+}
+
+auto QueryIndex::answer(const json& request) const -> json {
+	if (! request.is_object() || ! request.contains("queries") || ! request["queries"].is_array()) {
+		return json {{"error", "expected an object with a \"queries\" array"}};
+	}
+	auto results = json::array();
+	for (const auto& query : request["queries"]) {
+		results.push_back(answer_query(query));
+	}
+	return json {
+		{"step", snapshot.step},
+		{"simulation_time", snapshot.simulation_time},
+		{"results", std::move(results)},
+	};
+}
+
+auto QueryIndex::answer_query(const json& query) const -> json {
+	// Set if any coordinate is not finite, e.g. 1e300 does not fit in a float
+	bool	   finite = true;
+	const auto number = [&](const char* key) -> float {
+		const auto value = query.at(key).get<float>();
+		finite = finite && std::isfinite(value);
+		return value;
+	};
+	const auto not_finite = json {{"error", "coordinates must be finite numbers"}};
+	try {
+		const auto type = query.at("type").get<std::string>();
+		if (type == "lamp") {
+			const auto id = query.at("id").get<std::int64_t>();
+			const auto it = lamp_index_by_id.find(id);
+			if (it == lamp_index_by_id.end()) {
+				return json {{"error", "unknown lamp"}};
+			}
+			return lamp_state(it->second);
+		}
+		if (type == "point") {
+			const auto p = Point {number("x"), number("y")};
+			return finite ? nearest_lamp(p) : not_finite;
+		}
+		if (type == "radius") {
+			const auto x = number("x");
+			const auto y = number("y");
+			const auto r = number("r");
+			if (! finite) {
+				return not_finite;
+			}
+			if (! (r >= 0.0f)) {
+				return json {{"error", "r must not be negative"}};
+			}
+			return cars_and_lamps_in(x - r, y - r, x + r, y + r, [&](const Point p) {
+				return (p.x - x) * (p.x - x) + (p.y - y) * (p.y - y) <= r * r;
+			});
+		}
+		if (type == "bbox") {
+			const auto x0 = std::min(number("x0"), number("x1"));
+			const auto x1 = std::max(number("x0"), number("x1"));
+			const auto y0 = std::min(number("y0"), number("y1"));
+			const auto y1 = std::max(number("y0"), number("y1"));
+			if (! finite) {
+				return not_finite;
+			}
+			return cars_and_lamps_in(x0, y0, x1, y1, [](const Point) { return true; });
+		}
+		if (type == "lane") {
+			return lamps_near_lane(query.at("id").get<std::string>());
+		}
+		return json {{"error", "unknown query type"}};
+	} catch (const json::exception& err) {
+		return json {{"error", err.what()}};
+	}
+}
+
+auto QueryIndex::lamp_state(const std::uint32_t idx) const -> json {
+	const auto& lamp = grid.lamps[idx];
+	return json {
+		{"id", lamp.id},
+		{"x", lamp.lon},
+		{"y", lamp.lat},
+		{"lit", lamp_lit[idx] != 0},
+	};
+}
+
+auto QueryIndex::lamps_near_lane(const std::string_view lane_id) const -> json {
+	if (artifact == nullptr) {
+		return json {{"error", "lane queries need the lamps from a network artifact"}};
+	}
+	// The artifact's lamps are the grid's, so the indices of its lane table are valid here
+	auto lamps = json::array();
+	for (const auto idx : artifact->lamps_near_lane(lane_id)) {
+		lamps.push_back(lamp_state(idx));
+	}
+	return json {{"lamps", std::move(lamps)}};
+}
+
+namespace {
+	// The column or row `offset` from the origin of the grid is in, clamped to [-1, cells] while
+	// still a float, so a coordinate far outside of the grid does not overflow the conversion
+	auto clamped_cell(const GridSpec& spec, const float offset, const std::uint32_t cells)
+		-> std::int64_t {
+		return static_cast<std::int64_t>(
+			std::clamp(std::floor(offset / spec.cell_size), -1.0f, static_cast<float>(cells)));
+	}
+	auto clamped_column(const GridSpec& spec, const float x) -> std::int64_t {
+		return clamped_cell(spec, x - spec.origin_x, spec.columns);
+	}
+	auto clamped_row(const GridSpec& spec, const float y) -> std::int64_t {
+		return clamped_cell(spec, y - spec.origin_y, spec.rows);
+	}
+} // namespace
+
+auto QueryIndex::nearest_lamp(const Point p) const -> json {
+	const auto& spec = grid.spec;
+	if (grid.lamps.empty()) {
+		return json {{"error", "there are no lamps"}};
+	}
+	// Look at the cells in rings around the point's cell, until no closer lamp can be in the next
+	const auto column = std::clamp<std::int64_t>(clamped_column(spec, p.x), 0, spec.columns - 1);
+	const auto row = std::clamp<std::int64_t>(clamped_row(spec, p.y), 0, spec.rows - 1);
+
+	// In doubles, squares of distances between far apart floats do not fit in a float
+	auto best_idx = std::numeric_limits<std::uint32_t>::max();
+	auto best_distance_squared = std::numeric_limits<double>::max();
+	const auto visit = [&](const std::int64_t c, const std::int64_t r) {
+		if (! spec.contains(c, r)) {
+			return;
+		}
+		const auto cell = spec.cell_index(c, r);
+		const auto end = grid.cell_offsets[cell + 1];
+		for (auto idx = grid.cell_offsets[cell]; idx < end; ++idx) {
+			const auto dx = static_cast<double>(grid.lamps[idx].lon) - p.x;
+			const auto dy = static_cast<double>(grid.lamps[idx].lat) - p.y;
+			if (dx * dx + dy * dy < best_distance_squared) {
+				best_distance_squared = dx * dx + dy * dy;
+				best_idx = idx;
+			}
+		}
+	};
+	const auto edge = [&](const float origin, const std::int64_t cell) {
+		return static_cast<double>(origin) + static_cast<double>(cell) * spec.cell_size;
+	};
+	for (std::int64_t ring = 0;; ++ring) {
+		const auto first_column = column - ring;
+		const auto last_column = column + ring;
+		const auto first_row = row - ring;
+		const auto last_row = row + ring;
+		// Only the cells on the ring, the ones inside were searched in the rings before
+		const auto from_column = std::max<std::int64_t>(first_column, 0);
+		const auto to_column = std::min<std::int64_t>(last_column, spec.columns - 1);
+		for (auto c = from_column; c <= to_column; ++c) {
+			visit(c, first_row);
+			if (ring > 0) {
+				visit(c, last_row);
+			}
+		}
+		const auto from_row = std::max<std::int64_t>(first_row + 1, 0);
+		const auto to_row = std::min<std::int64_t>(last_row - 1, spec.rows - 1);
+		for (auto r = from_row; r <= to_row; ++r) {
+			visit(first_column, r);
+			visit(last_column, r);
+		}
+
+		// Every lamp not seen yet is in a cell beyond one of the sides of the block searched so
+		// far, so it is at least as far away as the closest side with cells of the grid beyond it
+		auto margin = std::numeric_limits<double>::max();
+		if (first_column > 0) {
+			margin = std::min(margin, p.x - edge(spec.origin_x, first_column));
+		}
+		if (last_column + 1 < spec.columns) {
+			margin = std::min(margin, edge(spec.origin_x, last_column + 1) - p.x);
+		}
+		if (first_row > 0) {
+			margin = std::min(margin, p.y - edge(spec.origin_y, first_row));
+		}
+		if (last_row + 1 < spec.rows) {
+			margin = std::min(margin, edge(spec.origin_y, last_row + 1) - p.y);
+		}
+		if (margin == std::numeric_limits<double>::max()) {
+			break; // The whole grid was searched
+		}
+		if (best_idx != std::numeric_limits<std::uint32_t>::max() && margin > 0.0 &&
+			best_distance_squared <= margin * margin) {
+			break;
+		}
+	}
+
+	auto result = lamp_state(best_idx);
+	result["distance"] = std::sqrt(best_distance_squared);
+	return result;
+}
+
+template <typename Inside>
+auto QueryIndex::cars_and_lamps_in(const float x0, const float y0, const float x1, const float y1,
+								   Inside&& inside) const -> json {
+	const auto& spec = grid.spec;
+	auto		cars = json::array();
+	auto		lamps = json::array();
+
+	const auto add_car = [&](const std::uint32_t idx) {
+		const auto p = car_positions[idx];
+		if (p.x < x0 || p.x > x1 || p.y < y0 || p.y > y1 || ! inside(p)) {
+			return;
+		}
+		const auto& car = snapshot.cars[idx];
+		cars.push_back(json {
+			{"id", snapshot.car_handles[idx]},
+			{"sumo_id", snapshot.car_names[idx]},
+			{"x", car.x},
+			{"y", car.y},
+			{"heading", car.heading},
+		});
+	};
+
+	const auto first_column = std::max<std::int64_t>(clamped_column(spec, x0), 0);
+	const auto last_column = std::min<std::int64_t>(clamped_column(spec, x1), spec.columns - 1);
+	const auto first_row = std::max<std::int64_t>(clamped_row(spec, y0), 0);
+	const auto last_row = std::min<std::int64_t>(clamped_row(spec, y1), spec.rows - 1);
+	for (auto r = first_row; r <= last_row; ++r) {
+		for (auto c = first_column; c <= last_column; ++c) {
+			const auto cell = spec.cell_index(c, r);
+			for (const auto idx : car_buckets.bucket(cell)) {
+				add_car(idx);
+			}
+			for (auto idx = grid.cell_offsets[cell]; idx < grid.cell_offsets[cell + 1]; ++idx) {
+				const auto& lamp = grid.lamps[idx];
+				const auto	p = Point {lamp.lon, lamp.lat};
+				if (p.x >= x0 && p.x <= x1 && p.y >= y0 && p.y <= y1 && inside(p)) {
+					lamps.push_back(lamp_state(idx));
+				}
+			}
+		}
+	}
+	// Cars outside of the lamp grid are not in any cell
+	for (const auto idx : car_buckets.bucket(spec.num_cells())) {
+		add_car(idx);
+	}
+
+	return json {{"cars", std::move(cars)}, {"lamps", std::move(lamps)}};
+}
+
+namespace {
+	auto report_latencies(std::vector<std::uint32_t>& latencies_us, const std::uint64_t requests,
+						  const std::uint64_t queries, const double seconds) -> void {
+		if (latencies_us.empty()) {
+			return;
+		}
+		std::sort(latencies_us.begin(), latencies_us.end());
+		const auto percentile = [&](const double p) {
+			return latencies_us[static_cast<std::size_t>(p * (latencies_us.size() - 1))];
+		};
+		spdlog::info("Query service: {:.1f} requests/s, {:.1f} queries/s, latency p50 {} us, "
+					 "p99 {} us, max {} us",
+					 requests / seconds, queries / seconds, percentile(0.5), percentile(0.99),
+					 latencies_us.back());
+		latencies_us.clear();
+	}
+} // namespace
+
+auto run_query_service(SnapshotRing::Consumer consumer, zmq::socket_t& socket, QueryIndex& index)
+	-> void {
+	using clock = std::chrono::steady_clock;
+	// Wake up now and then to notice when the simulation is over
+	socket.set(zmq::sockopt::rcvtimeo, 100);
+
+	auto		  frames = std::vector<zmq::message_t> {};
+	auto		  latencies_us = std::vector<std::uint32_t> {};
+	std::uint64_t requests = 0;
+	std::uint64_t queries = 0;
+	auto		  last_report_time = clock::now();
+
+	while (! consumer.closed()) {
+		const auto now = clock::now();
+		if (now - last_report_time >= std::chrono::seconds(10)) {
+			const auto seconds = std::chrono::duration<double>(now - last_report_time).count();
+			report_latencies(latencies_us, requests, queries, seconds);
+			requests = 0;
+			queries = 0;
+			last_report_time = now;
+		}
+
+		// A request is [routing id, (empty delimiter from REQ clients), payload]
+		frames.clear();
+		auto frame = zmq::message_t {};
+		if (! socket.recv(frame)) {
+			continue;
+		}
+		frames.push_back(std::move(frame));
+		while (frames.back().more()) {
+			auto next = zmq::message_t {};
+			(void)socket.recv(next);
+			frames.push_back(std::move(next));
+		}
+		if (frames.size() < 2) {
+			continue; // Not from a client, nowhere to send a reply to
+		}
+
+		const auto started = clock::now();
+		consumer.try_read_latest([&](const StepSnapshot& snapshot) { index.update(snapshot); });
+
+		const auto* payload = frames.back().data<char>();
+		const auto	request = json::parse(payload, payload + frames.back().size(), nullptr,
+										  /* allow_exceptions */ false);
+		const auto reply = request.is_discarded() ? json {{"error", "request is not valid JSON"}}
+												  : index.answer(request);
+		const auto reply_text = reply.dump();
+
+		for (std::size_t idx = 0; idx + 1 < frames.size(); ++idx) {
+			(void)socket.send(frames[idx], zmq::send_flags::sndmore);
+		}
+		(void)socket.send(zmq::buffer(reply_text), zmq::send_flags::none);
+
+		requests++;
+		if (! request.is_discarded() && request.contains("queries") &&
+			request["queries"].is_array()) {
+			queries += request["queries"].size();
+		}
+		latencies_us.push_back(static_cast<std::uint32_t>(
+			std::chrono::duration_cast<std::chrono::microseconds>(clock::now() - started).count()));
+	}
+
+	report_latencies(latencies_us, requests, queries,
+					 std::chrono::duration<double>(clock::now() - last_report_time).count());
+}
@@ -0,0 +1,68 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include <nlohmann/json.hpp>
+#include <parallel_hashmap/phmap.h>
+#include <zmq.hpp>
+
+#include "network-artifact.hpp"
+#include "step-snapshot.hpp"
+#include "streetlamp-grid.hpp"
+
+// Request/reply service answering one-off questions about the latest simulation step, for clients
+// that do not want to subscribe to a whole topic and filter it themselves.
+//
+// A request is a JSON object with a batch of queries, answered in order:
+//   { "queries": [
+//       { "type": "lamp", "id": 123 },                              state of one lamp
+//       { "type": "point", "x": 10.0, "y": 20.0 },                  lamp closest to a point
+//       { "type": "radius", "x": 10.0, "y": 20.0, "r": 200.0 },     cars and lamps within r
+//       { "type": "bbox", "x0": 0.0, "y0": 0.0, "x1": 50.0, "y1": 50.0 } cars and lamps inside
+//       { "type": "lane", "id": "-414865922#0_0" },                 lamps near a SUMO lane
+//   ] }
+// The reply is `{ "step": ..., "simulation_time": ..., "results": [ ... ] }` with one result per
+// query, or `{ "error": "..." }` for a query or request that can not be answered. Coordinates are
+// in the projected (x, y) plane SUMO uses for vehicle positions. Cars are given as
+// `{ "id": <handle>, "sumo_id": "veh0", "x": ..., "y": ..., "heading": ... }`.
+
+// Answers queries against the latest snapshot it was given and the street lamp grid. Owned by the
+// query thread, so it needs no synchronization.
+class QueryIndex {
+  public:
+	// Lane queries are answered from the lane to lamp table of `artifact`, if the lamps were
+	// loaded from one. It has to outlive the index.
+	explicit QueryIndex(const StreetLampGridView& grid, const NetworkArtifact* artifact = nullptr);
+
+	// Copies `snapshot`, which is only valid while the ring has it pinned
+	auto update(const StepSnapshot& snapshot) -> void;
+
+	[[nodiscard]] auto answer(const nlohmann::json& request) const -> nlohmann::json;
+
+  private:
+	[[nodiscard]] auto answer_query(const nlohmann::json& query) const -> nlohmann::json;
+	[[nodiscard]] auto lamp_state(std::uint32_t idx) const -> nlohmann::json;
+	[[nodiscard]] auto nearest_lamp(Point p) const -> nlohmann::json;
+	[[nodiscard]] auto lamps_near_lane(std::string_view lane_id) const -> nlohmann::json;
+	// Cars and lamps in the box [x0, x1] x [y0, y1] for which `inside` is true
+	template <typename Inside>
+	[[nodiscard]] auto cars_and_lamps_in(float x0, float y0, float x1, float y1,
+										 Inside&& inside) const -> nlohmann::json;
+
+	StreetLampGridView								  grid;
+	const NetworkArtifact*							  artifact;
+	phmap::flat_hash_map<std::int64_t, std::uint32_t> lamp_index_by_id;
+
+	StepSnapshot			  snapshot;
+	std::vector<std::uint8_t> lamp_lit; // Indexed like the lamps of the grid
+	std::vector<Point>		  car_positions;
+	CellBuckets				  car_buckets;
+};
+
+// Answers requests on the ROUTER socket until the ring is closed. The snapshot is only copied out
+// of the ring when a request comes in and a newer one is available, so an idle service costs
+// nothing.
+auto run_query_service(SnapshotRing::Consumer consumer, zmq::socket_t& socket, QueryIndex& index)
+	-> void;
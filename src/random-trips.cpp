@@ -0,0 +1,236 @@
+// Generates random trips on a SUMO network and routes them, writing a route file like
+//
+//   python "$SUMO_HOME/tools/randomTrips.py" -n <net.xml> -e 100000 -L -r <rou.xml>
+//
+// does, without the single threaded Python and duarouter. Trips depart every `--period` seconds
+// from `--begin` until `--end`, between edges drawn in proportion to their length with `-l`, to
+// their number of lanes with `-L`, or all alike, as with randomTrips.py. Every trip is routed
+// along the fastest edges, and trips between edges that are not connected are dropped, as
+// duarouter does with --ignore-errors.
+//
+// Trips are drawn on the main thread from one seeded generator, so the output only depends on
+// the options and not on the number of threads. They are routed in batches by the threads of a
+// work stealing pool, each with a router of its own, while the main thread writes the routes of
+// the previous batch.
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <filesystem>
+#include <functional>
+#include <iostream>
+#include <optional>
+#include <random>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include <argparse/argparse.hpp>
+#include <fmt/core.h>
+#include <spdlog/spdlog.h>
+
+#include "humantime.hpp"
+#include "road-network.hpp"
+#include "work-stealing-pool.hpp"
+
+namespace {
+	using clock = std::chrono::steady_clock;
+
+	// Trips routed by a worker between two looks at the shared counter
+	constexpr std::uint32_t trips_per_claim = 32;
+
+	struct Batch {
+		std::uint64_t first_id = 0;
+		// The start and end edge of every trip, nothing if none far enough apart was found
+		std::vector<std::optional<std::pair<std::uint32_t, std::uint32_t>>> trips;
+		std::vector<std::vector<std::uint32_t>>								routes;
+		std::atomic<std::uint32_t>											next {0};
+	};
+
+	auto elapsed_us(const clock::time_point start) -> long {
+		return static_cast<long>(
+			std::chrono::duration_cast<std::chrono::microseconds>(clock::now() - start).count());
+	}
+} // namespace
+
+auto main(int argc, char** argv) -> int {
+	auto argv_parser = argparse::ArgumentParser("random-trips", "0.1.0");
+	argv_parser.add_argument("net-file").help("The SUMO network, a .net.xml file");
+	argv_parser.add_argument("-o", "--output")
+		.help("The route file to write, defaults to the network with .rou.xml instead of .net.xml");
+	argv_parser.add_argument("-b", "--begin").default_value(0.0).scan<'g', double>();
+	argv_parser.add_argument("-e", "--end").default_value(100'000.0).scan<'g', double>();
+	argv_parser.add_argument("-p", "--period")
+		.help("Seconds between two departures")
+		.default_value(1.0)
+		.scan<'g', double>();
+	argv_parser.add_argument("--seed").default_value(42).scan<'i', int>();
+	argv_parser.add_argument("-l", "--length")
+		.help("Weight edges by their length")
+		.default_value(false)
+		.implicit_value(true);
+	argv_parser.add_argument("-L", "--lanes")
+		.help("Weight edges by their number of lanes")
+		.default_value(false)
+		.implicit_value(true);
+	argv_parser.add_argument("--vclass").default_value(std::string("passenger"));
+	argv_parser.add_argument("--min-distance")
+		.help("Least straight line distance between the start and end of a trip, in meters")
+		.default_value(0.0)
+		.scan<'g', double>();
+	argv_parser.add_argument("--max-tries")
+		.help("Draws per trip to find edges --min-distance apart before it is dropped")
+		.default_value(100)
+		.scan<'i', int>();
+	argv_parser.add_argument("--threads")
+		.help("Routing threads, 0 uses all but one hardware thread")
+		.default_value(0)
+		.scan<'i', int>();
+	argv_parser.add_argument("--batch")
+		.help("Trips routed before their routes are written")
+		.default_value(16'384)
+		.scan<'i', int>();
+
+	try {
+		argv_parser.parse_args(argc, argv);
+	} catch (const std::exception& err) {
+		spdlog::error("{}", err.what());
+		std::cerr << argv_parser;
+		return 2;
+	}
+
+	const auto net_file = std::filesystem::path(argv_parser.get<std::string>("net-file"));
+	const auto output = [&] {
+		if (const auto path = argv_parser.present("--output")) {
+			return std::filesystem::path(*path);
+		}
+		auto name = net_file.filename().string();
+		if (name.ends_with(".net.xml")) {
+			name.resize(name.size() - std::string_view(".net.xml").size());
+		}
+		return net_file.parent_path() / (name + ".rou.xml");
+	}();
+	const auto begin = argv_parser.get<double>("--begin");
+	const auto end = argv_parser.get<double>("--end");
+	const auto period = argv_parser.get<double>("--period");
+	if (! (period > 0.0)) {
+		spdlog::error("--period must be positive");
+		return 2;
+	}
+	const auto requested_threads = argv_parser.get<int>("--threads");
+	const auto num_threads =
+		requested_threads > 0 ? static_cast<unsigned>(requested_threads)
+							  : std::max(std::thread::hardware_concurrency(), 2u) - 1;
+	const auto batch_size = static_cast<std::size_t>(std::max(1, argv_parser.get<int>("--batch")));
+
+	const auto read_start = clock::now();
+	const auto network = read_road_network(net_file, argv_parser.get<std::string>("--vclass"));
+	if (! network) {
+		spdlog::error("Failed to read {}: {}", net_file.string(),
+					  format_read_road_network_error(network.error()));
+		return 1;
+	}
+	spdlog::info("Read {} edges and {} connections between them from {} in {}",
+				 network->num_edges(), network->successors.size(), net_file.string(),
+				 humantime(elapsed_us(read_start)));
+
+	auto writer = RouteFileWriter::create(output, *network, "random-trips");
+	if (! writer) {
+		spdlog::error("Failed to write {}: {}", output.string(),
+					  format_write_routes_error(writer.error()));
+		return 1;
+	}
+
+	const auto weighting = TripWeighting {
+		.length = argv_parser.get<bool>("--length"),
+		.lanes = argv_parser.get<bool>("--lanes"),
+	};
+	const auto sampler = TripSampler(*network, weighting, argv_parser.get<double>("--min-distance"),
+									 argv_parser.get<int>("--max-tries"));
+	auto	   rng = std::mt19937_64(static_cast<std::uint64_t>(argv_parser.get<int>("--seed")));
+	const auto num_trips =
+		end > begin ? static_cast<std::uint64_t>(std::ceil((end - begin) / period)) : 0;
+
+	auto routers = std::vector<Router> {};
+	for (unsigned idx = 0; idx < num_threads; ++idx) {
+		routers.emplace_back(*network);
+	}
+	auto pool = WorkStealingPool(num_threads);
+
+	// Two batches, one routed by the pool while the other is written. The tasks are built once,
+	// task i routes trips of the batch with router i until none are left.
+	auto batches = std::array<Batch, 2> {};
+	auto route_tasks = std::array<std::function<void(std::uint32_t)>, 2> {};
+	for (std::size_t slot = 0; slot < batches.size(); ++slot) {
+		route_tasks[slot] = [&, slot](const std::uint32_t worker) {
+			auto&	   batch = batches[slot];
+			auto&	   router = routers[worker];
+			const auto size = static_cast<std::uint32_t>(batch.trips.size());
+			for (auto first = batch.next.fetch_add(trips_per_claim, std::memory_order_relaxed);
+				 first < size;
+				 first = batch.next.fetch_add(trips_per_claim, std::memory_order_relaxed)) {
+				for (auto idx = first; idx < std::min(first + trips_per_claim, size); ++idx) {
+					if (const auto& trip = batch.trips[idx]) {
+						(void)router.route(trip->first, trip->second, batch.routes[idx]);
+					} else {
+						batch.routes[idx].clear();
+					}
+				}
+			}
+		};
+	}
+
+	std::uint64_t next_id = 0;
+	const auto	  draw_batch = [&](Batch& batch) {
+		batch.first_id = next_id;
+		const auto size = std::min<std::uint64_t>(batch_size, num_trips - next_id);
+		batch.trips.clear();
+		for (std::uint64_t idx = 0; idx < size; ++idx) {
+			batch.trips.push_back(sampler.sample(rng));
+		}
+		batch.routes.resize(batch.trips.size());
+		batch.next.store(0, std::memory_order_relaxed);
+		next_id += size;
+	};
+
+	const auto	  route_start = clock::now();
+	std::uint64_t done = 0;
+	std::uint64_t vehicles = 0;
+	std::size_t	  slot = 0;
+	if (num_trips > 0) {
+		draw_batch(batches[slot]);
+		pool.start(num_threads, route_tasks[slot]);
+	}
+	while (done < next_id) {
+		pool.wait();
+		const auto& batch = batches[slot];
+		if (next_id < num_trips) {
+			slot = 1 - slot;
+			draw_batch(batches[slot]);
+			pool.start(num_threads, route_tasks[slot]);
+		}
+		for (std::size_t idx = 0; idx < batch.routes.size(); ++idx) {
+			if (batch.routes[idx].empty()) {
+				continue;
+			}
+			const auto id = batch.first_id + idx;
+			writer->vehicle(id, begin + static_cast<double>(id) * period, batch.routes[idx]);
+			vehicles++;
+		}
+		done += batch.routes.size();
+	}
+	if (const auto closed = writer->close(); ! closed) {
+		spdlog::error("Failed to write {}: {}", output.string(),
+					  format_write_routes_error(closed.error()));
+		return 1;
+	}
+	spdlog::info("Routed {} trips on {} threads in {}, wrote {} vehicles to {}, dropped {} trips "
+				 "without a route",
+				 num_trips, num_threads, humantime(elapsed_us(route_start)), vehicles,
+				 output.string(), num_trips - vehicles);
+	return 0;
+}
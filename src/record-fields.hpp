@@ -0,0 +1,70 @@
+#pragma once
+
+#include <cstdint>
+#include <string_view>
+#include <tuple>
+#include <type_traits>
+
+// Compile time descriptions of the fields of the records sent to subscribers, so every wire
+// format is generated from one list per record instead of an encoder per record and format:
+//
+//   template <>
+//   struct RecordFields<Car> {
+//       static constexpr auto fields = std::tuple(field("x", &Car::x), field("y", &Car::y));
+//   };
+//
+// `encode_record(writer, car)` then writes the fields in that order with any of the writers
+// (`CborWriter`, `MsgpackWriter`, `JsonWriter`, `PackedWriter`). Adding a field is one line in
+// the list, adding a format is one writer.
+
+template <typename T, typename Member>
+struct Field {
+	std::string_view name;
+	Member T::*		 member;
+};
+
+template <typename T, typename Member>
+constexpr auto field(const std::string_view name, Member T::*member) -> Field<T, Member> {
+	return {name, member};
+}
+
+template <typename T>
+struct RecordFields;
+
+template <typename T>
+concept Record = requires { RecordFields<T>::fields; };
+
+template <typename Writer, typename V>
+auto write_value(Writer& writer, const V& value) -> void;
+
+// Writes `record` as a record with a field per entry of `RecordFields<T>::fields`. Self
+// describing formats write it as a map from field names to values.
+template <typename Writer, Record T>
+auto encode_record(Writer& writer, const T& record) -> void {
+	constexpr auto& fields = RecordFields<T>::fields;
+	writer.record(std::tuple_size_v<std::remove_cvref_t<decltype(fields)>>);
+	std::apply(
+		[&](const auto&... field) {
+			((writer.field_name(field.name), write_value(writer, record.*(field.member))), ...);
+		},
+		fields);
+}
+
+// Writes a single value. Writers with a `native` overload for the type (e.g. the packed format,
+// which keeps the width of every field) get it as is, the others get it widened.
+template <typename Writer, typename V>
+auto write_value(Writer& writer, const V& value) -> void {
+	if constexpr (requires { writer.native(value); }) {
+		writer.native(value);
+	} else if constexpr (std::is_same_v<V, bool>) {
+		writer.boolean(value);
+	} else if constexpr (std::is_integral_v<V>) {
+		writer.integer(static_cast<std::int64_t>(value));
+	} else if constexpr (std::is_floating_point_v<V>) {
+		writer.floating(static_cast<double>(value));
+	} else if constexpr (std::is_convertible_v<const V&, std::string_view>) {
+		writer.text(value);
+	} else {
+		encode_record(writer, value);
+	}
+}
@@ -1,8 +1,12 @@
 #pragma once
 
 #include <array>
+#include <atomic>
+#include <cstdint>
 #include <optional>
 #include <iostream>
+#include <stdexcept>
+#include <utility>
 // #include <vector>
 
 // template <typename T, std::size_t N, class Container = std::array<T, N>>
@@ -28,14 +32,14 @@ class RingBuffer {
     }
     auto pop_back() -> bool {
         if (!this->empty()) {
-            this->tail = (this->tail - 1) % N;
+            this->tail = (this->tail + N - 1) % N;
             this->num_items--;
             return true;
         }
         return false;
     }
 
-    auto back() const -> std::optional<T> { return !this->empty() ? std::optional<T>{this->buffer[this->tail - 1]} : std::nullopt; }
+    auto back() const -> std::optional<T> { return !this->empty() ? std::optional<T>{this->buffer[(this->tail + N - 1) % N]} : std::nullopt; }
 	auto front() const -> std::optional<T> { return !this->empty() ? std::optional<T>{this->buffer[this->head]} : std::nullopt; }
     auto full() const -> bool { return this->num_items == N; }
     auto empty() const -> bool { return this->num_items == 0; }
@@ -61,3 +65,250 @@ class RingBuffer {
 	std::size_t		 tail = 0;
 	std::size_t		 num_items = 0;
 };
+
+
+// Size of a cache line, used to keep data written by different threads on different lines.
+// (std::hardware_destructive_interference_size makes GCC warn when used in a header.)
+inline constexpr std::size_t cache_line_size = 64;
+
+// Lock-free single-producer/multi-consumer broadcast ring. The producer publishes items in
+// place, and every consumer reads all of them at its own pace. The producer never waits for
+// consumers: a consumer that falls more than N items behind skips the items that were
+// overwritten, and the number of skipped items is counted as its overruns.
+//
+// Items live in a pool of N + MaxConsumers + 1 buffers. The ring slots hold (sequence number,
+// buffer) pairs, and a consumer pins a buffer while it reads it, so the producer never writes to
+// a buffer that is being read. As each consumer pins at most one buffer at a time, there is
+// always a buffer that is neither in the ring nor pinned for the producer to write to.
+// The producer reuses buffers, so `T` holding e.g. vectors does not allocate in steady state.
+template <typename T, std::size_t N, std::size_t MaxConsumers = 8>
+class SpmcRing {
+	static_assert(N > 0);
+	static constexpr std::size_t num_buffers = N + MaxConsumers + 1;
+	static_assert(num_buffers < (1 << 16));
+
+  public:
+	class Consumer;
+
+	// Writes the next item in place with `fill(T&)` and publishes it. Returns its sequence number.
+	// Must only be called from one thread at a time.
+	template <typename F>
+	auto publish(F&& fill) -> std::uint64_t {
+		const auto seq = this->next_seq;
+		auto&	   slot = this->slots[seq % N];
+
+		std::size_t buffer = 0;
+		while (this->buffer_in_ring[buffer] ||
+			   this->buffers[buffer].pins.load(std::memory_order_seq_cst) != 0) {
+			buffer = (buffer + 1) % num_buffers;
+		}
+		fill(this->buffers[buffer].value);
+
+		if (seq >= N) {
+			this->buffer_in_ring[unpack_buffer(slot.entry.load(std::memory_order_relaxed))] = false;
+		}
+		slot.entry.store(pack(seq, buffer), std::memory_order_seq_cst);
+		this->buffer_in_ring[buffer] = true;
+
+		this->next_seq = seq + 1;
+		this->published.store(seq + 1, std::memory_order_seq_cst);
+		this->published.notify_all();
+		return seq;
+	}
+
+	// Wakes up all waiting consumers. They still get to read what was published before.
+	// Nothing can be published after closing.
+	auto close() -> void {
+		this->published.fetch_or(closed_bit, std::memory_order_seq_cst);
+		this->published.notify_all();
+	}
+
+	auto num_published() const -> std::uint64_t {
+		return this->published.load(std::memory_order_acquire) & ~closed_bit;
+	}
+
+	// Number of items consumer `idx` has skipped, because it fell too far behind
+	auto overruns(const std::size_t idx) const -> std::uint64_t {
+		return this->consumers[idx].overruns.load(std::memory_order_relaxed);
+	}
+	auto consumer_active(const std::size_t idx) const -> bool {
+		return this->consumers[idx].active.load(std::memory_order_relaxed);
+	}
+	static constexpr auto max_consumers() -> std::size_t { return MaxConsumers; }
+
+	// New consumer, which starts reading at the next item published.
+	// Throws std::length_error if there are already MaxConsumers consumers.
+	auto subscribe() -> Consumer {
+		for (std::size_t idx = 0; idx < MaxConsumers; ++idx) {
+			bool expected = false;
+			if (this->consumers[idx].active.compare_exchange_strong(expected, true)) {
+				this->consumers[idx].overruns.store(0, std::memory_order_relaxed);
+				return Consumer(*this, idx, this->num_published());
+			}
+		}
+		throw std::length_error("SpmcRing: too many consumers");
+	}
+
+	class Consumer {
+	  public:
+		Consumer(const Consumer&) = delete;
+		auto operator=(const Consumer&) -> Consumer& = delete;
+		Consumer(Consumer&& other) noexcept
+			: ring(std::exchange(other.ring, nullptr)), idx(other.idx), next(other.next) { }
+		~Consumer() {
+			if (this->ring != nullptr) {
+				this->ring->consumers[this->idx].active.store(false, std::memory_order_release);
+			}
+		}
+
+		// Calls `visit(const T&)` with the next unread item. Returns false if there is none.
+		template <typename F>
+		auto try_read(F&& visit) -> bool {
+			while (true) {
+				const auto published = this->ring->num_published();
+				if (this->next >= published) {
+					return false;
+				}
+				if (published - this->next > N) {
+					this->skip_to(published - N);
+				}
+				if (this->try_visit(this->next, visit)) {
+					this->next++;
+					return true;
+				}
+				// Overwritten while we were looking at it
+				this->skip_to(this->next + 1);
+			}
+		}
+
+		// Calls `visit(const T&)` with the most recent item, if it has not been read yet. Items
+		// before it are skipped on purpose, so they do not count as overruns. For consumers that
+		// only care about the latest state.
+		template <typename F>
+		auto try_read_latest(F&& visit) -> bool {
+			while (true) {
+				const auto published = this->ring->num_published();
+				if (this->next >= published) {
+					return false;
+				}
+				if (this->try_visit(published - 1, visit)) {
+					this->next = published;
+					return true;
+				}
+			}
+		}
+
+		// Calls `visit(const T&)` with the most recent item, even if it has been read already,
+		// without changing which items are unread. Returns false if nothing was published yet.
+		// The ring keeps the latest item, so it doubles as a last value cache, e.g. to send the
+		// current state to a subscriber that just joined.
+		template <typename F>
+		auto read_newest(F&& visit) const -> bool {
+			while (true) {
+				const auto published = this->ring->num_published();
+				if (published == 0) {
+					return false;
+				}
+				if (this->try_visit(published - 1, visit)) {
+					return true;
+				}
+			}
+		}
+
+		// Blocks until there is an unread item, or the ring is closed and everything is read.
+		// Returns false in the latter case.
+		auto wait() const -> bool {
+			while (true) {
+				const auto published = this->ring->published.load(std::memory_order_acquire);
+				if ((published & ~closed_bit) > this->next) {
+					return true;
+				}
+				if (published & closed_bit) {
+					return false;
+				}
+				this->ring->published.wait(published, std::memory_order_acquire);
+			}
+		}
+
+		auto closed() const -> bool {
+			return this->ring->published.load(std::memory_order_acquire) & closed_bit;
+		}
+		// Sequence number of the next item this consumer reads
+		auto position() const -> std::uint64_t { return this->next; }
+		auto index() const -> std::size_t { return this->idx; }
+		auto overruns() const -> std::uint64_t { return this->ring->overruns(this->idx); }
+
+	  private:
+		friend class SpmcRing;
+		Consumer(SpmcRing& ring, const std::size_t idx, const std::uint64_t next)
+			: ring(&ring), idx(idx), next(next) { }
+
+		auto skip_to(const std::uint64_t seq) -> void {
+			this->ring->consumers[this->idx].overruns.fetch_add(seq - this->next,
+																std::memory_order_relaxed);
+			this->next = seq;
+		}
+
+		template <typename F>
+		auto try_visit(const std::uint64_t seq, F& visit) const -> bool {
+			auto&	   slot = this->ring->slots[seq % N];
+			const auto entry = slot.entry.load(std::memory_order_seq_cst);
+			if (unpack_seq(entry) != seq) {
+				return false;
+			}
+			auto& buffer = this->ring->buffers[unpack_buffer(entry)];
+			buffer.pins.fetch_add(1, std::memory_order_seq_cst);
+			// The producer only writes to buffers that are not in the ring. If the slot still
+			// holds the buffer after pinning it, the producer will leave it alone until unpinned.
+			const bool still_there = slot.entry.load(std::memory_order_seq_cst) == entry;
+			if (still_there) {
+				visit(static_cast<const T&>(buffer.value));
+			}
+			buffer.pins.fetch_sub(1, std::memory_order_release);
+			return still_there;
+		}
+
+		SpmcRing*	  ring;
+		std::size_t	  idx;
+		std::uint64_t next;
+	};
+
+  private:
+	static constexpr std::uint64_t closed_bit = std::uint64_t {1} << 63;
+	static constexpr std::uint64_t empty_entry = ~std::uint64_t {0};
+
+	static constexpr auto pack(const std::uint64_t seq, const std::size_t buffer)
+		-> std::uint64_t {
+		return (seq << 16) | buffer;
+	}
+	static constexpr auto unpack_seq(const std::uint64_t entry) -> std::uint64_t {
+		return entry >> 16;
+	}
+	static constexpr auto unpack_buffer(const std::uint64_t entry) -> std::size_t {
+		return entry & 0xFFFF;
+	}
+
+	struct alignas(cache_line_size) Buffer {
+		std::atomic<std::uint32_t> pins = 0;
+		T						   value {};
+	};
+
+	struct alignas(cache_line_size) Slot {
+		std::atomic<std::uint64_t> entry = empty_entry;
+	};
+
+	struct alignas(cache_line_size) ConsumerState {
+		std::atomic<bool>		   active = false;
+		std::atomic<std::uint64_t> overruns = 0;
+	};
+
+	// Written by the producer, read by the consumers. The top bit is set when closed.
+	alignas(cache_line_size) std::atomic<std::uint64_t> published = 0;
+	std::array<Slot, N>						slots {};
+	std::array<Buffer, num_buffers>			buffers {};
+	std::array<ConsumerState, MaxConsumers> consumers {};
+
+	// Only touched by the producer
+	alignas(cache_line_size) std::uint64_t next_seq = 0;
+	std::array<bool, num_buffers> buffer_in_ring {};
+};
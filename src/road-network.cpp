@@ -0,0 +1,345 @@
+#include "road-network.hpp"
+
+#include <algorithm>
+#include <functional>
+
+#include <parallel_hashmap/phmap.h>
+#include <fmt/format.h>
+#include <pugixml.hpp>
+
+auto format_read_road_network_error(const read_road_network_error err) -> std::string_view {
+	switch (err) {
+		case read_road_network_error::file_not_found:
+			return "file not found";
+		case read_road_network_error::xml_parse_error:
+			return "failed to parse the XML";
+		case read_road_network_error::no_edges:
+			return "no edges the vehicle class may use";
+	}
+	return "unknown error";
+}
+
+namespace {
+	// Whether `list`, space separated vehicle classes like SUMO's allow and disallow attributes,
+	// names `vehicle_class`
+	auto names_class(std::string_view list, const std::string_view vehicle_class) -> bool {
+		while (! list.empty()) {
+			const auto end = std::min(list.find(' '), list.size());
+			const auto name = list.substr(0, end);
+			if (name == vehicle_class || name == "all") {
+				return true;
+			}
+			list.remove_prefix(std::min(end + 1, list.size()));
+		}
+		return false;
+	}
+
+	auto lane_allows(const pugi::xml_node lane, const std::string_view vehicle_class) -> bool {
+		if (const auto allow = lane.attribute("allow")) {
+			return names_class(allow.value(), vehicle_class);
+		}
+		if (const auto disallow = lane.attribute("disallow")) {
+			return ! names_class(disallow.value(), vehicle_class);
+		}
+		return true;
+	}
+
+	auto from_document(const pugi::xml_document& doc, const std::string_view vehicle_class)
+		-> tl::expected<RoadNetwork, read_road_network_error> {
+		const auto net = doc.child("net");
+
+		auto junctions = phmap::flat_hash_map<std::string, RoadNetwork::Position> {};
+		for (const auto junction : net.children("junction")) {
+			if (std::string_view(junction.attribute("type").value()) == "internal") {
+				continue;
+			}
+			junctions.emplace(junction.attribute("id").value(),
+							  RoadNetwork::Position {junction.attribute("x").as_float(),
+													 junction.attribute("y").as_float()});
+		}
+		const auto position_of = [&](const pugi::xml_attribute id) {
+			const auto it = junctions.find(std::string_view(id.value()));
+			return it != junctions.end() ? it->second : RoadNetwork::Position {};
+		};
+
+		auto network = RoadNetwork {};
+		auto edge_index = phmap::flat_hash_map<std::string, std::uint32_t> {};
+		// Bit i is set if lane i of the edge allows the vehicle class
+		auto allowed_lanes = std::vector<std::uint64_t> {};
+		for (const auto edge : net.children("edge")) {
+			// Only normal edges, not the internal ones, crossings and walking areas of junctions
+			if (edge.attribute("function")) {
+				continue;
+			}
+			std::uint64_t lanes = 0;
+			std::uint32_t lane_count = 0;
+			auto		  length = 0.0f;
+			auto		  speed = 0.0f;
+			for (const auto lane : edge.children("lane")) {
+				lane_count++;
+				const auto index = lane.attribute("index").as_uint();
+				if (index == 0) {
+					length = lane.attribute("length").as_float();
+				}
+				if (index < 64 && lane_allows(lane, vehicle_class)) {
+					lanes |= std::uint64_t {1} << index;
+					speed = std::max(speed, lane.attribute("speed").as_float());
+				}
+			}
+			if (lanes == 0 || speed <= 0.0f) {
+				continue;
+			}
+			edge_index.emplace(edge.attribute("id").value(), network.num_edges());
+			network.edge_ids.emplace_back(edge.attribute("id").value());
+			network.lengths.push_back(length);
+			network.lane_counts.push_back(lane_count);
+			network.travel_times.push_back(length / speed);
+			network.starts.push_back(position_of(edge.attribute("from")));
+			network.ends.push_back(position_of(edge.attribute("to")));
+			allowed_lanes.push_back(lanes);
+		}
+		if (network.edge_ids.empty()) {
+			return tl::make_unexpected(read_road_network_error::no_edges);
+		}
+
+		const auto lane_allowed = [&](const std::uint32_t edge, const unsigned lane) {
+			return lane < 64 && (allowed_lanes[edge] >> lane & 1) != 0;
+		};
+		auto links = std::vector<std::pair<std::uint32_t, std::uint32_t>> {};
+		const auto index_of = [&](const pugi::xml_attribute id) {
+			return edge_index.find(std::string_view(id.value()));
+		};
+		for (const auto connection : net.children("connection")) {
+			const auto from = index_of(connection.attribute("from"));
+			const auto to = index_of(connection.attribute("to"));
+			if (from == edge_index.end() || to == edge_index.end() ||
+				! lane_allowed(from->second, connection.attribute("fromLane").as_uint()) ||
+				! lane_allowed(to->second, connection.attribute("toLane").as_uint())) {
+				continue;
+			}
+			links.emplace_back(from->second, to->second);
+		}
+		// One link per pair of edges, however many lanes connect them
+		std::sort(links.begin(), links.end());
+		links.erase(std::unique(links.begin(), links.end()), links.end());
+
+		network.successor_offsets.assign(network.num_edges() + 1, 0);
+		network.successors.reserve(links.size());
+		for (const auto& [from, to] : links) {
+			network.successor_offsets[from + 1]++;
+			network.successors.push_back(to);
+		}
+		for (std::uint32_t edge = 0; edge < network.num_edges(); ++edge) {
+			network.successor_offsets[edge + 1] += network.successor_offsets[edge];
+		}
+		return network;
+	}
+} // namespace
+
+auto read_road_network(const std::filesystem::path& net_file, const std::string_view vehicle_class)
+	-> tl::expected<RoadNetwork, read_road_network_error> {
+	if (! std::filesystem::exists(net_file)) {
+		return tl::make_unexpected(read_road_network_error::file_not_found);
+	}
+	pugi::xml_document doc;
+	if (! doc.load_file(net_file.c_str())) {
+		return tl::make_unexpected(read_road_network_error::xml_parse_error);
+	}
+	return from_document(doc, vehicle_class);
+}
+
+auto parse_road_network(const std::string_view xml, const std::string_view vehicle_class)
+	-> tl::expected<RoadNetwork, read_road_network_error> {
+	pugi::xml_document doc;
+	if (! doc.load_buffer(xml.data(), xml.size())) {
+		return tl::make_unexpected(read_road_network_error::xml_parse_error);
+	}
+	return from_document(doc, vehicle_class);
+}
+
+Router::Router(const RoadNetwork& network)
+	: network(network), times(network.num_edges()), previous(network.num_edges()),
+	  reached_in(network.num_edges(), 0) {
+	heap.reserve(network.num_edges());
+}
+
+auto Router::route(const std::uint32_t from, const std::uint32_t to,
+				   std::vector<std::uint32_t>& route) -> bool {
+	route.clear();
+	// Stamps instead of clearing every edge for every search, wrapping around after 4 billion
+	if (++search == 0) {
+		std::fill(reached_in.begin(), reached_in.end(), 0);
+		search = 1;
+	}
+	heap.clear();
+
+	const auto reach = [&](const std::uint32_t edge, const float time, const std::uint32_t before) {
+		if (reached_in[edge] == search && times[edge] <= time) {
+			return;
+		}
+		reached_in[edge] = search;
+		times[edge] = time;
+		previous[edge] = before;
+		heap.push_back({time, edge});
+		std::push_heap(heap.begin(), heap.end(), std::greater<> {});
+	};
+	reach(from, network.travel_times[from], from);
+
+	while (! heap.empty()) {
+		std::pop_heap(heap.begin(), heap.end(), std::greater<> {});
+		const auto [time, edge] = heap.back();
+		heap.pop_back();
+		// Edges are pushed again when a faster way to them is found, the older entries are stale
+		if (time > times[edge]) {
+			continue;
+		}
+		if (edge == to) {
+			for (auto at = to; at != from; at = previous[at]) {
+				route.push_back(at);
+			}
+			route.push_back(from);
+			std::reverse(route.begin(), route.end());
+			return true;
+		}
+		for (const auto next : network.successors_of(edge)) {
+			reach(next, time + network.travel_times[next], edge);
+		}
+	}
+	return false;
+}
+
+TripSampler::TripSampler(const RoadNetwork& network, const TripWeighting weighting,
+						 const double min_distance, const int max_tries)
+	: network(network), min_distance_squared(min_distance * min_distance),
+	  max_tries(std::max(max_tries, 1)) {
+	const auto weight = [&](const std::uint32_t edge) {
+		auto result = 1.0;
+		if (weighting.length) {
+			result *= std::max(network.lengths[edge], 0.0f);
+		}
+		if (weighting.lanes) {
+			result *= network.lane_counts[edge];
+		}
+		return result;
+	};
+	cumulative_weights.reserve(network.num_edges());
+	auto sum = 0.0;
+	for (std::uint32_t edge = 0; edge < network.num_edges(); ++edge) {
+		sum += weight(edge);
+		cumulative_weights.push_back(sum);
+	}
+	// Only edges of length 0, draw them all alike instead of from an empty range
+	if (sum <= 0.0) {
+		for (std::uint32_t edge = 0; edge < network.num_edges(); ++edge) {
+			cumulative_weights[edge] = edge + 1.0;
+		}
+	}
+}
+
+auto TripSampler::edge(std::mt19937_64& rng) const -> std::uint32_t {
+	const auto total = cumulative_weights.back();
+	const auto at = std::uniform_real_distribution<double>(0.0, total)(rng);
+	const auto it = std::upper_bound(cumulative_weights.begin(), cumulative_weights.end(), at);
+	return static_cast<std::uint32_t>(
+		std::min<std::ptrdiff_t>(it - cumulative_weights.begin(), cumulative_weights.size() - 1));
+}
+
+auto TripSampler::sample(std::mt19937_64& rng) const
+	-> std::optional<std::pair<std::uint32_t, std::uint32_t>> {
+	for (int attempt = 0; attempt < max_tries; ++attempt) {
+		const auto from = this->edge(rng);
+		const auto to = this->edge(rng);
+		if (from == to) {
+			continue;
+		}
+		const auto dx = static_cast<double>(network.ends[to].x) - network.starts[from].x;
+		const auto dy = static_cast<double>(network.ends[to].y) - network.starts[from].y;
+		if (dx * dx + dy * dy >= min_distance_squared) {
+			return std::pair(from, to);
+		}
+	}
+	return std::nullopt;
+}
+
+auto format_write_routes_error(const write_routes_error err) -> std::string_view {
+	switch (err) {
+		case write_routes_error::open_failed:
+			return "failed to open the route file";
+		case write_routes_error::write_failed:
+			return "failed to write the route file";
+	}
+	return "unknown error";
+}
+
+namespace {
+	auto escape_xml(const std::string_view text) -> std::string {
+		auto escaped = std::string {};
+		for (const auto c : text) {
+			if (c == '&') {
+				escaped += "&amp;";
+			} else if (c == '<') {
+				escaped += "&lt;";
+			} else if (c == '>') {
+				escaped += "&gt;";
+			} else if (c == '"') {
+				escaped += "&quot;";
+			} else {
+				escaped += c;
+			}
+		}
+		return escaped;
+	}
+} // namespace
+
+auto RouteFileWriter::create(const std::filesystem::path& path, const RoadNetwork& network,
+							 const std::string_view generator)
+	-> tl::expected<RouteFileWriter, write_routes_error> {
+	auto writer = RouteFileWriter {};
+	writer.out.open(path, std::ios::binary | std::ios::trunc);
+	if (! writer.out) {
+		return tl::make_unexpected(write_routes_error::open_failed);
+	}
+	writer.escaped_ids.reserve(network.num_edges());
+	for (const auto& id : network.edge_ids) {
+		writer.escaped_ids.push_back(escape_xml(id));
+	}
+	writer.buffer.reserve(flush_bytes + 64 * 1024);
+	fmt::format_to(std::back_inserter(writer.buffer),
+				   "<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n\n<!-- generated by {} -->\n\n"
+				   "<routes xmlns:xsi=\"http://www.w3.org/2001/XMLSchema-instance\" "
+				   "xsi:noNamespaceSchemaLocation=\"http://sumo.dlr.de/xsd/routes_file.xsd\">\n",
+				   escape_xml(generator));
+	return writer;
+}
+
+auto RouteFileWriter::vehicle(const std::uint64_t id, const double depart,
+							  const std::span<const std::uint32_t> route) -> void {
+	fmt::format_to(std::back_inserter(buffer),
+				   "    <vehicle id=\"{}\" depart=\"{:.2f}\">\n        <route edges=\"", id,
+				   depart);
+	for (std::size_t idx = 0; idx < route.size(); ++idx) {
+		if (idx > 0) {
+			buffer += ' ';
+		}
+		buffer += escaped_ids[route[idx]];
+	}
+	buffer += "\"/>\n    </vehicle>\n";
+	if (buffer.size() >= flush_bytes) {
+		this->flush();
+	}
+}
+
+auto RouteFileWriter::flush() -> void {
+	out.write(buffer.data(), static_cast<std::streamsize>(buffer.size()));
+	buffer.clear();
+}
+
+auto RouteFileWriter::close() -> tl::expected<void, write_routes_error> {
+	buffer += "</routes>\n";
+	this->flush();
+	out.close();
+	if (! out) {
+		return tl::make_unexpected(write_routes_error::write_failed);
+	}
+	return {};
+}
@@ -0,0 +1,156 @@
+#pragma once
+
+#include <cstdint>
+#include <filesystem>
+#include <fstream>
+#include <optional>
+#include <random>
+#include <span>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+#include <tl/expected.hpp>
+
+// The roads of a SUMO .net.xml that one vehicle class may drive on, as a compact graph for
+// generating and routing random trips without SUMO's Python tools. Nodes are the edges of the
+// network, indexed in the order they appear in the file, and an edge is connected to another if
+// a lane of the first has a `<connection>` to a lane of the second that the vehicle class may use.
+// Internal edges of junctions are left out, their time is not counted.
+struct RoadNetwork {
+	struct Position {
+		float x = 0.0f;
+		float y = 0.0f;
+	};
+
+	std::vector<std::string> edge_ids;
+	std::vector<float>		 lengths;	   // Of the first lane, in meters
+	std::vector<float>		 travel_times; // Length over the speed of the fastest lane, in s
+	std::vector<Position>	 starts;	   // Of the junction the edge leaves
+	std::vector<Position>	 ends;		   // Of the junction the edge goes to
+	// All lanes of an edge, also the ones the vehicle class may not use, like SUMO's lane number
+	std::vector<std::uint32_t> lane_counts;
+	// Edges reachable from edge i are successors[successor_offsets[i], successor_offsets[i + 1])
+	std::vector<std::uint32_t> successor_offsets;
+	std::vector<std::uint32_t> successors;
+
+	[[nodiscard]] auto num_edges() const -> std::uint32_t {
+		return static_cast<std::uint32_t>(edge_ids.size());
+	}
+	[[nodiscard]] auto successors_of(const std::uint32_t edge) const
+		-> std::span<const std::uint32_t> {
+		const auto begin = successor_offsets[edge];
+		return std::span(successors).subspan(begin, successor_offsets[edge + 1] - begin);
+	}
+};
+
+enum class read_road_network_error {
+	file_not_found,
+	xml_parse_error,
+	no_edges,
+};
+
+[[nodiscard]] auto format_read_road_network_error(read_road_network_error err) -> std::string_view;
+
+// Reads the edges and connections `vehicle_class` (e.g. "passenger") may use from a .net.xml
+[[nodiscard]] auto read_road_network(const std::filesystem::path& net_file,
+									 std::string_view				vehicle_class)
+	-> tl::expected<RoadNetwork, read_road_network_error>;
+[[nodiscard]] auto parse_road_network(std::string_view xml, std::string_view vehicle_class)
+	-> tl::expected<RoadNetwork, read_road_network_error>;
+
+// Fastest routes by travel time with Dijkstra's algorithm. Everything a search needs is allocated
+// once and reused, so a router per thread routes any number of trips without allocating. Not
+// thread safe.
+class Router {
+  public:
+	explicit Router(const RoadNetwork& network);
+
+	// Replaces `route` with the fastest edges from `from` to `to`, both included. Returns false,
+	// and leaves `route` empty, if `to` can not be reached.
+	auto route(std::uint32_t from, std::uint32_t to, std::vector<std::uint32_t>& route) -> bool;
+
+  private:
+	struct Entry {
+		float		  time;
+		std::uint32_t edge;
+
+		auto operator>(const Entry& other) const -> bool { return time > other.time; }
+	};
+
+	const RoadNetwork& network;
+	// Time to the end of an edge and the edge before it, only valid if `reached_in` of the edge is
+	// the current search, so they never have to be cleared
+	std::vector<float>		   times;
+	std::vector<std::uint32_t> previous;
+	std::vector<std::uint32_t> reached_in;
+	std::uint32_t			   search = 0;
+	std::vector<Entry>		   heap;
+};
+
+// How likely an edge is drawn, like the options of SUMO's `randomTrips.py`: in proportion to its
+// length with `-l`, to its number of lanes with `-L`, to their product with both, and all edges
+// alike with neither
+struct TripWeighting {
+	bool length = false;
+	bool lanes = false;
+};
+
+// Draws the start and end edges of random trips like `randomTrips.py`: both weighted by
+// `weighting`, different from each other, and at least `min_distance` meters apart in a straight
+// line from the start of one to the end of the other.
+class TripSampler {
+  public:
+	TripSampler(const RoadNetwork& network, TripWeighting weighting, double min_distance,
+				int max_tries);
+
+	// The start and end edge of a trip, or nothing if `max_tries` draws were all too close
+	[[nodiscard]] auto sample(std::mt19937_64& rng) const
+		-> std::optional<std::pair<std::uint32_t, std::uint32_t>>;
+
+  private:
+	[[nodiscard]] auto edge(std::mt19937_64& rng) const -> std::uint32_t;
+
+	const RoadNetwork&	network;
+	std::vector<double> cumulative_weights;
+	double				min_distance_squared;
+	int					max_tries;
+};
+
+enum class write_routes_error {
+	open_failed,
+	write_failed,
+};
+
+[[nodiscard]] auto format_write_routes_error(write_routes_error err) -> std::string_view;
+
+// Streams a SUMO route file of vehicles with their routes, in the layout of the files
+// `randomTrips.py -r` writes, which the .sumocfg files of the networks load:
+//
+//   <routes ...>
+//       <vehicle id="3" depart="3.00">
+//           <route edges="-414865922#0 30096742 672680799"/>
+//       </vehicle>
+//   </routes>
+//
+// The text is built in a buffer and written in blocks of `flush_bytes`.
+class RouteFileWriter {
+  public:
+	[[nodiscard]] static auto create(const std::filesystem::path& path, const RoadNetwork& network,
+									 std::string_view generator)
+		-> tl::expected<RouteFileWriter, write_routes_error>;
+
+	auto vehicle(std::uint64_t id, double depart, std::span<const std::uint32_t> route) -> void;
+	// Ends the file and writes what is left in the buffer
+	[[nodiscard]] auto close() -> tl::expected<void, write_routes_error>;
+
+	static constexpr std::size_t flush_bytes = 1 << 20;
+
+  private:
+	auto flush() -> void;
+
+	std::ofstream			 out;
+	std::string				 buffer;
+	std::vector<std::string> escaped_ids; // Indexed like the edges of the network
+};
@@ -0,0 +1,305 @@
+#include "shm-snapshot.hpp"
+
+#include <algorithm>
+#include <cstring>
+#include <new>
+#include <utility>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#ifdef __linux__
+#include <linux/futex.h>
+#include <sys/syscall.h>
+#include <time.h>
+#else
+#include <thread>
+#endif
+
+namespace {
+	constexpr auto align_up(const std::size_t n, const std::size_t alignment) -> std::size_t {
+		return (n + alignment - 1) / alignment * alignment;
+	}
+
+	constexpr auto header_size = align_up(sizeof(ShmSnapshotHeader), 64);
+
+	auto buffer_size_for(const std::uint32_t max_cars, const std::uint32_t max_lit_streetlamps)
+		-> std::size_t {
+		return align_up(sizeof(ShmSnapshotBufferHeader) + max_cars * sizeof(ShmCar) +
+							max_lit_streetlamps * sizeof(std::int64_t),
+						64);
+	}
+
+	auto cars_of(std::byte* buffer) -> ShmCar* {
+		return reinterpret_cast<ShmCar*>(buffer + sizeof(ShmSnapshotBufferHeader));
+	}
+
+	// The futex is shared between processes, so the `_PRIVATE` variants can not be used, and
+	// neither can `std::atomic::wait`, which uses them.
+	auto futex_wake_all(std::atomic<std::uint32_t>* word) -> void {
+#ifdef __linux__
+		syscall(SYS_futex, reinterpret_cast<std::uint32_t*>(word), FUTEX_WAKE, INT32_MAX, nullptr,
+				nullptr, 0);
+#else
+		(void)word;
+#endif
+	}
+
+	auto futex_wait(const std::atomic<std::uint32_t>* word, const std::uint32_t expected,
+					const std::chrono::milliseconds timeout) -> void {
+#ifdef __linux__
+		auto ts = timespec {};
+		ts.tv_sec = timeout.count() / 1000;
+		ts.tv_nsec = (timeout.count() % 1000) * 1'000'000;
+		syscall(SYS_futex, reinterpret_cast<const std::uint32_t*>(word), FUTEX_WAIT, expected, &ts,
+				nullptr, 0);
+#else
+		(void)expected;
+		(void)word;
+		std::this_thread::sleep_for(std::min(timeout, std::chrono::milliseconds(1)));
+#endif
+	}
+} // namespace
+
+auto format_shm_snapshot_error(const shm_snapshot_error err) -> std::string_view {
+	switch (err) {
+		case shm_snapshot_error::shm_open_failed:
+			return "shm_open failed";
+		case shm_snapshot_error::resize_failed:
+			return "could not resize the shared memory segment";
+		case shm_snapshot_error::mmap_failed:
+			return "mmap failed";
+		case shm_snapshot_error::bad_magic:
+			return "not a snapshot segment";
+		case shm_snapshot_error::version_mismatch:
+			return "segment was created by a different version";
+		case shm_snapshot_error::truncated:
+			return "segment is smaller than its header says";
+	}
+	return "unknown error";
+}
+
+auto create_shm_snapshot_writer(const std::string& name, const std::uint32_t max_cars,
+								const std::uint32_t max_lit_streetlamps)
+	-> tl::expected<ShmSnapshotWriter, shm_snapshot_error> {
+	// Start over with a fresh segment, readers of an old one see it closed
+	shm_unlink(name.c_str());
+	const int fd = shm_open(name.c_str(), O_CREAT | O_EXCL | O_RDWR, 0644);
+	if (fd == -1) {
+		return tl::make_unexpected(shm_snapshot_error::shm_open_failed);
+	}
+
+	const auto buffer_size = buffer_size_for(max_cars, max_lit_streetlamps);
+	const auto size = header_size + shm_snapshot_num_buffers * buffer_size;
+	if (ftruncate(fd, static_cast<off_t>(size)) == -1) {
+		close(fd);
+		shm_unlink(name.c_str());
+		return tl::make_unexpected(shm_snapshot_error::resize_failed);
+	}
+
+	void* data = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	close(fd);
+	if (data == MAP_FAILED) {
+		shm_unlink(name.c_str());
+		return tl::make_unexpected(shm_snapshot_error::mmap_failed);
+	}
+
+	// The segment is zero filled, which is a valid state for all the atomics
+	auto* bytes = static_cast<std::byte*>(data);
+	auto* header = new (bytes) ShmSnapshotHeader {};
+	std::memcpy(header->magic, shm_snapshot_magic, sizeof(header->magic));
+	header->version = shm_snapshot_version;
+	header->max_cars = max_cars;
+	header->max_lit_streetlamps = max_lit_streetlamps;
+	header->buffer_size = static_cast<std::uint32_t>(buffer_size);
+	for (std::uint32_t idx = 0; idx < shm_snapshot_num_buffers; ++idx) {
+		new (bytes + header_size + idx * buffer_size) ShmSnapshotBufferHeader {};
+	}
+
+	return ShmSnapshotWriter(name, bytes, size);
+}
+
+ShmSnapshotWriter::ShmSnapshotWriter(ShmSnapshotWriter&& other) noexcept
+	: name_(std::move(other.name_)), data_(std::exchange(other.data_, nullptr)),
+	  size_(std::exchange(other.size_, 0)) { }
+
+auto ShmSnapshotWriter::operator=(ShmSnapshotWriter&& other) noexcept -> ShmSnapshotWriter& {
+	if (this != &other) {
+		this->~ShmSnapshotWriter();
+		name_ = std::move(other.name_);
+		data_ = std::exchange(other.data_, nullptr);
+		size_ = std::exchange(other.size_, 0);
+	}
+	return *this;
+}
+
+ShmSnapshotWriter::~ShmSnapshotWriter() {
+	if (data_ != nullptr) {
+		this->close();
+		munmap(data_, size_);
+		shm_unlink(name_.c_str());
+	}
+}
+
+auto ShmSnapshotWriter::publish(const StepSnapshot& snapshot) -> bool {
+	auto*	   header = reinterpret_cast<ShmSnapshotHeader*>(data_);
+	const auto generation = header->generation.load(std::memory_order_relaxed);
+	// The buffer that does not hold the latest snapshot, readers are only directed to it below
+	auto* bytes =
+		data_ + header_size + (generation % shm_snapshot_num_buffers) * header->buffer_size;
+	auto* buffer = reinterpret_cast<ShmSnapshotBufferHeader*>(bytes);
+
+	const auto num_cars = std::min<std::size_t>(snapshot.cars.size(), header->max_cars);
+	const auto num_lit_streetlamps =
+		std::min<std::size_t>(snapshot.lit_streetlamp_ids.size(), header->max_lit_streetlamps);
+	const bool truncated = num_cars < snapshot.cars.size() ||
+						   num_lit_streetlamps < snapshot.lit_streetlamp_ids.size();
+
+	// Seqlock: odd while writing, so a reader that raced with us sees a changed sequence
+	const auto sequence = buffer->sequence.load(std::memory_order_relaxed);
+	buffer->sequence.store(sequence + 1, std::memory_order_relaxed);
+	std::atomic_thread_fence(std::memory_order_release);
+
+	buffer->step = snapshot.step;
+	buffer->simulation_time = snapshot.simulation_time;
+	buffer->num_cars = static_cast<std::uint32_t>(num_cars);
+	buffer->num_lit_streetlamps = static_cast<std::uint32_t>(num_lit_streetlamps);
+	buffer->truncated = truncated;
+	auto* cars = cars_of(bytes);
+	for (std::size_t idx = 0; idx < num_cars; ++idx) {
+		const auto& car = snapshot.cars[idx];
+		cars[idx] = ShmCar {.handle = snapshot.car_handles[idx],
+							.x = car.x,
+							.y = car.y,
+							.heading = car.heading};
+	}
+	std::memcpy(cars + header->max_cars, snapshot.lit_streetlamp_ids.data(),
+				num_lit_streetlamps * sizeof(std::int64_t));
+
+	buffer->sequence.store(sequence + 2, std::memory_order_release);
+	header->generation.store(generation + 1, std::memory_order_release);
+
+	header->notify.fetch_add(1, std::memory_order_release);
+	futex_wake_all(&header->notify);
+	return ! truncated;
+}
+
+auto ShmSnapshotWriter::close() -> void {
+	auto* header = reinterpret_cast<ShmSnapshotHeader*>(data_);
+	header->closed.store(1, std::memory_order_release);
+	header->notify.fetch_add(1, std::memory_order_release);
+	futex_wake_all(&header->notify);
+}
+
+auto open_shm_snapshot_reader(const std::string& name)
+	-> tl::expected<ShmSnapshotReader, shm_snapshot_error> {
+	const int fd = shm_open(name.c_str(), O_RDONLY, 0);
+	if (fd == -1) {
+		return tl::make_unexpected(shm_snapshot_error::shm_open_failed);
+	}
+	struct stat st {};
+	if (fstat(fd, &st) == -1 || static_cast<std::size_t>(st.st_size) < header_size) {
+		close(fd);
+		return tl::make_unexpected(shm_snapshot_error::truncated);
+	}
+
+	const auto size = static_cast<std::size_t>(st.st_size);
+	void*	   data = mmap(nullptr, size, PROT_READ, MAP_SHARED, fd, 0);
+	close(fd);
+	if (data == MAP_FAILED) {
+		return tl::make_unexpected(shm_snapshot_error::mmap_failed);
+	}
+
+	auto		reader = ShmSnapshotReader(static_cast<const std::byte*>(data), size);
+	const auto* header = reader.header();
+	if (std::memcmp(header->magic, shm_snapshot_magic, sizeof(header->magic)) != 0) {
+		return tl::make_unexpected(shm_snapshot_error::bad_magic);
+	}
+	if (header->version != shm_snapshot_version) {
+		return tl::make_unexpected(shm_snapshot_error::version_mismatch);
+	}
+	if (header_size + shm_snapshot_num_buffers * std::size_t {header->buffer_size} > size ||
+		buffer_size_for(header->max_cars, header->max_lit_streetlamps) > header->buffer_size) {
+		return tl::make_unexpected(shm_snapshot_error::truncated);
+	}
+	return reader;
+}
+
+ShmSnapshotReader::ShmSnapshotReader(ShmSnapshotReader&& other) noexcept
+	: data_(std::exchange(other.data_, nullptr)), size_(std::exchange(other.size_, 0)) { }
+
+auto ShmSnapshotReader::operator=(ShmSnapshotReader&& other) noexcept -> ShmSnapshotReader& {
+	if (this != &other) {
+		this->~ShmSnapshotReader();
+		data_ = std::exchange(other.data_, nullptr);
+		size_ = std::exchange(other.size_, 0);
+	}
+	return *this;
+}
+
+ShmSnapshotReader::~ShmSnapshotReader() {
+	if (data_ != nullptr) {
+		munmap(const_cast<std::byte*>(data_), size_);
+	}
+}
+
+auto ShmSnapshotReader::header() const -> const ShmSnapshotHeader* {
+	return reinterpret_cast<const ShmSnapshotHeader*>(data_);
+}
+
+auto ShmSnapshotReader::buffer(const std::uint64_t idx) const -> const ShmSnapshotBufferHeader* {
+	return reinterpret_cast<const ShmSnapshotBufferHeader*>(data_ + header_size +
+															idx * this->header()->buffer_size);
+}
+
+auto ShmSnapshotReader::generation() const -> std::uint64_t {
+	return this->header()->generation.load(std::memory_order_acquire);
+}
+
+auto ShmSnapshotReader::closed() const -> bool {
+	return this->header()->closed.load(std::memory_order_acquire) != 0;
+}
+
+auto ShmSnapshotReader::view(const std::uint64_t generation,
+							 const ShmSnapshotBufferHeader* buffer) const -> ShmSnapshotView {
+	const auto* header = this->header();
+	const auto* cars = reinterpret_cast<const ShmCar*>(reinterpret_cast<const std::byte*>(buffer) +
+													   sizeof(ShmSnapshotBufferHeader));
+	const auto* lit_streetlamp_ids = reinterpret_cast<const std::int64_t*>(cars + header->max_cars);
+	// The counts can be torn while the writer is busy with the buffer. The read is retried in
+	// that case, but the spans must not point outside of the buffer in the meantime.
+	const auto num_cars = std::min(buffer->num_cars, header->max_cars);
+	const auto num_lit_streetlamps =
+		std::min(buffer->num_lit_streetlamps, header->max_lit_streetlamps);
+	return ShmSnapshotView {
+		.generation = generation,
+		.step = buffer->step,
+		.simulation_time = buffer->simulation_time,
+		.cars = {cars, num_cars},
+		.lit_streetlamp_ids = {lit_streetlamp_ids, num_lit_streetlamps},
+		.truncated = buffer->truncated != 0,
+	};
+}
+
+auto ShmSnapshotReader::wait_for_newer_than(const std::uint64_t generation,
+											const std::chrono::milliseconds timeout) const
+	-> std::uint64_t {
+	const auto* header = this->header();
+	const auto	deadline = std::chrono::steady_clock::now() + timeout;
+	while (true) {
+		// Read the futex word first, so a publish between the check and the wait is not missed
+		const auto notify = header->notify.load(std::memory_order_acquire);
+		const auto latest = this->generation();
+		if (latest > generation || this->closed()) {
+			return latest;
+		}
+		const auto now = std::chrono::steady_clock::now();
+		if (now >= deadline) {
+			return latest;
+		}
+		futex_wait(&header->notify, notify,
+				   std::chrono::ceil<std::chrono::milliseconds>(deadline - now));
+	}
+}
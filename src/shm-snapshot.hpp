@@ -0,0 +1,191 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <span>
+#include <string>
+#include <string_view>
+#include <utility>
+
+#include <tl/expected.hpp>
+
+#include "step-snapshot.hpp"
+
+// Shared memory transport for subscribers running on the same host as the publisher.
+//
+// The publisher creates a POSIX shared memory segment (`shm_open(name)`) holding two snapshot
+// buffers. Every step it writes into the buffer readers are not directed to, protected by a
+// seqlock, and then flips `generation` over to it. Readers map the segment read-only and look at
+// the snapshot in place: a read only fails, and is retried, if the writer lapped the reader by
+// two whole snapshots while it was reading. Readers that want to block until the next snapshot
+// wait on a futex in the segment. Nothing in here allocates or takes a lock after setup.
+//
+// Segment layout:
+//   ShmSnapshotHeader
+//   2 x { ShmSnapshotBufferHeader, ShmCar[max_cars], std::int64_t[max_lit_streetlamps] }
+
+inline constexpr char			 shm_snapshot_magic[8] = {'S', 'U', 'M', 'O', 'S', 'H', 'M', '\0'};
+inline constexpr std::uint32_t	 shm_snapshot_version = 2;
+inline constexpr std::uint32_t	 shm_snapshot_num_buffers = 2;
+inline constexpr std::string_view default_shm_snapshot_name = "/sumo-sim-data-publisher";
+
+// `handle` is the car's `VehicleHandle`, its SUMO id is published on the vehicle-ids topic
+struct ShmCar {
+	std::uint32_t handle;
+	std::int32_t  x;
+	std::int32_t  y;
+	double		  heading;
+};
+
+struct ShmSnapshotHeader {
+	char		  magic[8];
+	std::uint32_t version;
+	std::uint32_t max_cars;
+	std::uint32_t max_lit_streetlamps;
+	std::uint32_t buffer_size; // Bytes per buffer, including its header
+	// Set by the writer when it shuts down, readers waiting are woken up
+	alignas(64) std::atomic<std::uint32_t> closed;
+	// Number of snapshots published so far. The latest is in buffer `(generation - 1) % 2`
+	alignas(64) std::atomic<std::uint64_t> generation;
+	// Incremented on every publish. Readers block on it with a futex
+	alignas(64) std::atomic<std::uint32_t> notify;
+};
+
+struct ShmSnapshotBufferHeader {
+	// Odd while the writer is writing into the buffer
+	alignas(64) std::atomic<std::uint64_t> sequence;
+	std::uint64_t step;
+	double		  simulation_time;
+	std::uint32_t num_cars;
+	std::uint32_t num_lit_streetlamps;
+	// Set if there were more cars/lit lamps than fit in the buffer, and some were left out
+	std::uint32_t truncated;
+};
+
+static_assert(std::atomic<std::uint64_t>::is_always_lock_free);
+static_assert(std::atomic<std::uint32_t>::is_always_lock_free);
+
+// A snapshot as seen by a reader. Only valid inside the callback given to
+// `ShmSnapshotReader::read`, since the memory is reused by the writer.
+struct ShmSnapshotView {
+	std::uint64_t				  generation;
+	std::uint64_t				  step;
+	double						  simulation_time;
+	std::span<const ShmCar>		  cars;
+	std::span<const std::int64_t> lit_streetlamp_ids;
+	bool						  truncated;
+};
+
+enum class shm_snapshot_error {
+	shm_open_failed,
+	resize_failed,
+	mmap_failed,
+	bad_magic,
+	version_mismatch,
+	truncated,
+};
+
+[[nodiscard]] auto format_shm_snapshot_error(shm_snapshot_error err) -> std::string_view;
+
+class ShmSnapshotWriter;
+class ShmSnapshotReader;
+
+// Creates (or replaces) the segment `name`. It is unlinked again when the writer is destroyed.
+[[nodiscard]]
+auto create_shm_snapshot_writer(const std::string& name, std::uint32_t max_cars,
+								std::uint32_t max_lit_streetlamps)
+	-> tl::expected<ShmSnapshotWriter, shm_snapshot_error>;
+
+[[nodiscard]]
+auto open_shm_snapshot_reader(const std::string& name)
+	-> tl::expected<ShmSnapshotReader, shm_snapshot_error>;
+
+class ShmSnapshotWriter {
+  public:
+	ShmSnapshotWriter() = default;
+	ShmSnapshotWriter(const ShmSnapshotWriter&) = delete;
+	auto operator=(const ShmSnapshotWriter&) -> ShmSnapshotWriter& = delete;
+	ShmSnapshotWriter(ShmSnapshotWriter&& other) noexcept;
+	auto operator=(ShmSnapshotWriter&& other) noexcept -> ShmSnapshotWriter&;
+	~ShmSnapshotWriter();
+
+	// Copies `snapshot` into the segment and wakes up the waiting readers. Returns false if it
+	// did not fit, in which case as many cars and lamps as fit were written.
+	auto publish(const StepSnapshot& snapshot) -> bool;
+
+	// Tells the readers that no more snapshots are coming
+	auto close() -> void;
+
+	auto name() const -> const std::string& { return name_; }
+
+  private:
+	ShmSnapshotWriter(std::string name, std::byte* data, std::size_t size)
+		: name_(std::move(name)), data_(data), size_(size) { }
+
+	std::string name_;
+	std::byte*	data_ = nullptr;
+	std::size_t size_ = 0;
+
+	friend auto create_shm_snapshot_writer(const std::string& name, std::uint32_t max_cars,
+										   std::uint32_t max_lit_streetlamps)
+		-> tl::expected<ShmSnapshotWriter, shm_snapshot_error>;
+};
+
+class ShmSnapshotReader {
+  public:
+	ShmSnapshotReader() = default;
+	ShmSnapshotReader(const ShmSnapshotReader&) = delete;
+	auto operator=(const ShmSnapshotReader&) -> ShmSnapshotReader& = delete;
+	ShmSnapshotReader(ShmSnapshotReader&& other) noexcept;
+	auto operator=(ShmSnapshotReader&& other) noexcept -> ShmSnapshotReader&;
+	~ShmSnapshotReader();
+
+	// Number of snapshots the writer has published so far
+	auto generation() const -> std::uint64_t;
+	auto closed() const -> bool;
+
+	// Calls `visit(const ShmSnapshotView&)` on the latest snapshot, directly on the shared
+	// memory. `visit` must not keep pointers into the view, and may be called more than once if
+	// the writer overwrote the snapshot while it was being read; only the last call saw a
+	// consistent snapshot. Returns false if nothing has been published yet.
+	template <typename Visit>
+	auto read(Visit&& visit) const -> bool {
+		while (true) {
+			const auto generation = this->generation();
+			if (generation == 0) {
+				return false;
+			}
+			const auto* buffer = this->buffer((generation - 1) % shm_snapshot_num_buffers);
+			const auto	sequence = buffer->sequence.load(std::memory_order_acquire);
+			if (sequence % 2 == 1) {
+				continue; // Lapped by the writer, there is a newer snapshot
+			}
+			visit(this->view(generation, buffer));
+			std::atomic_thread_fence(std::memory_order_acquire);
+			if (buffer->sequence.load(std::memory_order_relaxed) == sequence) {
+				return true;
+			}
+		}
+	}
+
+	// Blocks until a snapshot newer than `generation` is published, the writer closes or the
+	// timeout passes. Returns the generation of the latest snapshot.
+	auto wait_for_newer_than(std::uint64_t generation, std::chrono::milliseconds timeout) const
+		-> std::uint64_t;
+
+  private:
+	ShmSnapshotReader(const std::byte* data, std::size_t size) : data_(data), size_(size) { }
+
+	auto header() const -> const ShmSnapshotHeader*;
+	auto buffer(std::uint64_t idx) const -> const ShmSnapshotBufferHeader*;
+	auto view(std::uint64_t generation, const ShmSnapshotBufferHeader* buffer) const
+		-> ShmSnapshotView;
+
+	const std::byte* data_ = nullptr;
+	std::size_t		 size_ = 0;
+
+	friend auto open_shm_snapshot_reader(const std::string& name)
+		-> tl::expected<ShmSnapshotReader, shm_snapshot_error>;
+};
@@ -0,0 +1,67 @@
+#pragma once
+
+#include <cstddef>
+#include <memory>
+#include <memory_resource>
+#include <optional>
+
+// Monotonic arena for data that only lives during one simulation step. Allocating is a pointer
+// bump, and `reset()` at the end of the step frees everything at once. When a step needs more
+// than the arena holds, the rest comes from the heap and the arena grows to fit on the next
+// `reset()`, so in steady state a step does not touch the heap.
+class StepArena {
+  public:
+	explicit StepArena(const std::size_t initial_capacity) {
+		this->allocate_buffer(initial_capacity);
+	}
+	StepArena(const StepArena&) = delete;
+	auto operator=(const StepArena&) -> StepArena& = delete;
+
+	auto resource() -> std::pmr::memory_resource* { return &*this->arena; }
+
+	auto reset() -> void {
+		if (this->overflow.bytes == 0) {
+			this->arena->release();
+			return;
+		}
+		// The overflow also counts the arena's own geometric growth, so this overshoots a bit
+		const auto capacity = 2 * (this->capacity_ + this->overflow.bytes);
+		this->arena.reset();
+		this->overflow.bytes = 0;
+		this->allocate_buffer(capacity);
+	}
+
+	auto capacity() const -> std::size_t { return this->capacity_; }
+	// Number of bytes taken from the heap since the last reset
+	auto overflow_bytes() const -> std::size_t { return this->overflow.bytes; }
+
+  private:
+	// Upstream of the arena, counting how much the arena had to get from the heap
+	class OverflowResource : public std::pmr::memory_resource {
+	  public:
+		std::size_t bytes = 0;
+
+	  private:
+		auto do_allocate(std::size_t n, std::size_t alignment) -> void* override {
+			this->bytes += n;
+			return std::pmr::new_delete_resource()->allocate(n, alignment);
+		}
+		auto do_deallocate(void* p, std::size_t n, std::size_t alignment) -> void override {
+			std::pmr::new_delete_resource()->deallocate(p, n, alignment);
+		}
+		auto do_is_equal(const std::pmr::memory_resource& other) const noexcept -> bool override {
+			return this == &other;
+		}
+	};
+
+	auto allocate_buffer(const std::size_t capacity) -> void {
+		this->buffer = std::make_unique<std::byte[]>(capacity);
+		this->capacity_ = capacity;
+		this->arena.emplace(this->buffer.get(), capacity, &this->overflow);
+	}
+
+	OverflowResource								   overflow;
+	std::unique_ptr<std::byte[]>					   buffer;
+	std::size_t										   capacity_ = 0;
+	std::optional<std::pmr::monotonic_buffer_resource> arena;
+};
@@ -0,0 +1,86 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "record-fields.hpp"
+#include "ringbuf.hpp"
+
+struct Car {
+	int	   x;
+	int	   y;
+	double heading;
+	bool   alive = false;
+};
+
+// The fields of a car on the wire: { "heading": 3, "x": 1, "y": 2 }. In the order nlohmann::json
+// sorts them, so the CBOR bytes are the same as before.
+template <>
+struct RecordFields<Car> {
+	static constexpr auto fields = std::tuple(field("heading", &Car::heading), field("x", &Car::x),
+											  field("y", &Car::y));
+};
+
+// The state of one simulation step, which the simulation thread publishes to the consumers
+// (ZMQ publisher, ...) through a `SpmcRing`. Snapshots are reused, so the vectors keep their
+// capacity from step to step.
+struct StepSnapshot {
+	std::uint64_t			   step = 0;
+	double					   simulation_time = 0.0;
+	std::int64_t			   step_done_ns = 0; // `monotonic_ns` when the step was done
+	std::vector<std::uint32_t> car_handles; // car_handles[i] is the `VehicleHandle` of cars[i]
+	std::vector<std::string>   car_names;	// car_names[i] is SUMO's id of cars[i]
+	std::vector<Car>		   cars;
+	std::vector<std::int64_t>  lit_streetlamp_ids;
+};
+
+// The simulation thread publishes a snapshot of every step into this ring. Consumers read it at
+// their own pace and never block the simulation; if they fall behind, old steps are overwritten.
+using SnapshotRing = SpmcRing<StepSnapshot, 8>;
+
+// The message encoders below take the writer of the topic's format as template argument, e.g.
+// `encode_cars_message<CborWriter>(snapshot, topic, out)`, see encoding-format.hpp. The publisher
+// passes an empty topic and writes the topic and the `MessageHeader` itself.
+
+// Appends `topic` followed by the cars, keyed by their handles:
+// { "1": { "heading": 3, "x": 1, "y": 2 }, "2": { "heading": 3, "x": 1, "y": 2 } }
+template <template <typename> class Writer, typename Buffer>
+auto encode_cars_message(const StepSnapshot& snapshot, const std::string_view topic, Buffer& out)
+	-> void {
+	out.insert(out.end(), topic.begin(), topic.end());
+	auto writer = Writer<Buffer>(out);
+	writer.map(snapshot.cars.size());
+	for (std::size_t idx = 0; idx < snapshot.cars.size(); ++idx) {
+		writer.integer_key(snapshot.car_handles[idx]);
+		encode_record(writer, snapshot.cars[idx]);
+	}
+}
+
+// Appends `topic` followed by the SUMO ids of the cars' handles, which clients use to name the
+// cars of the other topics: { "1": "veh0", "2": "flow.3" }
+template <template <typename> class Writer, typename Buffer>
+auto encode_vehicle_ids_message(const StepSnapshot& snapshot, const std::string_view topic,
+								Buffer& out) -> void {
+	out.insert(out.end(), topic.begin(), topic.end());
+	auto writer = Writer<Buffer>(out);
+	writer.map(snapshot.cars.size());
+	for (std::size_t idx = 0; idx < snapshot.cars.size(); ++idx) {
+		writer.integer_key(snapshot.car_handles[idx]);
+		writer.text(snapshot.car_names[idx]);
+	}
+}
+
+// Appends `topic` followed by the ids of the lamps with vehicles nearby: [ id, ... ]
+template <template <typename> class Writer, typename Buffer>
+auto encode_streetlamps_message(const StepSnapshot& snapshot, const std::string_view topic,
+								Buffer& out) -> void {
+	out.insert(out.end(), topic.begin(), topic.end());
+	auto writer = Writer<Buffer>(out);
+	writer.array(snapshot.lit_streetlamp_ids.size());
+	for (const auto id : snapshot.lit_streetlamp_ids) {
+		writer.integer(id);
+	}
+}
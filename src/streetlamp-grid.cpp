@@ -0,0 +1,197 @@
+#include "streetlamp-grid.hpp"
+
+#include <algorithm>
+#include <limits>
+#include <utility>
+
+#include "building-occlusion.hpp"
+
+[[nodiscard]] auto build_streetlamp_grid(std::vector<StreetLamp> lamps, const float cell_size)
+	-> StreetLampGrid {
+	auto min_x = std::numeric_limits<float>::max();
+	auto min_y = std::numeric_limits<float>::max();
+	auto max_x = std::numeric_limits<float>::lowest();
+	auto max_y = std::numeric_limits<float>::lowest();
+	for (const auto& lamp : lamps) {
+		min_x = std::min(min_x, lamp.lon);
+		min_y = std::min(min_y, lamp.lat);
+		max_x = std::max(max_x, lamp.lon);
+		max_y = std::max(max_y, lamp.lat);
+	}
+	if (lamps.empty()) {
+		min_x = min_y = max_x = max_y = 0.0f;
+	}
+
+	auto spec = GridSpec {
+		.origin_x = min_x - cell_size,
+		.origin_y = min_y - cell_size,
+		.cell_size = cell_size,
+	};
+	spec.columns = static_cast<std::uint32_t>(spec.column_of(max_x)) + 2;
+	spec.rows = static_cast<std::uint32_t>(spec.row_of(max_y)) + 2;
+
+	// Counting sort of the lamps by cell. Within a cell the order of the input is kept.
+	auto cell_offsets = std::vector<std::uint32_t>(spec.num_cells() + 1, 0);
+	for (const auto& lamp : lamps) {
+		cell_offsets[spec.cell_of({lamp.lon, lamp.lat}) + 1]++;
+	}
+	for (std::size_t cell = 1; cell < cell_offsets.size(); ++cell) {
+		cell_offsets[cell] += cell_offsets[cell - 1];
+	}
+	auto sorted = std::vector<StreetLamp>(lamps.size());
+	auto next = std::vector<std::uint32_t>(cell_offsets.begin(), cell_offsets.end() - 1);
+	for (const auto& lamp : lamps) {
+		sorted[next[spec.cell_of({lamp.lon, lamp.lat})]++] = lamp;
+	}
+
+	return StreetLampGrid {
+		.spec = spec,
+		.lamps = std::move(sorted),
+		.cell_offsets = std::move(cell_offsets),
+	};
+}
+
+auto CellBuckets::rebuild(const GridSpec& spec, std::span<const Point> points) -> void {
+	const auto num_buckets = spec.num_cells() + 1; // + overflow bucket
+	offsets.assign(num_buckets + 1, 0);
+	items.resize(points.size());
+
+	for (const auto p : points) {
+		offsets[spec.cell_of(p) + 1]++;
+	}
+	for (std::size_t bucket = 1; bucket < offsets.size(); ++bucket) {
+		offsets[bucket] += offsets[bucket - 1];
+	}
+	// Fill each bucket from the back, which leaves `offsets` pointing at the bucket starts
+	for (std::size_t idx = points.size(); idx-- > 0;) {
+		items[--offsets[spec.cell_of(points[idx]) + 1]] = static_cast<std::uint32_t>(idx);
+	}
+	// `offsets[b + 1]` now holds the start of bucket b, shift everything one to the left
+	std::rotate(offsets.begin(), offsets.begin() + 1, offsets.end());
+	offsets.back() = static_cast<std::uint32_t>(points.size());
+}
+
+auto mark_lit_streetlamps(const StreetLampGridView& grid, const CellBuckets& buckets,
+						  std::span<const Point> points, const float distance_threshold_squared,
+						  const std::size_t begin, const std::size_t end,
+						  std::span<std::uint8_t> lit, const BuildingOcclusion* occlusion)
+	-> std::size_t {
+	const auto& spec = grid.spec;
+	std::size_t num_lit = 0;
+	auto		stats = OcclusionStats {};
+	for (auto idx = begin; idx < end; ++idx) {
+		const auto& lamp = grid.lamps[idx];
+		const auto	column = spec.column_of(lamp.lon);
+		const auto	row = spec.row_of(lamp.lat);
+
+		bool found = false;
+		bool near = false; // A point is within the threshold, but maybe behind a building
+		for (auto r = row - 1; r <= row + 1 && ! found; ++r) {
+			for (auto c = column - 1; c <= column + 1 && ! found; ++c) {
+				if (! spec.contains(c, r)) {
+					continue;
+				}
+				const auto test_sight =
+					occlusion != nullptr &&
+					! occlusion->cell_clear(static_cast<std::uint32_t>(idx),
+											BuildingOcclusion::neighbour(c - column, r - row));
+				for (const auto point_idx : buckets.bucket(spec.cell_index(c, r))) {
+					const auto dx = points[point_idx].x - lamp.lon;
+					const auto dy = points[point_idx].y - lamp.lat;
+					if (dx * dx + dy * dy > distance_threshold_squared) {
+						continue;
+					}
+					near = true;
+					if (test_sight) {
+						stats.sight_tests++;
+						if (! occlusion->line_of_sight({lamp.lon, lamp.lat}, points[point_idx])) {
+							stats.blocked++;
+							continue;
+						}
+					}
+					found = true;
+					break;
+				}
+			}
+		}
+		lit[idx] = found ? 1 : 0;
+		num_lit += found ? 1 : 0;
+		stats.occluded_lamps += near && ! found ? 1 : 0;
+	}
+	if (occlusion != nullptr) {
+		stats.lit_lamps = num_lit;
+		occlusion->record(stats);
+	}
+	return num_lit;
+}
+
+namespace {
+	auto squared_distance_to_segment(const Point p, const Point a, const Point b) -> float {
+		const auto abx = b.x - a.x;
+		const auto aby = b.y - a.y;
+		const auto length_squared = abx * abx + aby * aby;
+		auto	   t = 0.0f;
+		if (length_squared > 0.0f) {
+			t = std::clamp(((p.x - a.x) * abx + (p.y - a.y) * aby) / length_squared, 0.0f, 1.0f);
+		}
+		const auto dx = a.x + t * abx - p.x;
+		const auto dy = a.y + t * aby - p.y;
+		return dx * dx + dy * dy;
+	}
+} // namespace
+
+[[nodiscard]] auto build_lane_streetlamp_table(const StreetLampGridView& grid,
+											   std::vector<LaneShape> lanes,
+											   const float distance_threshold)
+	-> LaneStreetLampTable {
+	std::sort(lanes.begin(), lanes.end(),
+			  [](const auto& a, const auto& b) { return a.id < b.id; });
+
+	const auto& spec = grid.spec;
+	const auto	threshold_squared = distance_threshold * distance_threshold;
+
+	auto table = LaneStreetLampTable {};
+	table.lane_ids.reserve(lanes.size());
+	table.offsets.reserve(lanes.size() + 1);
+	table.offsets.push_back(0);
+
+	auto near_lane = std::vector<std::uint32_t> {};
+	for (auto& lane : lanes) {
+		near_lane.clear();
+		// A shape with a single point is treated as a segment of length 0
+		const auto num_segments =
+			lane.shape.size() > 1 ? lane.shape.size() - 1 : lane.shape.size();
+		for (std::size_t i = 0; i < num_segments; ++i) {
+			const auto a = lane.shape[i];
+			const auto b = i + 1 < lane.shape.size() ? lane.shape[i + 1] : a;
+			// Only the cells overlapping the bounding box of the segment grown by the threshold
+			const auto c0 = spec.column_of(std::min(a.x, b.x) - distance_threshold);
+			const auto c1 = spec.column_of(std::max(a.x, b.x) + distance_threshold);
+			const auto r0 = spec.row_of(std::min(a.y, b.y) - distance_threshold);
+			const auto r1 = spec.row_of(std::max(a.y, b.y) + distance_threshold);
+			for (auto r = std::max<std::int64_t>(r0, 0);
+				 r <= std::min<std::int64_t>(r1, spec.rows - 1); ++r) {
+				for (auto c = std::max<std::int64_t>(c0, 0);
+					 c <= std::min<std::int64_t>(c1, spec.columns - 1); ++c) {
+					const auto cell = spec.cell_index(c, r);
+					for (auto idx = grid.cell_offsets[cell]; idx < grid.cell_offsets[cell + 1];
+						 ++idx) {
+						const auto& lamp = grid.lamps[idx];
+						if (squared_distance_to_segment({lamp.lon, lamp.lat}, a, b) <=
+							threshold_squared) {
+							near_lane.push_back(idx);
+						}
+					}
+				}
+			}
+		}
+		std::sort(near_lane.begin(), near_lane.end());
+		near_lane.erase(std::unique(near_lane.begin(), near_lane.end()), near_lane.end());
+
+		table.lane_ids.push_back(std::move(lane.id));
+		table.lamp_indices.insert(table.lamp_indices.end(), near_lane.begin(), near_lane.end());
+		table.offsets.push_back(static_cast<std::uint32_t>(table.lamp_indices.size()));
+	}
+
+	return table;
+}
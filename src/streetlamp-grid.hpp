@@ -0,0 +1,115 @@
+#pragma once
+
+#include <cmath>
+#include <cstdint>
+#include <span>
+#include <string>
+#include <vector>
+
+#include "streetlamp.hpp"
+
+// A point in the projected (x, y) plane that SUMO uses for vehicle positions.
+struct Point {
+	float x;
+	float y;
+};
+
+// Uniform grid over the projected plane. The cell size equals the street lamp distance threshold,
+// so every lamp within the threshold of a point is in the 3x3 block of cells around that point.
+struct GridSpec {
+	float		  origin_x = 0.0f;
+	float		  origin_y = 0.0f;
+	float		  cell_size = 1.0f;
+	std::uint32_t columns = 0;
+	std::uint32_t rows = 0;
+
+	auto num_cells() const -> std::uint32_t { return columns * rows; }
+
+	// Column/row of a point. Can be out of range for points outside the grid.
+	auto column_of(const float x) const -> std::int64_t {
+		return static_cast<std::int64_t>(std::floor((x - origin_x) / cell_size));
+	}
+	auto row_of(const float y) const -> std::int64_t {
+		return static_cast<std::int64_t>(std::floor((y - origin_y) / cell_size));
+	}
+	auto contains(const std::int64_t column, const std::int64_t row) const -> bool {
+		return 0 <= column && column < columns && 0 <= row && row < rows;
+	}
+	auto cell_index(const std::int64_t column, const std::int64_t row) const -> std::uint32_t {
+		return static_cast<std::uint32_t>(row * columns + column);
+	}
+	// Index of the cell containing `p`, or `num_cells()` if `p` is outside the grid.
+	auto cell_of(const Point p) const -> std::uint32_t {
+		const auto column = column_of(p.x);
+		const auto row = row_of(p.y);
+		return contains(column, row) ? cell_index(column, row) : num_cells();
+	}
+};
+
+// Non-owning view of a street lamp grid. The lamps are sorted by cell, and the lamps of cell `c`
+// are `lamps[cell_offsets[c] .. cell_offsets[c + 1])`. The backing memory is either a
+// `StreetLampGrid` or a memory mapped network artifact.
+struct StreetLampGridView {
+	GridSpec					   spec;
+	std::span<const StreetLamp>	   lamps;
+	std::span<const std::uint32_t> cell_offsets; // spec.num_cells() + 1 entries
+
+	auto lamps_in_cell(const std::uint32_t cell) const -> std::span<const StreetLamp> {
+		return lamps.subspan(cell_offsets[cell], cell_offsets[cell + 1] - cell_offsets[cell]);
+	}
+};
+
+struct StreetLampGrid {
+	GridSpec				   spec;
+	std::vector<StreetLamp>	   lamps;
+	std::vector<std::uint32_t> cell_offsets;
+
+	auto view() const -> StreetLampGridView { return {spec, lamps, cell_offsets}; }
+};
+
+// Builds a grid over already projected lamps (`lamp.lon` is x, `lamp.lat` is y). The grid is
+// padded by one cell on every side, so a point outside of it is too far away from every lamp.
+[[nodiscard]]
+auto build_streetlamp_grid(std::vector<StreetLamp> lamps, float cell_size) -> StreetLampGrid;
+
+// Points bucketed by the cell of a `GridSpec` they fall in, using a counting sort. Points
+// outside the grid are put in a trailing overflow bucket with index `spec.num_cells()`.
+// Meant to be rebuilt every simulation step, reusing its memory.
+struct CellBuckets {
+	std::vector<std::uint32_t> offsets; // spec.num_cells() + 2 entries
+	std::vector<std::uint32_t> items;	// indices into the points given to `rebuild`
+
+	auto rebuild(const GridSpec& spec, std::span<const Point> points) -> void;
+
+	auto bucket(const std::uint32_t cell) const -> std::span<const std::uint32_t> {
+		return std::span(items).subspan(offsets[cell], offsets[cell + 1] - offsets[cell]);
+	}
+};
+
+class BuildingOcclusion;
+
+// For the lamps with index in [begin, end) set `lit[idx]` to 1 if at least one point is within
+// `sqrt(distance_threshold_squared)` of it, else to 0. Returns the number of lit lamps.
+// Different threads can work on disjoint lamp ranges at the same time. With `occlusion`, points
+// behind a building do not count, and the lit and occluded lamps are added to its stats.
+auto mark_lit_streetlamps(const StreetLampGridView& grid, const CellBuckets& buckets,
+						  std::span<const Point> points, float distance_threshold_squared,
+						  std::size_t begin, std::size_t end, std::span<std::uint8_t> lit,
+						  const BuildingOcclusion* occlusion = nullptr) -> std::size_t;
+
+// For every lane of the network the indices of the lamps (in grid order) within the distance
+// threshold of the lane's shape. Lanes are sorted by id, so they can be binary searched.
+struct LaneStreetLampTable {
+	std::vector<std::string>   lane_ids;
+	std::vector<std::uint32_t> offsets; // lane_ids.size() + 1 entries
+	std::vector<std::uint32_t> lamp_indices;
+};
+
+struct LaneShape {
+	std::string		   id;
+	std::vector<Point> shape;
+};
+
+[[nodiscard]]
+auto build_lane_streetlamp_table(const StreetLampGridView& grid, std::vector<LaneShape> lanes,
+								 float distance_threshold) -> LaneStreetLampTable;
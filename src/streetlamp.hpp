@@ -6,12 +6,22 @@
 #include <cstdint>
 #include <tl/expected.hpp>
 
+#include "record-fields.hpp"
+
 struct StreetLamp {
 	std::int64_t id;
 	float lat;
 	float lon;
 };
 
+// The fields of a street lamp on the wire: { "id": 1, "lat": 2, "lon": 3 }
+template <>
+struct RecordFields<StreetLamp> {
+	static constexpr auto fields = std::tuple(field("id", &StreetLamp::id),
+											  field("lat", &StreetLamp::lat),
+											  field("lon", &StreetLamp::lon));
+};
+
 [[nodiscard]]
 auto pformat(const StreetLamp& lamp) -> std::string;
 auto pprint(const StreetLamp& lamp) -> void;
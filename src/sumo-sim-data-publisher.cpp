@@ -1,15 +1,18 @@
-// #include <algorithm>
+#include <algorithm>
+#include <charconv>
 #include <chrono>
 #include <cmath>
 using namespace std::chrono_literals;
 #include <cmath>
 #include <filesystem>
+#include <fstream>
 // #include <queue>
 // #include <functional>
 #include <iostream>
+#include <memory_resource>
 // #include <mutex>
 // #include <numeric>
-// #include <optional>
+#include <optional>
 #include <string>
 #include <string_view>
 // #include <execution>
@@ -22,17 +25,15 @@ using namespace std::string_view_literals;
 // 3rd party libraries
 #include <argparse/argparse.hpp>
 #include <fmt/core.h>
+#include <fmt/ranges.h>
 #include <nlohmann/json.hpp>
 // for convenience
 using json = nlohmann::json;
 using namespace nlohmann::literals; // for ""_json
-#include <indicators/cursor_control.hpp>
 #include <parallel_hashmap/phmap.h>
 #include <pugixml.hpp>
 #include <spdlog/spdlog.h>
 #include <tl/expected.hpp>
-// #include <indicators/progress_bar.hpp>
-#include <indicators/block_progress_bar.hpp>
 
 #include <BS_thread_pool.hpp>
 #include <toml.hpp>
@@ -41,11 +42,36 @@ using namespace nlohmann::literals; // for ""_json
 
 #include <libsumo/libtraci.h>
 
+#include "allocation-counter.hpp"
+#include "analysis-cadence.hpp"
 #include "ansi-escape-codes.hpp"
+#include "building-occlusion.hpp"
+#include "car-tiles.hpp"
+#include "checkpoint.hpp"
+#include "density-raster.hpp"
+#include "encoding-format.hpp"
 // #include "debug-macro.hpp"
 #include "humantime.hpp"
+#include "incremental-lamp-detector.hpp"
+#include "lamp-occupancy.hpp"
+#include "lamp-timeline.hpp"
+#include "latency-histogram.hpp"
+#include "message-header.hpp"
+#include "network-artifact.hpp"
+#include "pacer.hpp"
+#include "payload-compression.hpp"
 #include "pretty-printers.hpp"
+#include "progress-reporter.hpp"
+#include "query-service.hpp"
+#include "ringbuf.hpp"
+#include "shm-snapshot.hpp"
+#include "step-arena.hpp"
+#include "step-snapshot.hpp"
+#include "streetlamp-grid.hpp"
 #include "streetlamp.hpp"
+#include "thread-placement.hpp"
+#include "vehicle-id-table.hpp"
+#include "work-stealing-pool.hpp"
 
 using namespace libtraci;
 
@@ -162,18 +188,34 @@ auto parse_sumocfg(const std::filesystem::path& sumocfg_path)
 	};
 }
 
-struct Car {
-	int	   x;
-	int	   y;
-	double heading;
-	bool   alive = false;
+// Heap allocations of the simulation thread per simulation step, split into the ones made while
+// reading the vehicles over TraCI (mostly libtraci's own `std::string`s and buffers) and the ones
+// made by the rest of the step. The publisher, query, IO and pool threads count their own. The
+// first steps, where the arena and the containers are still growing, are not counted.
+struct AllocationStats {
+	static constexpr int warmup_steps = 100;
+
+	u64 steps = 0;
+	u64 traci = 0;
+	u64 publisher = 0;
+	u64 publisher_max = 0;
+
+	auto record(const int simulation_step, const u64 traci_allocations,
+				const u64 publisher_allocations) -> void {
+		if (simulation_step < warmup_steps) {
+			return;
+		}
+		this->steps++;
+		this->traci += traci_allocations;
+		this->publisher += publisher_allocations;
+		this->publisher_max = std::max(this->publisher_max, publisher_allocations);
+	}
 
-	inline auto to_json() const -> json {
-		return json {
-			{"x",		  this->x		 },
-			{"y",		  this->y		 },
-			{"heading", this->heading},
-		};
+	auto traci_per_step() const -> double {
+		return this->steps == 0 ? 0.0 : static_cast<double>(this->traci) / this->steps;
+	}
+	auto publisher_per_step() const -> double {
+		return this->steps == 0 ? 0.0 : static_cast<double>(this->publisher) / this->steps;
 	}
 };
 
@@ -209,9 +251,12 @@ struct ProgramOptions {
 	std::filesystem::path sumocfg_path;
 	std::filesystem::path osm_path;
 	// bool	 gui = true;
-	bool use_sumo_gui = false;
-	bool spawn_sumo = false;
-	i32	 streetlamp_distance_threshold;
+	bool				  use_sumo_gui = false;
+	bool				  spawn_sumo = false;
+	i32					  streetlamp_distance_threshold;
+	std::filesystem::path streetlamp_artifact_path;
+	bool				  incremental_lamp_detection = true;
+	bool				  building_occlusion = false;
 
 	static auto print_toml_schema() -> void {
 		fmt::print(R"(
@@ -230,6 +275,9 @@ gui = false # <bool>
 
 [sumo.streetlamps]
 distance-threshold = 10 # <unsigned integer>
+artifact-path = "katrinebjerg-lamp/katrinebjerg-lamp.lamps.bin" # <string> (optional)
+detection = "incremental" # "incremental" | "full"
+occlusion = false # <bool>
 )");
 	}
 };
@@ -253,6 +301,12 @@ auto pprint(const ProgramOptions& options) -> void {
 				 pformat(options.spawn_sumo));
 	fmt::println("{}{}.streetlamp_distance_threshold{} = {},", indent, markup::bold, reset,
 				 pformat(options.streetlamp_distance_threshold));
+	fmt::println("{}{}.streetlamp_artifact_path{} = {},", indent, markup::bold, reset,
+				 pformat(options.streetlamp_artifact_path));
+	fmt::println("{}{}.incremental_lamp_detection{} = {},", indent, markup::bold, reset,
+				 pformat(options.incremental_lamp_detection));
+	fmt::println("{}{}.building_occlusion{} = {},", indent, markup::bold, reset,
+				 pformat(options.building_occlusion));
 	fmt::println("}};");
 }
 
@@ -535,6 +589,20 @@ auto parse_configuration(const toml::parse_result& config) -> ProgramOptions {
 		std::exit(1);
 	}
 
+	// Defaults to the artifact next to the sumocfg file, e.g. horsens/horsens.lamps.bin
+	const auto streetlamp_artifact_path = [&]() {
+		const auto path = config["sumo"]["streetlamps"]["artifact-path"].value_or(""sv);
+		return path.empty() ? default_network_artifact_path(std::filesystem::absolute(sumocfg_path))
+							: std::filesystem::absolute(path);
+	}();
+
+	// "full" checks every lamp every step, "incremental" only the lamps around vehicles that moved
+	const auto detection = config["sumo"]["streetlamps"]["detection"].value_or("incremental"sv);
+	if (detection != "incremental"sv && detection != "full"sv) {
+		spdlog::error("sumo.streetlamps.detection must be \"incremental\" or \"full\"");
+		std::exit(1);
+	}
+
 	const bool verbose = config["verbose"].value_or(false);
 	if (verbose) {
 		std::cout << toml::json_formatter {config} << "\n";
@@ -550,29 +618,1258 @@ auto parse_configuration(const toml::parse_result& config) -> ProgramOptions {
 		.use_sumo_gui = use_sumo_gui,
 		.spawn_sumo = spawn_sumo,
 		.streetlamp_distance_threshold = streetlamp_distance_threshold,
+		.streetlamp_artifact_path = streetlamp_artifact_path,
+		.incremental_lamp_detection = detection == "incremental"sv,
+		.building_occlusion = config["sumo"]["streetlamps"]["occlusion"].value_or(false),
 	};
 }
 
 namespace topics {
 	static const auto cars = std::string("cars");
 	static const auto streetlamps = std::string("streetlamps");
+	static const auto car_tiles = std::string("car-tiles");
+	static const auto vehicle_ids = std::string("vehicle-ids");
+	static const auto heatmap = std::string("heatmap");
 }; // namespace topics
 
+// Options of the ZMQ socket a topic is published on
+struct ZmqSocketOptions {
+	int	 sndhwm = 1000;		   // Messages queued per subscriber, ZMQ_SNDHWM
+	int	 sndbuf = 0;		   // Kernel send buffer in bytes, 0 keeps the OS default, ZMQ_SNDBUF
+	bool conflate = false;	   // Only keep the latest message per subscriber, ZMQ_CONFLATE
+	bool block_on_hwm = false; // Wait up to one publish period when the HWM is hit, else drop
+	// Fail sends while any subscriber is at its HWM, ZMQ_XPUB_NODROP. A send then fails, or with
+	// block_on_hwm waits, for all subscribers at once. Off, ZMQ drops for the full subscriber only.
+	bool xpub_nodrop = false;
+
+	auto operator==(const ZmqSocketOptions&) const -> bool = default;
+};
+
 struct Topic {
-	std::string name;
-	int			publish_rate = 0;
-	bool		enabled = false;
+	std::string				 key; // The `[topics.<key>]` table it is configured in
+	std::string				 name;
+	int						 publish_rate = 0;
+	bool					 enabled = false;
+	std::vector<std::string> endpoints; // tcp://, ipc:// or inproc:// addresses to bind to
+	ZmqSocketOptions		 socket;
+	EncodingFormat			 format = EncodingFormat::cbor;
+	Compression				 compression = Compression::none; // Of the encoded payloads
+	int						 compression_level = 0;
+	std::string				 zstd_dictionary_path;
+	std::vector<u8>			 zstd_dictionary; // The contents of `zstd_dictionary_path`
 };
 
 auto pformat(const Topic& topic) -> std::string {
-	return fmt::format("Topic {{ name: {}, publish_rate: {}, enabled: {} }}", topic.name,
-					   topic.publish_rate, topic.enabled);
+	return fmt::format("Topic {{ name: {}, publish_rate: {}, enabled: {}, endpoints: [{}], sndhwm: "
+					   "{}, sndbuf: {}, conflate: {}, block_on_hwm: {}, format: {}, compression: "
+					   "{}, compression_level: {}, zstd_dictionary: {} }}",
+					   topic.name, topic.publish_rate, topic.enabled,
+					   fmt::join(topic.endpoints, ", "), topic.socket.sndhwm, topic.socket.sndbuf,
+					   topic.socket.conflate, topic.socket.block_on_hwm,
+					   encoding_format_name(topic.format), compression_name(topic.compression),
+					   topic.compression_level, topic.zstd_dictionary_path);
 }
 
 auto pprint(const Topic& topic) -> void {
 	fmt::println("{}", pformat(topic));
 }
 
+// Reads `[topics.<key>]` from the config. Exits on invalid values.
+[[nodiscard]] auto read_topic(const toml::table& config, const std::string& key, const u16 port)
+	-> Topic {
+	const auto table = config["topics"][key];
+	auto	   topic = Topic {};
+	topic.key = key;
+	topic.name = table["name"].value_or(key);
+	topic.publish_rate = table["publish-rate"].value_or(0);
+	topic.enabled = table["enabled"].value_or(false);
+	topic.socket.sndhwm = table["sndhwm"].value_or(1000);
+	topic.socket.sndbuf = table["sndbuf"].value_or(0);
+	topic.socket.conflate = table["conflate"].value_or(false);
+	topic.socket.block_on_hwm = table["block-on-hwm"].value_or(false);
+	topic.socket.xpub_nodrop = table["xpub-nodrop"].value_or(false);
+
+	const auto format = table["format"].value_or("cbor"sv);
+	if (format == "cbor"sv) {
+		topic.format = EncodingFormat::cbor;
+	} else if (format == "msgpack"sv) {
+		topic.format = EncodingFormat::msgpack;
+	} else if (format == "json"sv) {
+		topic.format = EncodingFormat::json;
+	} else if (format == "packed"sv) {
+		topic.format = EncodingFormat::packed;
+	} else {
+		spdlog::error("topics.{}.format must be one of \"cbor\", \"msgpack\", \"json\" or "
+					  "\"packed\"",
+					  key);
+		std::exit(1);
+	}
+
+	const auto compression = parse_compression(table["compression"].value_or("none"sv));
+	if (! compression) {
+		spdlog::error("topics.{}.compression must be one of \"none\", \"lz4\" or \"zstd\"", key);
+		std::exit(1);
+	}
+	topic.compression = *compression;
+	topic.compression_level = table["compression-level"].value_or(0);
+	topic.zstd_dictionary_path = table["zstd-dictionary"].value_or(""sv);
+	// Tiles are a few cars each, too small to compress
+	if (key == topics::car_tiles && topic.compression != Compression::none) {
+		spdlog::error("topics.{}.compression is not supported, tiles are too small to compress",
+					  key);
+		std::exit(1);
+	}
+	if (! topic.zstd_dictionary_path.empty()) {
+		auto file = std::ifstream(topic.zstd_dictionary_path, std::ios::binary);
+		topic.zstd_dictionary.assign(std::istreambuf_iterator<char>(file), {});
+		if (! file || topic.zstd_dictionary.empty()) {
+			spdlog::error("Failed to read topics.{}.zstd-dictionary {}", key,
+						  topic.zstd_dictionary_path);
+			std::exit(1);
+		}
+	}
+	if (const auto compressor = PayloadCompressor::create(
+			topic.compression, topic.compression_level, topic.zstd_dictionary);
+		! compressor) {
+		spdlog::error("topics.{}: {}", key, format_compression_error(compressor.error()));
+		std::exit(1);
+	}
+
+	if (topic.enabled && topic.publish_rate <= 0) {
+		spdlog::error("topics.{}.publish-rate must be positive", key);
+		std::exit(1);
+	}
+	if (topic.socket.sndhwm < 0 || topic.socket.sndbuf < 0) {
+		spdlog::error("topics.{}.sndhwm and topics.{}.sndbuf can not be negative", key, key);
+		std::exit(1);
+	}
+	// Without ZMQ_XPUB_NODROP a full queue never fails a send, so there is nothing to wait for
+	if (topic.socket.block_on_hwm && ! topic.socket.xpub_nodrop) {
+		spdlog::error("topics.{}.block-on-hwm needs topics.{}.xpub-nodrop", key, key);
+		std::exit(1);
+	}
+
+	if (const auto* endpoints = table["endpoints"].as_array()) {
+		for (const auto& endpoint : *endpoints) {
+			const auto address = endpoint.value<std::string>();
+			if (! address || ! (address->starts_with("tcp://") || address->starts_with("ipc://") ||
+								address->starts_with("inproc://"))) {
+				spdlog::error("topics.{}.endpoints must only contain tcp://, ipc:// or inproc:// "
+							  "addresses",
+							  key);
+				std::exit(1);
+			}
+			topic.endpoints.push_back(*address);
+		}
+	} else {
+		topic.endpoints.push_back(fmt::format("tcp://*:{}", port));
+	}
+	if (topic.endpoints.empty()) {
+		spdlog::error("topics.{}.endpoints must not be empty", key);
+		std::exit(1);
+	}
+	std::sort(topic.endpoints.begin(), topic.endpoints.end());
+
+	return topic;
+}
+
+// Messages handed to ZMQ, and the ones it would not take because a subscriber's queue was full.
+// ZMQ drops messages for a subscriber at its HWM silently, so those are only counted on sockets
+// with ZMQ_XPUB_NODROP, where a full queue shows up as a failed send.
+struct SendStats {
+	u64 sent = 0;
+	u64 dropped = 0;
+	u64 blocked = 0; // Sends that had to wait for a subscriber, only with block_on_hwm
+
+	auto operator-(const SendStats& other) const -> SendStats {
+		return {sent - other.sent, dropped - other.dropped, blocked - other.blocked};
+	}
+};
+
+// The drops and blocked sends of `stats` for the log, or that they are not known on a socket
+// where ZMQ drops without telling, rather than a misleading 0
+auto format_drops(const SendStats& stats, const ZmqSocketOptions& options) -> std::string {
+	if (! options.xpub_nodrop || options.conflate) {
+		return "drops not counted without xpub-nodrop";
+	}
+	return fmt::format("dropped {}, blocked {}", stats.dropped, stats.blocked);
+}
+
+// Bytes of the payloads a topic compressed, and the time it took
+struct CompressionStats {
+	u64 payloads = 0;
+	u64 bytes_in = 0;
+	u64 bytes_out = 0;
+	i64 ns = 0;
+
+	auto operator-(const CompressionStats& other) const -> CompressionStats {
+		return {payloads - other.payloads, bytes_in - other.bytes_in, bytes_out - other.bytes_out,
+				ns - other.ns};
+	}
+
+	auto ratio() const -> double {
+		return bytes_out == 0 ? 1.0 : static_cast<double>(bytes_in) / bytes_out;
+	}
+};
+
+// An XPUB socket bound to the endpoints of one or more topics. Topics with the same endpoints
+// share a socket, so clients can subscribe to all of them over one connection. XPUB sends like
+// PUB, but also hands the subscriptions of the clients to the publisher, see `publish_topics`.
+// ZMQ only conflates on PUB sockets, so conflated topics keep using one.
+struct TopicSocket {
+	std::vector<std::string> endpoints;
+	ZmqSocketOptions		 options;
+	std::vector<std::string> topics;
+	zmq::socket_t			 socket;
+};
+
+// Creates and binds the sockets of the enabled topics. Exits if two topics want the same endpoints
+// with different socket options, or a conflated socket would be shared, since ZMQ_CONFLATE keeps
+// only the latest message of any topic.
+[[nodiscard]] auto bind_topic_sockets(zmq::context_t& zmq_ctx, const std::vector<Topic>& topics)
+	-> std::vector<TopicSocket> {
+	auto sockets = std::vector<TopicSocket> {};
+	for (const auto& topic : topics) {
+		if (! topic.enabled) {
+			continue;
+		}
+		auto it = std::find_if(sockets.begin(), sockets.end(), [&](const TopicSocket& socket) {
+			return socket.endpoints == topic.endpoints;
+		});
+		if (it == sockets.end()) {
+			sockets.push_back(TopicSocket {topic.endpoints, topic.socket, {topic.name}, {}});
+			continue;
+		}
+		if (it->options != topic.socket) {
+			spdlog::error("Topics {} and {} are published on the same endpoints, so they need the "
+						  "same socket options",
+						  it->topics.front(), topic.name);
+			std::exit(1);
+		}
+		if (topic.socket.conflate) {
+			spdlog::error("Topic {} is conflated, so it needs endpoints of its own", topic.name);
+			std::exit(1);
+		}
+		it->topics.push_back(topic.name);
+	}
+
+	for (auto& socket : sockets) {
+		socket.socket = zmq::socket_t(zmq_ctx, socket.options.conflate ? zmq::socket_type::pub
+																		: zmq::socket_type::xpub);
+		socket.socket.set(zmq::sockopt::sndhwm, socket.options.sndhwm);
+		if (socket.options.sndbuf > 0) {
+			socket.socket.set(zmq::sockopt::sndbuf, socket.options.sndbuf);
+		}
+		socket.socket.set(zmq::sockopt::conflate, socket.options.conflate);
+		// Also pass on subscriptions to topics another client already subscribed to
+		if (! socket.options.conflate) {
+			socket.socket.set(zmq::sockopt::xpub_verbose, true);
+			socket.socket.set(zmq::sockopt::xpub_nodrop, socket.options.xpub_nodrop);
+		}
+		for (const auto& endpoint : socket.endpoints) {
+			try {
+				socket.socket.bind(endpoint);
+			} catch (const zmq::error_t& err) {
+				spdlog::error("Failed to bind zmq socket to {}: {}", endpoint, err.what());
+				std::exit(1);
+			}
+			spdlog::info("Bound zmq {} socket to {} for topics: {}",
+						 socket.options.conflate ? "PUB" : "XPUB", endpoint,
+						 fmt::join(socket.topics, ", "));
+		}
+	}
+	return sockets;
+}
+
+// True if a subscription to `prefix` gets messages of `topic`. Messages start with their topic,
+// so it has to be a prefix of the topic, or longer and match e.g. one tile of the car-tiles
+// topic. Those are only candidates, ZMQ still filters what each subscriber gets.
+auto subscription_matches(const std::string_view prefix, const std::string_view topic) -> bool {
+	return topic.starts_with(prefix) || prefix.starts_with(topic);
+}
+
+// Sends `message` without ever blocking longer than `max_block`. Returns false if it was dropped.
+auto send_message(TopicSocket& socket, const std::pmr::vector<u8>& message,
+				  const std::chrono::milliseconds max_block, SendStats& stats) -> bool {
+	const auto buffer = zmq::buffer(message.data(), message.size());
+	if (socket.socket.send(buffer, zmq::send_flags::dontwait)) {
+		stats.sent++;
+		return true;
+	}
+	if (socket.options.block_on_hwm) {
+		stats.blocked++;
+		socket.socket.set(zmq::sockopt::sndtimeo, static_cast<int>(max_block.count()));
+		if (socket.socket.send(buffer, zmq::send_flags::none)) {
+			stats.sent++;
+			return true;
+		}
+	}
+	stats.dropped++;
+	return false;
+}
+
+// Writes `header` with the current time as publish time into the room `reserve_message_header`
+// left at `header_offset` of `message`, and sends it like `send_message`. The payload size of an
+// uncompressed payload is filled in from the message.
+auto send_stamped_message(TopicSocket& socket, std::pmr::vector<u8>& message,
+						  const std::size_t header_offset, MessageHeader header,
+						  const std::chrono::milliseconds max_block, SendStats& stats) -> bool {
+	if (header.codec == Compression::none) {
+		header.payload_size =
+			static_cast<u32>(message.size() - header_offset - sizeof(MessageHeader));
+	}
+	header.publish_ns = monotonic_ns();
+	write_message_header(message, header_offset, header);
+	return send_message(socket, message, max_block, stats);
+}
+
+// Local subscribers can read the snapshots from shared memory instead of over ZMQ
+struct ShmTransport {
+	bool		  enabled = false;
+	std::string	  name;
+	std::uint32_t max_cars = 0;
+};
+
+auto pformat(const ShmTransport& shm) -> std::string {
+	return fmt::format("ShmTransport {{ enabled: {}, name: {}, max_cars: {} }}", shm.enabled,
+					   shm.name, shm.max_cars);
+}
+
+auto pprint(const ShmTransport& shm) -> void {
+	fmt::println("{}", pformat(shm));
+}
+
+// Request/reply endpoint answering queries about the latest step, see query-service.hpp
+struct QueryService {
+	bool		enabled = false;
+	std::string endpoint;
+};
+
+auto pformat(const QueryService& query) -> std::string {
+	return fmt::format("QueryService {{ enabled: {}, endpoint: {} }}", query.enabled,
+					   query.endpoint);
+}
+
+auto pprint(const QueryService& query) -> void {
+	fmt::println("{}", pformat(query));
+}
+
+auto pformat(const PacingOptions& pacing) -> std::string {
+	const auto wait = pacing.wait == PacingWait::sleep  ? "sleep"
+					  : pacing.wait == PacingWait::spin ? "spin"
+														: "hybrid";
+	return fmt::format(
+		"PacingOptions {{ realtime: {}, speed: {}, wait: {}, spin_threshold: {} us }}",
+		pacing.realtime, pacing.speed, wait, pacing.spin_threshold.count());
+}
+
+auto pprint(const PacingOptions& pacing) -> void {
+	fmt::println("{}", pformat(pacing));
+}
+
+// `[pacing]`, `speed` is either "max" or the number of simulated seconds per wall clock second
+auto read_pacing_options(const toml::parse_result& config) -> PacingOptions {
+	auto pacing = PacingOptions {};
+	const auto speed = config["pacing"]["speed"];
+	if (speed.is_string()) {
+		if (speed.value_or(""sv) != "max"sv) {
+			spdlog::error("pacing.speed must be \"max\" or a positive number");
+			std::exit(1);
+		}
+	} else if (speed) {
+		pacing.realtime = true;
+		pacing.speed = speed.value_or(0.0);
+		if (! (pacing.speed > 0.0)) {
+			spdlog::error("pacing.speed must be \"max\" or a positive number");
+			std::exit(1);
+		}
+	}
+
+	const auto wait = config["pacing"]["wait"].value_or("hybrid"sv);
+	if (wait == "sleep"sv) {
+		pacing.wait = PacingWait::sleep;
+	} else if (wait == "spin"sv) {
+		pacing.wait = PacingWait::spin;
+	} else if (wait == "hybrid"sv) {
+		pacing.wait = PacingWait::hybrid;
+	} else {
+		spdlog::error("pacing.wait must be one of \"sleep\", \"spin\" or \"hybrid\"");
+		std::exit(1);
+	}
+
+	const auto spin_threshold_us = config["pacing"]["spin-threshold"].value_or(2000);
+	if (spin_threshold_us < 0) {
+		spdlog::error("pacing.spin-threshold must not be negative");
+		std::exit(1);
+	}
+	pacing.spin_threshold = std::chrono::microseconds(spin_threshold_us);
+	return pacing;
+}
+
+auto pprint(const ReportingOptions& reporting) -> void {
+	fmt::println("{}", pformat(reporting));
+}
+
+// `[reporting]`, `rate` is how many times a second the progress bar is redrawn
+auto read_reporting_options(const toml::parse_result& config) -> ReportingOptions {
+	auto reporting = ReportingOptions {};
+	const auto rate = config["reporting"]["rate"].value_or(10.0);
+	if (! (rate > 0.0 && rate <= 1000.0)) {
+		spdlog::error("reporting.rate must be a number of redraws per second between 0 and 1000");
+		std::exit(1);
+	}
+	reporting.period = std::chrono::milliseconds(static_cast<long>(1000.0 / rate));
+
+	const auto log_queue_size = config["reporting"]["log-queue-size"].value_or(8192);
+	if (log_queue_size <= 0) {
+		spdlog::error("reporting.log-queue-size must be positive");
+		std::exit(1);
+	}
+	reporting.log_queue_size = static_cast<std::size_t>(log_queue_size);
+	return reporting;
+}
+
+auto pformat(const AnalysisCadenceOptions& analysis) -> std::string {
+	return fmt::format(
+		"AnalysisCadenceOptions {{ adaptive: {}, max_interval: {} s, max_displacement: {} m }}",
+		analysis.adaptive, analysis.max_interval, analysis.max_displacement);
+}
+
+auto pprint(const AnalysisCadenceOptions& analysis) -> void {
+	fmt::println("{}", pformat(analysis));
+}
+
+// Reads `threads.<key>`, a list of CPU indices and "node<N>" for every CPU of NUMA node N
+auto read_cpus(const toml::parse_result& config, const std::string_view key,
+			   const tl::expected<NumaTopology, numa_topology_error>& topology)
+	-> std::vector<int> {
+	auto cpus = std::vector<int> {};
+	const auto* entries = config["threads"][key].as_array();
+	if (! entries) {
+		return cpus;
+	}
+	for (const auto& entry : *entries) {
+		if (const auto index = entry.value<int>()) {
+			if (*index < 0) {
+				spdlog::error("threads.{} must not contain negative CPU indices", key);
+				std::exit(1);
+			}
+			cpus.push_back(*index);
+			continue;
+		}
+		const auto name = entry.value<std::string_view>().value_or(""sv);
+		int		   id = -1;
+		if (name.starts_with("node"sv)) {
+			const auto [end, ec] = std::from_chars(name.data() + 4, name.data() + name.size(), id);
+			if (ec != std::errc {} || end != name.data() + name.size()) {
+				id = -1;
+			}
+		}
+		if (id < 0) {
+			spdlog::error("threads.{} must only contain CPU indices and \"node<N>\"", key);
+			std::exit(1);
+		}
+		const auto* node = topology ? topology->find_node(id) : nullptr;
+		if (! node) {
+			spdlog::error("threads.{}: there is no NUMA node {} with CPUs", key, id);
+			std::exit(1);
+		}
+		cpus.insert(cpus.end(), node->cpus.begin(), node->cpus.end());
+	}
+	return cpus;
+}
+
+// Where the simulation thread and the IO threads run, `[threads]`
+struct ThreadPlacement {
+	bool			 pin = true; // false ignores every CPU list, to compare runs with and without
+	std::vector<int> simulation_cpus;
+	std::vector<int> io_cpus; // ZMQ's IO threads and the publisher, shm and query threads
+};
+
+auto pformat(const ThreadPlacement& placement) -> std::string {
+	return fmt::format("ThreadPlacement {{ pin: {}, simulation_cpus: [{}], io_cpus: [{}] }}",
+					   placement.pin, fmt::join(placement.simulation_cpus, ", "),
+					   fmt::join(placement.io_cpus, ", "));
+}
+
+auto pprint(const ThreadPlacement& placement) -> void {
+	fmt::println("{}", pformat(placement));
+}
+
+auto read_thread_placement(const toml::parse_result&						  config,
+						   const tl::expected<NumaTopology, numa_topology_error>& topology)
+	-> ThreadPlacement {
+	return ThreadPlacement {
+		.pin = config["threads"]["pin"].value_or(true),
+		.simulation_cpus = read_cpus(config, "simulation-cpus", topology),
+		.io_cpus = read_cpus(config, "io-cpus", topology),
+	};
+}
+
+// Threads that check every lamp every step, when `sumo.streetlamps.detection` is "full"
+struct AnalysisThreads {
+	unsigned		 count = 0;			   // 0 uses all but one hardware thread
+	bool			 work_stealing = true; // else BS::thread_pool's equal blocks of lamps
+	std::vector<int> cpus;				   // Pins thread i to cpus[i % cpus.size()] if work stealing
+	u32				 lamps_per_task = 256; // Lamps in grid order, so a task is a strip of cells
+};
+
+auto pformat(const AnalysisThreads& threads) -> std::string {
+	return fmt::format("AnalysisThreads {{ count: {}, work_stealing: {}, cpus: [{}], "
+					   "lamps_per_task: {} }}",
+					   threads.count, threads.work_stealing, fmt::join(threads.cpus, ", "),
+					   threads.lamps_per_task);
+}
+
+auto pprint(const AnalysisThreads& threads) -> void {
+	fmt::println("{}", pformat(threads));
+}
+
+auto read_analysis_threads(const toml::parse_result&							config,
+						   const tl::expected<NumaTopology, numa_topology_error>& topology)
+	-> AnalysisThreads {
+	auto	   threads = AnalysisThreads {};
+	const auto count = config["threads"]["count"].value_or(0);
+	if (count < 0) {
+		spdlog::error("threads.count must not be negative");
+		std::exit(1);
+	}
+	threads.count = static_cast<unsigned>(count);
+
+	const auto scheduler = config["threads"]["scheduler"].value_or("work-stealing"sv);
+	if (scheduler != "work-stealing"sv && scheduler != "static"sv) {
+		spdlog::error("threads.scheduler must be \"work-stealing\" or \"static\"");
+		std::exit(1);
+	}
+	threads.work_stealing = scheduler == "work-stealing"sv;
+
+	threads.cpus = read_cpus(config, "cpus", topology);
+
+	const auto lamps_per_task = config["threads"]["lamps-per-task"].value_or(256);
+	if (lamps_per_task <= 0) {
+		spdlog::error("threads.lamps-per-task must be positive");
+		std::exit(1);
+	}
+	threads.lamps_per_task = static_cast<u32>(lamps_per_task);
+	return threads;
+}
+
+// Periodic checkpoints of SUMO's and the publisher's state, `[checkpoint]`
+struct Checkpointing {
+	int					  every = 0; // In simulation steps, 0 turns checkpoints off
+	std::filesystem::path path;
+};
+
+auto pformat(const Checkpointing& checkpointing) -> std::string {
+	return fmt::format("Checkpointing {{ every: {}, path: {} }}", checkpointing.every,
+					   checkpointing.path.string());
+}
+
+auto pprint(const Checkpointing& checkpointing) -> void {
+	fmt::println("{}", pformat(checkpointing));
+}
+
+// Per lamp occupancy archived to SQLite, `[occupancy]`
+struct OccupancyArchiving {
+	bool				  enabled = false;
+	std::filesystem::path path;
+	std::vector<double>	  resolutions; // In simulated seconds, see `OccupancyArchive`
+};
+
+auto pformat(const OccupancyArchiving& occupancy) -> std::string {
+	return fmt::format("OccupancyArchiving {{ enabled: {}, path: {}, resolutions: [{}] s }}",
+					   occupancy.enabled, occupancy.path.string(),
+					   fmt::join(occupancy.resolutions, ", "));
+}
+
+auto pprint(const OccupancyArchiving& occupancy) -> void {
+	fmt::println("{}", pformat(occupancy));
+}
+
+// Options of the spatially filtered cars topic, `[topics.car-tiles]`
+struct CarTileOptions {
+	int zoom = 3;			// Tiles are 2^zoom x 2^zoom cells of the street lamp grid
+	int viewport_tiles = 3; // Side of the viewport, in tiles, used to report bytes per client
+};
+
+auto pformat(const CarTileOptions& options) -> std::string {
+	return fmt::format("CarTileOptions {{ zoom: {}, viewport_tiles: {} }}", options.zoom,
+					   options.viewport_tiles);
+}
+
+auto pprint(const CarTileOptions& options) -> void {
+	fmt::println("{}", pformat(options));
+}
+
+// Options of the vehicle density topic, `[topics.heatmap]`
+struct HeatmapOptions {
+	double	 cell_size = 25.0; // Side of a raster cell in meters
+	unsigned threads = 1;	   // Threads counting the cars into the raster
+};
+
+auto pformat(const HeatmapOptions& options) -> std::string {
+	return fmt::format("HeatmapOptions {{ cell_size: {} m, threads: {} }}", options.cell_size,
+					   options.threads);
+}
+
+auto pprint(const HeatmapOptions& options) -> void {
+	fmt::println("{}", pformat(options));
+}
+
+// Publishes one message per tile with cars in it, and an empty one for the tiles that had cars the
+// last time, so clients can clear them. All messages of one publish share `header`. Also keeps
+// track of the bytes a client looking at a `viewport_tiles` x `viewport_tiles` window around the
+// busiest tile receives.
+struct CarTilesPublisher {
+	CarTiles					tiles;
+	int							viewport_tiles;
+	std::vector<CarTiles::Tile> previous_tiles {};
+	std::vector<u64>			tile_bytes {}; // Bytes sent per tile of the latest publish
+	u64							bytes = 0;
+	u64							viewport_bytes = 0;
+
+	template <template <typename> class Writer>
+	auto publish(const StepSnapshot& snapshot, const Topic& topic, TopicSocket& socket,
+				 const MessageHeader& header, const std::chrono::milliseconds max_block,
+				 StepArena& arena, SendStats& stats) -> void {
+		this->tiles.assign(snapshot);
+		this->tile_bytes.clear();
+		for (const auto& tile : this->tiles.tiles()) {
+			auto message = std::pmr::vector<u8>(arena.resource());
+			this->tiles.append_topic(topic.name, tile, message);
+			const auto header_offset = reserve_message_header(message);
+			this->tiles.encode_tile_cars<Writer>(snapshot, tile, message);
+			send_stamped_message(socket, message, header_offset, header, max_block, stats);
+			this->bytes += message.size();
+			this->tile_bytes.push_back(message.size());
+		}
+
+		const auto current = this->tiles.tiles();
+		for (const auto& tile : this->previous_tiles) {
+			if (std::find(current.begin(), current.end(), tile) != current.end()) {
+				continue;
+			}
+			auto message = std::pmr::vector<u8>(arena.resource());
+			this->tiles.append_topic(topic.name, tile, message);
+			const auto header_offset = reserve_message_header(message);
+			Writer<std::pmr::vector<u8>>(message).map(0);
+			send_stamped_message(socket, message, header_offset, header, max_block, stats);
+			this->bytes += message.size();
+		}
+		this->previous_tiles.assign(current.begin(), current.end());
+
+		this->viewport_bytes += this->busiest_viewport_bytes();
+	}
+
+	// Sends the tiles of `snapshot` a new subscription to `prefix` matches, without touching
+	// what the next `publish` considers already sent
+	template <template <typename> class Writer>
+	auto publish_matching(const StepSnapshot& snapshot, const Topic& topic, TopicSocket& socket,
+						  const std::string_view prefix, const MessageHeader& header,
+						  const std::chrono::milliseconds max_block, StepArena& arena,
+						  SendStats& stats) -> void {
+		this->tiles.assign(snapshot);
+		for (const auto& tile : this->tiles.tiles()) {
+			auto message = std::pmr::vector<u8>(arena.resource());
+			this->tiles.append_topic(topic.name, tile, message);
+			const auto tile_topic =
+				std::string_view(reinterpret_cast<const char*>(message.data()), message.size());
+			if (! subscription_matches(prefix, tile_topic)) {
+				continue;
+			}
+			const auto header_offset = reserve_message_header(message);
+			this->tiles.encode_tile_cars<Writer>(snapshot, tile, message);
+			send_stamped_message(socket, message, header_offset, header, max_block, stats);
+			this->bytes += message.size();
+		}
+	}
+
+	// Bytes of the latest publish in the viewport, centered on a tile, with the most bytes
+	auto busiest_viewport_bytes() const -> u64 {
+		const auto tiles = this->tiles.tiles();
+		const auto radius = this->viewport_tiles / 2;
+		u64		   busiest = 0;
+		// Tiles are sorted by (y, x), so the tiles of a viewport row can be binary searched
+		const auto less = [](const CarTiles::Tile& a, const std::pair<i32, i32>& yx) {
+			return a.y != yx.first ? a.y < yx.first : a.x < yx.second;
+		};
+		for (const auto& center : tiles) {
+			u64 sum = 0;
+			for (i32 y = center.y - radius; y <= center.y + radius; ++y) {
+				auto it = std::lower_bound(tiles.begin(), tiles.end(),
+										   std::pair(y, center.x - radius), less);
+				for (; it != tiles.end() && it->y == y && it->x <= center.x + radius; ++it) {
+					sum += this->tile_bytes[static_cast<std::size_t>(it - tiles.begin())];
+				}
+			}
+			busiest = std::max(busiest, sum);
+		}
+		return busiest;
+	}
+};
+
+// Sends the topics, each at its own publish rate, from the latest snapshot in the ring. Runs on
+// its own thread until the ring is closed and drained, so sleeping until the next message is due
+// and the time spent in zmq do not slow down the simulation.
+//
+// The ring always holds the newest snapshot, which makes it a last value cache: when a client
+// subscribes, the topics it subscribed to are sent from that snapshot right away, instead of it
+// waiting for the next regular message. The subscriptions are checked once per snapshot or
+// publish period. XPUB can not address a single subscriber, so the clients already subscribed to
+// the topic get that message too, like the next regular one a bit early.
+//
+// Every message carries a `MessageHeader`. The time from the end of `Simulation::step()` to the
+// send of a topic's regular messages is logged with the other statistics of the topic.
+//
+// The heatmap is only rasterized when it is sent, so it costs nothing on the steps in between.
+auto publish_topics(SnapshotRing::Consumer consumer, std::vector<TopicSocket>& sockets,
+					const std::vector<Topic>& topics, const GridSpec& grid_spec,
+					const CarTileOptions& car_tile_options, const RasterSpec& heatmap_spec,
+					const HeatmapOptions& heatmap_options) -> void {
+	using clock = std::chrono::steady_clock;
+	using Encode = void (*)(const StepSnapshot&, std::string_view, std::pmr::vector<u8>&);
+
+	struct TopicPublisher {
+		const Topic*	  topic;
+		TopicSocket*	  socket;
+		Encode			  encode;
+		clock::duration	  period;
+		clock::time_point next;
+		SendStats		  stats;
+		SendStats		  stats_last_report;
+		// Prefixes subscribed to since the last check, served from the newest snapshot
+		std::vector<std::string> new_subscriptions {};
+		u64						 late_joiners = 0;
+		u64						 sequence = 0; // Of the next publish
+		LatencyHistogram		 step_to_send {};
+		LatencyHistogram		 step_to_send_last_second {};
+		// Reused for every payload of the topic, if it is compressed
+		std::optional<PayloadCompressor> compressor {};
+		CompressionStats				 compression {};
+		CompressionStats				 compression_last_report {};
+
+		auto next_header(const StepSnapshot& snapshot) -> MessageHeader {
+			return {.sequence = this->sequence++,
+					.step = snapshot.step,
+					.simulation_time = snapshot.simulation_time,
+					.step_done_ns = snapshot.step_done_ns,
+					.publish_ns = 0};
+		}
+	};
+
+	auto publishers = std::vector<TopicPublisher> {};
+	for (const auto& topic : topics) {
+		if (! topic.enabled) {
+			continue;
+		}
+		auto* socket = &*std::find_if(sockets.begin(), sockets.end(), [&](const auto& socket) {
+			return socket.endpoints == topic.endpoints;
+		});
+		// car-tiles sends a message per tile and heatmap encodes its raster, neither uses `encode`
+		const auto encode = with_writer(topic.format, [&](auto tag) -> Encode {
+			using Tag = decltype(tag);
+			if (topic.key == topics::cars) {
+				return encode_cars_message<Tag::template Writer>;
+			}
+			if (topic.key == topics::vehicle_ids) {
+				return encode_vehicle_ids_message<Tag::template Writer>;
+			}
+			if (topic.key == topics::heatmap) {
+				return nullptr;
+			}
+			return encode_streetlamps_message<Tag::template Writer>;
+		});
+		const auto period = std::chrono::duration_cast<clock::duration>(
+			std::chrono::duration<double>(1.0 / topic.publish_rate));
+		auto compressor = std::optional<PayloadCompressor> {};
+		if (topic.compression != Compression::none) {
+			// Checked when the config was read
+			compressor = *PayloadCompressor::create(topic.compression, topic.compression_level,
+													topic.zstd_dictionary);
+		}
+		publishers.push_back({&topic, socket, encode, period, clock::now(), {}, {}, {}, 0, 0, {},
+							  {}, std::move(compressor), {}, {}});
+	}
+	if (publishers.empty()) {
+		return;
+	}
+
+	auto car_tiles = CarTilesPublisher {
+		.tiles = CarTiles(grid_spec, car_tile_options.zoom),
+		.viewport_tiles = car_tile_options.viewport_tiles,
+	};
+	// Bytes sent on the cars topic, to compare the tiles with
+	u64 cars_bytes = 0;
+
+	auto heatmap = std::optional<DensityRaster> {};
+	const auto is_heatmap = [](const auto& publisher) {
+		return publisher.topic->key == topics::heatmap;
+	};
+	if (std::any_of(publishers.begin(), publishers.end(), is_heatmap)) {
+		heatmap.emplace(heatmap_spec, heatmap_options.threads);
+	}
+	// The payload of a message, without the topic and header
+	const auto encode_payload = [&](TopicPublisher& publisher, const StepSnapshot& snapshot,
+									std::pmr::vector<u8>& out) {
+		if (publisher.topic->key == topics::heatmap) {
+			heatmap->compute(snapshot.cars);
+			with_writer(publisher.topic->format, [&](auto tag) {
+				encode_density_raster<decltype(tag)::template Writer>(*heatmap, out);
+			});
+		} else {
+			publisher.encode(snapshot, {}, out);
+		}
+	};
+
+	// Messages are built in this arena, which is reset after every snapshot
+	auto arena = StepArena(1 << 20);
+	auto last_report_time = clock::now();
+
+	// The topic, the header and then the payload, returns if it was sent and its size. Compressed
+	// payloads are encoded on the side first.
+	const auto send_snapshot = [&](TopicPublisher& publisher, const StepSnapshot& snapshot,
+								   const std::chrono::milliseconds max_block) {
+		auto	   message = std::pmr::vector<u8>(arena.resource());
+		const auto name = std::string_view(publisher.topic->name);
+		message.insert(message.end(), name.begin(), name.end());
+		const auto header_offset = reserve_message_header(message);
+		auto	   header = publisher.next_header(snapshot);
+		if (publisher.compressor) {
+			auto payload = std::pmr::vector<u8>(arena.resource());
+			encode_payload(publisher, snapshot, payload);
+			const auto compress_start = monotonic_ns();
+			if (publisher.compressor->compress(payload, message)) {
+				header.codec = publisher.compressor->codec();
+				header.payload_size = static_cast<u32>(payload.size());
+			} else {
+				message.insert(message.end(), payload.begin(), payload.end());
+			}
+			auto& stats = publisher.compression;
+			stats.payloads++;
+			stats.bytes_in += payload.size();
+			stats.bytes_out += message.size() - header_offset - sizeof(MessageHeader);
+			stats.ns += monotonic_ns() - compress_start;
+		} else {
+			encode_payload(publisher, snapshot, message);
+		}
+		const auto sent = send_stamped_message(*publisher.socket, message, header_offset, header,
+											   max_block, publisher.stats);
+		return std::pair(sent, message.size());
+	};
+
+	const auto serve_new_subscribers = [&]() {
+		bool any_new = false;
+		for (auto& socket : sockets) {
+			if (socket.options.conflate) {
+				continue;
+			}
+			auto event = zmq::message_t {};
+			while (socket.socket.recv(event, zmq::recv_flags::dontwait)) {
+				// A subscribe is a 1 followed by the prefix, an unsubscribe starts with a 0
+				const auto bytes = event.to_string_view();
+				if (bytes.empty() || bytes[0] != 1) {
+					continue;
+				}
+				const auto prefix = bytes.substr(1);
+				for (auto& publisher : publishers) {
+					if (publisher.socket == &socket &&
+						subscription_matches(prefix, publisher.topic->name)) {
+						publisher.new_subscriptions.emplace_back(prefix);
+						any_new = true;
+					}
+				}
+			}
+		}
+		if (! any_new) {
+			return;
+		}
+		// Before the first snapshot the new subscribers get the first regular messages instead
+		consumer.read_newest([&](const StepSnapshot& snapshot) {
+			for (auto& publisher : publishers) {
+				if (publisher.new_subscriptions.empty()) {
+					continue;
+				}
+				const auto max_block =
+					std::chrono::ceil<std::chrono::milliseconds>(publisher.period);
+				if (publisher.topic->key == topics::car_tiles) {
+					const auto header = publisher.next_header(snapshot);
+					with_writer(publisher.topic->format, [&](auto tag) {
+						for (const auto& prefix : publisher.new_subscriptions) {
+							car_tiles.publish_matching<decltype(tag)::template Writer>(
+								snapshot, *publisher.topic, *publisher.socket, prefix, header,
+								max_block, arena, publisher.stats);
+						}
+					});
+				} else {
+					send_snapshot(publisher, snapshot, max_block);
+				}
+				publisher.late_joiners += publisher.new_subscriptions.size();
+			}
+		});
+		for (auto& publisher : publishers) {
+			publisher.new_subscriptions.clear();
+		}
+		arena.reset();
+	};
+
+	while (consumer.wait()) {
+		serve_new_subscribers();
+		const auto now = clock::now();
+		auto	   next_due = clock::time_point::max();
+		bool	   any_due = false;
+		for (const auto& publisher : publishers) {
+			any_due = any_due || now >= publisher.next;
+			next_due = std::min(next_due, publisher.next);
+		}
+		if (! any_due) {
+			std::this_thread::sleep_until(next_due);
+			continue;
+		}
+
+		consumer.try_read_latest([&](const StepSnapshot& snapshot) {
+			for (auto& publisher : publishers) {
+				if (now < publisher.next) {
+					continue;
+				}
+				const auto max_block =
+					std::chrono::ceil<std::chrono::milliseconds>(publisher.period);
+				if (publisher.topic->key == topics::car_tiles) {
+					const auto header = publisher.next_header(snapshot);
+					with_writer(publisher.topic->format, [&](auto tag) {
+						car_tiles.publish<decltype(tag)::template Writer>(
+							snapshot, *publisher.topic, *publisher.socket, header, max_block,
+							arena, publisher.stats);
+					});
+				} else {
+					const auto [sent, bytes] = send_snapshot(publisher, snapshot, max_block);
+					if (! sent) {
+						spdlog::debug("Dropped message on topic {}, a subscriber is too slow",
+									  publisher.topic->name);
+					}
+					if (publisher.topic->key == topics::cars) {
+						cars_bytes += bytes;
+					}
+				}
+				const auto step_to_send = monotonic_ns() - snapshot.step_done_ns;
+				publisher.step_to_send.record(step_to_send);
+				publisher.step_to_send_last_second.record(step_to_send);
+				// Skip the deadlines that were missed instead of sending a burst to catch up
+				publisher.next = std::max(publisher.next + publisher.period, now);
+			}
+		});
+		arena.reset();
+
+		if (now - last_report_time >= std::chrono::seconds(1)) {
+			for (auto& publisher : publishers) {
+				const auto stats = publisher.stats - publisher.stats_last_report;
+				const auto& latency = publisher.step_to_send_last_second;
+				spdlog::info("Published data {} times the last second on topic {} at a rate of {} "
+							 "Hz, {}, step to send p50 {} us, p99 {} us, max {} us",
+							 stats.sent, publisher.topic->name, publisher.topic->publish_rate,
+							 format_drops(stats, publisher.socket->options),
+							 latency.percentile(0.5) / 1000, latency.percentile(0.99) / 1000,
+							 latency.max() / 1000);
+				publisher.stats_last_report = publisher.stats;
+				publisher.step_to_send_last_second.reset();
+				if (publisher.compressor) {
+					const auto compression =
+						publisher.compression - publisher.compression_last_report;
+					spdlog::info("Topic {}: compressed {} B to {} B ({:.2f}x) with {} in {} us, {} "
+								 "us per payload",
+								 publisher.topic->name, compression.bytes_in, compression.bytes_out,
+								 compression.ratio(),
+								 compression_name(publisher.compressor->codec()),
+								 compression.ns / 1000,
+								 compression.ns / 1000 / std::max<u64>(compression.payloads, 1));
+					publisher.compression_last_report = publisher.compression;
+				}
+			}
+			if (car_tiles.bytes > 0) {
+				spdlog::info("Topic {}: {} B/s on all tiles, {} B/s for a client viewing {}x{} "
+							 "tiles around the busiest one, {} B/s on topic {}",
+							 topics::car_tiles, car_tiles.bytes, car_tiles.viewport_bytes,
+							 car_tiles.viewport_tiles, car_tiles.viewport_tiles, cars_bytes,
+							 topics::cars);
+			}
+			car_tiles.bytes = 0;
+			car_tiles.viewport_bytes = 0;
+			cars_bytes = 0;
+			last_report_time = now;
+		}
+	}
+
+	for (const auto& publisher : publishers) {
+		const auto& latency = publisher.step_to_send;
+		spdlog::info("Topic {}: sent {}, {}, {} subscriptions served from the last value cache, "
+					 "step to send p50 {} us, p99 {} us, max {} us",
+					 publisher.topic->name, publisher.stats.sent,
+					 format_drops(publisher.stats, publisher.socket->options),
+					 publisher.late_joiners,
+					 latency.percentile(0.5) / 1000, latency.percentile(0.99) / 1000,
+					 latency.max() / 1000);
+		if (publisher.compressor) {
+			const auto& compression = publisher.compression;
+			spdlog::info("Topic {}: compressed {} B to {} B ({:.2f}x) with {} in {}",
+						 publisher.topic->name, compression.bytes_in, compression.bytes_out,
+						 compression.ratio(), compression_name(publisher.compressor->codec()),
+						 humantime(compression.ns / 1000));
+		}
+	}
+}
+
+// Copies the latest snapshot into shared memory for the subscribers on this host, until the ring
+// is closed and drained
+auto write_snapshots_to_shm(SnapshotRing::Consumer consumer, ShmSnapshotWriter writer) -> void {
+	bool warned_about_truncation = false;
+	while (consumer.wait()) {
+		consumer.try_read_latest([&](const StepSnapshot& snapshot) {
+			if (! writer.publish(snapshot) && ! warned_about_truncation) {
+				spdlog::warn("{} cars do not fit in shared memory segment {}, increase "
+							 "transport.shm.max-cars",
+							 snapshot.cars.size(), writer.name());
+				warned_about_truncation = true;
+			}
+		});
+	}
+	writer.close();
+}
+
+[[nodiscard]] auto load_streetlamps(const std::filesystem::path& osm_path)
+	-> std::vector<StreetLamp> {
+	return extract_streetlamps_from_osm(osm_path)
+		.map_error([](const auto& err) {
+			if (err == extract_streetlamps_from_osm_error::file_not_found) {
+				spdlog::error("{}:{} OSM file not found", __FILE__, __LINE__);
+			} else if (err == extract_streetlamps_from_osm_error::xml_parse_error) {
+				spdlog::error("Failed to parse OSM file");
+			}
+			std::exit(1);
+		})
+		.value();
+}
+
+// Change each street lamp's lon/lat into x/y
+// We only need to do this once, as the street lamps are static
+// We need to do this since the OpenStreetMap file contains lon/lat coordinates of the street
+// lamps but the SUMO simulation uses x/y coordinates for the vehicles We do this here an not in
+// the parsing step because we need to have the simulation running to convert lon/lat to x/y
+auto project_streetlamps(std::vector<StreetLamp>& streetlamps) -> void {
+	for (auto& lamp : streetlamps) {
+		const auto geo = Simulation::convertGeo(lamp.lon, lamp.lat, true);
+		lamp.lon = geo.x;
+		lamp.lat = geo.y;
+	}
+}
+
+[[nodiscard]] auto create_compile_argv_parser() -> argparse::ArgumentParser {
+	auto argv_parser = argparse::ArgumentParser("compile", "0.1.0");
+	argv_parser.add_description(
+		"Precompile the street lamps of the scenario in config.toml into a network artifact, "
+		"which is memory mapped at startup instead of parsing and projecting the OSM file");
+	argv_parser.add_argument("-o", "--output")
+		.help("Where to write the artifact, defaults to sumo.streetlamps.artifact-path");
+	return argv_parser;
+}
+
+[[nodiscard]] auto create_timeline_argv_parser() -> argparse::ArgumentParser {
+	auto argv_parser = argparse::ArgumentParser("timeline", "0.1.0");
+	argv_parser.add_description(
+		"Compute when every street lamp was lit from a SUMO --fcd-output file (XML or CSV), "
+		"without running SUMO, and write it to an SQLite database. Needs the network artifact "
+		"of the `compile` subcommand.");
+	argv_parser.add_argument("fcd").help("The floating car data, in SUMO's x/y coordinates");
+	argv_parser.add_argument("-o", "--output")
+		.help("Where to write the timeline, defaults to the fcd file with a .timeline.sqlite "
+			  "extension");
+	argv_parser.add_argument("--chunk-size")
+		.help("MiB of the fcd file analysed at a time by one thread")
+		.default_value(16)
+		.scan<'i', int>();
+	return argv_parser;
+}
+
+[[nodiscard]] auto create_run_argv_parser() -> argparse::ArgumentParser {
+	auto argv_parser = argparse::ArgumentParser("sumo-sim-data-publisher", "0.1.0");
+	argv_parser.add_argument("--resume")
+		.help("Resume from the checkpoint at checkpoint.path instead of starting over")
+		.default_value(false)
+		.implicit_value(true);
+	return argv_parser;
+}
+
+// Projects the street lamps, builds the lamp grid and the lane to lamp table, and writes them to
+// a network artifact. Returns the exit code of the program.
+auto compile_network_artifact(const ProgramOptions& options, const SumoConfiguration& sumocfg,
+							  const std::filesystem::path& output) -> int {
+	const auto timer = Timer {};
+	// Projecting coordinates and reading lane shapes only needs the network, so the route files
+	// are not loaded
+	Simulation::start({"sumo", "--net-file", sumocfg.net_file.string(), "--no-step-log"});
+
+	auto streetlamps = load_streetlamps(options.osm_path);
+	project_streetlamps(streetlamps);
+	const auto distance_threshold = static_cast<f32>(options.streetlamp_distance_threshold);
+	const auto grid = build_streetlamp_grid(std::move(streetlamps), distance_threshold);
+
+	auto lanes = std::vector<LaneShape> {};
+	for (const auto& lane_id : Lane::getIDList()) {
+		auto& lane = lanes.emplace_back(LaneShape {.id = lane_id, .shape = {}});
+		for (const auto& p : Lane::getShape(lane_id).value) {
+			lane.shape.push_back({static_cast<f32>(p.x), static_cast<f32>(p.y)});
+		}
+	}
+	Simulation::close();
+
+	const auto num_lanes = lanes.size();
+	const auto lane_table =
+		build_lane_streetlamp_table(grid.view(), std::move(lanes), distance_threshold);
+
+	const auto written =
+		write_network_artifact(output, grid.view(), lane_table, distance_threshold, options.osm_path);
+	if (! written) {
+		if (written.error() == write_network_artifact_error::open_failed) {
+			spdlog::error("Failed to open {} for writing", output.string());
+		} else if (written.error() == write_network_artifact_error::write_failed) {
+			spdlog::error("Failed to write network artifact {}", output.string());
+		}
+		return 1;
+	}
+
+	spdlog::info("Compiled {} streetlamps in {} cells and {} lanes into {} ({} bytes) in {}",
+				 grid.lamps.size(), grid.spec.num_cells(), num_lanes, output.string(),
+				 std::filesystem::file_size(output), humantime(timer.elapsed_us()));
+	return 0;
+}
+
+// The buildings of the sumocfg's additional files. `additional-files` is a comma separated list,
+// relative to the sumocfg, so the cwd has to be its directory.
+auto load_scenario_buildings(const ProgramOptions& options, const SumoConfiguration& sumocfg)
+	-> BuildingFootprints {
+	auto	   footprints = BuildingFootprints {};
+	const auto additional_files = sumocfg.additional_files.string();
+	for (std::size_t begin = 0; begin < additional_files.size();) {
+		const auto end = std::min(additional_files.find(',', begin), additional_files.size());
+		const auto file = std::filesystem::path(additional_files.substr(begin, end - begin));
+		begin = end + 1;
+		if (file.empty()) {
+			continue;
+		}
+		const auto buildings = load_building_footprints(file).map_error([&](const auto& err) {
+			spdlog::error("Failed to read the buildings of {}: {}", file.string(),
+						  format_load_building_footprints_error(err));
+			std::exit(1);
+		});
+		footprints.append(*buildings);
+	}
+	if (footprints.size() == 0) {
+		spdlog::warn("sumo.streetlamps.occlusion is on, but the additional files of {} have no "
+					 "buildings",
+					 options.sumocfg_path.string());
+	}
+	return footprints;
+}
+
+// `timeline` subcommand
+struct TimelineCommand {
+	std::filesystem::path fcd_path;
+	std::filesystem::path output;
+	std::size_t			  chunk_bytes;
+};
+
+// Computes the lamp timeline of an FCD file from the network artifact's lamps, without TraCI.
+// The file is memory mapped and cut into chunks of whole timesteps, which the work stealing pool
+// analyses in parallel. Returns the exit code of the program.
+auto compute_lamp_timeline(const ProgramOptions& options, const SumoConfiguration& sumocfg,
+						   const AnalysisThreads& analysis_threads,
+						   const ThreadPlacement& thread_placement, const TimelineCommand& command)
+	-> int {
+	const auto timer = Timer {};
+	const auto distance_threshold = static_cast<f32>(options.streetlamp_distance_threshold);
+	const auto network_artifact =
+		load_network_artifact(options.streetlamp_artifact_path, options.osm_path,
+							  distance_threshold);
+	// Projecting the street lamps needs SUMO, so they have to be compiled already
+	if (! network_artifact) {
+		const auto err = network_artifact.error();
+		spdlog::error("Network artifact {} {}, run `compile` to {} it",
+					  options.streetlamp_artifact_path.string(),
+					  err == load_network_artifact_error::file_not_found ? "does not exist"
+					  : err == load_network_artifact_error::stale		  ? "is stale"
+																		  : "is invalid",
+					  err == load_network_artifact_error::file_not_found ? "create" : "update");
+		return 1;
+	}
+	const auto grid = network_artifact->grid();
+
+	auto building_occlusion = std::optional<BuildingOcclusion> {};
+	if (options.building_occlusion) {
+		building_occlusion.emplace(load_scenario_buildings(options, sumocfg), grid,
+								   distance_threshold);
+	}
+	const auto* occlusion = building_occlusion ? &*building_occlusion : nullptr;
+
+	const auto fcd = map_file_readonly(command.fcd_path);
+	if (! fcd) {
+		spdlog::error("Failed to map {}", command.fcd_path.string());
+		return 1;
+	}
+	const auto text = std::string_view(reinterpret_cast<const char*>(fcd->bytes().data()),
+									   fcd->size());
+	const auto layout = detect_fcd_layout(text);
+	if (! layout) {
+		spdlog::error("Failed to read {}: {}", command.fcd_path.string(),
+					  format_read_fcd_error(layout.error()));
+		return 1;
+	}
+	const auto chunks = split_fcd(text, *layout, command.chunk_bytes);
+
+	const auto num_threads = analysis_threads.count > 0
+								 ? analysis_threads.count
+								 : std::max(std::thread::hardware_concurrency(), 2u) - 1;
+	auto pool = WorkStealingPool(num_threads, thread_placement.pin ? analysis_threads.cpus
+																	: std::vector<int> {});
+	spdlog::info("Analysing {} ({} MiB) in {} chunks on {} threads", command.fcd_path.string(),
+				 fcd->size() >> 20, chunks.size(), pool.num_threads());
+
+	auto timeline_chunks = std::vector<TimelineChunk>(chunks.size());
+	auto errors = std::vector<std::optional<read_fcd_error>>(chunks.size());
+	const auto distance_threshold_squared = distance_threshold * distance_threshold;
+	pool.run(static_cast<u32>(chunks.size()), [&](const u32 idx) {
+		auto chunk = detect_timeline_chunk(grid, chunks[idx], *layout, distance_threshold_squared,
+										   occlusion);
+		if (chunk) {
+			timeline_chunks[idx] = std::move(*chunk);
+		} else {
+			errors[idx] = chunk.error();
+		}
+	});
+	for (const auto& err : errors) {
+		if (err) {
+			spdlog::error("Failed to read {}: {}", command.fcd_path.string(),
+						  format_read_fcd_error(*err));
+			return 1;
+		}
+	}
+	const auto analysed_us = timer.elapsed_us();
+
+	const auto timeline = merge_timeline_chunks(timeline_chunks, grid.lamps.size());
+	const auto written = write_lamp_timeline(command.output, grid, timeline,
+											 command.fcd_path.string(), distance_threshold);
+	if (! written) {
+		spdlog::error("Failed to write {}: {}", command.output.string(),
+					  format_write_lamp_timeline_error(written.error()));
+		return 1;
+	}
+
+	spdlog::info("Wrote {} lit intervals of {} lamps over {} timesteps ({}s to {}s) to {}",
+				 timeline.intervals.size(), grid.lamps.size(), timeline.steps, timeline.begin,
+				 timeline.end, command.output.string());
+	spdlog::info("Analysed in {} ({:.0f} MiB/s), {} in total", humantime(analysed_us),
+				 static_cast<double>(fcd->size()) / (1 << 20) / (analysed_us / 1e6),
+				 humantime(timer.elapsed_us()));
+	return 0;
+}
+
 auto main(int argc, char** argv) -> int {
 	const auto configuration_file_path = std::filesystem::path("config.toml");
 	if (! std::filesystem::exists(configuration_file_path)) {
@@ -596,6 +1893,9 @@ auto main(int argc, char** argv) -> int {
 
 	const auto config = toml::parse_file(configuration_file_path.string());
 	const auto options = parse_configuration(config);
+	const auto reporting_options = read_reporting_options(config);
+	// From here on logging never waits for the terminal
+	install_async_logger(reporting_options);
 	// const auto options = parse_args(argv_parser, argc, argv)
 	// 						 .map_error([&](const auto& err) {
 	// 							 spdlog::error("{}", err);
@@ -605,32 +1905,231 @@ auto main(int argc, char** argv) -> int {
 	//  .value();
 
 	pprint(options);
+	pprint(reporting_options);
+
+	// `compile` subcommand, with the output resolved before cwd changes below
+	const auto compile_output = [&]() -> std::optional<std::filesystem::path> {
+		if (argc < 2 || argv[1] != "compile"sv) {
+			return std::nullopt;
+		}
+		auto compile_argv_parser = create_compile_argv_parser();
+		try {
+			compile_argv_parser.parse_args(argc - 1, argv + 1);
+		} catch (const std::exception& err) {
+			spdlog::error("{}", err.what());
+			std::cerr << compile_argv_parser;
+			std::exit(2);
+		}
+		const auto output = compile_argv_parser.present("--output");
+		return output ? std::filesystem::absolute(*output) : options.streetlamp_artifact_path;
+	}();
+
+	// `timeline` subcommand, with the paths resolved before cwd changes below
+	const auto timeline_command = [&]() -> std::optional<TimelineCommand> {
+		if (argc < 2 || argv[1] != "timeline"sv) {
+			return std::nullopt;
+		}
+		auto timeline_argv_parser = create_timeline_argv_parser();
+		try {
+			timeline_argv_parser.parse_args(argc - 1, argv + 1);
+		} catch (const std::exception& err) {
+			spdlog::error("{}", err.what());
+			std::cerr << timeline_argv_parser;
+			std::exit(2);
+		}
+		const auto fcd_path = std::filesystem::absolute(timeline_argv_parser.get("fcd"));
+		const auto output = timeline_argv_parser.present("--output");
+		const auto chunk_size = timeline_argv_parser.get<int>("--chunk-size");
+		if (chunk_size <= 0) {
+			spdlog::error("--chunk-size must be positive");
+			std::exit(2);
+		}
+		auto default_output = fcd_path;
+		default_output.replace_extension(".timeline.sqlite");
+		return TimelineCommand {
+			.fcd_path = fcd_path,
+			.output = output ? std::filesystem::absolute(*output) : default_output,
+			.chunk_bytes = static_cast<std::size_t>(chunk_size) << 20,
+		};
+	}();
 
-	const auto topic_cars = Topic {
-		.name = config["topics"]["cars"].value_or("cars"),
-		.publish_rate = config["topics"]["cars"]["publish-rate"].value_or(0),
-		.enabled = config["topics"]["cars"]["enabled"].value_or(false),
+	const bool resume = [&]() {
+		if (compile_output || timeline_command) {
+			return false;
+		}
+		auto run_argv_parser = create_run_argv_parser();
+		try {
+			run_argv_parser.parse_args(argc, argv);
+		} catch (const std::exception& err) {
+			spdlog::error("{}", err.what());
+			std::cerr << run_argv_parser;
+			std::exit(2);
+		}
+		return run_argv_parser.get<bool>("--resume");
+	}();
+
+	const auto topics = std::vector<Topic> {
+		read_topic(config, topics::cars, options.port),
+		read_topic(config, topics::streetlamps, options.port),
+		read_topic(config, topics::car_tiles, options.port),
+		read_topic(config, topics::vehicle_ids, options.port),
+		read_topic(config, topics::heatmap, options.port),
+	};
+	for (const auto& topic : topics) {
+		pprint(topic);
+	}
+
+	const auto car_tile_options = CarTileOptions {
+		.zoom = config["topics"]["car-tiles"]["zoom"].value_or(3),
+		.viewport_tiles = config["topics"]["car-tiles"]["viewport-tiles"].value_or(3),
 	};
+	if (car_tile_options.zoom < 0 || car_tile_options.zoom > 16) {
+		spdlog::error("topics.car-tiles.zoom must be between 0 and 16");
+		std::exit(1);
+	}
+	if (car_tile_options.viewport_tiles <= 0) {
+		spdlog::error("topics.car-tiles.viewport-tiles must be positive");
+		std::exit(1);
+	}
+	pprint(car_tile_options);
 
-	if (topic_cars.publish_rate <= 0) {
-		spdlog::error("topics.cars.publish-rate must be positive");
+	const auto heatmap_options = HeatmapOptions {
+		.cell_size = config["topics"]["heatmap"]["cell-size"].value_or(25.0),
+		.threads = config["topics"]["heatmap"]["threads"].value_or(1u),
+	};
+	if (! (heatmap_options.cell_size > 0.0)) {
+		spdlog::error("topics.heatmap.cell-size must be positive");
+		std::exit(1);
+	}
+	if (heatmap_options.threads == 0) {
+		spdlog::error("topics.heatmap.threads must be positive");
 		std::exit(1);
 	}
+	pprint(heatmap_options);
 
-	pprint(topic_cars);
+	const auto zmq_io_threads = config["transport"]["zmq"]["io-threads"].value_or(1);
+	if (zmq_io_threads <= 0) {
+		spdlog::error("transport.zmq.io-threads must be positive");
+		std::exit(1);
+	}
 
-	const auto topic_streetlamps = Topic {
-		.name = config["topics"]["streetlamps"].value_or("streetlamps"),
-		.publish_rate = config["topics"]["streetlamps"]["publish-rate"].value_or(0),
-		.enabled = config["topics"]["streetlamps"]["enabled"].value_or(false),
+	const auto shm_transport = ShmTransport {
+		.enabled = config["transport"]["shm"]["enabled"].value_or(false),
+		.name = config["transport"]["shm"]["name"].value_or(
+			std::string(default_shm_snapshot_name)),
+		.max_cars = config["transport"]["shm"]["max-cars"].value_or(16384u),
 	};
 
-	if (topic_streetlamps.publish_rate <= 0) {
-		spdlog::error("topics.streetlamps.publish-rate must be positive");
+	if (shm_transport.enabled && (shm_transport.name.size() < 2 || shm_transport.name[0] != '/')) {
+		spdlog::error("transport.shm.name must start with a '/', e.g. \"{}\"",
+					  default_shm_snapshot_name);
 		std::exit(1);
 	}
 
-	pprint(topic_streetlamps);
+	pprint(shm_transport);
+
+	const auto query_service = QueryService {
+		.enabled = config["query"]["enabled"].value_or(false),
+		.endpoint =
+			config["query"]["endpoint"].value_or(fmt::format("tcp://*:{}", options.port + 1)),
+	};
+	pprint(query_service);
+
+	const auto pacing_options = read_pacing_options(config);
+	pprint(pacing_options);
+
+	const auto numa_topology = detect_numa_topology();
+	if (numa_topology) {
+		for (const auto& node : numa_topology->nodes) {
+			spdlog::info("NUMA node {}: CPUs {}", node.id, fmt::join(node.cpus, ","));
+		}
+	} else {
+		spdlog::info("No NUMA topology: {}", format_numa_topology_error(numa_topology.error()));
+	}
+	const auto thread_placement = read_thread_placement(config, numa_topology);
+	pprint(thread_placement);
+	const auto analysis_threads = read_analysis_threads(config, numa_topology);
+	pprint(analysis_threads);
+
+	// max-displacement is a fraction of the distance threshold
+	const auto analysis_options = [&]() {
+		auto analysis = AnalysisCadenceOptions {
+			.adaptive = config["analysis"]["adaptive"].value_or(false),
+			.max_interval = config["analysis"]["max-interval"].value_or(1.0),
+		};
+		const auto max_displacement = config["analysis"]["max-displacement"].value_or(0.25);
+		if (! (analysis.max_interval > 0.0)) {
+			spdlog::error("analysis.max-interval must be positive");
+			std::exit(1);
+		}
+		if (! (max_displacement > 0.0 && max_displacement <= 1.0)) {
+			spdlog::error("analysis.max-displacement must be in (0, 1]");
+			std::exit(1);
+		}
+		analysis.max_displacement =
+			static_cast<f32>(max_displacement * options.streetlamp_distance_threshold);
+		return analysis;
+	}();
+	pprint(analysis_options);
+
+	// Defaults to a file next to the sumocfg file, e.g. horsens/horsens.checkpoint.bin
+	const auto checkpointing = Checkpointing {
+		.every = config["checkpoint"]["every"].value_or(0),
+		.path = [&]() {
+			const auto path = config["checkpoint"]["path"].value_or(""sv);
+			if (! path.empty()) {
+				return std::filesystem::absolute(path);
+			}
+			auto default_path = options.sumocfg_path;
+			default_path.replace_extension(".checkpoint.bin");
+			return default_path;
+		}(),
+	};
+	if (checkpointing.every < 0) {
+		spdlog::error("checkpoint.every must not be negative");
+		std::exit(1);
+	}
+	pprint(checkpointing);
+
+	// Defaults to a file next to the sumocfg file, e.g. horsens/horsens.occupancy.sqlite
+	const auto occupancy_archiving = [&]() {
+		auto occupancy = OccupancyArchiving {
+			.enabled = config["occupancy"]["enabled"].value_or(false),
+			.path = config["occupancy"]["path"].value_or(""sv),
+		};
+		if (occupancy.path.empty()) {
+			occupancy.path = options.sumocfg_path;
+			occupancy.path.replace_extension(".occupancy.sqlite");
+		} else {
+			occupancy.path = std::filesystem::absolute(occupancy.path);
+		}
+		if (const auto* resolutions = config["occupancy"]["resolutions"].as_array()) {
+			for (const auto& resolution : *resolutions) {
+				occupancy.resolutions.push_back(resolution.value_or(0.0));
+			}
+		} else {
+			occupancy.resolutions = {1.0, 60.0, 900.0};
+		}
+		if (occupancy.resolutions.empty() || ! (occupancy.resolutions.front() > 0.0)) {
+			spdlog::error("occupancy.resolutions must be positive numbers of seconds");
+			std::exit(1);
+		}
+		for (std::size_t idx = 1; idx < occupancy.resolutions.size(); ++idx) {
+			const auto multiple = occupancy.resolutions[idx] / occupancy.resolutions[idx - 1];
+			if (multiple < 2.0 - 1e-9 || std::abs(multiple - std::round(multiple)) > 1e-9) {
+				spdlog::error("occupancy.resolutions must be ascending, each a multiple of the "
+							  "one before");
+				std::exit(1);
+			}
+		}
+		if (occupancy.enabled && ! options.incremental_lamp_detection) {
+			spdlog::error("occupancy needs sumo.streetlamps.detection = \"incremental\", which "
+						  "counts the vehicles near every lamp");
+			std::exit(1);
+		}
+		return occupancy;
+	}();
+	pprint(occupancy_archiving);
 
 	const auto sumo_home_path = [&]() {
 		auto result = get_sumo_home_directory_path();
@@ -682,280 +2181,597 @@ auto main(int argc, char** argv) -> int {
 		spdlog::warn("Changed cwd to {}", std::filesystem::current_path().string());
 	}
 
-	pugi::xml_document route_files_xml_doc;
-
-	const auto result = route_files_xml_doc.load_file(sumocfg.route_files.c_str());
-	if (! result) {
-		spdlog::error("Failed to parse route files: {}", result.description());
-		return 1;
+	if (compile_output) {
+		return compile_network_artifact(options, sumocfg, *compile_output);
 	}
 
-	// phmap::flat_hash_map<int, Car> cars;
-	phmap::parallel_flat_hash_map<int, Car> cars;
+	// The heatmap covers the network SUMO simulates, which has its boundary in its <location>
+	auto heatmap_spec = RasterSpec {};
+	const auto heatmap_enabled = std::any_of(topics.begin(), topics.end(), [](const auto& topic) {
+		return topic.key == topics::heatmap && topic.enabled;
+	});
+	if (heatmap_enabled) {
+		const auto boundary = read_net_boundary(sumocfg.net_file);
+		if (! boundary) {
+			spdlog::error("Failed to read the boundary of {} for the heatmap: {}",
+						  sumocfg.net_file.string(),
+						  format_read_net_boundary_error(boundary.error()));
+			std::exit(1);
+		}
+		heatmap_spec = RasterSpec::covering(*boundary, heatmap_options.cell_size);
+		spdlog::info("Heatmap raster: {} x {} cells of {} m", heatmap_spec.columns,
+					 heatmap_spec.rows, heatmap_spec.cell_size);
+	}
+	if (timeline_command) {
+		return compute_lamp_timeline(options, sumocfg, analysis_threads, thread_placement,
+									 *timeline_command);
+	}
 
-	zmq::context_t zmq_ctx;
-	zmq::socket_t  sock(zmq_ctx, zmq::socket_type::pub);
-	// FIXME: do not use tcp maybe ipc://
-	const std::string addr = fmt::format("tcp://*:{}", options.port);
-	sock.bind(addr);
-	spdlog::info("Bound zmq PUB socket to {}", addr);
+	const auto startup_timer = Timer {};
+	// Map the precompiled street lamps, falling back to parsing the OSM file if there are none
+	const auto network_artifact =
+		load_network_artifact(options.streetlamp_artifact_path, options.osm_path,
+							  static_cast<f32>(options.streetlamp_distance_threshold))
+			.map_error([&](const auto& err) {
+				const auto path = options.streetlamp_artifact_path.string();
+				if (err == load_network_artifact_error::file_not_found) {
+					spdlog::warn("No network artifact at {}, run `{} compile` to create it", path,
+								 argv[0]);
+				} else if (err == load_network_artifact_error::stale) {
+					spdlog::warn("Network artifact {} is stale, run `{} compile` to update it",
+								 path, argv[0]);
+				} else {
+					spdlog::warn("Network artifact {} is invalid, run `{} compile` to recreate it",
+								 path, argv[0]);
+				}
+			});
+
+	// SUMO's vehicle ids interned as dense handles, and the cars indexed by them. A car is alive
+	// while its vehicle is on the road.
+	auto vehicle_ids = VehicleIdTable {};
+	auto cars = std::vector<Car> {};
+
+	auto zmq_ctx = zmq::context_t(zmq_io_threads);
+	// Has to be set before the first socket starts the IO threads
+	if (thread_placement.pin) {
+		for (const auto cpu : thread_placement.io_cpus) {
+			zmq_ctx.set(zmq::ctxopt::thread_affinity_cpu_add, cpu);
+		}
+	}
+	auto topic_sockets = bind_topic_sockets(zmq_ctx, topics);
+	auto query_socket = zmq::socket_t {};
+	if (query_service.enabled) {
+		query_socket = zmq::socket_t(zmq_ctx, zmq::socket_type::router);
+		try {
+			query_socket.bind(query_service.endpoint);
+		} catch (const zmq::error_t& err) {
+			spdlog::error("Failed to bind zmq ROUTER socket to {}: {}", query_service.endpoint,
+						  err.what());
+			std::exit(1);
+		}
+		spdlog::info("Bound zmq ROUTER socket for queries to {}", query_service.endpoint);
+	}
 
 	const int num_retries_sumo_sim_connect = 100;
 	Simulation::init(options.sumo_port, num_retries_sumo_sim_connect, "localhost");
 	const double dt = Simulation::getDeltaT();
 
-	auto streetlamps =
-		extract_streetlamps_from_osm(options.osm_path)
-			.map_error([](const auto& err) {
-				if (err == extract_streetlamps_from_osm_error::file_not_found) {
-					spdlog::error("{}:{} OSM file not found", __FILE__, __LINE__);
-				} else if (err == extract_streetlamps_from_osm_error::xml_parse_error) {
-					spdlog::error("Failed to parse OSM file");
-				}
-				std::exit(1);
-			})
-			.value();
-
-	// Change each street lamp's lon/lat into x/y
-	// We only need to do this once, as the street lamps are static
-	// We need to do this since the OpenStreetMap file contains lon/lat coordinates of the street
-	// lamps but the SUMO simulation uses x/y coordinates for the vehicles We do this here an not in
-	// the parsing step because we need to have the simulation running to convert lon/lat to x/y
-	for (auto& lamp : streetlamps) {
-		const auto geo = Simulation::convertGeo(lamp.lon, lamp.lat, true);
-		lamp.lon = geo.x;
-		lamp.lat = geo.y;
-		// pprint(lamp);
+	auto streetlamp_grid_storage = StreetLampGrid {};
+	if (! network_artifact) {
+		auto streetlamps = load_streetlamps(options.osm_path);
+		project_streetlamps(streetlamps);
+		streetlamp_grid_storage = build_streetlamp_grid(
+			std::move(streetlamps), static_cast<f32>(options.streetlamp_distance_threshold));
 	}
+	// Lamps sorted by grid cell. A lamp's index in this order is used to refer to it below
+	const auto streetlamp_grid =
+		network_artifact ? network_artifact->grid() : streetlamp_grid_storage.view();
+	const auto& streetlamps = streetlamp_grid.lamps;
 
 	spdlog::info("streetlamps.size(): {}", streetlamps.size());
-	spdlog::info("dt: {}", dt);
 
-	auto bar = indicators::BlockProgressBar {
-		indicators::option::BarWidth {80},
-		indicators::option::Start {"|"},
-		indicators::option::End {"|"},
-		indicators::option::ShowElapsedTime {true},
-		indicators::option::ForegroundColor {indicators::Color::blue},
+	// Lamps are not lit by vehicles behind the buildings of the sumocfg's additional files
+	auto building_occlusion = std::optional<BuildingOcclusion> {};
+	if (options.building_occlusion) {
+		const auto occlusion_timer = Timer {};
+		building_occlusion.emplace(load_scenario_buildings(options, sumocfg), streetlamp_grid,
+								   static_cast<f32>(options.streetlamp_distance_threshold));
+		spdlog::info("Loaded {} buildings for lamp occlusion in {}, {:.1f}% of the cells around "
+					 "the lamps have no building in the way",
+					 building_occlusion->num_buildings(),
+					 humantime(occlusion_timer.elapsed_us()),
+					 100.0 * building_occlusion->clear_share());
+	}
+	const auto* occlusion = building_occlusion ? &*building_occlusion : nullptr;
+
+	spdlog::info("dt: {}", dt);
+	spdlog::info("Startup took: {}", humantime(startup_timer.elapsed_us()));
+
+
+	// `streetlamp_lit[idx]` is 1 if the lamp at index idx has vehicles nearby, when it is
+	// recomputed every step instead of kept up to date by `incremental_detector`. It and the copy
+	// of the lamps the analysis threads read are first written below, by the threads using them.
+	auto streetlamp_lit = FirstTouchArray<u8>(streetlamps.size());
+	auto analysis_lamps = FirstTouchArray<StreetLamp>(streetlamps.size());
+	const auto analysis_grid = StreetLampGridView {
+		.spec = streetlamp_grid.spec,
+		.lamps = analysis_lamps.span(),
+		.cell_offsets = streetlamp_grid.cell_offsets,
 	};
+	// Positions of the alive cars, and them bucketed by the cells of the street lamp grid
+	auto car_positions = std::vector<Point> {};
+	auto car_buckets = CellBuckets {};
 
-	// Hide cursor
-	indicators::show_console_cursor(false);
+	const auto n_hardware_threads = std::thread::hardware_concurrency();
+	spdlog::info("n_threads: {}", n_hardware_threads);
+	const auto n_threads_in_pool = analysis_threads.count > 0
+									   ? analysis_threads.count
+									   : std::max(n_hardware_threads, 2u) - 1;
+
+	// The incremental detector runs on the simulation thread, else one of the two pools checks
+	// every lamp
+	auto static_pool = std::optional<BS::thread_pool> {};
+	auto stealing_pool = std::optional<WorkStealingPool> {};
+	if (! options.incremental_lamp_detection && analysis_threads.work_stealing) {
+		stealing_pool.emplace(n_threads_in_pool, thread_placement.pin ? analysis_threads.cpus
+																	   : std::vector<int> {});
+		spdlog::info("Created work stealing pool with {} threads", stealing_pool->num_threads());
+	} else if (! options.incremental_lamp_detection) {
+		static_pool.emplace(n_threads_in_pool);
+		spdlog::info("Created thread pool with {} threads", static_pool->get_thread_count());
+	}
 
+	const auto streetlamp_distance_threshold_squared =
+		static_cast<f32>(std::pow(options.streetlamp_distance_threshold, 2));
+	// Tasks are rounded up to whole pages of the analysis lamps, so every page of them is first
+	// written by, and placed on the node of, the thread that owns its task. The lit flags are a
+	// byte per lamp, so a page of them is shared by the tasks of several pages of lamps.
+	const auto lamps_per_page = FirstTouchArray<StreetLamp>::elements_per_page();
+	const auto lamps_per_task =
+		(analysis_threads.lamps_per_task + lamps_per_page - 1) / lamps_per_page * lamps_per_page;
+	if (stealing_pool && lamps_per_task != analysis_threads.lamps_per_task) {
+		spdlog::info("Rounded threads.lamps-per-task up to {}, a whole number of pages of lamps",
+					 lamps_per_task);
+	}
+	const auto num_lamp_tasks =
+		static_cast<u32>((streetlamps.size() + lamps_per_task - 1) / lamps_per_task);
+	const auto lamps_of_task = [&](const u32 task) {
+		const auto begin = static_cast<std::size_t>(task) * lamps_per_task;
+		return std::pair(begin, std::min(begin + lamps_per_task, streetlamps.size()));
+	};
 
-	// Preallocate memory for the streetlamp_ids_with_vehicles_nearby vector
-	auto streetlamp_ids_with_vehicles_nearby = std::vector<std::int64_t>(streetlamps.size(), 0);
+	// Every work stealing thread writes the lamps of its own share of the tasks first, so they
+	// are on its NUMA node, and remembers which node that is. Tasks that are stolen, or run after
+	// the OS moved an unpinned thread, read their lamps from another node.
+	const auto track_numa_nodes = numa_topology && numa_topology->nodes.size() > 1;
+	auto	   task_home_node = std::vector<int>(num_lamp_tasks, -1);
+	auto	   task_runs_off_node = std::vector<u64>(num_lamp_tasks, 0);
+	if (stealing_pool) {
+		stealing_pool->run_own_shares(num_lamp_tasks, [&](const u32 task) {
+			const auto [begin, end] = lamps_of_task(task);
+			std::copy(streetlamps.begin() + begin, streetlamps.begin() + end,
+					  analysis_lamps.data() + begin);
+			std::fill(streetlamp_lit.data() + begin, streetlamp_lit.data() + end, u8 {0});
+			if (track_numa_nodes) {
+				task_home_node[task] = numa_topology->node_of_cpu(current_cpu());
+			}
+		});
+	} else {
+		std::copy(streetlamps.begin(), streetlamps.end(), analysis_lamps.data());
+		std::fill(streetlamp_lit.data(), streetlamp_lit.data() + streetlamp_lit.size(), u8 {0});
+	}
 
-	const auto n_hardware_threads = std::thread::hardware_concurrency();
-	spdlog::info("n_threads: {}", n_hardware_threads);
-	const auto n_threads_in_pool = n_hardware_threads - 1;
+	auto incremental_detector = std::optional<IncrementalLampDetector> {};
+	if (options.incremental_lamp_detection) {
+		incremental_detector.emplace(streetlamp_grid, streetlamp_distance_threshold_squared,
+									 occlusion);
+	}
+	auto allocation_stats = AllocationStats {};
+
+	auto snapshots = SnapshotRing {};
+	auto publisher_thread =
+		std::thread(publish_topics, snapshots.subscribe(), std::ref(topic_sockets),
+					std::cref(topics), streetlamp_grid.spec, std::cref(car_tile_options),
+					std::cref(heatmap_spec), std::cref(heatmap_options));
+	auto query_index = std::optional<QueryIndex> {};
+	auto query_thread = std::thread {};
+	if (query_service.enabled) {
+		query_index.emplace(streetlamp_grid, network_artifact ? &*network_artifact : nullptr);
+		query_thread = std::thread(run_query_service, snapshots.subscribe(), std::ref(query_socket),
+								   std::ref(*query_index));
+	}
+	auto shm_thread = std::thread {};
+	if (shm_transport.enabled) {
+		auto writer = create_shm_snapshot_writer(shm_transport.name, shm_transport.max_cars,
+												 static_cast<std::uint32_t>(streetlamps.size()));
+		if (! writer) {
+			spdlog::error("Failed to create shared memory segment {}: {}", shm_transport.name,
+						  format_shm_snapshot_error(writer.error()));
+			std::exit(1);
+		}
+		spdlog::info("Writing snapshots to shared memory segment {}", shm_transport.name);
+		shm_thread =
+			std::thread(write_snapshots_to_shm, snapshots.subscribe(), std::move(*writer));
+	}
+	if (thread_placement.pin && ! thread_placement.io_cpus.empty()) {
+		for (auto* thread : {&publisher_thread, &query_thread, &shm_thread}) {
+			if (thread->joinable() && ! pin_thread_to_cpus(*thread, thread_placement.io_cpus)) {
+				spdlog::warn("Failed to pin an IO thread to CPUs {}",
+							 fmt::join(thread_placement.io_cpus, ","));
+			}
+		}
+	}
 
-	// Constructs a thread pool with as many threads as available in the hardware.
-	BS::thread_pool pool(n_threads_in_pool);
-	spdlog::info("Created thread pool with {} threads", pool.get_thread_count());
+	int first_simulation_step = 0;
+	if (resume) {
+		const auto checkpoint =
+			read_checkpoint(checkpointing.path)
+				.map_error([&](const auto& err) {
+					spdlog::error("Failed to resume from checkpoint {}: {}",
+								  checkpointing.path.string(), format_checkpoint_error(err));
+					std::exit(1);
+				})
+				.value();
+		Simulation::loadState(checkpoint.sumo_state_path.string());
+		// The vehicles of the checkpoint departed before SUMO's state was saved, so they get the
+		// handles they had back
+		for (std::size_t idx = 0; idx < checkpoint.snapshot.cars.size(); ++idx) {
+			const auto handle = checkpoint.snapshot.car_handles[idx];
+			vehicle_ids.assign(handle, checkpoint.snapshot.car_names[idx]);
+			cars.resize(std::max<std::size_t>(cars.size(), handle + 1));
+			cars[handle] = checkpoint.snapshot.cars[idx];
+		}
+		first_simulation_step = static_cast<int>(checkpoint.snapshot.step) + 1;
+		// Subscribers see the state of the checkpoint before the first new step is done
+		snapshots.publish([&](StepSnapshot& snapshot) {
+			snapshot = checkpoint.snapshot;
+			snapshot.step_done_ns = monotonic_ns();
+		});
+		spdlog::info("Resumed from checkpoint {} at step {} ({} cars)", checkpointing.path.string(),
+					 checkpoint.snapshot.step, checkpoint.snapshot.cars.size());
+	}
+	// Vehicles that departed before the first step, which `getDepartedIDList` will not report,
+	// e.g. the ones of a state file loaded by the sumocfg
+	for (const auto& id : Vehicle::getIDList()) {
+		if (vehicle_ids.find(id) == VehicleIdTable::no_handle) {
+			const auto handle = vehicle_ids.intern(id);
+			cars.resize(std::max<std::size_t>(cars.size(), handle + 1));
+		}
+	}
 
-	const auto streetlamp_distance_threshold_doubled =
-		std::pow(options.streetlamp_distance_threshold, 2);
-	// TODO: detect signed overflow
-	// deallocate-inactive-cars-every
-	const auto do_deallocation_pass_every_n_steps =
-		config["sumo"]["deallocate-inactive-cars-every"].value_or(1000);
-	if (do_deallocation_pass_every_n_steps <= 0) {
-		spdlog::error("sumo.deallocate-inactive-cars-every must be positive");
-		std::exit(1);
+	auto checkpoint_writer = std::optional<CheckpointWriter> {};
+	if (checkpointing.every > 0) {
+		checkpoint_writer.emplace(checkpointing.path);
 	}
 
-	int do_deallocation_pass_at_step = do_deallocation_pass_every_n_steps;
+	auto occupancy_archive = std::optional<OccupancyArchive> {};
+	if (occupancy_archiving.enabled) {
+		auto lamp_osm_ids = std::vector<std::int64_t>(streetlamps.size());
+		for (std::size_t idx = 0; idx < streetlamps.size(); ++idx) {
+			lamp_osm_ids[idx] = streetlamps[idx].id;
+		}
+		auto database = OccupancyDatabase::open(occupancy_archiving.path, lamp_osm_ids);
+		if (! database) {
+			spdlog::error("Failed to open the occupancy archive {}: {}",
+						  occupancy_archiving.path.string(),
+						  format_occupancy_archive_error(database.error()));
+			std::exit(1);
+		}
+		occupancy_archive.emplace(std::move(*database), streetlamps.size(),
+								  occupancy_archiving.resolutions);
+		spdlog::info("Archiving lamp occupancy to {}", occupancy_archiving.path.string());
+	}
+	// Simulated time up to which the occupancy is archived
+	auto occupancy_recorded_until = first_simulation_step * dt;
+
+	auto cadence = AnalysisCadence(analysis_options);
+
+	// Built once, the work stealing pool only keeps a reference to it
+	const auto look_for_cars_close_to_streetlamps_in_task =
+		std::function<void(u32)>([&](const u32 task) {
+			const auto [begin, end] = lamps_of_task(task);
+			mark_lit_streetlamps(analysis_grid, car_buckets, car_positions,
+								 streetlamp_distance_threshold_squared, begin, end,
+								 streetlamp_lit.span(), occlusion);
+			if (track_numa_nodes &&
+				numa_topology->node_of_cpu(current_cpu()) != task_home_node[task]) {
+				task_runs_off_node[task]++;
+			}
+		});
+	u64 lamp_analysis_runs = 0;
+
+	// Draws the progress bar and warns about lag, so the loop below never writes to the terminal
+	auto reporter = ProgressReporter(reporting_options, first_simulation_step,
+									 options.simulation_steps, options.verbose,
+									 pacing_options.speed, thread_placement.io_cpus);
+	auto& progress = reporter.progress();
+
+	// Pinned last, threads started by this thread inherit its CPUs
+	if (thread_placement.pin && ! thread_placement.simulation_cpus.empty() &&
+		! pin_current_thread_to_cpus(thread_placement.simulation_cpus)) {
+		spdlog::warn("Failed to pin the simulation thread to CPUs {}",
+					 fmt::join(thread_placement.simulation_cpus, ","));
+	}
 
 	// const auto t_sim_start = std::chrono::high_resolution_clock::now();
 	const auto sim_timer = Timer {};
+	const auto pacer = Pacer(dt, pacing_options);
 
-	for (int simulation_step = 0; simulation_step < options.simulation_steps; ++simulation_step) {
+	for (int simulation_step = first_simulation_step; simulation_step < options.simulation_steps;
+		 ++simulation_step) {
 		// Keep track of the accumelated time of the simulation
 		// const auto t_start = std::chrono::high_resolution_clock::now();
-		const auto sim_step_timer = Timer {};
-		Simulation::step();
-
-		{ // Get (x,y, theta) of all vehicles
-			const auto vehicles_ids = Vehicle::getIDList();
-
-			for (const auto& id : vehicles_ids) {
-				const int id_as_int = std::stoi(id);
-				cars.try_emplace(id_as_int, Car {});
-				auto& car = cars[id_as_int];
-
-				const auto position = Vehicle::getPosition(id);
-
-				car.x = position.x;
-				car.y = position.y;
-				car.heading = Vehicle::getAngle(id);
-				car.alive = true;
-			}
+		const auto lag = pacer.wait_for(static_cast<u64>(simulation_step - first_simulation_step));
+		if (lag > Pacer::clock::duration::zero()) {
+			progress.record_lag(std::chrono::duration_cast<std::chrono::microseconds>(lag));
 		}
 
-		if (simulation_step == do_deallocation_pass_at_step) {
-			// Go through all cars and deallocate the memory of the ones that are not alive
-			if (options.verbose) {
-				fmt::print("Deallocating memory of dead cars\r");
+		const auto sim_step_timer = Timer {};
+		const auto allocations_at_step_start = allocation_count();
+		Simulation::step();
+		const auto step_done_ns = monotonic_ns();
+
+		{ // Vehicles get a handle when they depart and give it back when they arrive, the ids
+		  // of all the others are not looked at
+			const auto departed = Simulation::getDepartedIDList();
+			const auto arrived = Simulation::getArrivedIDList();
+			for (const auto& id : departed) {
+				const auto handle = vehicle_ids.intern(id);
+				if (handle >= cars.size()) {
+					cars.resize(handle + 1);
+				}
+				cars[handle] = Car {.x = 0, .y = 0, .heading = 0.0, .alive = false};
 			}
-			const auto num_cars_before = cars.size();
-			for (auto it = cars.begin(); it != cars.end();) {
-				if (! it->second.alive) {
-					it = cars.erase(it);
-				} else {
-					++it;
+			for (const auto& id : arrived) {
+				const auto handle = vehicle_ids.find(id);
+				if (handle != VehicleIdTable::no_handle) {
+					cars[handle].alive = false;
+					vehicle_ids.release(handle);
 				}
 			}
-			const auto num_cars_after = cars.size();
-			if (options.verbose) {
-				fmt::println("Deallocated {} - {} = {} cars", num_cars_before, num_cars_after,
-							 num_cars_before - num_cars_after);
+			if (! departed.empty() || ! arrived.empty()) {
+				cadence.entered_or_left();
 			}
-			do_deallocation_pass_at_step += do_deallocation_pass_every_n_steps;
 		}
 
-		std::atomic<int> num_streetlamps_with_vehicles_nearby = 0;
-		// Check if any cars are close to a street lamp
-		const auto look_for_cars_close_to_streetlamps = [&](const auto start, const auto end) {
-			for (auto idx = start; idx < end; ++idx) {
-				const auto lamp = streetlamps[idx];
-				for (const auto& [_, car] : cars) {
-					// TODO: maybe not as x and y are quite large numbers
-					// TODO PERF: use squared distance instead of distance to avoid the sqrt call
-					const double distance = (car.x - lamp.lon) * (car.x - lamp.lon) +
-											(car.y - lamp.lat) * (car.y - lamp.lat);
-					// const double distance = std::hypot(car.x - lamp.lon, car.y - lamp.lat);
-
-					// streetlamp_distance_threshold_doubled
-					if (distance <= streetlamp_distance_threshold_doubled) {
-						streetlamp_ids_with_vehicles_nearby[num_streetlamps_with_vehicles_nearby] =
-							lamp.id;
-						num_streetlamps_with_vehicles_nearby++;
-					}
-				}
+		// Get (x,y, theta) of all vehicles
+		for (VehicleHandle handle = 0; handle < vehicle_ids.capacity(); ++handle) {
+			if (! vehicle_ids.live(handle)) {
+				continue;
 			}
+			const auto& id = vehicle_ids.name(handle);
+			auto&		car = cars[handle];
+			const auto	position = Vehicle::getPosition(id);
+			// Teleporting vehicles are not on the road, and have no position
+			car.alive = position.x != INVALID_DOUBLE_VALUE;
+			if (! car.alive) {
+				continue;
+			}
+			car.x = static_cast<int>(position.x);
+			car.y = static_cast<int>(position.y);
+			car.heading = Vehicle::getAngle(id);
+			cadence.observe(handle, static_cast<f32>(car.x), static_cast<f32>(car.y));
+		}
+		const auto allocations_after_traci = allocation_count();
+
+		// Bookkeeping of every step, also the ones the cadence skips
+		const auto finish_step = [&] {
+			allocation_stats.record(simulation_step,
+									allocations_after_traci - allocations_at_step_start,
+									allocation_count() - allocations_after_traci);
+
+			// Read by the reporter thread, which draws the progress bar
+			progress.step_us.store(static_cast<std::int64_t>(sim_step_timer.elapsed_us()),
+								   std::memory_order_relaxed);
+			progress.traci_allocations_per_step.store(allocation_stats.traci_per_step(),
+													  std::memory_order_relaxed);
+			progress.publisher_allocations_per_step.store(allocation_stats.publisher_per_step(),
+														  std::memory_order_relaxed);
+			progress.steps_done.store(simulation_step + 1, std::memory_order_relaxed);
 		};
 
-		auto multi_future =
-			pool.parallelize_loop(0, streetlamps.size(), look_for_cars_close_to_streetlamps);
-
-		{ // Publish information about the position and heading of all active cars
-			// TODO: preallocate some of the memory structures used in this block
-			// TODO: rate limit the publish rate
-			static auto last_publish_time = std::chrono::high_resolution_clock::now();
-			const auto	now = std::chrono::high_resolution_clock::now();
-			const auto	elapsed =
-				std::chrono::duration_cast<std::chrono::microseconds>(now - last_publish_time)
-					.count();
-			const auto publish_freq = (1.0 / static_cast<double>(topic_cars.publish_rate)) *
-									  1e6; // FIXME: calculated wrong
-			if (elapsed < publish_freq) {
-				const auto sleep_for =
-					std::chrono::microseconds(static_cast<int>(publish_freq - elapsed));
-				// spdlog::info("Sleeping for {} μs", sleep_for.count());
-				std::this_thread::sleep_for(sleep_for);
-				// std::this_thread::yield();
-				// spdlog::info("Sleeping for {} μs", static_cast<int>(publish_freq -
-				// elapsed.count()));
-			}
-
-			json j; // { "1": { "x": 1, "y": 2, "heading": 3 }, "2": { "x": 1, "y": 2, "heading": 3
-					// } }
-			// Find all cars that are alive and put them into a json object
-			for (auto& [vehicle_id, car] : cars) {
+		const bool checkpoint_this_step =
+			checkpoint_writer && (simulation_step + 1) % checkpointing.every == 0;
+		if (! cadence.due((simulation_step + 1) * dt, checkpoint_this_step)) {
+			// Nothing is analysed or published for this step
+			finish_step();
+			continue;
+		}
+
+		{ // Bucket the alive cars by grid cell, so each lamp only looks at the cars in the 3x3
+		  // cells around it. The incremental detector only looks at the cars that moved.
+			car_positions.clear();
+			for (VehicleHandle handle = 0; handle < cars.size(); ++handle) {
+				const auto& car = cars[handle];
 				if (car.alive) {
-					car.alive = false; // Reset the alive flag to prevent staying alive forever
-					j[std::to_string(vehicle_id)] = car.to_json();
+					const auto position = Point {static_cast<f32>(car.x), static_cast<f32>(car.y)};
+					car_positions.push_back(position);
+					cadence.analysed(handle, position.x, position.y);
+					if (incremental_detector) {
+						incremental_detector->update(handle, position);
+					}
 				}
 			}
-
-			// Serialize to CBOR encoding format
-			const std::vector<u8> v = json::to_cbor(j);
-			const std::string	  payload(v.begin(), v.end());
-			// Publish the data to all clients
-			const auto flags = zmq::send_flags::none;
-			const auto send_result = sock.send(zmq::buffer(topics::cars + payload), flags);
-			if (! send_result.has_value()) {
-				spdlog::error("{}:{} Failed to publish data on topic {}", __FILE__, __LINE__,
-							  topics::cars);
-			}
-
-			last_publish_time = now;
-			{
-				static auto num_messages_published_last_second = 0;
-				num_messages_published_last_second++;
-				static auto last_report_publish_rate_time =
-					std::chrono::high_resolution_clock::now();
-				const auto now = std::chrono::high_resolution_clock::now();
-				const auto elapsed = std::chrono::duration_cast<std::chrono::seconds>(
-					now - last_report_publish_rate_time);
-				if (elapsed.count() >= 1) {
-					spdlog::info(
-						"Published data {} times the last second on topic {} at a rate of {} Hz",
-						num_messages_published_last_second, topics::cars, topic_cars.publish_rate);
-					last_report_publish_rate_time = now;
-					num_messages_published_last_second = 0;
+			if (incremental_detector) {
+				incremental_detector->end_step();
+				if (occlusion) {
+					occlusion->record({.lit_lamps = incremental_detector->num_lit(),
+									   .occluded_lamps = incremental_detector->num_occluded()});
 				}
+			} else {
+				car_buckets.rebuild(streetlamp_grid.spec, car_positions);
 			}
 		}
 
-		// Wait for all threads in the thread pool to finish
-		// NOTE: We do this here after the code that generates the data of all alive cars, to have
-		// the main thread do something while we wait for the other threads to finish This is better
-		// than calling .wait() right after the call to pool.parallelize_loop()
-		multi_future.wait();
+		// Check if any cars are close to a street lamp
+		const auto look_for_cars_close_to_streetlamps = [&](const auto start, const auto end) {
+			mark_lit_streetlamps(analysis_grid, car_buckets, car_positions,
+								 streetlamp_distance_threshold_squared, start, end,
+								 streetlamp_lit.span(), occlusion);
+		};
+
+		auto multi_future = BS::multi_future<void> {};
+		if (static_pool) {
+			multi_future = static_pool->parallelize_loop(0, streetlamps.size(),
+														 look_for_cars_close_to_streetlamps);
+		} else if (stealing_pool) {
+			stealing_pool->start(num_lamp_tasks, look_for_cars_close_to_streetlamps_in_task);
+			lamp_analysis_runs++;
+		}
+		const auto lit = incremental_detector ? incremental_detector->lit()
+											  : std::span<const u8>(streetlamp_lit.span());
+		if (occupancy_archive) {
+			// Skipped steps count as having the vehicles of the step that ends them
+			const auto now = (simulation_step + 1) * dt;
+			occupancy_archive->record(occupancy_recorded_until, now - occupancy_recorded_until,
+									  incremental_detector->vehicles_near());
+			occupancy_recorded_until = now;
+		}
+
+		// SUMO saves its state while the thread pool looks for cars close to the street lamps. The
+		// snapshot of this step is handed to the checkpoint writer once it is complete.
+		const auto sumo_state_path =
+			checkpoint_this_step
+				? checkpoint_writer->sumo_state_path(static_cast<u64>(simulation_step))
+				: std::filesystem::path {};
+		if (checkpoint_this_step) {
+			Simulation::saveState(sumo_state_path.string());
+		}
 
-		{ // Publish information about which street lamps that have vehicles nearby
-			json array = json::array();
-			for (int idx = 0; idx < num_streetlamps_with_vehicles_nearby; idx++) {
-				array.push_back(streetlamp_ids_with_vehicles_nearby[idx]);
+		// The snapshot of the cars is filled in while the thread pool looks for cars close to the
+		// street lamps. The lit street lamps are added once it is done.
+		snapshots.publish([&](StepSnapshot& snapshot) {
+			snapshot.step = static_cast<u64>(simulation_step);
+			snapshot.simulation_time = (simulation_step + 1) * dt;
+			snapshot.step_done_ns = step_done_ns;
+			snapshot.car_handles.clear();
+			snapshot.cars.clear();
+			// The ids are assigned into the strings this snapshot had the last time it was used,
+			// so ids that fit in the small string buffer do not allocate
+			std::size_t num_cars = 0;
+			for (VehicleHandle handle = 0; handle < cars.size(); ++handle) {
+				if (! cars[handle].alive) {
+					continue;
+				}
+				snapshot.car_handles.push_back(handle);
+				snapshot.cars.push_back(cars[handle]);
+				if (num_cars == snapshot.car_names.size()) {
+					snapshot.car_names.emplace_back();
+				}
+				snapshot.car_names[num_cars++] = vehicle_ids.name(handle);
 			}
-			// Serialize to CBOR encoding format
-			const std::vector<u8> v = json::to_cbor(array);
-			const std::string	  payload(v.begin(), v.end());
-			// Send the data to all clients
-			const auto flags = zmq::send_flags::none;
-			const auto send_result = sock.send(zmq::buffer(topics::streetlamps + payload), flags);
-			if (! send_result.has_value()) {
-				spdlog::error("{}:{} Failed to publish data on topic {}", __FILE__, __LINE__,
-							  topics::streetlamps);
+			snapshot.car_names.resize(num_cars);
+
+			multi_future.wait();
+			if (stealing_pool) {
+				stealing_pool->wait();
 			}
-		}
 
-		{ // Update the progress bar
+			snapshot.lit_streetlamp_ids.clear();
+			for (std::size_t idx = 0; idx < streetlamps.size(); idx++) {
+				if (lit[idx]) {
+					snapshot.lit_streetlamp_ids.push_back(streetlamps[idx].id);
+				}
+			}
 
-			const double percent_done =
-				static_cast<double>(simulation_step) / options.simulation_steps * 100.0;
-			bar.set_progress(percent_done);
-			if (options.verbose) {
-				// const auto t_end = std::chrono::high_resolution_clock::now();
-				// const auto duration = std::chrono::duration_cast<std::chrono::microseconds>(t_end
-				// - t_start);
-				const auto duration = sim_step_timer.elapsed_us();
-				// Estimate the remaining time of the simulation
-				static long duration_avg = 0;
-				duration_avg = (duration_avg + duration) / 2;
-				const auto remaining_time_estimate = std::chrono::microseconds(
-					duration_avg * (options.simulation_steps - simulation_step));
-				const auto postfix =
-					fmt::format("simulation-step: {}/{} (in percent: {:.2f}%) took: {} μs, "
-								"estimated time to completion: {}",
-								simulation_step, options.simulation_steps, percent_done, duration,
-								humantime(remaining_time_estimate.count()));
-				bar.set_option(indicators::option::PostfixText(postfix));
+			if (checkpoint_this_step) {
+				checkpoint_writer->submit(snapshot, sumo_state_path);
 			}
-		}
+		});
+
+		finish_step();
+	}
+
+	if (checkpoint_writer) {
+		checkpoint_writer->close();
+	}
+	if (occupancy_archive) {
+		occupancy_archive->close();
+		spdlog::info("Archived lamp occupancy: {} rows, {} buckets dropped because the archive "
+					 "fell behind",
+					 occupancy_archive->rows(), occupancy_archive->dropped());
+	}
+
+	// Let the publisher send the last snapshot before shutting down
+	snapshots.close();
+	publisher_thread.join();
+	if (shm_thread.joinable()) {
+		shm_thread.join();
+	}
+	if (query_thread.joinable()) {
+		query_thread.join();
 	}
 
 	// const auto t_sim_end = std::chrono::high_resolution_clock::now();
 
-	bar.set_progress(100.0);
-	bar.mark_as_completed();
-	indicators::show_console_cursor(true);
+	reporter.stop();
 
 	Simulation::close();
 
-	spdlog::info("Simulation took: {}", humantime(sim_timer.elapsed_us()));
+	const auto simulated_steps = options.simulation_steps - first_simulation_step;
+	spdlog::info("Simulation took: {} ({:.1f} steps/s)", humantime(sim_timer.elapsed_us()),
+				 simulated_steps * 1e6 / std::max<double>(sim_timer.elapsed_us(), 1.0));
+	if (analysis_options.adaptive) {
+		const auto& stats = cadence.stats();
+		spdlog::info("Analysed {} of {} steps ({:.1f}%), at most {:.3f} s of simulated time apart. "
+					 "Skipped steps were at most {:.2f} m behind (bound {:.2f} m, {:.0f}% of "
+					 "distance-threshold)",
+					 stats.analysed, stats.steps,
+					 stats.steps == 0 ? 0.0 : 100.0 * stats.analysed / stats.steps,
+					 stats.max_interval, stats.max_skipped_displacement,
+					 analysis_options.max_displacement,
+					 100.0 * analysis_options.max_displacement /
+						 options.streetlamp_distance_threshold);
+	}
+	if (stealing_pool) {
+		const auto stats = stealing_pool->stats();
+		const auto seconds = std::chrono::duration<double>(stealing_pool->time_in_run()).count();
+		for (std::size_t worker = 0; worker < stats.size(); ++worker) {
+			const auto busy = std::chrono::duration<double>(stats[worker].busy).count();
+			spdlog::info("Lamp analysis thread {}: {:.1f}% busy, {} tasks, {} steals", worker,
+						 seconds == 0.0 ? 0.0 : 100.0 * busy / seconds, stats[worker].tasks,
+						 stats[worker].steals);
+		}
+		if (track_numa_nodes) {
+			const auto tasks = lamp_analysis_runs * num_lamp_tasks;
+			u64		   off_node = 0;
+			for (const auto runs : task_runs_off_node) {
+				off_node += runs;
+			}
+			spdlog::info("{:.1f}% of the lamp analysis tasks ran on another NUMA node than their "
+						 "lamps (pinning {})",
+						 tasks == 0 ? 0.0 : 100.0 * off_node / tasks,
+						 thread_placement.pin ? "on" : "off");
+		}
+	}
+	if (incremental_detector) {
+		const auto& stats = incremental_detector->stats();
+		spdlog::info("Incremental lamp detection looked up {} of {} vehicle positions ({:.1f}%)",
+					 stats.requeried, stats.updates,
+					 stats.updates == 0 ? 0.0 : 100.0 * stats.requeried / stats.updates);
+	}
+	if (occlusion) {
+		// The full pass records its line of sight tests itself, the incremental detector in its
+		// own stats
+		auto stats = occlusion->stats();
+		if (incremental_detector) {
+			stats.sight_tests = incremental_detector->stats().sight_tests;
+			stats.blocked = incremental_detector->stats().blocked;
+		}
+		const auto steps = static_cast<double>(std::max<u64>(cadence.stats().analysed, 1));
+		const auto near = stats.lit_lamps + stats.occluded_lamps;
+		spdlog::info("Building occlusion: {:.1f} line of sight tests per analysed step, {:.1f}% "
+					 "blocked. {:.1f} lamps lit per analysed step instead of {:.1f} ({:.1f}% "
+					 "fewer)",
+					 stats.sight_tests / steps,
+					 stats.sight_tests == 0 ? 0.0 : 100.0 * stats.blocked / stats.sight_tests,
+					 stats.lit_lamps / steps, near / steps,
+					 near == 0 ? 0.0 : 100.0 * stats.occluded_lamps / near);
+	}
+	spdlog::info("Heap allocations per step on the simulation thread: traci {:.1f}, publisher "
+				 "{:.1f} (max {})",
+				 allocation_stats.traci_per_step(), allocation_stats.publisher_per_step(),
+				 allocation_stats.publisher_max);
 	// const auto t_sim_duration = std::chrono::duration_cast<std::chrono::microseconds>(t_sim_end -
 	// t_sim_start); spdlog::info("Simulation took: {}", humantime(t_sim_duration.count()));
 	return 0;
@@ -0,0 +1,225 @@
+#include "thread-placement.hpp"
+
+#include <algorithm>
+#include <charconv>
+#include <fstream>
+#include <string>
+
+#ifdef __linux__
+#include <pthread.h>
+#include <sched.h>
+#include <sys/mman.h>
+#include <sys/resource.h>
+#include <unistd.h>
+#endif
+
+auto NumaTopology::node_of_cpu(const int cpu) const -> int {
+	for (const auto& node : nodes) {
+		if (std::binary_search(node.cpus.begin(), node.cpus.end(), cpu)) {
+			return node.id;
+		}
+	}
+	return -1;
+}
+
+auto NumaTopology::find_node(const int id) const -> const NumaNode* {
+	const auto it =
+		std::find_if(nodes.begin(), nodes.end(), [&](const auto& node) { return node.id == id; });
+	return it == nodes.end() ? nullptr : &*it;
+}
+
+auto format_numa_topology_error(const numa_topology_error err) -> std::string_view {
+	switch (err) {
+		case numa_topology_error::no_sysfs:
+			return "no NUMA information in sysfs";
+		case numa_topology_error::no_nodes:
+			return "no NUMA node with CPUs";
+		case numa_topology_error::malformed_cpu_list:
+			return "malformed CPU list";
+	}
+	return "unknown error";
+}
+
+namespace {
+	auto parse_cpu(std::string_view& list, int& cpu) -> bool {
+		const auto [end, ec] = std::from_chars(list.data(), list.data() + list.size(), cpu);
+		if (ec != std::errc {} || cpu < 0) {
+			return false;
+		}
+		list.remove_prefix(static_cast<std::size_t>(end - list.data()));
+		return true;
+	}
+} // namespace
+
+auto parse_cpu_list(std::string_view list) -> tl::expected<std::vector<int>, numa_topology_error> {
+	while (! list.empty() && (list.back() == '\n' || list.back() == ' ')) {
+		list.remove_suffix(1);
+	}
+	auto cpus = std::vector<int> {};
+	while (! list.empty()) {
+		int first = 0;
+		if (! parse_cpu(list, first)) {
+			return tl::make_unexpected(numa_topology_error::malformed_cpu_list);
+		}
+		int last = first;
+		if (list.starts_with('-')) {
+			list.remove_prefix(1);
+			if (! parse_cpu(list, last) || last < first) {
+				return tl::make_unexpected(numa_topology_error::malformed_cpu_list);
+			}
+		}
+		for (int cpu = first; cpu <= last; ++cpu) {
+			cpus.push_back(cpu);
+		}
+		if (list.starts_with(',')) {
+			list.remove_prefix(1);
+			if (list.empty()) {
+				return tl::make_unexpected(numa_topology_error::malformed_cpu_list);
+			}
+		} else if (! list.empty()) {
+			return tl::make_unexpected(numa_topology_error::malformed_cpu_list);
+		}
+	}
+	std::sort(cpus.begin(), cpus.end());
+	cpus.erase(std::unique(cpus.begin(), cpus.end()), cpus.end());
+	return cpus;
+}
+
+auto detect_numa_topology(const std::filesystem::path& sysfs_node_dir)
+	-> tl::expected<NumaTopology, numa_topology_error> {
+	auto ec = std::error_code {};
+	auto it = std::filesystem::directory_iterator(sysfs_node_dir, ec);
+	if (ec) {
+		return tl::make_unexpected(numa_topology_error::no_sysfs);
+	}
+
+	auto topology = NumaTopology {};
+	for (const auto& entry : it) {
+		// node0, node1, ... next to files like "online" and "possible"
+		const auto name = entry.path().filename().string();
+		auto	   id = 0;
+		if (! name.starts_with("node")) {
+			continue;
+		}
+		const auto* name_end = name.data() + name.size();
+		const auto [end, parse_ec] = std::from_chars(name.data() + 4, name_end, id);
+		if (parse_ec != std::errc {} || end != name_end) {
+			continue;
+		}
+
+		auto file = std::ifstream(entry.path() / "cpulist");
+		auto list = std::string {};
+		if (! file || ! std::getline(file, list)) {
+			continue;
+		}
+		auto cpus = parse_cpu_list(list);
+		if (! cpus) {
+			return tl::make_unexpected(cpus.error());
+		}
+		if (! cpus->empty()) {
+			topology.nodes.push_back(NumaNode {.id = id, .cpus = std::move(*cpus)});
+		}
+	}
+	if (topology.nodes.empty()) {
+		return tl::make_unexpected(numa_topology_error::no_nodes);
+	}
+	std::sort(topology.nodes.begin(), topology.nodes.end(),
+			  [](const auto& a, const auto& b) { return a.id < b.id; });
+	return topology;
+}
+
+#ifdef __linux__
+namespace {
+	auto cpu_set_of(const std::span<const int> cpus, cpu_set_t& set) -> bool {
+		CPU_ZERO(&set);
+		for (const auto cpu : cpus) {
+			if (cpu < 0 || cpu >= CPU_SETSIZE) {
+				return false;
+			}
+			CPU_SET(cpu, &set);
+		}
+		return ! cpus.empty();
+	}
+} // namespace
+#endif
+
+auto pin_current_thread_to_cpu(const int cpu) -> bool {
+	return pin_current_thread_to_cpus(std::span(&cpu, 1));
+}
+
+auto pin_current_thread_to_cpus(const std::span<const int> cpus) -> bool {
+#ifdef __linux__
+	cpu_set_t set;
+	return cpu_set_of(cpus, set) && pthread_setaffinity_np(pthread_self(), sizeof(set), &set) == 0;
+#else
+	(void)cpus;
+	return false;
+#endif
+}
+
+auto pin_thread_to_cpus(std::thread& thread, const std::span<const int> cpus) -> bool {
+#ifdef __linux__
+	cpu_set_t set;
+	return cpu_set_of(cpus, set) &&
+		   pthread_setaffinity_np(thread.native_handle(), sizeof(set), &set) == 0;
+#else
+	(void)thread;
+	(void)cpus;
+	return false;
+#endif
+}
+
+auto current_cpu() -> int {
+#ifdef __linux__
+	return sched_getcpu();
+#else
+	return -1;
+#endif
+}
+
+auto lower_current_thread_priority() -> bool {
+#ifdef __linux__
+	// On Linux the nice value belongs to the thread, not the whole process
+	return setpriority(PRIO_PROCESS, static_cast<id_t>(gettid()), 19) == 0;
+#else
+	return false;
+#endif
+}
+
+auto page_size() -> std::size_t {
+#ifdef __linux__
+	static const auto size = static_cast<std::size_t>(sysconf(_SC_PAGESIZE));
+	return size;
+#else
+	return 4096;
+#endif
+}
+
+namespace {
+	auto round_up_to_pages(const std::size_t bytes) -> std::size_t {
+		return (bytes + page_size() - 1) / page_size() * page_size();
+	}
+} // namespace
+
+auto allocate_untouched_pages(const std::size_t bytes) -> void* {
+	// Not from malloc, which hands out small blocks from pages other threads already wrote
+#ifdef __linux__
+	void* pages = mmap(nullptr, round_up_to_pages(bytes), PROT_READ | PROT_WRITE,
+					   MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	return pages == MAP_FAILED ? nullptr : pages;
+#else
+	return std::aligned_alloc(page_size(), round_up_to_pages(bytes));
+#endif
+}
+
+auto free_untouched_pages(void* pages, const std::size_t bytes) -> void {
+	if (pages == nullptr) {
+		return;
+	}
+#ifdef __linux__
+	munmap(pages, round_up_to_pages(bytes));
+#else
+	(void)bytes;
+	std::free(pages);
+#endif
+}
@@ -0,0 +1,112 @@
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdlib>
+#include <filesystem>
+#include <memory>
+#include <new>
+#include <span>
+#include <string_view>
+#include <thread>
+#include <type_traits>
+#include <vector>
+
+#include <tl/expected.hpp>
+
+// A NUMA node and the CPUs that belong to it
+struct NumaNode {
+	int				 id;
+	std::vector<int> cpus;
+};
+
+struct NumaTopology {
+	std::vector<NumaNode> nodes; // Sorted by id
+
+	// The node `cpu` belongs to, or -1 if it is not in any of them
+	[[nodiscard]] auto node_of_cpu(int cpu) const -> int;
+	[[nodiscard]] auto find_node(int id) const -> const NumaNode*;
+};
+
+enum class numa_topology_error {
+	no_sysfs,
+	no_nodes,
+	malformed_cpu_list,
+};
+
+[[nodiscard]] auto format_numa_topology_error(numa_topology_error err) -> std::string_view;
+
+// Parses a CPU list in the kernel's format, e.g. "0-3,8-11" or "5". Empty means no CPUs.
+[[nodiscard]] auto parse_cpu_list(std::string_view list)
+	-> tl::expected<std::vector<int>, numa_topology_error>;
+
+// Reads the NUMA nodes and their CPUs from `sysfs_node_dir/node<N>/cpulist`. Nodes without CPUs
+// (memory only) are left out.
+[[nodiscard]] auto detect_numa_topology(
+	const std::filesystem::path& sysfs_node_dir = "/sys/devices/system/node")
+	-> tl::expected<NumaTopology, numa_topology_error>;
+
+// Pins the calling thread to `cpu`. Returns false if that is not supported or fails.
+auto pin_current_thread_to_cpu(int cpu) -> bool;
+// Restricts `thread` to run on `cpus`. Returns false if that is not supported or fails.
+auto pin_thread_to_cpus(std::thread& thread, std::span<const int> cpus) -> bool;
+auto pin_current_thread_to_cpus(std::span<const int> cpus) -> bool;
+// The CPU the calling thread runs on right now, or -1 if that is not supported
+[[nodiscard]] auto current_cpu() -> int;
+// Lowers the scheduling priority of the calling thread to the lowest nice value, for threads that
+// must not take CPU time from the simulation. Returns false if that is not supported or fails.
+auto lower_current_thread_priority() -> bool;
+
+// Size of a page of memory, the unit Linux places on a NUMA node
+[[nodiscard]] auto page_size() -> std::size_t;
+// Whole, page aligned pages for `bytes`, that no thread has written yet: fresh anonymous pages
+// from mmap on Linux. Returns nullptr if there is no memory. Freed with `free_untouched_pages`
+// and the same `bytes`.
+[[nodiscard]] auto allocate_untouched_pages(std::size_t bytes) -> void*;
+auto free_untouched_pages(void* pages, std::size_t bytes) -> void;
+
+// A fixed size array whose pages are not written when it is allocated. Linux places a page on the
+// NUMA node of the thread that writes it first, so filling the parts of the array from the threads
+// that use them keeps those parts on their node. The array starts on a page of its own, so
+// parts of `elements_per_page()` elements fill whole pages. Only for types that can live in raw
+// memory.
+template <typename T>
+class FirstTouchArray {
+	static_assert(std::is_trivially_copyable_v<T> && std::is_trivially_destructible_v<T>);
+
+  public:
+	FirstTouchArray() = default;
+	explicit FirstTouchArray(const std::size_t size)
+		: data_(static_cast<T*>(allocate_untouched_pages(bytes_for(size))),
+				Unmap {bytes_for(size)}),
+		  size_(size) {
+		if (! data_) {
+			throw std::bad_alloc();
+		}
+	}
+
+	[[nodiscard]] static auto elements_per_page() -> std::size_t {
+		return std::max<std::size_t>(page_size() / sizeof(T), 1);
+	}
+
+	[[nodiscard]] auto data() -> T* { return data_.get(); }
+	[[nodiscard]] auto size() const -> std::size_t { return size_; }
+	[[nodiscard]] auto span() -> std::span<T> { return {data_.get(), size_}; }
+	[[nodiscard]] auto span() const -> std::span<const T> { return {data_.get(), size_}; }
+	auto operator[](const std::size_t idx) -> T& { return data_[idx]; }
+	auto operator[](const std::size_t idx) const -> const T& { return data_[idx]; }
+
+  private:
+	static auto bytes_for(const std::size_t size) -> std::size_t {
+		return std::max<std::size_t>(size, 1) * sizeof(T);
+	}
+
+	struct Unmap {
+		std::size_t bytes = 0;
+
+		auto operator()(T* ptr) const -> void { free_untouched_pages(ptr, bytes); }
+	};
+
+	std::unique_ptr<T[], Unmap> data_;
+	std::size_t					size_ = 0;
+};
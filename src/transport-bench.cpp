@@ -0,0 +1,269 @@
+// Compares the latency of getting a step snapshot from the publisher to a subscriber on the same
+// host over shared memory, ZMQ over TCP and ZMQ over IPC. The publisher and the subscriber are
+// threads of this process, so both sides use the same clock.
+//
+// For ZMQ the subscriber decodes the CBOR payload like a client would; for shared memory it reads
+// the snapshot in place. Both sum up the car positions, so the data is actually touched.
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <iostream>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+#include <argparse/argparse.hpp>
+#include <fmt/core.h>
+#include <nlohmann/json.hpp>
+#include <spdlog/spdlog.h>
+#include <zmq.hpp>
+
+#include "cbor-writer.hpp"
+#include "shm-snapshot.hpp"
+#include "step-snapshot.hpp"
+
+namespace {
+	using clock = std::chrono::steady_clock;
+
+	constexpr auto topic_cars = std::string_view("cars");
+	constexpr auto topic_streetlamps = std::string_view("streetlamps");
+
+	struct BenchOptions {
+		int num_snapshots;
+		int num_cars;
+		int num_lit_streetlamps;
+		int interval_us;
+	};
+
+	struct LatencyReport {
+		std::string			 transport;
+		std::size_t			 message_bytes = 0;
+		std::vector<std::int64_t> latencies_ns {}; // One per received snapshot
+		int					 num_sent = 0;
+	};
+
+	auto now_ns() -> std::int64_t {
+		return std::chrono::duration_cast<std::chrono::nanoseconds>(
+				   clock::now().time_since_epoch())
+			.count();
+	}
+
+	auto make_snapshot(const BenchOptions& options) -> StepSnapshot {
+		auto snapshot = StepSnapshot {};
+		for (int i = 0; i < options.num_cars; ++i) {
+			snapshot.car_handles.push_back(static_cast<std::uint32_t>(i));
+			snapshot.cars.push_back(Car {.x = 1000 + i, .y = 2000 + i, .heading = 0.5 * i});
+		}
+		for (int i = 0; i < options.num_lit_streetlamps; ++i) {
+			snapshot.lit_streetlamp_ids.push_back(3'000'000'000 + i);
+		}
+		return snapshot;
+	}
+
+	// Publishes `options.num_snapshots` snapshots, one every `interval_us`, recording when each was
+	// sent in `sent_at_ns[step]`
+	template <typename Publish>
+	auto run_publisher(const BenchOptions& options,
+					   std::vector<std::atomic<std::int64_t>>& sent_at_ns, Publish&& publish)
+		-> void {
+		auto snapshot = make_snapshot(options);
+		auto next = clock::now();
+		for (int step = 0; step < options.num_snapshots; ++step) {
+			std::this_thread::sleep_until(next);
+			next += std::chrono::microseconds(options.interval_us);
+			snapshot.step = static_cast<std::uint64_t>(step);
+			for (auto& car : snapshot.cars) {
+				car.x++;
+			}
+			sent_at_ns[step].store(now_ns(), std::memory_order_relaxed);
+			publish(snapshot);
+		}
+	}
+
+	auto bench_shm(const BenchOptions& options) -> LatencyReport {
+		auto report = LatencyReport {.transport = "shm"};
+		auto writer = create_shm_snapshot_writer("/sumo-sim-data-publisher-bench",
+												 options.num_cars, options.num_lit_streetlamps);
+		if (! writer) {
+			spdlog::error("Failed to create shared memory segment: {}",
+						  format_shm_snapshot_error(writer.error()));
+			std::exit(1);
+		}
+		auto reader = open_shm_snapshot_reader(writer->name());
+		if (! reader) {
+			spdlog::error("Failed to open shared memory segment: {}",
+						  format_shm_snapshot_error(reader.error()));
+			std::exit(1);
+		}
+		auto sent_at_ns = std::vector<std::atomic<std::int64_t>>(options.num_snapshots);
+
+		auto subscriber = std::thread([&] {
+			std::uint64_t generation = 0;
+			std::int64_t  checksum = 0;
+			while (! reader->closed()) {
+				const auto latest =
+					reader->wait_for_newer_than(generation, std::chrono::milliseconds(100));
+				if (latest == generation) {
+					continue;
+				}
+				generation = latest;
+				std::uint64_t step = 0;
+				reader->read([&](const ShmSnapshotView& view) {
+					step = view.step;
+					for (const auto& car : view.cars) {
+						checksum += car.x + car.y;
+					}
+				});
+				report.latencies_ns.push_back(now_ns() - sent_at_ns[step].load());
+			}
+			spdlog::debug("checksum: {}", checksum);
+		});
+
+		run_publisher(options, sent_at_ns, [&](const StepSnapshot& snapshot) {
+			writer->publish(snapshot);
+			report.message_bytes = sizeof(ShmSnapshotBufferHeader) +
+								   snapshot.cars.size() * sizeof(ShmCar) +
+								   snapshot.lit_streetlamp_ids.size() * sizeof(std::int64_t);
+		});
+		writer->close();
+		subscriber.join();
+		report.num_sent = options.num_snapshots;
+		return report;
+	}
+
+	auto bench_zmq(const BenchOptions& options, const std::string& transport,
+				   const std::string& endpoint) -> LatencyReport {
+		auto report = LatencyReport {.transport = transport};
+		auto zmq_ctx = zmq::context_t();
+		auto pub = zmq::socket_t(zmq_ctx, zmq::socket_type::pub);
+		pub.bind(endpoint);
+		auto sub = zmq::socket_t(zmq_ctx, zmq::socket_type::sub);
+		sub.set(zmq::sockopt::subscribe, "");
+		sub.set(zmq::sockopt::rcvtimeo, 100);
+		sub.connect(endpoint);
+		// Give the subscription time to reach the publisher, or the first messages are dropped
+		std::this_thread::sleep_for(std::chrono::milliseconds(200));
+
+		auto sent_at_ns = std::vector<std::atomic<std::int64_t>>(options.num_snapshots);
+		auto done = std::atomic<bool>(false);
+
+		auto subscriber = std::thread([&] {
+			std::int64_t checksum = 0;
+			while (true) {
+				auto cars = zmq::message_t {};
+				if (! sub.recv(cars)) {
+					if (done) {
+						break;
+					}
+					continue;
+				}
+				auto streetlamps = zmq::message_t {};
+				(void)sub.recv(streetlamps);
+				// Skip the topic in front of the CBOR payload
+				const auto* car_bytes = static_cast<const std::uint8_t*>(cars.data());
+				const auto* lamp_bytes = static_cast<const std::uint8_t*>(streetlamps.data());
+				const auto	car_json = nlohmann::json::from_cbor(car_bytes + topic_cars.size(),
+																 car_bytes + cars.size());
+				const auto	lamp_json = nlohmann::json::from_cbor(
+					 lamp_bytes + topic_streetlamps.size(), lamp_bytes + streetlamps.size());
+				for (const auto& [_, car] : car_json.items()) {
+					checksum += car["x"].get<std::int64_t>() + car["y"].get<std::int64_t>();
+				}
+				checksum += static_cast<std::int64_t>(lamp_json.size());
+				// Every car's x is 1000 + its id + the step + 1
+				const auto step = car_json["0"]["x"].get<std::int64_t>() - 1001;
+				report.latencies_ns.push_back(now_ns() - sent_at_ns[step].load());
+			}
+			spdlog::debug("checksum: {}", checksum);
+		});
+
+		auto cars_message = std::vector<std::uint8_t> {};
+		auto streetlamps_message = std::vector<std::uint8_t> {};
+		run_publisher(options, sent_at_ns, [&](const StepSnapshot& snapshot) {
+			cars_message.clear();
+			encode_cars_message<CborWriter>(snapshot, topic_cars, cars_message);
+			streetlamps_message.clear();
+			encode_streetlamps_message<CborWriter>(snapshot, topic_streetlamps, streetlamps_message);
+			(void)pub.send(zmq::buffer(cars_message), zmq::send_flags::none);
+			(void)pub.send(zmq::buffer(streetlamps_message), zmq::send_flags::none);
+			report.message_bytes = cars_message.size() + streetlamps_message.size();
+		});
+		done = true;
+		subscriber.join();
+		report.num_sent = options.num_snapshots;
+		return report;
+	}
+
+	auto print_report(LatencyReport& report) -> void {
+		auto& latencies = report.latencies_ns;
+		if (latencies.empty()) {
+			fmt::println("{:>8}: nothing received", report.transport);
+			return;
+		}
+		std::sort(latencies.begin(), latencies.end());
+		const auto percentile = [&](const double p) {
+			const auto idx = static_cast<std::size_t>(p * (latencies.size() - 1));
+			return static_cast<double>(latencies[idx]) / 1000.0;
+		};
+		fmt::println("{:>8}: {:>8} bytes/snapshot, received {:>6}/{:<6} latency p50 {:>8.1f} us, "
+					 "p99 {:>8.1f} us, max {:>8.1f} us",
+					 report.transport, report.message_bytes, latencies.size(), report.num_sent,
+					 percentile(0.5), percentile(0.99), percentile(1.0));
+	}
+} // namespace
+
+auto main(int argc, char** argv) -> int {
+	auto argv_parser = argparse::ArgumentParser("transport-bench", "0.1.0");
+	argv_parser.add_argument("--snapshots")
+		.help("Number of snapshots to publish per transport")
+		.default_value(2000)
+		.scan<'i', int>();
+	argv_parser.add_argument("--cars")
+		.help("Number of cars in every snapshot")
+		.default_value(2000)
+		.scan<'i', int>();
+	argv_parser.add_argument("--lit-streetlamps")
+		.help("Number of lit street lamps in every snapshot")
+		.default_value(500)
+		.scan<'i', int>();
+	argv_parser.add_argument("--interval-us")
+		.help("Time between snapshots in microseconds")
+		.default_value(1000)
+		.scan<'i', int>();
+	argv_parser.add_argument("--port")
+		.help("Port used for the TCP run")
+		.default_value(12999)
+		.scan<'i', int>();
+
+	try {
+		argv_parser.parse_args(argc, argv);
+	} catch (const std::exception& err) {
+		spdlog::error("{}", err.what());
+		std::cerr << argv_parser;
+		return 2;
+	}
+
+	const auto options = BenchOptions {
+		.num_snapshots = argv_parser.get<int>("--snapshots"),
+		.num_cars = std::max(1, argv_parser.get<int>("--cars")),
+		.num_lit_streetlamps = argv_parser.get<int>("--lit-streetlamps"),
+		.interval_us = argv_parser.get<int>("--interval-us"),
+	};
+	const auto port = argv_parser.get<int>("--port");
+
+	auto reports = std::vector<LatencyReport> {};
+	reports.push_back(bench_shm(options));
+	reports.push_back(bench_zmq(options, "zmq-tcp", fmt::format("tcp://127.0.0.1:{}", port)));
+	reports.push_back(bench_zmq(options, "zmq-ipc", "ipc:///tmp/sumo-sim-data-publisher-bench"));
+
+	fmt::println("{} snapshots of {} cars and {} lit street lamps, one every {} us",
+				 options.num_snapshots, options.num_cars, options.num_lit_streetlamps,
+				 options.interval_us);
+	for (auto& report : reports) {
+		print_report(report);
+	}
+	return 0;
+}
@@ -0,0 +1,94 @@
+#pragma once
+
+#include <cstdint>
+#include <deque>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include <parallel_hashmap/phmap.h>
+
+// Dense handle of a vehicle in the simulation, see `VehicleIdTable`
+using VehicleHandle = std::uint32_t;
+
+// Interns SUMO's vehicle ids, which are arbitrary strings ("veh0", "flow.3", "42"), as dense
+// handles. A vehicle gets its handle when it departs and gives it back when it arrives, so the
+// handles stay below the most vehicles there ever were at once and can index plain arrays. The
+// id strings are stored once, and passing `name(handle)` to TraCI does not allocate.
+//
+// Released handles are handed out again oldest first, so a handle does not name another vehicle
+// right after its vehicle left.
+class VehicleIdTable {
+  public:
+	static constexpr VehicleHandle no_handle = ~VehicleHandle {0};
+
+	// The handle of `id`, interning it if it has none
+	auto intern(const std::string_view id) -> VehicleHandle {
+		if (const auto handle = this->find(id); handle != no_handle) {
+			return handle;
+		}
+		auto handle = static_cast<VehicleHandle>(names.size());
+		if (! released.empty()) {
+			handle = released.front();
+			released.pop_front();
+			names[handle] = id;
+			live_[handle] = 1;
+		} else {
+			names.emplace_back(id);
+			live_.push_back(1);
+		}
+		handles.emplace(names[handle], handle);
+		return handle;
+	}
+
+	// Gives `id` the handle it had before, e.g. when resuming from a checkpoint. `handle` must not
+	// be live.
+	auto assign(const VehicleHandle handle, const std::string_view id) -> void {
+		if (handle >= names.size()) {
+			for (auto free = static_cast<VehicleHandle>(names.size()); free < handle; ++free) {
+				released.push_back(free);
+			}
+			names.resize(handle + 1);
+			live_.resize(handle + 1, 0);
+		} else {
+			std::erase(released, handle);
+		}
+		names[handle] = id;
+		live_[handle] = 1;
+		handles.emplace(names[handle], handle);
+	}
+
+	// The handle of `id`, or `no_handle` if it is not interned
+	[[nodiscard]] auto find(const std::string_view id) const -> VehicleHandle {
+		const auto it = handles.find(id);
+		return it == handles.end() ? no_handle : it->second;
+	}
+
+	auto release(const VehicleHandle handle) -> void {
+		if (handle >= names.size() || ! live_[handle]) {
+			return;
+		}
+		handles.erase(names[handle]);
+		live_[handle] = 0;
+		released.push_back(handle);
+	}
+
+	[[nodiscard]] auto name(const VehicleHandle handle) const -> const std::string& {
+		return names[handle];
+	}
+	[[nodiscard]] auto live(const VehicleHandle handle) const -> bool {
+		return handle < live_.size() && live_[handle];
+	}
+	// One past the largest handle handed out so far
+	[[nodiscard]] auto capacity() const -> VehicleHandle {
+		return static_cast<VehicleHandle>(names.size());
+	}
+	// Number of live handles
+	[[nodiscard]] auto size() const -> std::size_t { return handles.size(); }
+
+  private:
+	phmap::flat_hash_map<std::string, VehicleHandle> handles;
+	std::vector<std::string>						 names; // By handle, kept after release
+	std::vector<std::uint8_t>						 live_;
+	std::deque<VehicleHandle>						 released;
+};
@@ -0,0 +1,168 @@
+#include "work-stealing-pool.hpp"
+
+#include <algorithm>
+
+#include "thread-placement.hpp"
+
+WorkStealingPool::WorkStealingPool(const unsigned num_threads, std::vector<int> cpus)
+	: workers(std::max(num_threads, 1u)), cpus(std::move(cpus)) {
+	for (unsigned worker_idx = 0; worker_idx < workers.size(); ++worker_idx) {
+		threads.emplace_back([this, worker_idx] { this->thread_main(worker_idx); });
+	}
+}
+
+WorkStealingPool::~WorkStealingPool() {
+	this->wait();
+	{
+		const auto lock = std::lock_guard(mutex);
+		stopping = true;
+	}
+	started.notify_all();
+	for (auto& thread : threads) {
+		thread.join();
+	}
+}
+
+auto WorkStealingPool::start(const std::uint32_t num_tasks,
+							 const std::function<void(std::uint32_t)>& task) -> void {
+	this->start(num_tasks, task, true);
+}
+
+auto WorkStealingPool::run_own_shares(const std::uint32_t num_tasks,
+									  const std::function<void(std::uint32_t)>& task) -> void {
+	this->start(num_tasks, task, false);
+	this->wait();
+}
+
+auto WorkStealingPool::start(const std::uint32_t num_tasks,
+							 const std::function<void(std::uint32_t)>& task, const bool steal)
+	-> void {
+	this->wait();
+	started_at = std::chrono::steady_clock::now();
+	running = true;
+	const auto num_workers = static_cast<std::uint32_t>(workers.size());
+	{
+		const auto lock = std::lock_guard(mutex);
+		this->task = &task;
+		this->stealing = steal;
+		// Contiguous shares, so every worker starts on tasks next to each other
+		for (std::uint32_t worker_idx = 0; worker_idx < num_workers; ++worker_idx) {
+			const auto begin = static_cast<std::uint32_t>(
+				static_cast<std::uint64_t>(num_tasks) * worker_idx / num_workers);
+			const auto end = static_cast<std::uint32_t>(
+				static_cast<std::uint64_t>(num_tasks) * (worker_idx + 1) / num_workers);
+			workers[worker_idx].range.store(pack(begin, end), std::memory_order_relaxed);
+		}
+		workers_done.store(0, std::memory_order_relaxed);
+		generation++;
+	}
+	started.notify_all();
+}
+
+auto WorkStealingPool::wait() -> void {
+	if (! running) {
+		return;
+	}
+	// Workers are done once they found nothing left to run or steal
+	for (auto done = workers_done.load(std::memory_order_acquire); done < workers.size();
+		 done = workers_done.load(std::memory_order_acquire)) {
+		workers_done.wait(done, std::memory_order_acquire);
+	}
+	running = false;
+	time_in_run_ += std::chrono::steady_clock::now() - started_at;
+}
+
+auto WorkStealingPool::stats() const -> std::vector<WorkerStats> {
+	auto result = std::vector<WorkerStats> {};
+	for (const auto& worker : workers) {
+		result.push_back(worker.stats);
+	}
+	return result;
+}
+
+auto WorkStealingPool::work(const unsigned worker_idx) -> void {
+	auto&		  worker = workers[worker_idx];
+	std::uint32_t task_idx = 0;
+	while (true) {
+		if (! this->pop(worker, task_idx)) {
+			if (! stealing || ! this->steal(worker_idx)) {
+				return;
+			}
+			continue;
+		}
+		const auto start = std::chrono::steady_clock::now();
+		(*task)(task_idx);
+		worker.stats.busy += std::chrono::steady_clock::now() - start;
+		worker.stats.tasks++;
+	}
+}
+
+auto WorkStealingPool::pop(Worker& worker, std::uint32_t& task_idx) -> bool {
+	auto range = worker.range.load(std::memory_order_acquire);
+	while (true) {
+		const auto begin = static_cast<std::uint32_t>(range);
+		const auto end = static_cast<std::uint32_t>(range >> 32);
+		if (begin >= end) {
+			return false;
+		}
+		if (worker.range.compare_exchange_weak(range, pack(begin + 1, end),
+											   std::memory_order_acq_rel)) {
+			task_idx = begin;
+			return true;
+		}
+	}
+}
+
+auto WorkStealingPool::steal(const unsigned thief_idx) -> bool {
+	while (true) {
+		// The victim with the most tasks left, so one steal moves as much work as possible
+		auto		  victim_idx = thief_idx;
+		auto		  victim_range = std::uint64_t {0};
+		std::uint32_t most_left = 0;
+		for (unsigned worker_idx = 0; worker_idx < workers.size(); ++worker_idx) {
+			const auto range = workers[worker_idx].range.load(std::memory_order_acquire);
+			const auto begin = static_cast<std::uint32_t>(range);
+			const auto end = static_cast<std::uint32_t>(range >> 32);
+			const auto left = end > begin ? end - begin : 0;
+			if (worker_idx != thief_idx && left > most_left) {
+				victim_idx = worker_idx;
+				victim_range = range;
+				most_left = left;
+			}
+		}
+		if (most_left == 0) {
+			return false;
+		}
+
+		const auto begin = static_cast<std::uint32_t>(victim_range);
+		const auto end = static_cast<std::uint32_t>(victim_range >> 32);
+		const auto split = end - (most_left + 1) / 2;
+		if (workers[victim_idx].range.compare_exchange_strong(victim_range, pack(begin, split),
+															  std::memory_order_acq_rel)) {
+			// Nobody steals from an empty share, so the thief can overwrite its own
+			workers[thief_idx].range.store(pack(split, end), std::memory_order_release);
+			workers[thief_idx].stats.steals++;
+			return true;
+		}
+	}
+}
+
+auto WorkStealingPool::thread_main(const unsigned worker_idx) -> void {
+	if (! cpus.empty()) {
+		(void)pin_current_thread_to_cpu(cpus[worker_idx % cpus.size()]);
+	}
+	std::uint64_t seen_generation = 0;
+	while (true) {
+		{
+			auto lock = std::unique_lock(mutex);
+			started.wait(lock, [&] { return stopping || generation != seen_generation; });
+			if (stopping) {
+				return;
+			}
+			seen_generation = generation;
+		}
+		this->work(worker_idx);
+		workers_done.fetch_add(1, std::memory_order_release);
+		workers_done.notify_all();
+	}
+}
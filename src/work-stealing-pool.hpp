@@ -0,0 +1,97 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Runs the tasks of a parallel loop over `[0, num_tasks)` on a fixed set of threads, with work
+// stealing. Every thread starts on its own contiguous share of the task indices, so neighbouring
+// tasks run on the same thread. A thread that runs out steals the back half of the largest share
+// left, so a thread that got expensive tasks (e.g. the lamps in the city centre, where most cars
+// are) is helped by the others instead of holding up the whole step.
+//
+// `start` returns right away, so the caller can do other work until it `wait`s for the loop.
+class WorkStealingPool {
+  public:
+	struct WorkerStats {
+		std::uint64_t tasks = 0;
+		std::uint64_t steals = 0;
+		std::chrono::nanoseconds busy {0};
+	};
+
+	// `cpus` pins worker i to cpus[i % cpus.size()], empty leaves placement to the OS
+	explicit WorkStealingPool(unsigned num_threads, std::vector<int> cpus = {});
+	~WorkStealingPool();
+
+	WorkStealingPool(const WorkStealingPool&) = delete;
+	auto operator=(const WorkStealingPool&) -> WorkStealingPool& = delete;
+
+	[[nodiscard]] auto num_threads() const -> unsigned {
+		return static_cast<unsigned>(workers.size());
+	}
+
+	// Starts calling `task(idx)` for every idx in [0, num_tasks) exactly once. `task` has to stay
+	// alive until `wait` returns.
+	auto start(std::uint32_t num_tasks, const std::function<void(std::uint32_t)>& task) -> void;
+	// Waits until every task of the loop started last is done
+	auto wait() -> void;
+
+	auto run(const std::uint32_t num_tasks, const std::function<void(std::uint32_t)>& task)
+		-> void {
+		this->start(num_tasks, task);
+		this->wait();
+	}
+
+	// Like `run`, but every worker only runs its own share of the tasks and nothing is stolen.
+	// The shares only depend on `num_tasks` and the number of workers, so a task runs on the
+	// worker that `start` gives it to first, e.g. to first touch the memory the task uses so it
+	// ends up on that worker's NUMA node.
+	auto run_own_shares(std::uint32_t num_tasks, const std::function<void(std::uint32_t)>& task)
+		-> void;
+
+	// Per worker stats since construction, and the time from `start` to the end of `wait`
+	[[nodiscard]] auto stats() const -> std::vector<WorkerStats>;
+	[[nodiscard]] auto time_in_run() const -> std::chrono::nanoseconds { return time_in_run_; }
+
+  private:
+	// A share of the task indices, [begin, end) packed into one word so the owner taking from the
+	// front and thieves taking from the back can both use a compare and swap
+	struct alignas(64) Worker {
+		std::atomic<std::uint64_t> range {0};
+		WorkerStats				   stats;
+	};
+
+	static auto pack(const std::uint32_t begin, const std::uint32_t end) -> std::uint64_t {
+		return (static_cast<std::uint64_t>(end) << 32) | begin;
+	}
+
+	auto start(std::uint32_t num_tasks, const std::function<void(std::uint32_t)>& task, bool steal)
+		-> void;
+	auto work(unsigned worker_idx) -> void;
+	auto pop(Worker& worker, std::uint32_t& task_idx) -> bool;
+	auto steal(unsigned thief_idx) -> bool;
+	auto thread_main(unsigned worker_idx) -> void;
+
+	std::vector<Worker>		 workers;
+	std::vector<std::thread> threads;
+	std::vector<int>		 cpus;
+
+	// The loop being run, set before `generation` is bumped
+	const std::function<void(std::uint32_t)>* task = nullptr;
+	bool									  stealing = true;
+
+	std::mutex				mutex;
+	std::condition_variable started;
+	std::uint64_t			generation = 0;
+	bool					stopping = false;
+	std::atomic<unsigned>	workers_done {0};
+
+	std::chrono::steady_clock::time_point started_at;
+	bool								  running = false;
+	std::chrono::nanoseconds			  time_in_run_ {0};
+};
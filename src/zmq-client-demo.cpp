@@ -1,50 +1,455 @@
+// Latency probe and load generator for the published topics. Runs `--subscribers` subscribers to
+// one topic, each on its own thread with its own ZMQ context and connection, like as many
+// dashboards in their own processes. Every subscriber optionally decodes the payloads, and reports
+// how old the messages are when they arrive, from the `MessageHeader` every message carries:
+//
+//   transport:   from the publisher handing the message to ZMQ to it being received here
+//   end to end:  from the end of `Simulation::step()` to it being received here, so it includes
+//                the analysis of the step and the wait for the topic's next publish
+//
+// The timestamps are only comparable on the publisher's host, so run the probe there. Messages
+// missing from the sequence of the topic are counted as gaps: once the publisher's send high
+// water mark (`sndhwm`) is reached for a subscriber, messages to it are dropped. A tile of the
+// car-tiles topic is not sent when it stays empty, so there the gaps also include the publishes
+// without cars in the tile.
+//
+// Compressed payloads are decompressed by every subscriber, with the zstd dictionary of the topic
+// given with --dictionary. --train-dictionary trains one on the payloads of an uncompressed topic
+// instead, for the publisher's `zstd-dictionary`.
+#include <algorithm>
+#include <atomic>
+#include <bit>
 #include <chrono>
-using namespace std::chrono_literals;
+#include <csignal>
+#include <cstdint>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <limits>
+#include <mutex>
+#include <optional>
+#include <span>
+#include <string>
+#include <string_view>
 #include <thread>
+#include <unordered_map>
+#include <vector>
 
 #include <argparse/argparse.hpp>
 #include <fmt/core.h>
 #include <nlohmann/json.hpp>
-// for convenience
-using json = nlohmann::json;
-using namespace nlohmann::literals; // for ""_json
 #include <spdlog/spdlog.h>
 #include <zmq.hpp>
 
+#include "encoding-format.hpp"
+#include "latency-histogram.hpp"
+#include "message-header.hpp"
+#include "payload-compression.hpp"
+
+using json = nlohmann::json;
+
+namespace {
+	std::atomic<bool> stop_requested = false;
+
+	struct ProbeStats {
+		std::uint64_t	 messages = 0;
+		std::uint64_t	 bytes = 0;
+		std::uint64_t	 payload_bytes = 0; // Before compression
+		std::uint64_t	 malformed = 0;		// No header, or failed to decompress or decode
+		std::uint64_t	 gaps = 0;		// Messages missing from the sequence
+		std::uint64_t	 reordered = 0; // Sequence numbers at or below the last one, e.g. repeated
+		LatencyHistogram transport {};
+		LatencyHistogram end_to_end {};
+
+		auto operator+=(const ProbeStats& other) -> ProbeStats& {
+			messages += other.messages;
+			bytes += other.bytes;
+			payload_bytes += other.payload_bytes;
+			malformed += other.malformed;
+			gaps += other.gaps;
+			reordered += other.reordered;
+			transport += other.transport;
+			end_to_end += other.end_to_end;
+			return *this;
+		}
+	};
+
+	// The stats of one subscriber. `total` is only touched by its thread until it is joined,
+	// `interval` is shared with the reports.
+	struct Subscriber {
+		ProbeStats total {};
+		std::mutex mutex;
+		ProbeStats interval {};
+	};
+
+	struct ProbeOptions {
+		std::string					  endpoint;
+		std::string					  topic;
+		std::string					  tiles;
+		std::optional<EncodingFormat> decode;
+		int							  rcvhwm;
+		std::vector<std::uint8_t>	  dictionary;
+	};
+
+	auto connect_subscriber(zmq::context_t& zmq_ctx, const ProbeOptions& options)
+		-> zmq::socket_t {
+		auto socket = zmq::socket_t(zmq_ctx, zmq::socket_type::sub);
+		socket.set(zmq::sockopt::rcvtimeo, 100);
+		socket.set(zmq::sockopt::rcvhwm, options.rcvhwm);
+		socket.connect(options.endpoint);
+		socket.set(zmq::sockopt::subscribe, options.topic);
+		return socket;
+	}
+
+	// Where the header of `message` starts. The topic of a tile ends at the 4th '/' after the
+	// name of the car-tiles topic.
+	auto topic_size_of(const ProbeOptions& options, const std::string_view message)
+		-> std::size_t {
+		auto size = std::min(options.tiles.empty() ? options.topic.size() : options.tiles.size(),
+							 message.size());
+		if (! options.tiles.empty()) {
+			for (int slashes = 0; slashes < 4 && size < message.size(); ++size) {
+				slashes += message[size] == '/' ? 1 : 0;
+			}
+		}
+		return size;
+	}
+
+	// Decodes `payload` like a dashboard would, false if it is malformed. The packed format has no
+	// schema, so it is decoded as the cars of the cars and car-tiles topics.
+	auto decode_payload(const EncodingFormat format, const std::span<const std::uint8_t> payload)
+		-> bool {
+		switch (format) {
+			case EncodingFormat::cbor:
+				return ! json::from_cbor(payload, true, false).is_discarded();
+			case EncodingFormat::msgpack:
+				return ! json::from_msgpack(payload, true, false).is_discarded();
+			case EncodingFormat::json:
+				return ! json::parse(payload.begin(), payload.end(), nullptr, false).is_discarded();
+			case EncodingFormat::packed: {
+				// u32 number of cars, then u32 handle, f64 heading, i32 x, i32 y per car
+				constexpr auto car_size = std::size_t {20};
+				std::uint32_t  num_cars = 0;
+				if (payload.size() < sizeof(num_cars)) {
+					return false;
+				}
+				std::memcpy(&num_cars, payload.data(), sizeof(num_cars));
+				return payload.size() == sizeof(num_cars) + num_cars * car_size;
+			}
+		}
+		return false;
+	}
+
+	// The payload of `message` after the header, decompressed into `scratch` if it is compressed
+	auto payload_of(const std::span<const std::uint8_t> message, const std::size_t topic_size,
+					const MessageHeader& header, PayloadDecompressor& decompressor,
+					std::vector<std::uint8_t>& scratch)
+		-> std::optional<std::span<const std::uint8_t>> {
+		const auto payload = message.subspan(topic_size + sizeof(MessageHeader));
+		if (header.codec == Compression::none) {
+			return payload;
+		}
+		if (! decompressor.decompress(header.codec, payload, header.payload_size, scratch)) {
+			return std::nullopt;
+		}
+		return scratch;
+	}
+
+	// Receives until stopped, counting into `subscriber`
+	auto run_subscriber(const ProbeOptions& options, Subscriber& subscriber) -> void {
+		auto zmq_ctx = zmq::context_t(1);
+		auto socket = connect_subscriber(zmq_ctx, options);
+		// Checked in main
+		auto decompressor = *PayloadDecompressor::create(options.dictionary);
+		auto scratch = std::vector<std::uint8_t> {};
+
+		// The last sequence number of every topic received, tiles have a sequence each
+		auto last_sequences = std::unordered_map<std::string, std::uint64_t> {};
+		auto message = zmq::message_t {};
+		while (! stop_requested) {
+			if (! socket.recv(message, zmq::recv_flags::none)) {
+				continue;
+			}
+			const auto received_ns = monotonic_ns();
+			const auto bytes =
+				std::span(static_cast<const std::uint8_t*>(message.data()), message.size());
+			const auto text = message.to_string_view();
+			const auto topic_size = topic_size_of(options, text);
+
+			auto	   stats = ProbeStats {.messages = 1, .bytes = bytes.size()};
+			const auto header = read_message_header(bytes, topic_size);
+			const auto payload =
+				header ? payload_of(bytes, topic_size, *header, decompressor, scratch)
+					   : std::nullopt;
+			if (! payload || (options.decode && ! decode_payload(*options.decode, *payload))) {
+				stats.malformed = 1;
+			}
+			if (header) {
+				stats.payload_bytes = header->payload_size;
+				stats.transport.record(received_ns - header->publish_ns);
+				stats.end_to_end.record(received_ns - header->step_done_ns);
+				const auto [it, inserted] =
+					last_sequences.try_emplace(std::string(text.substr(0, topic_size)), 0);
+				if (! inserted && header->sequence > it->second + 1) {
+					stats.gaps = header->sequence - it->second - 1;
+				} else if (! inserted && header->sequence <= it->second) {
+					stats.reordered = 1;
+				}
+				it->second = std::max(it->second, header->sequence);
+			}
+
+			subscriber.total += stats;
+			const auto lock = std::lock_guard(subscriber.mutex);
+			subscriber.interval += stats;
+		}
+	}
+
+	// Collects the payloads of `num_samples` messages and trains a zstd dictionary on them
+	auto train_dictionary(const ProbeOptions& options, const std::filesystem::path& path,
+						  const int num_samples, const std::size_t capacity) -> int {
+		auto zmq_ctx = zmq::context_t(1);
+		auto socket = connect_subscriber(zmq_ctx, options);
+		auto decompressor = *PayloadDecompressor::create(options.dictionary);
+		auto scratch = std::vector<std::uint8_t> {};
+		auto samples = std::vector<std::vector<std::uint8_t>> {};
+		auto message = zmq::message_t {};
+		while (! stop_requested && samples.size() < static_cast<std::size_t>(num_samples)) {
+			if (! socket.recv(message, zmq::recv_flags::none)) {
+				continue;
+			}
+			const auto bytes =
+				std::span(static_cast<const std::uint8_t*>(message.data()), message.size());
+			const auto topic_size = topic_size_of(options, message.to_string_view());
+			const auto header = read_message_header(bytes, topic_size);
+			if (! header) {
+				continue;
+			}
+			const auto payload = payload_of(bytes, topic_size, *header, decompressor, scratch);
+			if (payload) {
+				samples.emplace_back(payload->begin(), payload->end());
+			}
+		}
+
+		const auto dictionary = train_zstd_dictionary(samples, capacity);
+		if (! dictionary) {
+			spdlog::error("Failed to train a dictionary on {} payloads: {}", samples.size(),
+						  format_compression_error(dictionary.error()));
+			return 1;
+		}
+		auto file = std::ofstream(path, std::ios::binary);
+		file.write(reinterpret_cast<const char*>(dictionary->data()),
+				   static_cast<std::streamsize>(dictionary->size()));
+		if (! file) {
+			spdlog::error("Failed to write {}", path.string());
+			return 1;
+		}
+		spdlog::info("Wrote a {} B zstd dictionary trained on {} payloads to {}",
+					 dictionary->size(), samples.size(), path.string());
+		return 0;
+	}
+
+	auto us(const std::int64_t ns) -> double {
+		return static_cast<double>(ns) / 1000.0;
+	}
+
+	auto print_summary(const std::string_view label, const ProbeStats& stats, const double seconds)
+		-> void {
+		fmt::println("{}: {:.1f} messages/s, {:.2f} MB/s ({:.2f} MB/s decompressed), {} gaps, {} "
+					 "reordered, {} malformed",
+					 label, stats.messages / seconds, stats.bytes / seconds / 1e6,
+					 stats.payload_bytes / seconds / 1e6, stats.gaps, stats.reordered,
+					 stats.malformed);
+		const auto print = [](const std::string_view name, const LatencyHistogram& histogram) {
+			fmt::println("  {:<10} p50 {:.1f} us, p90 {:.1f} us, p99 {:.1f} us, max {:.1f} us",
+						 name, us(histogram.percentile(0.5)), us(histogram.percentile(0.9)),
+						 us(histogram.percentile(0.99)), us(histogram.max()));
+		};
+		print("transport", stats.transport);
+		print("end to end", stats.end_to_end);
+	}
+
+	// One row per power of two, with a bar relative to the fullest row
+	auto print_histogram(const std::string_view name, const LatencyHistogram& histogram) -> void {
+		struct Row {
+			std::int64_t  begin;
+			std::int64_t  end;
+			std::uint64_t count;
+		};
+		auto rows = std::vector<Row> {};
+		histogram.for_each_bucket([&](const auto begin, const auto end, const auto count) {
+			const auto row_begin =
+				begin == 0 ? 0 : std::int64_t {1} << (std::bit_width(std::uint64_t(begin)) - 1);
+			if (rows.empty() || rows.back().begin != row_begin) {
+				rows.push_back({row_begin, end, 0});
+			}
+			rows.back().end = end;
+			rows.back().count += count;
+		});
+		std::uint64_t fullest = 1;
+		for (const auto& row : rows) {
+			fullest = std::max(fullest, row.count);
+		}
+		fmt::println("{} latency:", name);
+		for (const auto& row : rows) {
+			const auto width = static_cast<std::size_t>(40 * row.count / fullest);
+			fmt::println("  {:>10.1f} - {:>10.1f} us | {:<40} {}", us(row.begin), us(row.end),
+						 std::string(std::max<std::size_t>(width, 1), '#'), row.count);
+		}
+	}
+} // namespace
 
 auto main(int argc, char** argv) -> int {
-	auto argv_parser = argparse::ArgumentParser(__FILE__, "0.1.0");
-	argv_parser.add_argument("-p", "--port")
-		.default_value(11111)
+	auto argv_parser = argparse::ArgumentParser("zmq-client-demo", "0.1.0");
+	argv_parser.add_argument("-e", "--endpoint")
+		.default_value(std::string("tcp://localhost:11111"))
+		.help("Endpoint of the publisher's socket for the topic, tcp:// or ipc://");
+	argv_parser.add_argument("-t", "--topic")
+		.default_value(std::string("cars"))
+		.help("Topic, or topic prefix, to subscribe to");
+	argv_parser.add_argument("--tiles")
+		.default_value(std::string {})
+		.help("Name of the car-tiles topic, if --topic is one of its tiles, e.g. --topic "
+			  "car-tiles/4/ --tiles car-tiles");
+	argv_parser.add_argument("-n", "--subscribers")
+		.default_value(1)
+		.scan<'i', int>()
+		.help("Number of concurrent subscribers");
+	argv_parser.add_argument("--decode")
+		.default_value(std::string("none"))
+		.help("Decode the payloads as \"cbor\", \"msgpack\", \"json\" or \"packed\" (cars), or "
+			  "\"none\"");
+	argv_parser.add_argument("--rcvhwm")
+		.default_value(1000)
+		.scan<'i', int>()
+		.help("Messages every subscriber queues before ZMQ drops them");
+	argv_parser.add_argument("--dictionary")
+		.default_value(std::string {})
+		.help("zstd dictionary the topic is compressed with, the publisher's zstd-dictionary");
+	argv_parser.add_argument("--train-dictionary")
+		.default_value(std::string {})
+		.help("Train a zstd dictionary on the payloads of the topic and write it to this file");
+	argv_parser.add_argument("--samples")
+		.default_value(1000)
+		.scan<'i', int>()
+		.help("Payloads to train the dictionary on");
+	argv_parser.add_argument("--dictionary-size")
+		.default_value(112640)
 		.scan<'i', int>()
-		.help(fmt::format("Port used for the zeromq PUB server, constraints: 0 < port <= {}",
-						  std::pow(2, 16) - 1));
+		.help("Maximum size of the trained dictionary in bytes");
+	argv_parser.add_argument("--report-every")
+		.default_value(1.0)
+		.scan<'g', double>()
+		.help("Seconds between the reports of the latest messages");
+	argv_parser.add_argument("--duration")
+		.default_value(0.0)
+		.scan<'g', double>()
+		.help("Seconds to run for, 0 to run until interrupted");
 
 	try {
 		argv_parser.parse_args(argc, argv);
 	} catch (const std::exception& err) {
-		fmt::println("{}", err.what());
+		spdlog::error("{}", err.what());
+		std::cerr << argv_parser;
 		return 2;
 	}
 
-	const auto port = argv_parser.get<int>("port");
+	auto options = ProbeOptions {
+		.endpoint = argv_parser.get<std::string>("endpoint"),
+		.topic = argv_parser.get<std::string>("topic"),
+		.tiles = argv_parser.get<std::string>("tiles"),
+		.decode = std::nullopt,
+		.rcvhwm = argv_parser.get<int>("rcvhwm"),
+		.dictionary = {},
+	};
+	const auto decode = argv_parser.get<std::string>("decode");
+	for (const auto format : {EncodingFormat::cbor, EncodingFormat::msgpack, EncodingFormat::json,
+							  EncodingFormat::packed}) {
+		if (decode == encoding_format_name(format)) {
+			options.decode = format;
+		}
+	}
+	if (! options.decode && decode != "none") {
+		spdlog::error("Unknown payload format {}", decode);
+		return 2;
+	}
+	if (const auto path = argv_parser.get<std::string>("dictionary"); ! path.empty()) {
+		auto file = std::ifstream(path, std::ios::binary);
+		options.dictionary.assign(std::istreambuf_iterator<char>(file), {});
+		if (! file || options.dictionary.empty()) {
+			spdlog::error("Failed to read the dictionary {}", path);
+			return 1;
+		}
+	}
+	if (const auto decompressor = PayloadDecompressor::create(options.dictionary);
+		! decompressor) {
+		spdlog::error("{}", format_compression_error(decompressor.error()));
+		return 1;
+	}
+	const auto num_subscribers = std::max(1, argv_parser.get<int>("subscribers"));
+	const auto report_every =
+		std::chrono::duration<double>(argv_parser.get<double>("report-every"));
+	const auto duration = std::chrono::duration<double>(argv_parser.get<double>("duration"));
 
-	auto	   zmq_ctx = zmq::context_t();
-	auto	   subscriber = zmq::socket_t(zmq_ctx, zmq::socket_type::sub);
-	const auto addr = fmt::format("tcp://*:{}", port);
-	subscriber.connect(addr);
-	const auto topic = std::string("/cars");
-	subscriber.set(zmq::sockopt::subscribe, topic);
-	spdlog::info("Created zeromq SUB socket connected to addr: {} listening on topic: {}", addr,
-				 topic);
+	std::signal(SIGINT, [](int) { stop_requested = true; });
+	std::signal(SIGTERM, [](int) { stop_requested = true; });
 
-	while (true) {
-		zmq::message_t message;
-		subscriber.recv(&message, ZMQ_RCVMORE);
-		std::string text(static_cast<char*>(message.data()), message.size());
-		fmt::println("Received {}", text);
-		std::this_thread::sleep_for(10ms);
+	if (const auto path = argv_parser.get<std::string>("train-dictionary"); ! path.empty()) {
+		return train_dictionary(options, path, std::max(1, argv_parser.get<int>("samples")),
+								static_cast<std::size_t>(argv_parser.get<int>("dictionary-size")));
 	}
 
+	auto subscribers = std::vector<Subscriber>(static_cast<std::size_t>(num_subscribers));
+	auto threads = std::vector<std::thread> {};
+	for (auto& subscriber : subscribers) {
+		threads.emplace_back(run_subscriber, std::cref(options), std::ref(subscriber));
+	}
+	spdlog::info("Started {} subscribers connected to {} subscribed to {}", num_subscribers,
+				 options.endpoint, options.topic);
+
+	using clock = std::chrono::steady_clock;
+	const auto started = clock::now();
+	auto	   last_report = started;
+	while (! stop_requested && (duration.count() <= 0.0 || clock::now() - started < duration)) {
+		std::this_thread::sleep_for(std::chrono::milliseconds(50));
+		const auto now = clock::now();
+		if (now - last_report < report_every) {
+			continue;
+		}
+		const auto seconds = std::chrono::duration<double>(now - last_report).count();
+		auto	   interval = ProbeStats {};
+		auto	   slowest = std::numeric_limits<std::uint64_t>::max();
+		for (auto& subscriber : subscribers) {
+			const auto lock = std::lock_guard(subscriber.mutex);
+			interval += subscriber.interval;
+			slowest = std::min(slowest, subscriber.interval.messages);
+			subscriber.interval = ProbeStats {};
+		}
+		if (num_subscribers > 1) {
+			fmt::println("slowest subscriber: {:.1f} messages/s", slowest / seconds);
+		}
+		print_summary("last interval", interval, seconds);
+		last_report = now;
+	}
+	stop_requested = true;
+	for (auto& thread : threads) {
+		thread.join();
+	}
+
+	const auto seconds = std::chrono::duration<double>(clock::now() - started).count();
+	auto	   total = ProbeStats {};
+	for (std::size_t idx = 0; idx < subscribers.size(); ++idx) {
+		const auto& stats = subscribers[idx].total;
+		if (num_subscribers > 1) {
+			fmt::println("subscriber {}: {:.1f} messages/s, {:.2f} MB/s, {} gaps, end to end p99 "
+						 "{:.1f} us",
+						 idx, stats.messages / seconds, stats.bytes / seconds / 1e6, stats.gaps,
+						 us(stats.end_to_end.percentile(0.99)));
+		}
+		total += stats;
+	}
+	print_summary(fmt::format("total of {} subscribers", num_subscribers), total, seconds);
+	print_histogram("transport", total.transport);
+	print_histogram("end to end", total.end_to_end);
 	return 0;
 }
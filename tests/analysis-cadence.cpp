@@ -0,0 +1,76 @@
+#include <catch2/catch_test_macros.hpp>
+
+#include "analysis-cadence.hpp"
+
+namespace {
+	// Moves one car along the x axis, analysing whenever the cadence says so. Returns the steps
+	// that were analysed.
+	auto drive(AnalysisCadence& cadence, const int num_steps, const float speed, const double dt)
+		-> int {
+		int analysed = 0;
+		for (int step = 0; step < num_steps; ++step) {
+			const auto x = speed * static_cast<float>((step + 1) * dt);
+			cadence.observe(1, x, 0.0f);
+			if (cadence.due((step + 1) * dt)) {
+				cadence.analysed(1, x, 0.0f);
+				analysed++;
+			}
+		}
+		return analysed;
+	}
+} // namespace
+
+TEST_CASE("every step is analysed unless adaptive", "[analysis-cadence]") {
+	auto cadence = AnalysisCadence(AnalysisCadenceOptions {.adaptive = false});
+	REQUIRE(drive(cadence, 100, 10.0f, 0.001) == 100);
+}
+
+TEST_CASE("displacement bounds the skipped steps", "[analysis-cadence]") {
+	// 10 m/s with 1 ms steps moves 1 cm per step, so about every 250th step is analysed
+	auto cadence = AnalysisCadence(AnalysisCadenceOptions {
+		.adaptive = true, .max_interval = 100.0, .max_displacement = 2.5f});
+	const auto analysed = drive(cadence, 10'000, 10.0f, 0.001);
+	REQUIRE(analysed >= 35);
+	REQUIRE(analysed <= 45);
+	REQUIRE(cadence.stats().max_skipped_displacement <= 2.5f);
+	REQUIRE(cadence.stats().steps == 10'000);
+}
+
+TEST_CASE("a parked car is analysed every max interval", "[analysis-cadence]") {
+	auto cadence = AnalysisCadence(AnalysisCadenceOptions {
+		.adaptive = true, .max_interval = 0.5, .max_displacement = 2.5f});
+	REQUIRE(drive(cadence, 10'000, 0.0f, 0.001) == 20);
+}
+
+TEST_CASE("vehicles entering or leaving are analysed right away", "[analysis-cadence]") {
+	auto cadence = AnalysisCadence(AnalysisCadenceOptions {
+		.adaptive = true, .max_interval = 100.0, .max_displacement = 2.5f});
+	cadence.observe(1, 0.0f, 0.0f);
+	REQUIRE(cadence.due(0.1));
+	cadence.analysed(1, 0.0f, 0.0f);
+
+	cadence.observe(1, 0.0f, 0.0f);
+	REQUIRE(! cadence.due(0.2));
+
+	cadence.observe(1, 0.0f, 0.0f);
+	cadence.observe(2, 5.0f, 5.0f);
+	REQUIRE(cadence.due(0.3));
+	cadence.analysed(1, 0.0f, 0.0f);
+	cadence.analysed(2, 5.0f, 5.0f);
+
+	cadence.observe(2, 5.0f, 5.0f);
+	REQUIRE(cadence.due(0.4));
+}
+
+TEST_CASE("a vehicle taking over a handle is analysed right away", "[analysis-cadence]") {
+	auto cadence = AnalysisCadence(AnalysisCadenceOptions {
+		.adaptive = true, .max_interval = 100.0, .max_displacement = 2.5f});
+	cadence.observe(1, 0.0f, 0.0f);
+	REQUIRE(cadence.due(0.1));
+	cadence.analysed(1, 0.0f, 0.0f);
+
+	// Vehicle 1 arrived and a new vehicle departed from the same spot with its handle
+	cadence.entered_or_left();
+	cadence.observe(1, 0.0f, 0.0f);
+	REQUIRE(cadence.due(0.2));
+}
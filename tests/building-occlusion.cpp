@@ -0,0 +1,207 @@
+#include <catch2/catch_test_macros.hpp>
+
+#include "building-occlusion.hpp"
+#include "incremental-lamp-detector.hpp"
+
+#include <filesystem>
+#include <fstream>
+#include <random>
+#include <vector>
+
+namespace {
+	auto square(BuildingFootprints& footprints, const float x, const float y, const float size)
+		-> void {
+		const auto outline = std::vector<Point> {
+			{x, y}, {x + size, y}, {x + size, y + size}, {x, y + size}, {x, y}};
+		footprints.add(outline);
+	}
+
+	// Every lamp against every vehicle, testing every building outline
+	auto brute_force_lit(const StreetLampGridView& grid, const BuildingOcclusion& occlusion,
+						 const std::vector<Point>& points, const float distance_threshold_squared)
+		-> std::vector<std::uint8_t> {
+		auto lit = std::vector<std::uint8_t>(grid.lamps.size(), 0);
+		for (std::size_t idx = 0; idx < grid.lamps.size(); ++idx) {
+			const auto lamp = Point {grid.lamps[idx].lon, grid.lamps[idx].lat};
+			for (const auto p : points) {
+				const auto dx = p.x - lamp.x;
+				const auto dy = p.y - lamp.y;
+				if (dx * dx + dy * dy <= distance_threshold_squared &&
+					occlusion.line_of_sight(lamp, p)) {
+					lit[idx] = 1;
+					break;
+				}
+			}
+		}
+		return lit;
+	}
+} // namespace
+
+TEST_CASE("r-tree finds the boxes overlapping a query box", "[building-occlusion]") {
+	auto rng = std::mt19937(3);
+	auto coordinate = std::uniform_real_distribution<float>(0.0f, 1000.0f);
+	auto extent = std::uniform_real_distribution<float>(0.0f, 30.0f);
+	auto boxes = std::vector<Box> {};
+	for (int i = 0; i < 1000; ++i) {
+		const auto x = coordinate(rng);
+		const auto y = coordinate(rng);
+		boxes.push_back(Box {.min_x = x, .min_y = y, .max_x = x + extent(rng),
+							 .max_y = y + extent(rng)});
+	}
+	const auto tree = BoxRTree(boxes);
+	REQUIRE(tree.size() == boxes.size());
+
+	for (int query = 0; query < 100; ++query) {
+		const auto x = coordinate(rng);
+		const auto y = coordinate(rng);
+		const auto box = Box {.min_x = x, .min_y = y, .max_x = x + 50.0f, .max_y = y + 50.0f};
+		auto	   found = std::vector<std::uint8_t>(boxes.size(), 0);
+		tree.query(box, [&](const std::uint32_t item) {
+			found[item]++;
+			return false;
+		});
+		for (std::size_t item = 0; item < boxes.size(); ++item) {
+			REQUIRE(found[item] == (boxes[item].overlaps(box) ? 1 : 0));
+		}
+	}
+	REQUIRE(! BoxRTree().query(Box {}, [](std::uint32_t) { return true; }));
+}
+
+TEST_CASE("buildings block the line of sight", "[building-occlusion]") {
+	auto footprints = BuildingFootprints {};
+	square(footprints, 10.0f, 10.0f, 10.0f);
+	const auto lamps = std::vector<StreetLamp> {{.id = 1, .lat = 15.0f, .lon = 0.0f}};
+	const auto grid_storage = build_streetlamp_grid(lamps, 50.0f);
+	const auto occlusion = BuildingOcclusion(footprints, grid_storage.view(), 50.0f);
+	REQUIRE(occlusion.num_buildings() == 1);
+
+	REQUIRE(! occlusion.line_of_sight({0.0f, 15.0f}, {30.0f, 15.0f}));
+	REQUIRE(occlusion.line_of_sight({0.0f, 15.0f}, {30.0f, 35.0f}));
+	// Running along a wall or ending at a corner is not blocked
+	REQUIRE(occlusion.line_of_sight({0.0f, 10.0f}, {30.0f, 10.0f}));
+	REQUIRE(occlusion.line_of_sight({0.0f, 0.0f}, {10.0f, 10.0f}));
+	REQUIRE(occlusion.clear_share() < 1.0);
+}
+
+TEST_CASE("lamp cells without buildings in between need no tests", "[building-occlusion]") {
+	auto footprints = BuildingFootprints {};
+	square(footprints, 1000.0f, 1000.0f, 10.0f);
+	const auto lamps = std::vector<StreetLamp> {{.id = 1, .lat = 0.0f, .lon = 0.0f}};
+	const auto grid_storage = build_streetlamp_grid(lamps, 50.0f);
+	const auto occlusion = BuildingOcclusion(footprints, grid_storage.view(), 50.0f);
+	for (int neighbour = 0; neighbour < 9; ++neighbour) {
+		REQUIRE(occlusion.cell_clear(0, neighbour));
+	}
+	REQUIRE(occlusion.clear_share() == 1.0);
+}
+
+TEST_CASE("vehicles behind buildings do not light lamps", "[building-occlusion]") {
+	constexpr float threshold = 50.0f;
+	auto			footprints = BuildingFootprints {};
+	square(footprints, 10.0f, -10.0f, 20.0f);
+	const auto lamps = std::vector<StreetLamp> {{.id = 1, .lat = 0.0f, .lon = 0.0f},
+												{.id = 2, .lat = 40.0f, .lon = 30.0f}};
+	const auto grid_storage = build_streetlamp_grid(lamps, threshold);
+	const auto grid = grid_storage.view();
+	const auto occlusion = BuildingOcclusion(footprints, grid, threshold);
+
+	// Behind the building from lamp 1, in plain sight of lamp 2
+	const auto points = std::vector<Point> {{40.0f, 0.0f}};
+	auto	   buckets = CellBuckets {};
+	buckets.rebuild(grid.spec, points);
+	auto lit = std::vector<std::uint8_t>(grid.lamps.size(), 0);
+	REQUIRE(mark_lit_streetlamps(grid, buckets, points, threshold * threshold, 0, grid.lamps.size(),
+								 lit, &occlusion) == 1);
+	REQUIRE(mark_lit_streetlamps(grid, buckets, points, threshold * threshold, 0, grid.lamps.size(),
+								 lit) == 2);
+
+	const auto stats = occlusion.stats();
+	REQUIRE(stats.lit_lamps == 1);
+	REQUIRE(stats.occluded_lamps == 1);
+	REQUIRE(stats.blocked == 1);
+	REQUIRE(stats.sight_tests >= 1);
+
+	auto detector = IncrementalLampDetector(grid, threshold * threshold, &occlusion);
+	detector.update(1, points[0]);
+	detector.end_step();
+	REQUIRE(detector.num_lit() == 1);
+	REQUIRE(detector.num_occluded() == 1);
+	// Once it drives in front of the building lamp 1 sees it too
+	detector.update(1, {0.0f, 30.0f});
+	detector.end_step();
+	REQUIRE(detector.num_lit() == 2);
+	REQUIRE(detector.num_occluded() == 0);
+	detector.end_step();
+	REQUIRE(detector.num_lit() == 0);
+}
+
+TEST_CASE("occlusion matches testing every pair", "[building-occlusion]") {
+	constexpr float threshold = 25.0f;
+	constexpr float extent = 1000.0f;
+	auto			rng = std::mt19937(11);
+	auto			coordinate = std::uniform_real_distribution<float>(0.0f, extent);
+	auto			size = std::uniform_real_distribution<float>(2.0f, 20.0f);
+	auto			step = std::uniform_real_distribution<float>(-10.0f, 10.0f);
+
+	auto footprints = BuildingFootprints {};
+	for (int i = 0; i < 400; ++i) {
+		square(footprints, coordinate(rng), coordinate(rng), size(rng));
+	}
+	auto lamps = std::vector<StreetLamp> {};
+	for (std::int64_t id = 0; id < 2000; ++id) {
+		lamps.push_back(StreetLamp {.id = id, .lat = coordinate(rng), .lon = coordinate(rng)});
+	}
+	const auto grid_storage = build_streetlamp_grid(std::move(lamps), threshold);
+	const auto grid = grid_storage.view();
+	const auto occlusion = BuildingOcclusion(footprints, grid, threshold);
+
+	auto detector = IncrementalLampDetector(grid, threshold * threshold, &occlusion);
+	auto points = std::vector<Point>(300);
+	for (auto& p : points) {
+		p = {coordinate(rng), coordinate(rng)};
+	}
+	auto buckets = CellBuckets {};
+	auto full_lit = std::vector<std::uint8_t>(grid.lamps.size(), 0);
+	for (int simulation_step = 0; simulation_step < 20; ++simulation_step) {
+		for (std::uint32_t id = 0; id < points.size(); ++id) {
+			points[id].x += step(rng);
+			points[id].y += step(rng);
+			detector.update(id, points[id]);
+		}
+		detector.end_step();
+
+		buckets.rebuild(grid.spec, points);
+		const auto occluded_before = occlusion.stats().occluded_lamps;
+		const auto num_lit = mark_lit_streetlamps(grid, buckets, points, threshold * threshold, 0,
+												  grid.lamps.size(), full_lit, &occlusion);
+		REQUIRE(full_lit == brute_force_lit(grid, occlusion, points, threshold * threshold));
+		REQUIRE(std::vector<std::uint8_t>(detector.lit().begin(), detector.lit().end()) ==
+				full_lit);
+		REQUIRE(detector.num_lit() == num_lit);
+		REQUIRE(detector.num_occluded() == occlusion.stats().occluded_lamps - occluded_before);
+	}
+	REQUIRE(occlusion.stats().blocked > 0);
+	REQUIRE(detector.stats().sight_tests > 0);
+}
+
+TEST_CASE("building footprints are read from a poly.xml", "[building-occlusion]") {
+	const auto path = std::filesystem::temp_directory_path() / "building-occlusion-test.poly.xml";
+	{
+		auto file = std::ofstream(path);
+		file << R"(<additional>
+    <poly id="1" type="building" shape="0.00,0.00 10.00,0.00 10.00,10.00 0.00,10.00 0.00,0.00"/>
+    <poly id="2" type="water" shape="0.00,0.00 10.00,0.00 10.00,10.00"/>
+    <poly id="3" type="building.yes" shape="20.5,20.5 30.5,20.5 30.5,30.5"/>
+</additional>
+)";
+	}
+	const auto footprints = load_building_footprints(path);
+	std::filesystem::remove(path);
+	REQUIRE(footprints.has_value());
+	REQUIRE(footprints->size() == 2);
+	REQUIRE(footprints->outline(0).size() == 5);
+	REQUIRE(footprints->outline(1)[0].x == 20.5f);
+
+	REQUIRE(load_building_footprints("does-not-exist.poly.xml").error() ==
+			load_building_footprints_error::file_not_found);
+}
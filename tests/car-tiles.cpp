@@ -0,0 +1,45 @@
+#include <catch2/catch_test_macros.hpp>
+
+#include "car-tiles.hpp"
+
+#include <string>
+#include <vector>
+
+namespace {
+	auto add_car(StepSnapshot& snapshot, const std::uint32_t handle, const int x, const int y)
+		-> void {
+		snapshot.car_handles.push_back(handle);
+		snapshot.cars.push_back(Car {.x = x, .y = y, .heading = 0.0});
+	}
+} // namespace
+
+TEST_CASE("car tiles group cars by tile", "[car-tiles]") {
+	// Zoom 1 with 10 m cells gives 20 m tiles starting at (100, 100)
+	const auto spec = GridSpec {.origin_x = 100.0f, .origin_y = 100.0f, .cell_size = 10.0f};
+	auto	   tiles = CarTiles(spec, 1);
+
+	auto snapshot = StepSnapshot {};
+	add_car(snapshot, 1, 105, 105); // (0, 0)
+	add_car(snapshot, 2, 125, 105); // (1, 0)
+	add_car(snapshot, 3, 119, 119); // (0, 0)
+	add_car(snapshot, 4, 95, 130);	// (-1, 1), outside of the grid
+	tiles.assign(snapshot);
+
+	const auto result = tiles.tiles();
+	REQUIRE(result.size() == 3);
+	REQUIRE((result[0].x == 0 && result[0].y == 0));
+	REQUIRE(tiles.car_indices(result[0]).size() == 2);
+	REQUIRE((result[1].x == 1 && result[1].y == 0));
+	REQUIRE(tiles.car_indices(result[1]).front() == 1);
+	REQUIRE((result[2].x == -1 && result[2].y == 1));
+	REQUIRE(tiles.car_indices(result[2]).front() == 3);
+}
+
+TEST_CASE("car tile topics end with a separator", "[car-tiles]") {
+	const auto spec = GridSpec {.origin_x = 0.0f, .origin_y = 0.0f, .cell_size = 10.0f};
+	const auto tiles = CarTiles(spec, 3);
+
+	auto topic = std::vector<std::uint8_t> {};
+	tiles.append_topic("car-tiles", CarTiles::Tile {.x = 12, .y = -3, .begin = 0, .end = 0}, topic);
+	REQUIRE(std::string(topic.begin(), topic.end()) == "car-tiles/3/12/-3/");
+}
@@ -0,0 +1,100 @@
+#include <catch2/catch_test_macros.hpp>
+
+#include "checkpoint.hpp"
+
+#include <filesystem>
+#include <fstream>
+#include <string>
+
+#include <unistd.h>
+
+namespace {
+	auto temporary_path(const std::string& name) -> std::filesystem::path {
+		return std::filesystem::temp_directory_path() /
+			   ("sumo-sim-data-publisher-test-" + std::to_string(getpid()) + "-" + name);
+	}
+
+	auto make_checkpoint(const std::uint64_t step, const int num_cars) -> Checkpoint {
+		auto checkpoint = Checkpoint {};
+		checkpoint.snapshot.step = step;
+		checkpoint.snapshot.simulation_time = static_cast<double>(step + 1) * 0.1;
+		for (int i = 0; i < num_cars; ++i) {
+			checkpoint.snapshot.car_handles.push_back(static_cast<std::uint32_t>(100 + i));
+			checkpoint.snapshot.car_names.push_back("flow." + std::to_string(i));
+			checkpoint.snapshot.cars.push_back(Car {.x = i, .y = -i, .heading = 45.0 * i});
+		}
+		checkpoint.snapshot.lit_streetlamp_ids = {7, 123456789012};
+		checkpoint.sumo_state_path = "horsens.1000.state.xml";
+		return checkpoint;
+	}
+} // namespace
+
+TEST_CASE("checkpoints round trip", "[checkpoint]") {
+	const auto path = temporary_path("round-trip.bin");
+	const auto written = make_checkpoint(1000, 3);
+	REQUIRE(write_checkpoint(path, written));
+
+	const auto read = read_checkpoint(path);
+	REQUIRE(read.has_value());
+	REQUIRE(read->snapshot.step == 1000);
+	REQUIRE(read->snapshot.simulation_time == written.snapshot.simulation_time);
+	REQUIRE(read->snapshot.car_handles == written.snapshot.car_handles);
+	REQUIRE(read->snapshot.cars.size() == 3);
+	REQUIRE(read->snapshot.cars[2].x == 2);
+	REQUIRE(read->snapshot.cars[2].y == -2);
+	REQUIRE(read->snapshot.cars[2].heading == 90.0);
+	REQUIRE(read->snapshot.lit_streetlamp_ids == written.snapshot.lit_streetlamp_ids);
+	REQUIRE(read->snapshot.car_names == written.snapshot.car_names);
+	REQUIRE(read->sumo_state_path == written.sumo_state_path);
+	std::filesystem::remove(path);
+}
+
+TEST_CASE("damaged checkpoints are rejected", "[checkpoint]") {
+	REQUIRE(read_checkpoint(temporary_path("missing.bin")).error() ==
+			checkpoint_error::file_not_found);
+
+	const auto path = temporary_path("damaged.bin");
+	REQUIRE(write_checkpoint(path, make_checkpoint(1, 5)));
+	std::filesystem::resize_file(path, std::filesystem::file_size(path) - 8);
+	REQUIRE(read_checkpoint(path).error() == checkpoint_error::truncated);
+
+	{
+		auto out = std::ofstream(path, std::ios::binary | std::ios::trunc);
+		out << std::string(256, 'x');
+	}
+	REQUIRE(read_checkpoint(path).error() == checkpoint_error::bad_magic);
+	std::filesystem::remove(path);
+}
+
+TEST_CASE("checkpoint writer keeps the latest SUMO state", "[checkpoint]") {
+	const auto path = temporary_path("writer.bin");
+	{
+		auto writer = CheckpointWriter(path);
+		for (const std::uint64_t step : {10, 20}) {
+			const auto sumo_state_path = writer.sumo_state_path(step);
+			std::ofstream(sumo_state_path) << "<snapshot/>";
+			writer.submit(make_checkpoint(step, 2).snapshot, sumo_state_path);
+		}
+		writer.close();
+	}
+
+	const auto read = read_checkpoint(path);
+	REQUIRE(read.has_value());
+	REQUIRE(read->snapshot.step == 20);
+	REQUIRE(std::filesystem::exists(read->sumo_state_path));
+	// The state of step 10 is removed, whether it was written or skipped
+	REQUIRE(! std::filesystem::exists(temporary_path("writer.bin.10.state.xml")));
+	std::filesystem::remove(read->sumo_state_path);
+	std::filesystem::remove(path);
+}
+
+TEST_CASE("checkpoint writer removes the SUMO state of failed checkpoints", "[checkpoint]") {
+	const auto sumo_state_path = temporary_path("failed.10.state.xml");
+	std::ofstream(sumo_state_path) << "<snapshot/>";
+	{
+		auto writer = CheckpointWriter(temporary_path("missing-directory") / "writer.bin");
+		writer.submit(make_checkpoint(10, 2).snapshot, sumo_state_path);
+		writer.close();
+	}
+	REQUIRE(! std::filesystem::exists(sumo_state_path));
+}
@@ -0,0 +1,95 @@
+#include <catch2/catch_test_macros.hpp>
+
+#include "density-raster.hpp"
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdlib>
+#include <vector>
+
+TEST_CASE("the boundary of a network is read from its location", "[density-raster]") {
+	const auto xml = R"(<?xml version="1.0" encoding="UTF-8"?>
+<net version="1.16" junctionCornerDetail="5" limitTurnSpeed="5.50">
+    <location netOffset="-552712.10,-6224508.05" convBoundary="0.00,-12.50,8403.87,6006.24"
+              origBoundary="10.10,56.10,10.25,56.20" projParameter="+proj=utm +zone=32"/>
+    <edge id=":1_0" function="internal">)";
+	const auto boundary = parse_net_boundary(xml);
+	REQUIRE(boundary.has_value());
+	REQUIRE(boundary->x_min == 0.0);
+	REQUIRE(boundary->y_min == -12.5);
+	REQUIRE(boundary->x_max == 8403.87);
+	REQUIRE(boundary->y_max == 6006.24);
+
+	REQUIRE(parse_net_boundary("<net><edge/></net>").error() ==
+			read_net_boundary_error::no_location);
+	REQUIRE(parse_net_boundary(R"(<location convBoundary="0,0,10"/>)").error() ==
+			read_net_boundary_error::malformed_boundary);
+	REQUIRE(parse_net_boundary(R"(<location convBoundary="0,0,10,x"/>)").error() ==
+			read_net_boundary_error::malformed_boundary);
+
+	const auto spec = RasterSpec::covering(*boundary, 25.0);
+	REQUIRE(spec.columns == 337);
+	REQUIRE(spec.rows == 241);
+	REQUIRE(spec.cell_of(0.0, -12.5) == 0);
+	REQUIRE(spec.cell_of(25.0, 12.5) == spec.columns + 1);
+	REQUIRE(spec.cell_of(-1.0, 0.0) == spec.num_cells());
+	REQUIRE(spec.cell_of(8425.0, 0.0) == spec.num_cells());
+}
+
+TEST_CASE("cars are counted per cell with their mean heading", "[density-raster]") {
+	const auto spec = RasterSpec::covering({0.0, 0.0, 99.0, 49.0}, 25.0); // 4 x 2 cells
+	const auto cars = std::vector<Car> {
+		{.x = 1, .y = 1, .heading = 350.0, .alive = true},
+		{.x = 24, .y = 24, .heading = 10.0, .alive = true},
+		{.x = 30, .y = 30, .heading = 90.0, .alive = true},
+		{.x = 31, .y = 31, .heading = 180.0, .alive = false}, // Not in the simulation any more
+		{.x = 500, .y = 30, .heading = 0.0, .alive = true},	  // Outside the raster
+	};
+
+	auto raster = DensityRaster(spec, 1);
+	raster.compute(cars);
+	REQUIRE(raster.cars() == 3);
+	REQUIRE(raster.count(0) == 2);
+	REQUIRE(raster.count(5) == 1);
+	REQUIRE(raster.count(1) == 0);
+	// The mean of 350 and 10 degrees is north, not south
+	REQUIRE((raster.heading(0) < 2 || raster.heading(0) > 65534));
+	REQUIRE(raster.heading(5) == 16384);
+	REQUIRE(raster.heading(1) == 0);
+	REQUIRE(raster.counts().size() == 2 * spec.num_cells());
+	REQUIRE(raster.headings().size() == 2 * spec.num_cells());
+
+	// The next step starts from an empty raster
+	raster.compute(std::span(cars).first(1));
+	REQUIRE(raster.cars() == 1);
+	REQUIRE(raster.count(0) == 1);
+	REQUIRE(raster.count(5) == 0);
+}
+
+TEST_CASE("counting on several threads gives the same raster", "[density-raster]") {
+	// More cells than one reduction task, so the reduction is split as well
+	const auto spec = RasterSpec::covering({0.0, 0.0, 5000.0, 5000.0}, 25.0);
+	auto	   cars = std::vector<Car> {};
+	for (int idx = 0; idx < 20000; ++idx) {
+		cars.push_back(Car {
+			.x = (idx * 7919) % 5200 - 100,
+			.y = (idx * 104729) % 5100,
+			.heading = static_cast<double>((idx * 37) % 360),
+			.alive = idx % 11 != 0,
+		});
+	}
+
+	auto single = DensityRaster(spec, 1);
+	auto parallel = DensityRaster(spec, 4);
+	for (int run = 0; run < 2; ++run) {
+		single.compute(cars);
+		parallel.compute(cars);
+		REQUIRE(single.cars() == parallel.cars());
+		for (std::size_t cell = 0; cell < spec.num_cells(); ++cell) {
+			REQUIRE(single.count(cell) == parallel.count(cell));
+			// Sums of floats in another order, so the last bit may differ
+			const auto difference = std::abs(single.heading(cell) - parallel.heading(cell));
+			REQUIRE(std::min(difference, 65536 - difference) <= 1);
+		}
+	}
+}
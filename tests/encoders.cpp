@@ -0,0 +1,212 @@
+#include <catch2/catch_test_macros.hpp>
+
+#include "encoding-format.hpp"
+#include "step-snapshot.hpp"
+#include "streetlamp.hpp"
+
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <limits>
+#include <string>
+#include <vector>
+
+#include <nlohmann/json.hpp>
+
+using json = nlohmann::json;
+using Bytes = std::vector<std::uint8_t>;
+
+namespace {
+	auto make_snapshot() -> StepSnapshot {
+		auto snapshot = StepSnapshot {};
+		const auto add = [&](const std::uint32_t handle, std::string name, const Car car) {
+			snapshot.car_handles.push_back(handle);
+			snapshot.car_names.push_back(std::move(name));
+			snapshot.cars.push_back(car);
+		};
+		add(0, "veh0", Car {.x = 1, .y = -2, .heading = 90.0});
+		add(7, "flow.3", Car {.x = 300000, .y = -40000, .heading = 0.1});
+		add(70000, "a \"quoted\"\n\\name", Car {.x = -200, .y = 127, .heading = -1.5});
+		snapshot.lit_streetlamp_ids = {0, 23, 24, 255, 256, 65536, -1, -33, -129, 5000000000};
+		return snapshot;
+	}
+
+	// The messages as nlohmann::json trees, like the publisher built them before the writers
+	auto cars_json(const StepSnapshot& snapshot) -> json {
+		auto cars = json::object();
+		for (std::size_t idx = 0; idx < snapshot.cars.size(); ++idx) {
+			const auto& car = snapshot.cars[idx];
+			cars[std::to_string(snapshot.car_handles[idx])] = {
+				{"heading", car.heading},
+				{"x", car.x},
+				{"y", car.y},
+			};
+		}
+		return cars;
+	}
+
+	auto vehicle_ids_json(const StepSnapshot& snapshot) -> json {
+		auto ids = json::object();
+		for (std::size_t idx = 0; idx < snapshot.cars.size(); ++idx) {
+			ids[std::to_string(snapshot.car_handles[idx])] = snapshot.car_names[idx];
+		}
+		return ids;
+	}
+
+	auto encode(void (*encode_message)(const StepSnapshot&, std::string_view, Bytes&),
+				const StepSnapshot& snapshot) -> Bytes {
+		auto out = Bytes {};
+		encode_message(snapshot, "", out);
+		return out;
+	}
+
+	template <typename T>
+	auto read(const Bytes& bytes, std::size_t& at) -> T {
+		auto value = T {};
+		std::memcpy(&value, bytes.data() + at, sizeof(T));
+		at += sizeof(T);
+		return value;
+	}
+} // namespace
+
+TEST_CASE("cbor and msgpack writers match nlohmann", "[encoders]") {
+	const auto snapshot = make_snapshot();
+
+	REQUIRE(encode(encode_cars_message<CborWriter>, snapshot) ==
+			json::to_cbor(cars_json(snapshot)));
+	REQUIRE(encode(encode_vehicle_ids_message<CborWriter>, snapshot) ==
+			json::to_cbor(vehicle_ids_json(snapshot)));
+	REQUIRE(encode(encode_streetlamps_message<CborWriter>, snapshot) ==
+			json::to_cbor(json(snapshot.lit_streetlamp_ids)));
+
+	REQUIRE(encode(encode_cars_message<MsgpackWriter>, snapshot) ==
+			json::to_msgpack(cars_json(snapshot)));
+	REQUIRE(encode(encode_vehicle_ids_message<MsgpackWriter>, snapshot) ==
+			json::to_msgpack(vehicle_ids_json(snapshot)));
+	REQUIRE(encode(encode_streetlamps_message<MsgpackWriter>, snapshot) ==
+			json::to_msgpack(json(snapshot.lit_streetlamp_ids)));
+}
+
+TEST_CASE("msgpack writer uses the sizes of nlohmann for long containers", "[encoders]") {
+	auto out = Bytes {};
+	auto writer = MsgpackWriter(out);
+	const auto long_text = std::string(300, 'x');
+	writer.array(3);
+	writer.text(long_text);
+	writer.text(std::string(40, 'y'));
+	writer.array(20);
+	for (int i = 0; i < 20; ++i) {
+		writer.boolean(i % 2 == 0);
+	}
+
+	auto expected = json::array({long_text, std::string(40, 'y'), json::array()});
+	for (int i = 0; i < 20; ++i) {
+		expected[2].push_back(i % 2 == 0);
+	}
+	REQUIRE(out == json::to_msgpack(expected));
+}
+
+TEST_CASE("byte strings are written like nlohmann's binary values", "[encoders]") {
+	for (const auto size : {0, 5, 300, 70000}) {
+		auto bytes = Bytes(static_cast<std::size_t>(size));
+		for (std::size_t idx = 0; idx < bytes.size(); ++idx) {
+			bytes[idx] = static_cast<std::uint8_t>(idx * 7);
+		}
+		auto cbor = Bytes {};
+		CborWriter(cbor).bytes(bytes);
+		REQUIRE(cbor == json::to_cbor(json::binary(bytes)));
+		auto msgpack = Bytes {};
+		MsgpackWriter(msgpack).bytes(bytes);
+		REQUIRE(msgpack == json::to_msgpack(json::binary(bytes)));
+	}
+
+	// JSON has no byte strings, they are base64 text
+	auto out = Bytes {};
+	auto writer = JsonWriter(out);
+	writer.array(4);
+	for (const auto* text : {"", "M", "Ma", "Man"}) {
+		const auto view = std::string_view(text);
+		writer.bytes(Bytes(view.begin(), view.end()));
+	}
+	REQUIRE(std::string(out.begin(), out.end()) == R"(["","TQ==","TWE=","TWFu"])");
+}
+
+TEST_CASE("json writer writes the same values as nlohmann", "[encoders]") {
+	const auto snapshot = make_snapshot();
+
+	const auto cars = encode(encode_cars_message<JsonWriter>, snapshot);
+	REQUIRE(json::parse(cars) == cars_json(snapshot));
+	const auto ids = encode(encode_vehicle_ids_message<JsonWriter>, snapshot);
+	REQUIRE(json::parse(ids) == vehicle_ids_json(snapshot));
+	const auto lamps = encode(encode_streetlamps_message<JsonWriter>, snapshot);
+	REQUIRE(json::parse(lamps) == json(snapshot.lit_streetlamp_ids));
+}
+
+TEST_CASE("json writer closes nested and empty containers", "[encoders]") {
+	auto out = Bytes {};
+	auto writer = JsonWriter(out);
+	writer.map(3);
+	writer.text("empty");
+	writer.array(0);
+	writer.text("nested");
+	writer.array(2);
+	writer.map(0);
+	writer.array(1);
+	writer.floating(std::numeric_limits<double>::quiet_NaN());
+	writer.text("lamp");
+	encode_record(writer, StreetLamp {.id = 3, .lat = 55.5f, .lon = 12.25f});
+
+	REQUIRE(std::string(out.begin(), out.end()) ==
+			R"({"empty":[],"nested":[{},[null]],"lamp":{"id":3,"lat":55.5,"lon":12.25}})");
+}
+
+TEST_CASE("packed writer keeps the width of record fields", "[encoders]") {
+	const auto snapshot = make_snapshot();
+	const auto out = encode(encode_cars_message<PackedWriter>, snapshot);
+	REQUIRE(out.size() == 4 + snapshot.cars.size() * 20);
+
+	auto at = std::size_t {0};
+	REQUIRE(read<std::uint32_t>(out, at) == snapshot.cars.size());
+	for (std::size_t idx = 0; idx < snapshot.cars.size(); ++idx) {
+		const auto& car = snapshot.cars[idx];
+		REQUIRE(read<std::uint32_t>(out, at) == snapshot.car_handles[idx]);
+		REQUIRE(read<double>(out, at) == car.heading);
+		REQUIRE(read<std::int32_t>(out, at) == car.x);
+		REQUIRE(read<std::int32_t>(out, at) == car.y);
+	}
+
+	const auto ids = encode(encode_vehicle_ids_message<PackedWriter>, snapshot);
+	at = 0;
+	REQUIRE(read<std::uint32_t>(ids, at) == snapshot.cars.size());
+	REQUIRE(read<std::uint32_t>(ids, at) == snapshot.car_handles[0]);
+	const auto name_size = read<std::uint32_t>(ids, at);
+	REQUIRE(name_size == snapshot.car_names[0].size());
+	const auto* name = reinterpret_cast<const char*>(ids.data() + at);
+	REQUIRE(std::string_view(name, name_size) == snapshot.car_names[0]);
+}
+
+TEST_CASE("with_writer picks the writer of a format", "[encoders]") {
+	const auto snapshot = make_snapshot();
+	for (const auto format : {EncodingFormat::cbor, EncodingFormat::msgpack, EncodingFormat::json,
+							  EncodingFormat::packed}) {
+		auto out = Bytes {};
+		with_writer(format, [&](auto tag) {
+			encode_cars_message<decltype(tag)::template Writer>(snapshot, "cars", out);
+		});
+		const auto payload = Bytes(out.begin() + 4, out.end());
+		switch (format) {
+			case EncodingFormat::cbor:
+				REQUIRE(json::from_cbor(payload) == cars_json(snapshot));
+				break;
+			case EncodingFormat::msgpack:
+				REQUIRE(json::from_msgpack(payload) == cars_json(snapshot));
+				break;
+			case EncodingFormat::json:
+				REQUIRE(json::parse(payload) == cars_json(snapshot));
+				break;
+			case EncodingFormat::packed:
+				REQUIRE(payload.size() == 4 + snapshot.cars.size() * 20);
+				break;
+		}
+	}
+}
@@ -0,0 +1,111 @@
+#include <catch2/catch_test_macros.hpp>
+
+#include "incremental-lamp-detector.hpp"
+
+#include <random>
+#include <vector>
+
+namespace {
+	// Every lamp against every vehicle
+	auto brute_force_lit(const StreetLampGridView& grid, const std::vector<Point>& points,
+						 const float distance_threshold_squared) -> std::vector<std::uint8_t> {
+		auto lit = std::vector<std::uint8_t>(grid.lamps.size(), 0);
+		for (std::size_t idx = 0; idx < grid.lamps.size(); ++idx) {
+			for (const auto p : points) {
+				const auto dx = p.x - grid.lamps[idx].lon;
+				const auto dy = p.y - grid.lamps[idx].lat;
+				if (dx * dx + dy * dy <= distance_threshold_squared) {
+					lit[idx] = 1;
+					break;
+				}
+			}
+		}
+		return lit;
+	}
+} // namespace
+
+TEST_CASE("incremental lamp detection matches full recomputation", "[incremental-lamp-detector]") {
+	constexpr float threshold = 25.0f;
+	constexpr float extent = 1000.0f;
+	auto			rng = std::mt19937(42);
+	auto			coordinate = std::uniform_real_distribution<float>(0.0f, extent);
+	// Some vehicles drive off the grid on purpose
+	auto			step = std::uniform_real_distribution<float>(-15.0f, 15.0f);
+	auto			percent = std::uniform_int_distribution<int>(0, 99);
+
+	auto lamps = std::vector<StreetLamp> {};
+	for (std::int64_t id = 0; id < 2000; ++id) {
+		lamps.push_back(StreetLamp {.id = id, .lat = coordinate(rng), .lon = coordinate(rng)});
+	}
+	// A lamp exactly on the threshold of the first vehicle
+	lamps.push_back(StreetLamp {.id = 2000, .lat = 500.0f, .lon = 525.0f});
+	const auto grid_storage = build_streetlamp_grid(std::move(lamps), threshold);
+	const auto grid = grid_storage.view();
+
+	auto detector = IncrementalLampDetector(grid, threshold * threshold);
+	auto vehicles = std::vector<std::pair<int, Point>> {{0, Point {500.0f, 500.0f}}};
+	int	 next_id = 1;
+	auto points = std::vector<Point> {};
+	auto buckets = CellBuckets {};
+	auto full_lit = std::vector<std::uint8_t>(grid.lamps.size(), 0);
+
+	for (int simulation_step = 0; simulation_step < 300; ++simulation_step) {
+		// Vehicles enter, leave, stand still or move
+		for (int n = percent(rng) % 8; n > 0; --n) {
+			vehicles.emplace_back(next_id++, Point {coordinate(rng), coordinate(rng)});
+		}
+		for (std::size_t idx = 0; idx < vehicles.size();) {
+			if (percent(rng) < 3) {
+				vehicles[idx] = vehicles.back();
+				vehicles.pop_back();
+				continue;
+			}
+			if (percent(rng) < 70) {
+				vehicles[idx].second.x += step(rng);
+				vehicles[idx].second.y += step(rng);
+			}
+			++idx;
+		}
+
+		points.clear();
+		for (const auto& [id, p] : vehicles) {
+			detector.update(id, p);
+			points.push_back(p);
+		}
+		detector.end_step();
+
+		buckets.rebuild(grid.spec, points);
+		const auto num_lit = mark_lit_streetlamps(grid, buckets, points, threshold * threshold, 0,
+												  grid.lamps.size(), full_lit);
+		const auto incremental_lit =
+			std::vector<std::uint8_t>(detector.lit().begin(), detector.lit().end());
+		REQUIRE(incremental_lit == full_lit);
+		REQUIRE(detector.num_lit() == num_lit);
+		if (simulation_step % 50 == 0) {
+			REQUIRE(incremental_lit == brute_force_lit(grid, points, threshold * threshold));
+		}
+	}
+
+	REQUIRE(detector.stats().left > 0);
+	REQUIRE(detector.stats().requeried < detector.stats().updates);
+}
+
+TEST_CASE("lamps go dark when the last vehicle leaves", "[incremental-lamp-detector]") {
+	auto		lamps = std::vector<StreetLamp> {{.id = 1, .lat = 0.0f, .lon = 0.0f}};
+	const auto	grid_storage = build_streetlamp_grid(std::move(lamps), 10.0f);
+	auto		detector = IncrementalLampDetector(grid_storage.view(), 100.0f);
+
+	detector.update(1, {5.0f, 0.0f});
+	detector.update(2, {0.0f, 5.0f});
+	detector.end_step();
+	REQUIRE(detector.num_lit() == 1);
+
+	detector.update(2, {0.0f, 5.0f});
+	detector.end_step();
+	REQUIRE(detector.num_lit() == 1);
+
+	detector.update(2, {0.0f, 50.0f});
+	detector.end_step();
+	REQUIRE(detector.num_lit() == 0);
+	REQUIRE(detector.lit()[0] == 0);
+}
@@ -0,0 +1,125 @@
+#include <catch2/catch_test_macros.hpp>
+
+#include "lamp-occupancy.hpp"
+
+#include <array>
+#include <cmath>
+#include <cstdint>
+#include <filesystem>
+#include <string>
+#include <vector>
+
+#include <sqlite3.h>
+
+namespace {
+	struct Query {
+		sqlite3* db = nullptr;
+
+		explicit Query(const std::filesystem::path& path) {
+			REQUIRE(sqlite3_open(path.c_str(), &db) == SQLITE_OK);
+		}
+		~Query() { sqlite3_close(db); }
+
+		auto number(const std::string& sql) -> double {
+			sqlite3_stmt* statement = nullptr;
+			REQUIRE(sqlite3_prepare_v2(db, sql.c_str(), -1, &statement, nullptr) == SQLITE_OK);
+			REQUIRE(sqlite3_step(statement) == SQLITE_ROW);
+			const auto value = sqlite3_column_double(statement, 0);
+			sqlite3_finalize(statement);
+			return value;
+		}
+	};
+
+	// Lamp 0 has 2 vehicles near it for the first 3 s of every 4 s, lamp 1 one vehicle in the
+	// second half of the run, lamp 2 never any
+	auto record_run(OccupancyArchive& archive, const double dt, const int steps) -> void {
+		for (int step = 0; step < steps; ++step) {
+			const auto time = step * dt;
+			const auto near = std::array<std::uint32_t, 3> {
+				std::fmod(time, 4.0) < 3.0 ? 2u : 0u,
+				step >= steps / 2 ? 1u : 0u,
+				0u,
+			};
+			archive.record(time, dt, near);
+		}
+	}
+} // namespace
+
+TEST_CASE("occupancy is archived at every resolution", "[lamp-occupancy]") {
+	const auto path = std::filesystem::temp_directory_path() / "lamp-occupancy-test.sqlite";
+	std::filesystem::remove(path);
+	const auto osm_ids = std::array<std::int64_t, 3> {100, 200, 300};
+	{
+		auto database = OccupancyDatabase::open(path, osm_ids);
+		REQUIRE(database.has_value());
+		// Enough buffers for every bucket, so none is dropped however slow the flusher is
+		auto archive = OccupancyArchive(std::move(*database), 3, {1.0, 4.0, 16.0}, 32);
+		record_run(archive, 0.5, 64); // 32 s
+		archive.close();
+		REQUIRE(archive.dropped() == 0);
+	}
+
+	auto query = Query(path);
+	REQUIRE(query.number("SELECT count(*) FROM lamps") == 3);
+	REQUIRE(query.number("SELECT osm_id FROM lamps WHERE lamp = 1") == 200);
+	for (const auto resolution : {"1", "4", "16"}) {
+		const auto where = std::string(" FROM occupancy WHERE resolution = ") + resolution;
+		// Lamp 0 is lit 3 of every 4 s with 2 vehicles, lamp 1 the last 16 s with one
+		REQUIRE(query.number("SELECT sum(lit_seconds)" + where + " AND lamp = 0") == 24.0);
+		REQUIRE(query.number("SELECT sum(vehicle_seconds)" + where + " AND lamp = 0") == 48.0);
+		REQUIRE(query.number("SELECT sum(activations)" + where + " AND lamp = 0") == 8);
+		REQUIRE(query.number("SELECT max(max_vehicles)" + where + " AND lamp = 0") == 2);
+		REQUIRE(query.number("SELECT sum(lit_seconds)" + where + " AND lamp = 1") == 16.0);
+		REQUIRE(query.number("SELECT sum(activations)" + where + " AND lamp = 1") == 1);
+		// Dark lamps have no rows
+		REQUIRE(query.number("SELECT count(*)" + where + " AND lamp = 2") == 0);
+	}
+	REQUIRE(query.number("SELECT count(*) FROM occupancy WHERE resolution = 4 AND lamp = 0") ==
+			8);
+	REQUIRE(query.number("SELECT count(*) FROM occupancy WHERE resolution = 16 AND lamp = 1") ==
+			1);
+	std::filesystem::remove(path);
+}
+
+TEST_CASE("archiving the same buckets again replaces them", "[lamp-occupancy]") {
+	const auto path = std::filesystem::temp_directory_path() / "lamp-occupancy-resume.sqlite";
+	std::filesystem::remove(path);
+	const auto osm_ids = std::array<std::int64_t, 3> {100, 200, 300};
+	for (int run = 0; run < 2; ++run) {
+		auto database = OccupancyDatabase::open(path, osm_ids);
+		REQUIRE(database.has_value());
+		auto archive = OccupancyArchive(std::move(*database), 3, {1.0, 4.0});
+		record_run(archive, 1.0, 8);
+	}
+
+	auto query = Query(path);
+	REQUIRE(query.number("SELECT sum(lit_seconds) FROM occupancy WHERE resolution = 4 AND "
+						 "lamp = 0") == 6.0);
+	std::filesystem::remove(path);
+}
+
+TEST_CASE("intervals longer than a bucket are split between the buckets", "[lamp-occupancy]") {
+	const auto path = std::filesystem::temp_directory_path() / "lamp-occupancy-split.sqlite";
+	std::filesystem::remove(path);
+	const auto osm_ids = std::array<std::int64_t, 3> {100, 200, 300};
+	{
+		auto database = OccupancyDatabase::open(path, osm_ids);
+		REQUIRE(database.has_value());
+		auto archive = OccupancyArchive(std::move(*database), 3, {1.0, 4.0});
+		// Two intervals of 2.5 s, e.g. steps skipped by the cadence, with one vehicle near lamp 0
+		const auto near = std::array<std::uint32_t, 3> {1u, 0u, 0u};
+		archive.record(0.0, 2.5, near);
+		archive.record(2.5, 2.5, near);
+	}
+
+	auto	   query = Query(path);
+	const auto where = std::string(" FROM occupancy WHERE resolution = 1 AND lamp = 0");
+	REQUIRE(query.number("SELECT count(*)" + where) == 5);
+	REQUIRE(query.number("SELECT min(lit_seconds)" + where) == 1.0);
+	REQUIRE(query.number("SELECT max(vehicle_seconds)" + where) == 1.0);
+	REQUIRE(query.number("SELECT lit_seconds" + where + " AND start = 2") == 1.0);
+	REQUIRE(query.number("SELECT sum(activations)" + where) == 1);
+	REQUIRE(query.number("SELECT sum(lit_seconds) FROM occupancy WHERE resolution = 4 AND "
+						 "lamp = 0") == 5.0);
+	std::filesystem::remove(path);
+}
@@ -0,0 +1,236 @@
+#include <catch2/catch_test_macros.hpp>
+
+#include "fcd-reader.hpp"
+#include "lamp-timeline.hpp"
+
+#include <cmath>
+#include <filesystem>
+#include <random>
+#include <string>
+#include <vector>
+
+#include <fmt/core.h>
+#include <sqlite3.h>
+
+namespace {
+	struct Timestep {
+		double			   time;
+		std::vector<Point> positions;
+
+		auto operator==(const Timestep& other) const -> bool {
+			if (time != other.time || positions.size() != other.positions.size()) {
+				return false;
+			}
+			for (std::size_t idx = 0; idx < positions.size(); ++idx) {
+				if (positions[idx].x != other.positions[idx].x ||
+					positions[idx].y != other.positions[idx].y) {
+					return false;
+				}
+			}
+			return true;
+		}
+	};
+
+	auto read_all(const std::string_view text, const std::size_t chunk_bytes)
+		-> std::vector<Timestep> {
+		const auto layout = detect_fcd_layout(text);
+		REQUIRE(layout.has_value());
+		auto timesteps = std::vector<Timestep> {};
+		for (const auto chunk : split_fcd(text, *layout, chunk_bytes)) {
+			const auto read =
+				read_fcd_chunk(chunk, *layout, [&](const double time, const auto points) {
+					timesteps.push_back({time, {points.begin(), points.end()}});
+				});
+			REQUIRE(read.has_value());
+		}
+		return timesteps;
+	}
+
+	// Vehicles wandering around a 1000 x 1000 area, some steps without any
+	auto random_timesteps(const int num_steps) -> std::vector<Timestep> {
+		auto rng = std::mt19937(5);
+		auto coordinate = std::uniform_real_distribution<float>(0.0f, 1000.0f);
+		auto count = std::uniform_int_distribution<int>(0, 12);
+		auto timesteps = std::vector<Timestep> {};
+		for (int step = 0; step < num_steps; ++step) {
+			auto& timestep = timesteps.emplace_back(Timestep {step * 0.5, {}});
+			for (int n = step % 7 == 3 ? 0 : count(rng); n > 0; --n) {
+				// Round trips through the text unchanged
+				const auto x = std::round(coordinate(rng) * 100) / 100;
+				timestep.positions.push_back({x, std::round(coordinate(rng) * 100) / 100});
+			}
+		}
+		return timesteps;
+	}
+
+	auto to_xml(const std::vector<Timestep>& timesteps) -> std::string {
+		auto xml = std::string(R"(<?xml version="1.0" encoding="UTF-8"?>
+<!-- generated by sumo
+<configuration>
+    <fcd-output value="fcd.xml"/>
+</configuration>
+-->
+<fcd-export xmlns:xsi="http://www.w3.org/2001/XMLSchema-instance">
+)");
+		for (const auto& timestep : timesteps) {
+			if (timestep.positions.empty()) {
+				xml += fmt::format("    <timestep time=\"{:.2f}\"/>\n", timestep.time);
+				continue;
+			}
+			xml += fmt::format("    <timestep time=\"{:.2f}\">\n", timestep.time);
+			for (std::size_t idx = 0; idx < timestep.positions.size(); ++idx) {
+				const auto p = timestep.positions[idx];
+				xml += fmt::format("        <vehicle id=\"v{}\" x=\"{:.2f}\" y=\"{:.2f}\" "
+								   "angle=\"90.00\" speed=\"13.89\" lane=\"e_0\"/>\n",
+								   idx, p.x, p.y);
+			}
+			xml += fmt::format("        <person id=\"p\" x=\"1.00\" y=\"2.00\"/>\n");
+			xml += "    </timestep>\n";
+		}
+		return xml + "</fcd-export>\n";
+	}
+
+	auto to_csv(const std::vector<Timestep>& timesteps) -> std::string {
+		auto csv = std::string("timestep_time;vehicle_angle;vehicle_id;vehicle_x;vehicle_y\n");
+		for (const auto& timestep : timesteps) {
+			if (timestep.positions.empty()) {
+				csv += fmt::format("{:.2f};;;;\n", timestep.time);
+			}
+			for (std::size_t idx = 0; idx < timestep.positions.size(); ++idx) {
+				const auto p = timestep.positions[idx];
+				csv +=
+					fmt::format("{:.2f};90.00;v{};{:.2f};{:.2f}\n", timestep.time, idx, p.x, p.y);
+			}
+		}
+		return csv;
+	}
+
+	auto random_grid() -> StreetLampGrid {
+		auto rng = std::mt19937(9);
+		auto coordinate = std::uniform_real_distribution<float>(0.0f, 1000.0f);
+		auto lamps = std::vector<StreetLamp> {};
+		for (std::int64_t id = 0; id < 1500; ++id) {
+			lamps.push_back(StreetLamp {.id = id, .lat = coordinate(rng), .lon = coordinate(rng)});
+		}
+		return build_streetlamp_grid(std::move(lamps), 40.0f);
+	}
+
+	auto timeline_of(const StreetLampGridView& grid, const std::string_view text,
+					 const std::size_t chunk_bytes) -> LampTimeline {
+		const auto layout = detect_fcd_layout(text);
+		REQUIRE(layout.has_value());
+		auto chunks = std::vector<TimelineChunk> {};
+		for (const auto chunk : split_fcd(text, *layout, chunk_bytes)) {
+			auto detected = detect_timeline_chunk(grid, chunk, *layout, 40.0f * 40.0f);
+			REQUIRE(detected.has_value());
+			chunks.push_back(std::move(*detected));
+		}
+		return merge_timeline_chunks(chunks, grid.lamps.size());
+	}
+} // namespace
+
+TEST_CASE("fcd timesteps are read from xml and csv", "[lamp-timeline]") {
+	const auto timesteps = random_timesteps(60);
+	const auto xml = to_xml(timesteps);
+	const auto csv = to_csv(timesteps);
+
+	REQUIRE(detect_fcd_layout(xml)->format == FcdFormat::xml);
+	const auto csv_layout = detect_fcd_layout(csv);
+	REQUIRE(csv_layout->format == FcdFormat::csv);
+	REQUIRE(csv_layout->separator == ';');
+	REQUIRE(csv_layout->time_column == 0);
+	REQUIRE(csv_layout->x_column == 3);
+	REQUIRE(csv_layout->y_column == 4);
+
+	// Every chunk size sees every timestep exactly once
+	for (const auto chunk_bytes : {std::size_t {1}, std::size_t {97}, std::size_t {1000},
+								   std::size_t {1} << 30}) {
+		REQUIRE(read_all(xml, chunk_bytes) == timesteps);
+		REQUIRE(read_all(csv, chunk_bytes) == timesteps);
+	}
+}
+
+TEST_CASE("malformed fcd is reported", "[lamp-timeline]") {
+	REQUIRE(detect_fcd_layout("  \n").error() == read_fcd_error::empty_file);
+	REQUIRE(detect_fcd_layout("time;id\n0;a\n").error() == read_fcd_error::missing_columns);
+
+	const auto read = [](const std::string_view text) {
+		const auto layout = *detect_fcd_layout(text);
+		return read_fcd_chunk(text.substr(layout.data_begin), layout, [](double, auto) {});
+	};
+	REQUIRE(read("<timestep time=\"0\"><vehicle id=\"a\" x=\"1\"/></timestep>").error() ==
+			read_fcd_error::malformed_vehicle);
+	REQUIRE(read("<timestep><vehicle id=\"a\" x=\"1\" y=\"2\"/></timestep>").error() ==
+			read_fcd_error::malformed_timestep);
+	REQUIRE(read("time;x;y\n0.0;1;2\nnan?;1;2\n").error() == read_fcd_error::malformed_timestep);
+	REQUIRE(read("time;x;y\n0.0;1;b\n").error() == read_fcd_error::malformed_vehicle);
+}
+
+TEST_CASE("chunked timelines match reading the file at once", "[lamp-timeline]") {
+	const auto grid_storage = random_grid();
+	const auto grid = grid_storage.view();
+	const auto timesteps = random_timesteps(200);
+	const auto xml = to_xml(timesteps);
+
+	const auto whole = timeline_of(grid, xml, std::size_t {1} << 30);
+	REQUIRE(whole.steps == timesteps.size());
+	REQUIRE(whole.begin == 0.0);
+	REQUIRE(whole.end == 100.0); // The last step at 99.5, plus one step length
+	REQUIRE(! whole.intervals.empty());
+
+	// Replaying the intervals gives the lamps lit at every timestep
+	auto buckets = CellBuckets {};
+	auto lit = std::vector<std::uint8_t>(grid.lamps.size(), 0);
+	for (const auto& timestep : timesteps) {
+		buckets.rebuild(grid.spec, timestep.positions);
+		mark_lit_streetlamps(grid, buckets, timestep.positions, 40.0f * 40.0f, 0, grid.lamps.size(),
+							 lit);
+		auto replayed = std::vector<std::uint8_t>(grid.lamps.size(), 0);
+		for (const auto& interval : whole.intervals) {
+			REQUIRE(interval.on_at < interval.off_at);
+			if (interval.on_at <= timestep.time && timestep.time < interval.off_at) {
+				REQUIRE(replayed[interval.lamp] == 0);
+				replayed[interval.lamp] = 1;
+			}
+		}
+		REQUIRE(replayed == lit);
+	}
+
+	for (const auto chunk_bytes : {std::size_t {1}, std::size_t {500}, std::size_t {4096}}) {
+		for (const auto& text : {xml, to_csv(timesteps)}) {
+			const auto chunked = timeline_of(grid, text, chunk_bytes);
+			REQUIRE(chunked.steps == whole.steps);
+			REQUIRE(chunked.end == whole.end);
+			REQUIRE(chunked.intervals.size() == whole.intervals.size());
+			for (std::size_t idx = 0; idx < whole.intervals.size(); ++idx) {
+				REQUIRE(chunked.intervals[idx].lamp == whole.intervals[idx].lamp);
+				REQUIRE(chunked.intervals[idx].on_at == whole.intervals[idx].on_at);
+				REQUIRE(chunked.intervals[idx].off_at == whole.intervals[idx].off_at);
+			}
+		}
+	}
+}
+
+TEST_CASE("the timeline is written to sqlite", "[lamp-timeline]") {
+	const auto grid_storage = random_grid();
+	const auto grid = grid_storage.view();
+	const auto timeline = timeline_of(grid, to_xml(random_timesteps(50)), 1000);
+	const auto path = std::filesystem::temp_directory_path() / "lamp-timeline-test.sqlite";
+	REQUIRE(write_lamp_timeline(path, grid, timeline, "fcd.xml", 40.0f).has_value());
+
+	sqlite3* db = nullptr;
+	REQUIRE(sqlite3_open(path.c_str(), &db) == SQLITE_OK);
+	const auto count = [&](const char* sql) {
+		sqlite3_stmt* statement = nullptr;
+		REQUIRE(sqlite3_prepare_v2(db, sql, -1, &statement, nullptr) == SQLITE_OK);
+		REQUIRE(sqlite3_step(statement) == SQLITE_ROW);
+		const auto value = sqlite3_column_int64(statement, 0);
+		sqlite3_finalize(statement);
+		return static_cast<std::size_t>(value);
+	};
+	REQUIRE(count("SELECT count(*) FROM lamps") == grid.lamps.size());
+	REQUIRE(count("SELECT count(*) FROM lit") == timeline.intervals.size());
+	REQUIRE(count("SELECT value FROM info WHERE key = 'steps'") == 50);
+	sqlite3_close(db);
+	std::filesystem::remove(path);
+}
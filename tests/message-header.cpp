@@ -0,0 +1,73 @@
+#include <catch2/catch_test_macros.hpp>
+
+#include "latency-histogram.hpp"
+#include "message-header.hpp"
+
+#include <cstdint>
+#include <string_view>
+#include <vector>
+
+TEST_CASE("message headers are read back after the topic", "[message-header]") {
+	const auto topic = std::string_view("car-tiles/3/1/-2/");
+	auto	   message = std::vector<std::uint8_t>(topic.begin(), topic.end());
+	const auto offset = reserve_message_header(message);
+	REQUIRE(offset == topic.size());
+	message.push_back(0xa0); // An empty CBOR map as payload
+
+	const auto header = MessageHeader {.sequence = 7,
+									   .step = 42,
+									   .simulation_time = 4.2,
+									   .step_done_ns = 1000,
+									   .publish_ns = monotonic_ns()};
+	write_message_header(message, offset, header);
+	REQUIRE(message.size() == topic.size() + sizeof(MessageHeader) + 1);
+	REQUIRE(message.back() == 0xa0);
+
+	const auto read = read_message_header(message, topic.size());
+	REQUIRE(read.has_value());
+	REQUIRE(read->sequence == 7);
+	REQUIRE(read->step == 42);
+	REQUIRE(read->simulation_time == 4.2);
+	REQUIRE(read->step_done_ns == 1000);
+	REQUIRE(read->publish_ns == header.publish_ns);
+
+	// Too short to hold a header after the topic
+	message.resize(topic.size() + sizeof(MessageHeader) - 1);
+	REQUIRE(! read_message_header(message, topic.size()).has_value());
+}
+
+TEST_CASE("latency percentiles are within a bucket of the exact ones", "[message-header]") {
+	auto histogram = LatencyHistogram {};
+	REQUIRE(histogram.percentile(0.5) == 0);
+
+	// 1 us to 1 ms
+	for (std::int64_t ns = 1000; ns <= 1'000'000; ns += 1000) {
+		histogram.record(ns);
+	}
+	REQUIRE(histogram.count() == 1000);
+	REQUIRE(histogram.max() == 1'000'000);
+	for (const auto p : {0.01, 0.5, 0.9, 0.99}) {
+		const auto exact = static_cast<std::int64_t>(p * 1000) * 1000;
+		const auto estimate = histogram.percentile(p);
+		REQUIRE(estimate >= exact);
+		REQUIRE(estimate <= exact + exact / 8);
+	}
+	REQUIRE(histogram.percentile(1.0) == 1'000'000);
+
+	// Every value is in the bucket the histogram reports for it
+	for (const std::uint64_t value : {0ull, 7ull, 8ull, 15ull, 16ull, 1000ull, 123'456'789ull}) {
+		const auto idx = LatencyHistogram::bucket_of(value);
+		REQUIRE(LatencyHistogram::bucket_begin(idx) <= static_cast<std::int64_t>(value));
+		REQUIRE(static_cast<std::int64_t>(value) < LatencyHistogram::bucket_end(idx));
+	}
+
+	auto other = LatencyHistogram {};
+	other.record(-5); // A clock read out of order counts as 0
+	other.record(5'000'000);
+	histogram += other;
+	REQUIRE(histogram.count() == 1002);
+	REQUIRE(histogram.max() == 5'000'000);
+	REQUIRE(histogram.percentile(0.0) == 0);
+	histogram.reset();
+	REQUIRE(histogram.count() == 0);
+}
@@ -0,0 +1,158 @@
+#include <catch2/catch_test_macros.hpp>
+
+#include "network-artifact.hpp"
+
+#include <cstddef>
+#include <filesystem>
+#include <fstream>
+#include <string>
+#include <vector>
+
+#include <unistd.h>
+
+namespace {
+	auto temporary_path(const std::string& name) -> std::filesystem::path {
+		return std::filesystem::temp_directory_path() /
+			   ("sumo-sim-data-publisher-test-" + std::to_string(getpid()) + "-" + name);
+	}
+
+	auto write_file(const std::filesystem::path& path, const std::string& contents) -> void {
+		auto out = std::ofstream(path, std::ios::binary | std::ios::trunc);
+		out << contents;
+	}
+
+	// Overwrites `size` bytes at `offset` of the file with `bytes`
+	auto patch_file(const std::filesystem::path& path, const std::size_t offset, const void* bytes,
+					const std::size_t size) -> void {
+		auto file = std::fstream(path, std::ios::binary | std::ios::in | std::ios::out);
+		file.seekp(static_cast<std::streamoff>(offset));
+		file.write(static_cast<const char*>(bytes), static_cast<std::streamsize>(size));
+	}
+
+	constexpr auto distance_threshold = 50.0f;
+
+	// Lamps at (10, 10), (100, 10) and (300, 300), a lane along the first two and one far away
+	struct Scenario {
+		std::filesystem::path osm = temporary_path("lamps.osm");
+		std::filesystem::path artifact = temporary_path("lamps.bin");
+		StreetLampGrid		  grid;
+		LaneStreetLampTable	  lanes;
+
+		Scenario() {
+			write_file(osm, "<osm/>");
+			grid = build_streetlamp_grid(
+				{
+					StreetLamp {.id = 1, .lat = 10.0f, .lon = 10.0f},
+					StreetLamp {.id = 2, .lat = 10.0f, .lon = 100.0f},
+					StreetLamp {.id = 3, .lat = 300.0f, .lon = 300.0f},
+				},
+				distance_threshold);
+			lanes = build_lane_streetlamp_table(
+				grid.view(),
+				{
+					LaneShape {.id = "south_0", .shape = {{0.0f, 0.0f}, {120.0f, 0.0f}}},
+					LaneShape {.id = "far_0", .shape = {{1000.0f, 1000.0f}, {1100.0f, 1000.0f}}},
+				},
+				distance_threshold);
+			REQUIRE(write_network_artifact(artifact, grid.view(), lanes, distance_threshold, osm));
+		}
+		~Scenario() {
+			std::filesystem::remove(osm);
+			std::filesystem::remove(artifact);
+		}
+
+		auto load() const -> tl::expected<NetworkArtifact, load_network_artifact_error> {
+			return load_network_artifact(artifact, osm, distance_threshold);
+		}
+		auto header() const -> NetworkArtifactHeader {
+			auto header = NetworkArtifactHeader {};
+			auto file = std::ifstream(artifact, std::ios::binary);
+			file.read(reinterpret_cast<char*>(&header), sizeof(header));
+			return header;
+		}
+	};
+} // namespace
+
+TEST_CASE("network artifacts round trip", "[network-artifact]") {
+	const auto scenario = Scenario {};
+	const auto artifact = scenario.load();
+	REQUIRE(artifact.has_value());
+
+	const auto grid = artifact->grid();
+	const auto expected = scenario.grid.view();
+	REQUIRE(grid.spec.num_cells() == expected.spec.num_cells());
+	REQUIRE(grid.lamps.size() == 3);
+	for (std::size_t idx = 0; idx < grid.lamps.size(); ++idx) {
+		REQUIRE(grid.lamps[idx].id == expected.lamps[idx].id);
+		REQUIRE(grid.lamps[idx].lon == expected.lamps[idx].lon);
+	}
+	REQUIRE(std::vector(grid.cell_offsets.begin(), grid.cell_offsets.end()) ==
+			std::vector(expected.cell_offsets.begin(), expected.cell_offsets.end()));
+
+	REQUIRE(artifact->num_lanes() == 2);
+	REQUIRE(artifact->lane_id(0) == "far_0");
+	REQUIRE(artifact->lane_id(1) == "south_0");
+	const auto near_south = artifact->lamps_near_lane("south_0");
+	REQUIRE(near_south.size() == 2);
+	REQUIRE(grid.lamps[near_south[0]].id != 3);
+	REQUIRE(grid.lamps[near_south[1]].id != 3);
+	REQUIRE(artifact->lamps_near_lane("far_0").empty());
+	REQUIRE(artifact->lamps_near_lane("unknown_0").empty());
+}
+
+TEST_CASE("network artifacts of another OSM file are stale", "[network-artifact]") {
+	const auto scenario = Scenario {};
+	REQUIRE(load_network_artifact(scenario.artifact, scenario.osm, 25.0f).error() ==
+			load_network_artifact_error::stale);
+	write_file(scenario.osm, "<osm version=\"0.6\"/>");
+	REQUIRE(scenario.load().error() == load_network_artifact_error::stale);
+	std::filesystem::remove(scenario.osm);
+	REQUIRE(scenario.load().error() == load_network_artifact_error::stale);
+}
+
+TEST_CASE("corrupt network artifacts are rejected", "[network-artifact]") {
+	const auto missing = load_network_artifact(temporary_path("missing.bin"), "", 50.0f);
+	REQUIRE(missing.error() == load_network_artifact_error::file_not_found);
+
+	SECTION("bad magic") {
+		const auto scenario = Scenario {};
+		patch_file(scenario.artifact, 0, "SUMOLAMQ", 8);
+		REQUIRE(scenario.load().error() == load_network_artifact_error::bad_magic);
+	}
+	SECTION("truncated") {
+		const auto scenario = Scenario {};
+		std::filesystem::resize_file(scenario.artifact, scenario.header().file_size - 8);
+		REQUIRE(scenario.load().error() == load_network_artifact_error::truncated);
+	}
+	SECTION("section past the end of the file") {
+		const auto scenario = Scenario {};
+		const auto num_lamps = std::uint64_t {1} << 40;
+		patch_file(scenario.artifact, offsetof(NetworkArtifactHeader, num_lamps), &num_lamps,
+				   sizeof(num_lamps));
+		REQUIRE(scenario.load().error() == load_network_artifact_error::corrupt);
+	}
+	SECTION("grid larger than the cell offsets") {
+		const auto scenario = Scenario {};
+		const auto columns = std::uint32_t {1} << 20;
+		patch_file(scenario.artifact, offsetof(NetworkArtifactHeader, grid.columns), &columns,
+				   sizeof(columns));
+		REQUIRE(scenario.load().error() == load_network_artifact_error::corrupt);
+	}
+	SECTION("cell offsets past the lamps") {
+		const auto scenario = Scenario {};
+		const auto header = scenario.header();
+		const auto past_end = std::uint32_t {4};
+		patch_file(scenario.artifact,
+				   header.cell_offsets_offset + header.grid.num_cells() * sizeof(std::uint32_t),
+				   &past_end, sizeof(past_end));
+		REQUIRE(scenario.load().error() == load_network_artifact_error::corrupt);
+	}
+	SECTION("decreasing lane offsets") {
+		const auto scenario = Scenario {};
+		const auto header = scenario.header();
+		const auto first = std::uint32_t {3};
+		patch_file(scenario.artifact, header.lane_offsets_offset + sizeof(std::uint32_t), &first,
+				   sizeof(first));
+		REQUIRE(scenario.load().error() == load_network_artifact_error::corrupt);
+	}
+}
@@ -0,0 +1,44 @@
+#include <catch2/catch_test_macros.hpp>
+
+#include "pacer.hpp"
+
+#include <chrono>
+
+using namespace std::chrono_literals;
+
+TEST_CASE("pacer deadlines are absolute", "[pacer]") {
+	const auto pacer = Pacer(0.001, PacingOptions {.realtime = true, .speed = 10.0});
+	// Every step is 100 us of wall clock time at 10x, without rounding piling up
+	REQUIRE(pacer.deadline(9) - pacer.deadline(0) == 900us);
+	REQUIRE(pacer.deadline(99'999) - pacer.deadline(0) == 9'999'900us);
+}
+
+TEST_CASE("pacer does not wait when running as fast as possible", "[pacer]") {
+	const auto pacer = Pacer(1.0, PacingOptions {.realtime = false});
+	const auto start = Pacer::clock::now();
+	for (std::uint64_t step = 0; step < 1000; ++step) {
+		REQUIRE(pacer.wait_for(step) == Pacer::clock::duration::zero());
+	}
+	REQUIRE(Pacer::clock::now() - start < 1s);
+}
+
+TEST_CASE("pacer keeps sub-millisecond steps on schedule", "[pacer]") {
+	for (const auto wait : {PacingWait::spin, PacingWait::hybrid}) {
+		const auto pacer = Pacer(0.0005, PacingOptions {.realtime = true, .wait = wait});
+		for (std::uint64_t step = 0; step < 100; ++step) {
+			(void)pacer.wait_for(step);
+		}
+		// Never early, and at most the last wait was late
+		const auto now = Pacer::clock::now();
+		REQUIRE(now >= pacer.deadline(99));
+		REQUIRE(now - pacer.deadline(99) < 20ms);
+	}
+}
+
+TEST_CASE("pacer reports how far behind a late step is", "[pacer]") {
+	const auto pacer = Pacer(0.001, PacingOptions {.realtime = true});
+	std::this_thread::sleep_for(10ms);
+	REQUIRE(pacer.wait_for(0) >= 9ms);
+	// Later steps are due at their own deadline, the lag is not added to them
+	REQUIRE(pacer.deadline(20) - pacer.deadline(0) == 20ms);
+}
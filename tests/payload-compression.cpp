@@ -0,0 +1,105 @@
+#include <catch2/catch_test_macros.hpp>
+
+#include "encoding-format.hpp"
+#include "payload-compression.hpp"
+#include "step-snapshot.hpp"
+
+#include <cstdint>
+#include <memory_resource>
+#include <random>
+#include <vector>
+
+namespace {
+	// The CBOR payload of the cars topic for a step of `num_cars` cars driving around
+	auto cars_payload(const int step, const int num_cars) -> std::vector<std::uint8_t> {
+		auto rng = std::mt19937(static_cast<std::uint32_t>(step));
+		auto offset = std::uniform_int_distribution<int>(-50, 50);
+		auto snapshot = StepSnapshot {};
+		for (int idx = 0; idx < num_cars; ++idx) {
+			snapshot.car_handles.push_back(static_cast<std::uint32_t>(idx));
+			snapshot.cars.push_back(Car {.x = 1000 + idx * 7 + offset(rng),
+										 .y = 2000 + idx * 3 + offset(rng),
+										 .heading = (idx % 360) * 1.0,
+										 .alive = true});
+		}
+		auto payload = std::vector<std::uint8_t> {};
+		encode_cars_message<CborWriter>(snapshot, {}, payload);
+		return payload;
+	}
+
+	auto round_trip(PayloadCompressor& compressor, PayloadDecompressor& decompressor,
+					const std::vector<std::uint8_t>& payload) -> std::size_t {
+		auto compressed = std::pmr::vector<std::uint8_t> {};
+		compressed.push_back('t'); // Compressed payloads are appended after the header
+		REQUIRE(compressor.compress(payload, compressed));
+		REQUIRE(compressed.front() == 't');
+
+		auto out = std::vector<std::uint8_t> {};
+		const auto compressed_payload = std::span(compressed).subspan(1);
+		REQUIRE(decompressor.decompress(compressor.codec(), compressed_payload, payload.size(), out)
+					.has_value());
+		REQUIRE(out == payload);
+		return compressed_payload.size();
+	}
+} // namespace
+
+TEST_CASE("payloads round trip through every codec", "[payload-compression]") {
+	REQUIRE(parse_compression("lz4") == Compression::lz4);
+	REQUIRE(! parse_compression("gzip").has_value());
+
+	auto decompressor = *PayloadDecompressor::create({});
+	for (const auto codec : {Compression::lz4, Compression::zstd}) {
+		auto compressor = *PayloadCompressor::create(codec, 0, {});
+		for (const auto num_cars : {0, 1, 500}) {
+			const auto payload = cars_payload(1, num_cars);
+			const auto size = round_trip(compressor, decompressor, payload);
+			if (num_cars == 500) {
+				REQUIRE(size < payload.size());
+			}
+		}
+	}
+}
+
+TEST_CASE("corrupt payloads are reported", "[payload-compression]") {
+	const auto payload = cars_payload(1, 100);
+	auto	   decompressor = *PayloadDecompressor::create({});
+	for (const auto codec : {Compression::lz4, Compression::zstd}) {
+		auto compressor = *PayloadCompressor::create(codec, 0, {});
+		auto compressed = std::pmr::vector<std::uint8_t> {};
+		REQUIRE(compressor.compress(payload, compressed));
+
+		auto out = std::vector<std::uint8_t> {};
+		// A wrong size in the header
+		REQUIRE(decompressor.decompress(codec, compressed, payload.size() + 1, out).error() ==
+				compression_error::corrupt_payload);
+		// Cut off
+		const auto cut = std::span(compressed).first(compressed.size() / 2);
+		REQUIRE(decompressor.decompress(codec, cut, payload.size(), out).error() ==
+				compression_error::corrupt_payload);
+	}
+}
+
+TEST_CASE("a trained dictionary improves the zstd ratio of small payloads",
+		  "[payload-compression]") {
+	auto samples = std::vector<std::vector<std::uint8_t>> {};
+	for (int step = 0; step < 200; ++step) {
+		samples.push_back(cars_payload(step, 20));
+	}
+	const auto dictionary = train_zstd_dictionary(samples, 16 * 1024);
+	REQUIRE(dictionary.has_value());
+	REQUIRE(train_zstd_dictionary({}, 16 * 1024).error() == compression_error::too_few_samples);
+
+	auto plain = *PayloadCompressor::create(Compression::zstd, 0, {});
+	auto with_dictionary = *PayloadCompressor::create(Compression::zstd, 0, *dictionary);
+	auto plain_decompressor = *PayloadDecompressor::create({});
+	auto decompressor = *PayloadDecompressor::create(*dictionary);
+
+	std::size_t plain_bytes = 0;
+	std::size_t dictionary_bytes = 0;
+	for (int step = 1000; step < 1020; ++step) {
+		const auto payload = cars_payload(step, 20);
+		plain_bytes += round_trip(plain, plain_decompressor, payload);
+		dictionary_bytes += round_trip(with_dictionary, decompressor, payload);
+	}
+	REQUIRE(dictionary_bytes < plain_bytes);
+}
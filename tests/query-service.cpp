@@ -0,0 +1,106 @@
+#include <catch2/catch_test_macros.hpp>
+
+#include "query-service.hpp"
+
+#include <vector>
+
+namespace {
+	// Lamps at (10, 10), (100, 10) and (300, 300), already projected
+	auto make_grid() -> StreetLampGrid {
+		auto lamps = std::vector<StreetLamp> {
+			StreetLamp {.id = 1, .lat = 10.0f, .lon = 10.0f},
+			StreetLamp {.id = 2, .lat = 10.0f, .lon = 100.0f},
+			StreetLamp {.id = 3, .lat = 300.0f, .lon = 300.0f},
+		};
+		return build_streetlamp_grid(std::move(lamps), 50.0f);
+	}
+
+	auto make_snapshot() -> StepSnapshot {
+		auto snapshot = StepSnapshot {};
+		snapshot.step = 7;
+		snapshot.car_handles = {10, 11, 12};
+		snapshot.car_names = {"veh0", "flow.3", "42"};
+		snapshot.cars = {
+			Car {.x = 12, .y = 12, .heading = 0.0},
+			Car {.x = 290, .y = 300, .heading = 90.0},
+			Car {.x = -500, .y = -500, .heading = 180.0}, // Outside of the lamp grid
+		};
+		snapshot.lit_streetlamp_ids = {1};
+		return snapshot;
+	}
+
+	auto query(const QueryIndex& index, nlohmann::json q) -> nlohmann::json {
+		const auto reply = index.answer({{"queries", {std::move(q)}}});
+		return reply.at("results").at(0);
+	}
+} // namespace
+
+TEST_CASE("query service answers lamp queries", "[query-service]") {
+	const auto grid = make_grid();
+	auto	   index = QueryIndex(grid.view());
+	index.update(make_snapshot());
+
+	const auto lit = query(index, {{"type", "lamp"}, {"id", 1}});
+	REQUIRE(lit.at("lit") == true);
+	const auto unlit = query(index, {{"type", "lamp"}, {"id", 3}});
+	REQUIRE(unlit.at("lit") == false);
+	REQUIRE(query(index, {{"type", "lamp"}, {"id", 42}}).contains("error"));
+}
+
+TEST_CASE("query service finds the nearest lamp", "[query-service]") {
+	const auto grid = make_grid();
+	auto	   index = QueryIndex(grid.view());
+	index.update(make_snapshot());
+
+	REQUIRE(query(index, {{"type", "point"}, {"x", 90.0}, {"y", 0.0}}).at("id") == 2);
+	REQUIRE(query(index, {{"type", "point"}, {"x", 250.0}, {"y", 250.0}}).at("id") == 3);
+	// Outside of the grid
+	REQUIRE(query(index, {{"type", "point"}, {"x", -1000.0}, {"y", -1000.0}}).at("id") == 1);
+}
+
+TEST_CASE("query service answers radius and bbox queries", "[query-service]") {
+	const auto grid = make_grid();
+	auto	   index = QueryIndex(grid.view());
+	index.update(make_snapshot());
+
+	const auto near_origin =
+		query(index, {{"type", "radius"}, {"x", 0.0}, {"y", 0.0}, {"r", 50.0}});
+	REQUIRE(near_origin.at("cars").size() == 1);
+	REQUIRE(near_origin.at("cars").at(0).at("id") == 10);
+	REQUIRE(near_origin.at("cars").at(0).at("sumo_id") == "veh0");
+	REQUIRE(near_origin.at("lamps").size() == 1);
+
+	const auto everything = query(index, {{"type", "bbox"},
+										  {"x0", -1000.0},
+										  {"y0", -1000.0},
+										  {"x1", 1000.0},
+										  {"y1", 1000.0}});
+	REQUIRE(everything.at("cars").size() == 3);
+	REQUIRE(everything.at("lamps").size() == 3);
+
+	REQUIRE(query(index, {{"type", "radius"}, {"x", 0.0}}).contains("error"));
+	// The lane table is only in network artifacts
+	REQUIRE(query(index, {{"type", "lane"}, {"id", "south_0"}}).contains("error"));
+	REQUIRE(index.answer({{"nope", 1}}).contains("error"));
+}
+
+TEST_CASE("query service rejects non-finite and survives huge coordinates", "[query-service]") {
+	const auto grid = make_grid();
+	auto	   index = QueryIndex(grid.view());
+	index.update(make_snapshot());
+
+	// 1e300 parses as a double, but does not fit in a float
+	REQUIRE(query(index, {{"type", "point"}, {"x", 1e300}, {"y", 0.0}}).contains("error"));
+	REQUIRE(query(index, {{"type", "radius"}, {"x", 0.0}, {"y", 0.0}, {"r", 1e300}})
+				.contains("error"));
+	REQUIRE(query(index, {{"type", "bbox"}, {"x0", 0.0}, {"y0", 0.0}, {"x1", -1e300}, {"y1", 1.0}})
+				.contains("error"));
+
+	REQUIRE(query(index, {{"type", "point"}, {"x", 1e30}, {"y", 1e30}}).at("id") == 3);
+	REQUIRE(query(index, {{"type", "point"}, {"x", -1e30}, {"y", 5.0}}).at("id") == 1);
+	REQUIRE(query(index, {{"type", "point"}, {"x", 100.0}, {"y", -1e7}}).at("id") == 2);
+	const auto everything = query(
+		index, {{"type", "radius"}, {"x", 0.0}, {"y", 0.0}, {"r", 3e38}});
+	REQUIRE(everything.at("cars").size() == 3);
+	REQUIRE(everything.at("lamps").size() == 3);
+}
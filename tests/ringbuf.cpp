@@ -73,3 +73,17 @@ TEST_CASE("ringbuf", "[ringbuf]") {
     }
     
 }
+
+TEST_CASE("ringbuf wraps around in pop_back and back", "[ringbuf]") {
+	auto ringbuf = RingBuffer<int, 3> {};
+	ringbuf.push_back(0);
+	ringbuf.push_back(1);
+	ringbuf.push_back(2); // tail wraps around to 0
+	REQUIRE(ringbuf.back().value() == 2);
+	REQUIRE(ringbuf.pop_back());
+	REQUIRE(ringbuf.back().value() == 1);
+	REQUIRE(ringbuf.size() == 2);
+	ringbuf.push_back(3);
+	REQUIRE(ringbuf.back().value() == 3);
+	REQUIRE(ringbuf.front().value() == 0);
+}
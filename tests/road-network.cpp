@@ -0,0 +1,202 @@
+#include <catch2/catch_test_macros.hpp>
+
+#include "road-network.hpp"
+
+#include <algorithm>
+#include <filesystem>
+#include <fstream>
+#include <iterator>
+#include <random>
+#include <string>
+#include <vector>
+
+namespace {
+	// A square of junctions a (0, 0), b (100, 0), c (100, 100), d (0, 100), and e (200, 100):
+	// - ab and bc, 10 m/s, form the slow way from a to c, ad and dc, 20 m/s, the fast one
+	// - ca leads back, but only buses may turn from dc into it, ce leads out to e
+	// - the footpath bd and the internal edge of b are no roads for cars
+	constexpr auto square_net = R"(<?xml version="1.0" encoding="UTF-8"?>
+<net version="1.16">
+    <location netOffset="0.00,0.00" convBoundary="0.00,0.00,100.00,100.00"/>
+    <edge id=":b_0" function="internal">
+        <lane id=":b_0_0" index="0" speed="10.00" length="5.00" shape="100.00,0.00 100.00,5.00"/>
+    </edge>
+    <edge id="ab" from="a" to="b" priority="1">
+        <lane id="ab_0" index="0" speed="10.00" length="100.00" shape="0.00,0.00 100.00,0.00"/>
+    </edge>
+    <edge id="bc" from="b" to="c" priority="1">
+        <lane id="bc_0" index="0" speed="10.00" length="100.00" shape="100.00,0.00 100.00,100.00"/>
+    </edge>
+    <edge id="ad" from="a" to="d" priority="1">
+        <lane id="ad_0" index="0" speed="20.00" length="100.00" shape="0.00,0.00 0.00,100.00"/>
+    </edge>
+    <edge id="dc" from="d" to="c" priority="1">
+        <lane id="dc_0" index="0" allow="bus" speed="20.00" length="100.00" shape="0.00,100.00 100.00,100.00"/>
+        <lane id="dc_1" index="1" disallow="tram rail" speed="20.00" length="100.00" shape="0.00,100.00 100.00,100.00"/>
+    </edge>
+    <edge id="ca" from="c" to="a" priority="1">
+        <lane id="ca_0" index="0" speed="20.00" length="141.42" shape="100.00,100.00 0.00,0.00"/>
+    </edge>
+    <edge id="ce" from="c" to="e" priority="1">
+        <lane id="ce_0" index="0" speed="10.00" length="100.00" shape="100.00,100.00 200.00,100.00"/>
+    </edge>
+    <edge id="bd" from="b" to="d" priority="1">
+        <lane id="bd_0" index="0" allow="pedestrian" speed="2.00" length="141.42" shape="100.00,0.00 0.00,100.00"/>
+    </edge>
+    <junction id="a" type="priority" x="0.00" y="0.00" incLanes="ca_0" intLanes="" shape=""/>
+    <junction id="b" type="priority" x="100.00" y="0.00" incLanes="ab_0" intLanes=":b_0_0" shape=""/>
+    <junction id="c" type="priority" x="100.00" y="100.00" incLanes="bc_0 dc_1" intLanes="" shape=""/>
+    <junction id="d" type="priority" x="0.00" y="100.00" incLanes="ad_0" intLanes="" shape=""/>
+    <junction id="e" type="dead_end" x="200.00" y="100.00" incLanes="ce_0" intLanes="" shape=""/>
+    <connection from="ab" to="bc" fromLane="0" toLane="0" via=":b_0_0" dir="l" state="M"/>
+    <connection from=":b_0" to="bc" fromLane="0" toLane="0" dir="s" state="M"/>
+    <connection from="ab" to="bd" fromLane="0" toLane="0" dir="l" state="M"/>
+    <connection from="ad" to="dc" fromLane="0" toLane="0" dir="r" state="M"/>
+    <connection from="ad" to="dc" fromLane="0" toLane="1" dir="r" state="M"/>
+    <connection from="bc" to="ca" fromLane="0" toLane="0" dir="l" state="M"/>
+    <connection from="dc" to="ca" fromLane="0" toLane="0" dir="l" state="M"/>
+    <connection from="bc" to="ce" fromLane="0" toLane="0" dir="r" state="M"/>
+    <connection from="dc" to="ce" fromLane="1" toLane="0" dir="s" state="M"/>
+    <connection from="ca" to="ab" fromLane="0" toLane="0" dir="l" state="M"/>
+    <connection from="ca" to="ad" fromLane="0" toLane="0" dir="r" state="M"/>
+</net>
+)";
+
+	auto edge_named(const RoadNetwork& network, const std::string& id) -> std::uint32_t {
+		const auto it = std::find(network.edge_ids.begin(), network.edge_ids.end(), id);
+		REQUIRE(it != network.edge_ids.end());
+		return static_cast<std::uint32_t>(it - network.edge_ids.begin());
+	}
+
+	auto names(const RoadNetwork& network, const std::vector<std::uint32_t>& route)
+		-> std::vector<std::string> {
+		auto result = std::vector<std::string> {};
+		for (const auto edge : route) {
+			result.push_back(network.edge_ids[edge]);
+		}
+		return result;
+	}
+} // namespace
+
+TEST_CASE("the roads a vehicle class may use are read from a network", "[road-network]") {
+	const auto network = parse_road_network(square_net, "passenger");
+	REQUIRE(network.has_value());
+	REQUIRE(network->edge_ids == std::vector<std::string> {"ab", "bc", "ad", "dc", "ca", "ce"});
+	REQUIRE(network->travel_times[edge_named(*network, "ab")] == 10.0f);
+	REQUIRE(network->travel_times[edge_named(*network, "dc")] == 5.0f);
+	REQUIRE(network->ends[edge_named(*network, "bc")].y == 100.0f);
+
+	const auto successors = [&](const std::string& id) {
+		const auto edges = network->successors_of(edge_named(*network, id));
+		return names(*network, {edges.begin(), edges.end()});
+	};
+	REQUIRE(successors("ab") == std::vector<std::string> {"bc"});
+	REQUIRE(successors("ad") == std::vector<std::string> {"dc"});
+	REQUIRE(successors("bc") == std::vector<std::string> {"ca", "ce"});
+	// Only the bus lane of dc turns into ca
+	REQUIRE(successors("dc") == std::vector<std::string> {"ce"});
+	REQUIRE(successors("ca") == std::vector<std::string> {"ab", "ad"});
+
+	const auto buses = parse_road_network(square_net, "bus");
+	REQUIRE(buses.has_value());
+	REQUIRE(buses->successors_of(edge_named(*buses, "dc")).size() == 2);
+
+	constexpr auto bus_only = R"(<net><edge id="x" from="a" to="b">
+        <lane id="x_0" index="0" allow="bus" speed="10.00" length="10.00"/></edge></net>)";
+	REQUIRE(parse_road_network(bus_only, "passenger").error() == read_road_network_error::no_edges);
+	REQUIRE(parse_road_network("<net><edge", "passenger").error() ==
+			read_road_network_error::xml_parse_error);
+}
+
+TEST_CASE("trips are routed along the fastest edges", "[road-network]") {
+	const auto network = parse_road_network(square_net, "passenger");
+	REQUIRE(network.has_value());
+	auto router = Router(*network);
+	auto route = std::vector<std::uint32_t> {};
+
+	// From a to c the way over d takes 10 s, the one over b 20 s
+	REQUIRE(router.route(edge_named(*network, "ca"), edge_named(*network, "ce"), route));
+	REQUIRE(names(*network, route) == std::vector<std::string> {"ca", "ad", "dc", "ce"});
+	REQUIRE(router.route(edge_named(*network, "bc"), edge_named(*network, "ab"), route));
+	REQUIRE(names(*network, route) == std::vector<std::string> {"bc", "ca", "ab"});
+	// Cars can not get from dc back into the square, and the router is reused for every search
+	for (int search = 0; search < 3; ++search) {
+		REQUIRE_FALSE(router.route(edge_named(*network, "dc"), edge_named(*network, "ab"), route));
+		REQUIRE(route.empty());
+		REQUIRE(router.route(edge_named(*network, "ab"), edge_named(*network, "ad"), route));
+		REQUIRE(names(*network, route) == std::vector<std::string> {"ab", "bc", "ca", "ad"});
+	}
+}
+
+TEST_CASE("trips start and end on different edges far enough apart", "[road-network]") {
+	const auto network = parse_road_network(square_net, "passenger");
+	REQUIRE(network.has_value());
+	auto rng = std::mt19937_64(42);
+
+	const auto most_drawn = [&](const TripWeighting weighting) {
+		const auto sampler = TripSampler(*network, weighting, 0.0, 100);
+		auto	   drawn = std::vector<int>(network->num_edges(), 0);
+		for (int trip = 0; trip < 2000; ++trip) {
+			const auto edges = sampler.sample(rng);
+			REQUIRE(edges.has_value());
+			REQUIRE(edges->first != edges->second);
+			drawn[edges->first]++;
+		}
+		return static_cast<std::uint32_t>(std::max_element(drawn.begin(), drawn.end()) -
+										  drawn.begin());
+	};
+	// dc is the only edge with two lanes, ca the longest, and with both dc's 200 m of lanes win
+	REQUIRE(most_drawn({.length = false, .lanes = true}) == edge_named(*network, "dc"));
+	REQUIRE(most_drawn({.length = true, .lanes = false}) == edge_named(*network, "ca"));
+	REQUIRE(most_drawn({.length = true, .lanes = true}) == edge_named(*network, "dc"));
+
+	// Edges of length 0 are drawn alike instead of from an empty range
+	auto flat = *network;
+	std::fill(flat.lengths.begin(), flat.lengths.end(), 0.0f);
+	const auto unweighted = TripSampler(flat, {.length = true, .lanes = false}, 0.0, 100);
+	for (int trip = 0; trip < 100; ++trip) {
+		const auto edges = unweighted.sample(rng);
+		REQUIRE(edges.has_value());
+		REQUIRE(edges->first < flat.num_edges());
+	}
+
+	// Only trips from a to c or e, and from b or d to e, are at least 140 m
+	const auto far = TripSampler(*network, {}, 140.0, 100);
+	for (int trip = 0; trip < 100; ++trip) {
+		const auto edges = far.sample(rng);
+		REQUIRE(edges.has_value());
+		const auto from = network->starts[edges->first];
+		const auto to = network->ends[edges->second];
+		REQUIRE((from.x - to.x) * (from.x - to.x) + (from.y - to.y) * (from.y - to.y) >=
+				140.0f * 140.0f);
+	}
+	REQUIRE_FALSE(TripSampler(*network, {}, 300.0, 10).sample(rng).has_value());
+}
+
+TEST_CASE("routes are written in the layout of randomTrips.py", "[road-network]") {
+	const auto network = parse_road_network(square_net, "passenger");
+	REQUIRE(network.has_value());
+	const auto path = std::filesystem::temp_directory_path() / "road-network-test.rou.xml";
+	{
+		auto writer = RouteFileWriter::create(path, *network, "road-network-test");
+		REQUIRE(writer.has_value());
+		writer->vehicle(3, 3.0, std::vector<std::uint32_t> {edge_named(*network, "ca"),
+															edge_named(*network, "ad")});
+		writer->vehicle(7, 7.5, std::vector<std::uint32_t> {edge_named(*network, "bc")});
+		REQUIRE(writer->close().has_value());
+	}
+
+	auto file = std::ifstream(path);
+	const auto text = std::string(std::istreambuf_iterator<char>(file), {});
+	REQUIRE(text.starts_with("<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n"));
+	REQUIRE(text.find("<routes xmlns:xsi=\"http://www.w3.org/2001/XMLSchema-instance\" "
+					  "xsi:noNamespaceSchemaLocation=\"http://sumo.dlr.de/xsd/routes_file.xsd\">\n"
+					  "    <vehicle id=\"3\" depart=\"3.00\">\n"
+					  "        <route edges=\"ca ad\"/>\n"
+					  "    </vehicle>\n"
+					  "    <vehicle id=\"7\" depart=\"7.50\">\n"
+					  "        <route edges=\"bc\"/>\n"
+					  "    </vehicle>\n"
+					  "</routes>\n") != std::string::npos);
+	std::filesystem::remove(path);
+}
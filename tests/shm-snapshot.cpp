@@ -0,0 +1,110 @@
+#include <catch2/catch_test_macros.hpp>
+
+#include "shm-snapshot.hpp"
+
+#include <atomic>
+#include <string>
+#include <thread>
+
+#include <unistd.h>
+
+namespace {
+	auto unique_segment_name() -> std::string {
+		return "/sumo-sim-data-publisher-test-" + std::to_string(getpid());
+	}
+
+	auto make_snapshot(const std::uint64_t step, const int num_cars) -> StepSnapshot {
+		auto snapshot = StepSnapshot {};
+		snapshot.step = step;
+		snapshot.simulation_time = static_cast<double>(step) * 0.1;
+		for (int i = 0; i < num_cars; ++i) {
+			snapshot.car_handles.push_back(static_cast<std::uint32_t>(i));
+			snapshot.cars.push_back(Car {.x = i, .y = -i, .heading = 90.0, .alive = true});
+			snapshot.lit_streetlamp_ids.push_back(1000 + i);
+		}
+		return snapshot;
+	}
+} // namespace
+
+TEST_CASE("shm snapshot reader sees the latest published snapshot", "[shm-snapshot]") {
+	auto writer = create_shm_snapshot_writer(unique_segment_name(), 4, 4);
+	REQUIRE(writer.has_value());
+	auto reader = open_shm_snapshot_reader(writer->name());
+	REQUIRE(reader.has_value());
+
+	REQUIRE(! reader->read([](const ShmSnapshotView&) {}));
+
+	REQUIRE(writer->publish(make_snapshot(1, 2)));
+	REQUIRE(writer->publish(make_snapshot(2, 3)));
+
+	std::uint64_t step = 0;
+	std::size_t	  num_cars = 0;
+	std::int64_t  last_lamp = 0;
+	REQUIRE(reader->read([&](const ShmSnapshotView& view) {
+		step = view.step;
+		num_cars = view.cars.size();
+		last_lamp = view.lit_streetlamp_ids.back();
+	}));
+	REQUIRE(step == 2);
+	REQUIRE(num_cars == 3);
+	REQUIRE(last_lamp == 1002);
+	REQUIRE(reader->generation() == 2);
+}
+
+TEST_CASE("shm snapshot writer truncates what does not fit", "[shm-snapshot]") {
+	auto writer = create_shm_snapshot_writer(unique_segment_name(), 2, 2);
+	REQUIRE(writer.has_value());
+	auto reader = open_shm_snapshot_reader(writer->name());
+	REQUIRE(reader.has_value());
+
+	REQUIRE(! writer->publish(make_snapshot(1, 5)));
+	bool truncated = false;
+	REQUIRE(reader->read([&](const ShmSnapshotView& view) {
+		REQUIRE(view.cars.size() == 2);
+		REQUIRE(view.lit_streetlamp_ids.size() == 2);
+		truncated = view.truncated;
+	}));
+	REQUIRE(truncated);
+}
+
+TEST_CASE("shm snapshot readers never see a torn snapshot", "[shm-snapshot][stress]") {
+	constexpr int num_cars = 64;
+	auto		  writer = create_shm_snapshot_writer(unique_segment_name(), num_cars, num_cars);
+	REQUIRE(writer.has_value());
+
+	// Every car of a snapshot has x == step, so a torn read shows up as a mismatch
+	std::atomic<bool> consistent = true;
+
+	auto reader_thread = std::thread([&, name = writer->name()] {
+		auto reader = open_shm_snapshot_reader(name);
+		if (! reader) {
+			consistent = false;
+			return;
+		}
+		std::uint64_t generation = 0;
+		while (! reader->closed()) {
+			generation = reader->wait_for_newer_than(generation, std::chrono::milliseconds(10));
+			bool ok = true;
+			reader->read([&](const ShmSnapshotView& view) {
+				ok = true;
+				for (const auto& car : view.cars) {
+					ok = ok && static_cast<std::uint64_t>(car.x) == view.step;
+				}
+			});
+			consistent = consistent && ok;
+		}
+	});
+
+	auto snapshot = make_snapshot(0, num_cars);
+	for (std::uint64_t step = 0; step < 20'000; ++step) {
+		snapshot.step = step;
+		for (auto& car : snapshot.cars) {
+			car.x = static_cast<int>(step);
+		}
+		writer->publish(snapshot);
+	}
+	writer->close();
+	reader_thread.join();
+
+	REQUIRE(consistent);
+}
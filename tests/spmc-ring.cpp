@@ -0,0 +1,159 @@
+#include <catch2/catch_test_macros.hpp>
+
+#include "ringbuf.hpp"
+
+#include <array>
+#include <cstdint>
+#include <thread>
+#include <vector>
+
+namespace {
+	// Every word holds the sequence number, so a torn read shows up as a mismatch
+	struct Item {
+		std::array<std::uint64_t, 16> words {};
+
+		auto fill(const std::uint64_t seq) -> void { words.fill(seq); }
+		auto consistent() const -> bool {
+			for (const auto w : words) {
+				if (w != words[0]) {
+					return false;
+				}
+			}
+			return true;
+		}
+	};
+} // namespace
+
+TEST_CASE("spmc ring delivers items in order", "[spmc-ring]") {
+	auto ring = SpmcRing<int, 4, 2> {};
+	auto consumer = ring.subscribe();
+
+	int value = -1;
+	REQUIRE(! consumer.try_read([&](const int& x) { value = x; }));
+
+	for (int i = 0; i < 3; ++i) {
+		ring.publish([&](int& x) { x = i; });
+	}
+	for (int i = 0; i < 3; ++i) {
+		REQUIRE(consumer.try_read([&](const int& x) { value = x; }));
+		REQUIRE(value == i);
+	}
+	REQUIRE(! consumer.try_read([&](const int& x) { value = x; }));
+	REQUIRE(consumer.overruns() == 0);
+}
+
+TEST_CASE("spmc ring counts overruns of a slow consumer", "[spmc-ring]") {
+	auto ring = SpmcRing<int, 4, 2> {};
+	auto slow = ring.subscribe();
+
+	for (int i = 0; i < 10; ++i) {
+		ring.publish([&](int& x) { x = i; });
+	}
+	// Only the last 4 items are still in the ring
+	int value = -1;
+	REQUIRE(slow.try_read([&](const int& x) { value = x; }));
+	REQUIRE(value == 6);
+	REQUIRE(slow.overruns() == 6);
+	REQUIRE(ring.overruns(slow.index()) == 6);
+}
+
+TEST_CASE("spmc ring read latest skips without overruns", "[spmc-ring]") {
+	auto ring = SpmcRing<int, 4, 2> {};
+	auto consumer = ring.subscribe();
+
+	for (int i = 0; i < 10; ++i) {
+		ring.publish([&](int& x) { x = i; });
+	}
+	int value = -1;
+	REQUIRE(consumer.try_read_latest([&](const int& x) { value = x; }));
+	REQUIRE(value == 9);
+	REQUIRE(! consumer.try_read_latest([&](const int& x) { value = x; }));
+	REQUIRE(consumer.overruns() == 0);
+}
+
+TEST_CASE("spmc ring reads the newest item again", "[spmc-ring]") {
+	auto ring = SpmcRing<int, 4, 2> {};
+	auto consumer = ring.subscribe();
+
+	int value = -1;
+	REQUIRE(! consumer.read_newest([&](const int& x) { value = x; }));
+	for (int i = 0; i < 6; ++i) {
+		ring.publish([&](int& x) { x = i; });
+	}
+	REQUIRE(consumer.try_read_latest([&](const int& x) { value = x; }));
+	value = -1;
+	REQUIRE(consumer.read_newest([&](const int& x) { value = x; }));
+	REQUIRE(value == 5);
+	// Reading the newest item does not mark anything as read
+	ring.publish([&](int& x) { x = 6; });
+	REQUIRE(consumer.read_newest([&](const int& x) { value = x; }));
+	REQUIRE(value == 6);
+	REQUIRE(consumer.try_read([&](const int& x) { value = x; }));
+	REQUIRE(value == 6);
+	REQUIRE(consumer.overruns() == 0);
+}
+
+TEST_CASE("spmc ring limits the number of consumers", "[spmc-ring]") {
+	auto ring = SpmcRing<int, 4, 2> {};
+	{
+		auto a = ring.subscribe();
+		auto b = ring.subscribe();
+		REQUIRE_THROWS_AS(ring.subscribe(), std::length_error);
+	}
+	// Destroyed consumers give their place back
+	auto c = ring.subscribe();
+	REQUIRE(ring.consumer_active(c.index()));
+}
+
+TEST_CASE("spmc ring stress with concurrent consumers", "[spmc-ring][stress]") {
+	constexpr std::uint64_t num_items = 200'000;
+	constexpr std::size_t	num_consumers = 4;
+	auto					ring = SpmcRing<Item, 16, num_consumers> {};
+
+	struct Result {
+		std::uint64_t read = 0;
+		std::uint64_t overruns = 0;
+		bool		  in_order = true;
+		bool		  consistent = true;
+	};
+	auto results = std::array<Result, num_consumers> {};
+
+	auto consumers = std::vector<std::thread> {};
+	for (std::size_t c = 0; c < num_consumers; ++c) {
+		auto consumer = ring.subscribe();
+		consumers.emplace_back([&, c, consumer = std::move(consumer)]() mutable {
+			auto&		  result = results[c];
+			std::uint64_t last = 0;
+			bool		  first = true;
+			while (consumer.wait()) {
+				consumer.try_read([&](const Item& item) {
+					result.consistent = result.consistent && item.consistent();
+					result.in_order = result.in_order && (first || item.words[0] > last);
+					last = item.words[0];
+					first = false;
+					result.read++;
+				});
+				// Every other consumer is slow, to force overruns
+				if (c % 2 == 1 && result.read % 64 == 0) {
+					std::this_thread::yield();
+				}
+			}
+			result.overruns = consumer.overruns();
+		});
+	}
+
+	for (std::uint64_t seq = 0; seq < num_items; ++seq) {
+		ring.publish([&](Item& item) { item.fill(seq); });
+	}
+	ring.close();
+	for (auto& t : consumers) {
+		t.join();
+	}
+
+	for (const auto& result : results) {
+		REQUIRE(result.consistent);
+		REQUIRE(result.in_order);
+		// Every item is either read or counted as an overrun
+		REQUIRE(result.read + result.overruns == num_items);
+	}
+}
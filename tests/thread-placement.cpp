@@ -0,0 +1,84 @@
+#include <catch2/catch_test_macros.hpp>
+
+#include "thread-placement.hpp"
+
+#include <cstdint>
+#include <filesystem>
+#include <fstream>
+#include <utility>
+#include <vector>
+
+namespace {
+	// A sysfs like directory with a node<N>/cpulist file per entry
+	auto make_node_dir(const std::vector<std::pair<std::string, std::string>>& nodes)
+		-> std::filesystem::path {
+		const auto dir = std::filesystem::temp_directory_path() / "thread-placement-test-node";
+		std::filesystem::remove_all(dir);
+		std::filesystem::create_directories(dir);
+		std::ofstream(dir / "online") << "0-1\n";
+		for (const auto& [name, cpulist] : nodes) {
+			std::filesystem::create_directories(dir / name);
+			std::ofstream(dir / name / "cpulist") << cpulist;
+		}
+		return dir;
+	}
+} // namespace
+
+TEST_CASE("CPU lists in the kernel's format are parsed", "[thread-placement]") {
+	REQUIRE(parse_cpu_list("").value() == std::vector<int> {});
+	REQUIRE(parse_cpu_list("\n").value() == std::vector<int> {});
+	REQUIRE(parse_cpu_list("5").value() == std::vector<int> {5});
+	REQUIRE(parse_cpu_list("0-3,8-9\n").value() == std::vector<int> {0, 1, 2, 3, 8, 9});
+	REQUIRE(parse_cpu_list("8,0-1,1").value() == std::vector<int> {0, 1, 8});
+
+	for (const auto* malformed : {"a", "3-1", "1-", "1,", ",1", "1;2", "-1"}) {
+		const auto cpus = parse_cpu_list(malformed);
+		REQUIRE(! cpus);
+		REQUIRE(cpus.error() == numa_topology_error::malformed_cpu_list);
+	}
+}
+
+TEST_CASE("NUMA nodes are read from sysfs", "[thread-placement]") {
+	const auto dir = make_node_dir({{"node1", "4-7\n"}, {"node0", "0-3\n"}, {"node2", "\n"}});
+	const auto topology = detect_numa_topology(dir);
+	std::filesystem::remove_all(dir);
+
+	REQUIRE(topology);
+	// node2 has memory but no CPUs
+	REQUIRE(topology->nodes.size() == 2);
+	REQUIRE(topology->nodes[0].id == 0);
+	REQUIRE(topology->nodes[0].cpus == std::vector<int> {0, 1, 2, 3});
+	REQUIRE(topology->nodes[1].id == 1);
+	REQUIRE(topology->node_of_cpu(0) == 0);
+	REQUIRE(topology->node_of_cpu(6) == 1);
+	REQUIRE(topology->node_of_cpu(8) == -1);
+	REQUIRE(topology->find_node(1) != nullptr);
+	REQUIRE(topology->find_node(2) == nullptr);
+}
+
+TEST_CASE("missing or broken sysfs is reported", "[thread-placement]") {
+	const auto missing = detect_numa_topology("/nonexistent/sys/devices/system/node");
+	REQUIRE(! missing);
+	REQUIRE(missing.error() == numa_topology_error::no_sysfs);
+
+	auto dir = make_node_dir({});
+	REQUIRE(detect_numa_topology(dir).error() == numa_topology_error::no_nodes);
+	dir = make_node_dir({{"node0", "0-x\n"}});
+	REQUIRE(detect_numa_topology(dir).error() == numa_topology_error::malformed_cpu_list);
+	std::filesystem::remove_all(dir);
+}
+
+TEST_CASE("first touch arrays hold what is written to them", "[thread-placement]") {
+	auto array = FirstTouchArray<int>(1000);
+	REQUIRE(array.size() == 1000);
+	for (std::size_t idx = 0; idx < array.size(); ++idx) {
+		array[idx] = static_cast<int>(idx);
+	}
+	REQUIRE(array.span()[999] == 999);
+	REQUIRE(FirstTouchArray<int>(0).span().empty());
+	// On pages of their own, so parts of whole pages are first touched by one thread
+	REQUIRE(reinterpret_cast<std::uintptr_t>(array.data()) % page_size() == 0);
+	REQUIRE(FirstTouchArray<int>::elements_per_page() * sizeof(int) == page_size());
+	auto moved = std::move(array);
+	REQUIRE(moved[999] == 999);
+}
@@ -0,0 +1,52 @@
+#include <catch2/catch_test_macros.hpp>
+
+#include "vehicle-id-table.hpp"
+
+#include <string>
+
+TEST_CASE("vehicle ids are interned as dense handles", "[vehicle-id-table]") {
+	auto table = VehicleIdTable {};
+	REQUIRE(table.intern("veh0") == 0);
+	REQUIRE(table.intern("flow.3") == 1);
+	REQUIRE(table.intern("42") == 2);
+	REQUIRE(table.intern("flow.3") == 1);
+	REQUIRE(table.find("42") == 2);
+	REQUIRE(table.find("veh1") == VehicleIdTable::no_handle);
+	REQUIRE(table.name(1) == "flow.3");
+	REQUIRE(table.size() == 3);
+	REQUIRE(table.capacity() == 3);
+}
+
+TEST_CASE("released handles are reused oldest first", "[vehicle-id-table]") {
+	auto table = VehicleIdTable {};
+	for (int i = 0; i < 4; ++i) {
+		REQUIRE(table.intern("veh" + std::to_string(i)) == static_cast<VehicleHandle>(i));
+	}
+	table.release(2);
+	table.release(0);
+	table.release(0); // Twice is harmless
+	REQUIRE(! table.live(2));
+	REQUIRE(table.find("veh2") == VehicleIdTable::no_handle);
+	REQUIRE(table.size() == 2);
+
+	REQUIRE(table.intern("veh4") == 2);
+	REQUIRE(table.intern("a vehicle id longer than the small string buffer") == 0);
+	REQUIRE(table.intern("veh5") == 4);
+	REQUIRE(table.name(0) == "a vehicle id longer than the small string buffer");
+	REQUIRE(table.find("veh4") == 2);
+	REQUIRE(table.capacity() == 5);
+}
+
+TEST_CASE("handles can be restored", "[vehicle-id-table]") {
+	auto table = VehicleIdTable {};
+	table.assign(3, "veh3");
+	table.assign(1, "veh1");
+	REQUIRE(table.capacity() == 4);
+	REQUIRE(table.find("veh3") == 3);
+	REQUIRE(table.live(1));
+	REQUIRE(! table.live(0));
+	// The handles below the restored ones are free
+	REQUIRE(table.intern("veh0") == 0);
+	REQUIRE(table.intern("veh2") == 2);
+	REQUIRE(table.intern("veh4") == 4);
+}
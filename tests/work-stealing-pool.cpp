@@ -0,0 +1,82 @@
+#include <catch2/catch_test_macros.hpp>
+
+#include "work-stealing-pool.hpp"
+
+#include <atomic>
+#include <chrono>
+#include <thread>
+#include <vector>
+
+TEST_CASE("work stealing pool runs every task exactly once", "[work-stealing-pool]") {
+	auto pool = WorkStealingPool(4);
+	REQUIRE(pool.num_threads() == 4);
+
+	for (const std::uint32_t num_tasks : {0u, 1u, 3u, 4u, 1000u}) {
+		auto runs = std::vector<std::atomic<int>>(num_tasks);
+		pool.run(num_tasks, [&](const std::uint32_t idx) { runs[idx]++; });
+		for (const auto& count : runs) {
+			REQUIRE(count.load() == 1);
+		}
+	}
+}
+
+TEST_CASE("work stealing pool moves work to idle threads", "[work-stealing-pool]") {
+	auto pool = WorkStealingPool(4);
+	// All the expensive tasks are in the first worker's share
+	constexpr std::uint32_t num_tasks = 64;
+	pool.run(num_tasks, [](const std::uint32_t idx) {
+		if (idx < num_tasks / 4) {
+			std::this_thread::sleep_for(std::chrono::milliseconds(2));
+		}
+	});
+
+	const auto stats = pool.stats();
+	std::uint64_t tasks = 0;
+	std::uint64_t steals = 0;
+	for (const auto& worker : stats) {
+		tasks += worker.tasks;
+		steals += worker.steals;
+	}
+	REQUIRE(tasks == num_tasks);
+	REQUIRE(steals > 0);
+	REQUIRE(stats[0].tasks < num_tasks / 4 + num_tasks / 4);
+}
+
+TEST_CASE("the caller can work while the pool runs a loop", "[work-stealing-pool]") {
+	auto	   pool = WorkStealingPool(2);
+	auto	   sum = std::atomic<std::uint64_t> {0};
+	const auto add = std::function<void(std::uint32_t)>([&](const std::uint32_t idx) {
+		sum += idx;
+	});
+	for (int round = 0; round < 100; ++round) {
+		pool.start(100, add);
+		std::this_thread::yield();
+		pool.wait();
+	}
+	REQUIRE(sum == 100 * (99 * 100 / 2));
+	REQUIRE(pool.stats()[0].tasks + pool.stats()[1].tasks == 100 * 100);
+}
+
+TEST_CASE("run_own_shares runs every share on the thread it starts on", "[work-stealing-pool]") {
+	auto pool = WorkStealingPool(4);
+	constexpr std::uint32_t num_tasks = 64;
+	auto first = std::vector<std::thread::id>(num_tasks);
+	auto again = std::vector<std::thread::id>(num_tasks);
+	// Slow tasks in one share would be stolen by `run`
+	pool.run_own_shares(num_tasks, [&](const std::uint32_t idx) {
+		if (idx < num_tasks / 4) {
+			std::this_thread::sleep_for(std::chrono::milliseconds(1));
+		}
+		first[idx] = std::this_thread::get_id();
+	});
+	pool.run_own_shares(num_tasks, [&](const std::uint32_t idx) {
+		again[idx] = std::this_thread::get_id();
+	});
+	REQUIRE(first == again);
+	for (std::uint32_t idx = 0; idx < num_tasks; ++idx) {
+		REQUIRE(first[idx] == first[idx / (num_tasks / 4) * (num_tasks / 4)]);
+	}
+	for (const auto& worker : pool.stats()) {
+		REQUIRE(worker.steals == 0);
+	}
+}